@@ -19,23 +19,26 @@ IS_REMOTE_BQR="1"
 BQR_READ_BUF_LEN="0"
 WRITE_RATIO="-1"
 EXEC="kite"
+KVS="mica"
 
 IS_ROCE="0"
 
 # Each letter is an option argument, if it's followed by a collum
 # it requires an argument. The first colum indicates the '\?'
 # help/error command when no arguments are given
-while getopts ":B:R:w:x:h" opt; do
+while getopts ":B:R:w:x:k:h" opt; do
   case $opt in
      x) EXEC=$OPTARG
        ;;
      w) WRITE_RATIO=$OPTARG
        ;;
+     k) KVS=$OPTARG
+       ;;
      B) BQR_READ_BUF_LEN=$OPTARG
        ;;
      R) IS_REMOTE_BQR=$OPTARG
        ;;
-     h) echo "Usage: -w <write ratio>  (x1000 --> 10 for 1%)"
+     h) echo "Usage: -w <write ratio>  (x1000 --> 10 for 1%) -k <mica|bplus|splinterdb>"
       exit 1
       ;;
     \?)
@@ -123,6 +126,7 @@ sleep 1
 	--write-ratio ${WRITE_RATIO} \
   --device_name ${NET_DEVICE_NAME} \
   --is-roce ${IS_ROCE} \
+  --kvs ${KVS} \
   2>&1
 
 #  --device_name ${NET_DEVICE_NAME} \
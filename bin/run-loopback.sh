@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+
+# Runs all machines of a deployment as processes on this host.
+# The executable must be built with ENABLE_LOOPBACK set in od_top.h;
+# machines exchange messages through shared memory instead of RDMA.
+# Each machine runs in its own directory under $RUN_DIR, so that file-backed
+# stores (bplus, splinterdb) and client logs do not collide.
+BIN_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" &> /dev/null && pwd )"
+
+WRITE_RATIO="-1"
+EXEC="hermes"
+KVS="mica"
+MACHINE_NUM="3"
+RUN_DIR="/tmp/odyssey-loopback"
+
+while getopts ":w:x:k:n:d:h" opt; do
+  case $opt in
+     x) EXEC=$OPTARG
+       ;;
+     w) WRITE_RATIO=$OPTARG
+       ;;
+     k) KVS=$OPTARG
+       ;;
+     n) MACHINE_NUM=$OPTARG
+       ;;
+     d) RUN_DIR=$OPTARG
+       ;;
+     h) echo "Usage: -x <executable> -n <machines, must match MACHINE_NUM> -w <write ratio>  (x1000 --> 10 for 1%) -k <mica|bplus|splinterdb> -d <run dir>"
+      exit 1
+      ;;
+    \?)
+      echo "Invalid option: -$OPTARG use -h to get info for arguments" >&2
+      exit 1
+      ;;
+    :)
+      echo "Option -$OPTARG requires an argument." >&2
+      exit 1
+      ;;
+  esac
+done
+
+EXEC_PATH="$(realpath ${EXEC})"
+killall ${EXEC} 2>/dev/null
+
+# Segments left behind by a previous run
+rm -f /dev/shm/odyssey_lb_* 2>/dev/null
+
+allIPs="127.0.0.1"
+for m in `seq 1 $((MACHINE_NUM - 1))`; do
+  allIPs="${allIPs},127.0.0.1"
+done
+
+pids=()
+for m in `seq 0 $((MACHINE_NUM - 1))`; do
+  mkdir -p ${RUN_DIR}/m${m}
+  (cd ${RUN_DIR}/m${m} && exec ${EXEC_PATH} \
+    --all-ips ${allIPs} \
+    --machine-id ${m} \
+    --write-ratio ${WRITE_RATIO} \
+    --kvs ${KVS} \
+    > ${RUN_DIR}/m${m}/out.log 2>&1) &
+  pids+=($!)
+done
+
+echo "Machines running, logs in ${RUN_DIR}/m*/out.log"
+# Machine 0 prints the throughput; stop everyone when it exits
+wait ${pids[0]}
+status=$?
+kill ${pids[@]:1} 2>/dev/null
+cat ${RUN_DIR}/m0/out.log
+exit ${status}
@@ -30,6 +30,20 @@ typedef void (*bp_range_cb)(void *arg,
                             const bp_value_t *value);
 typedef int (*bp_filter_cb)(void* arg, const bp_key_t *key);
 
+typedef struct bp_compact_stats_s {
+    uint64_t runs;
+    uint64_t file_size; /* current size of the db file */
+    uint64_t live_size; /* its size after the last compaction (or at open) */
+    double space_amp; /* file_size / live_size */
+
+    /* last compaction */
+    uint64_t copied_bytes;
+    uint64_t copied_pages;
+    double duration; /* seconds */
+    double stall; /* seconds writers waited for the switch-over */
+    double throughput; /* copied bytes per second */
+} bp_compact_stats_t;
+
 #include "private/tree.h"
 
 /*
@@ -44,6 +58,16 @@ int bp_close(bp_db_t *tree);
 int bp_get(bp_db_t *tree, const bp_key_t *key, bp_value_t *value);
 int bp_gets(bp_db_t *tree, const char *key, char **value);
 
+/*
+ * Get one value by key without copying it: cb is invoked with a value that
+ * points into the database (the file mapping of uncompressed trees) and is
+ * only valid until cb returns
+ */
+int bp_get_ref(bp_db_t *tree,
+               const bp_key_t *key,
+               bp_range_cb cb,
+               void *arg);
+
 /*
  * Get previous value
  */
@@ -158,6 +182,24 @@ int bp_get_filtered_ranges(bp_db_t *tree,
  */
 int bp_compact(bp_db_t *tree);
 
+/*
+ * Run compaction on a background thread: reads and writes go on while live
+ * pages are copied, writers only wait for the final catch-up and switch-over
+ */
+int bp_compact_start(bp_db_t *tree);
+int bp_compact_wait(bp_db_t *tree);
+
+/*
+ * Start a background compaction whenever the file grows past max_space_amp
+ * times its size after the last compaction (0 turns it off)
+ */
+void bp_set_auto_compact(bp_db_t *tree, double max_space_amp);
+
+/*
+ * Space amplification and throughput of compactions
+ */
+void bp_compact_stats(bp_db_t *tree, bp_compact_stats_t *stats);
+
 /*
  * Set compare function to define order of keys in database
  */
@@ -168,6 +210,11 @@ void bp_set_compare_cb(bp_db_t *tree, bp_compare_cb cb);
  */
 int bp_fsync(bp_db_t *tree);
 
+/*
+ * Hits and misses of the page cache that reads go through
+ */
+void bp_cache_stats(bp_db_t *tree, uint64_t *hits, uint64_t *misses);
+
 struct bp_db_s {
     BP_TREE_PRIVATE
 };
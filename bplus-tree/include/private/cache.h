@@ -0,0 +1,78 @@
+#ifndef _PRIVATE_CACHE_H_
+#define _PRIVATE_CACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Cache of decoded pages, keyed by their file offset.
+ * Pages never change once written, so entries are only dropped by
+ * CLOCK eviction or when compaction replaces the file. Cached pages are
+ * shared by readers and reference counted: bp__page_destroy releases them.
+ * Lookups take no lock: readers walk a shard inside their epoch and take
+ * their reference with a CAS. Inserts and eviction take the shard lock,
+ * and the cache's reference to an evicted page is dropped through the epoch.
+ */
+#define BP__CACHE_SHARDS 16
+#ifndef BP_CACHE_PAGES
+#define BP_CACHE_PAGES 8192
+#endif
+#define BP__CACHE_SHARD_PAGES (BP_CACHE_PAGES / BP__CACHE_SHARDS)
+#define BP__CACHE_BUCKETS (BP__CACHE_SHARD_PAGES * 2)
+
+#define BP_CACHE_PRIVATE                \
+    bp__cache_shard_t *shards;
+
+typedef struct bp__cache_s bp__cache_t;
+typedef struct bp__cache_shard_s bp__cache_shard_t;
+typedef struct bp__cache_entry_s bp__cache_entry_t;
+
+int bp__cache_create(bp__cache_t *c);
+void bp__cache_destroy(bp_db_t *t, bp__cache_t *c);
+
+/* drop every entry, callers must make sure no reader holds one */
+void bp__cache_clear(bp_db_t *t, bp__cache_t *c);
+
+/* returns a referenced page or NULL on a miss, from inside an epoch */
+struct bp__page_s *bp__cache_get(bp__cache_t *c, const uint64_t offset);
+/*
+ * takes over page, returns the referenced page that is cached for offset,
+ * or page itself, uncached, if no entry can be freed
+ */
+struct bp__page_s *bp__cache_put(bp_db_t *t,
+                                 bp__cache_t *c,
+                                 struct bp__page_s *page);
+
+void bp__cache_stats(bp__cache_t *c, uint64_t *hits, uint64_t *misses);
+
+/* written under the shard lock, read by lookups with atomic loads */
+struct bp__cache_entry_s {
+    uint64_t offset;
+    struct bp__page_s *page; /* NULL when the entry is free */
+    int32_t next; /* next entry in the bucket, -1 ends it */
+    uint8_t referenced;
+};
+
+struct bp__cache_shard_s {
+    pthread_mutex_t lock;
+    uint64_t hits;
+    uint64_t misses;
+    uint32_t hand;
+    bp__retired_t *retired; /* evicted pages lookups may still reach */
+    int32_t buckets[BP__CACHE_BUCKETS];
+    bp__cache_entry_t entries[BP__CACHE_SHARD_PAGES];
+};
+
+struct bp__cache_s {
+    BP_CACHE_PRIVATE
+};
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _PRIVATE_CACHE_H_ */
@@ -0,0 +1,60 @@
+#ifndef _PRIVATE_COMPACT_H_
+#define _PRIVATE_COMPACT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Incremental compaction.
+ * Live pages are copied into the .compact file without holding the write
+ * lock, BP__COMPACT_CHUNK pages at a time. Pages are immutable, so each
+ * catch-up round only copies what writers appended since the previous
+ * one and reuses the copies of everything else. Writers are only blocked
+ * for the last round, once it is small, and for the switch-over.
+ */
+#define BP__COMPACT_CHUNK 64 /* pages copied between two pauses */
+#define BP__COMPACT_PAUSE_US 50 /* background compactions only */
+#define BP__COMPACT_ROUNDS 8 /* catch-up rounds without the write lock */
+#define BP__COMPACT_CATCHUP_SIZE (1024 * 1024) /* delta for the last round */
+#define BP__COMPACT_MIN_SIZE (16 * 1024 * 1024) /* no auto compaction below */
+
+enum compact_state {
+    kCompactIdle = 0,
+    kCompactSync = 1, /* bp_compact, in the caller's thread */
+    kCompactThread = 2 /* background thread, joined once finished */
+};
+
+#define BP_COMPACT_PRIVATE                      \
+    pthread_mutex_t lock;                       \
+    pthread_t thread;                           \
+    enum compact_state state;                   \
+    int finished;                               \
+    int result;                                 \
+    double auto_amp;                            \
+    uint64_t live_size;                         \
+    bp_compact_stats_t stats;
+
+typedef struct bp__compact_s bp__compact_t;
+
+int bp__compact_init(bp_db_t *t);
+void bp__compact_destroy(bp_db_t *t);
+
+/* copies the tree and switches over to the copy, throttled if background */
+int bp__compact_run(bp_db_t *t, const int background);
+
+/* writers call it under the write lock, after every change */
+void bp__compact_maybe_start(bp_db_t *t);
+
+struct bp__compact_s {
+    BP_COMPACT_PRIVATE
+};
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _PRIVATE_COMPACT_H_ */
@@ -0,0 +1,72 @@
+#ifndef _PRIVATE_EPOCH_H_
+#define _PRIVATE_EPOCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Epoch-based reclamation of head pages and of evicted cache pages.
+ * Readers announce the epoch they entered in, in a slot of their own,
+ * and only then load the published head. Writers retire the head they
+ * replaced with the current epoch and bump it: the page is freed once
+ * no reader announces an epoch that old.
+ * Readers beyond BP__EPOCH_SLOTS yield until a slot frees up.
+ */
+#define BP__EPOCH_SLOTS 128
+
+#define BP_EPOCH_PRIVATE                                \
+    uint64_t global;                                    \
+    char global_padding[BP_PADDING - sizeof(uint64_t)]; \
+    bp__epoch_slot_t slots[BP__EPOCH_SLOTS];            \
+    bp__retired_t *retired;
+
+typedef struct bp__epoch_s bp__epoch_t;
+typedef struct bp__epoch_slot_s bp__epoch_slot_t;
+typedef struct bp__retired_s bp__retired_t;
+
+void bp__epoch_init(bp__epoch_t *e);
+
+/* returns the slot the reader announced itself in */
+int bp__epoch_enter(bp__epoch_t *e);
+void bp__epoch_exit(bp__epoch_t *e, const int slot);
+
+/* writers only, serialized by the tree's write lock */
+int bp__epoch_retire(bp_db_t *t, struct bp__page_s *page);
+void bp__epoch_reclaim(bp_db_t *t, const int all);
+
+/*
+ * The same on a list that the caller serializes with a lock of its own:
+ * page must be unpublished already, r is taken over
+ */
+void bp__epoch_retire_on(bp__epoch_t *e,
+                         bp__retired_t **list,
+                         bp__retired_t *r,
+                         struct bp__page_s *page);
+void bp__epoch_reclaim_on(bp_db_t *t, bp__retired_t **list, const int all);
+
+/* wait for every reader that entered before the call to exit */
+void bp__epoch_synchronize(bp__epoch_t *e);
+
+struct bp__epoch_slot_s {
+    uint64_t epoch; /* 0 when the slot is free */
+    char padding[BP_PADDING - sizeof(uint64_t)];
+};
+
+struct bp__retired_s {
+    struct bp__page_s *page;
+    uint64_t epoch;
+    bp__retired_t *next;
+};
+
+struct bp__epoch_s {
+    BP_EPOCH_PRIVATE
+};
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _PRIVATE_EPOCH_H_ */
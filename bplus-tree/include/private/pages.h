@@ -18,7 +18,8 @@ enum page_type {
 
 enum search_type {
     kNotLoad = 0,
-    kLoad = 1
+    kLoad = 1,
+    kLoadShared = 2 /* read-only, through the page cache */
 };
 
 int bp__page_create(bp_db_t *t,
@@ -34,6 +35,10 @@ int bp__page_load(bp_db_t *t,
                   const uint64_t offset,
                   const uint64_t config,
                   bp__page_t **page);
+int bp__page_load_shared(bp_db_t *t,
+                         const uint64_t offset,
+                         const uint64_t config,
+                         bp__page_t **page);
 int bp__page_save(bp_db_t *t, bp__page_t *page);
 
 int bp__page_load_value(bp_db_t *t,
@@ -58,6 +63,11 @@ int bp__page_get(bp_db_t *t,
                  bp__page_t *page,
                  const bp_key_t *key,
                  bp_value_t *value);
+int bp__page_get_ref(bp_db_t *t,
+                     bp__page_t *page,
+                     const bp_key_t *key,
+                     bp_range_cb cb,
+                     void *arg);
 int bp__page_get_range(bp_db_t *t,
                        bp__page_t *page,
                        const bp_key_t *start,
@@ -107,6 +117,7 @@ struct bp__page_s {
 
     void *buff_;
     int is_head;
+    uint32_t refs; /* cached pages only, private ones have 0 */
 
     bp__kv_t keys[1];
 };
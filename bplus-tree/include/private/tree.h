@@ -7,16 +7,27 @@ extern "C" {
 
 #include "private/writer.h"
 #include "private/pages.h"
+#include "private/epoch.h"
+#include "private/cache.h"
+#include "private/compact.h"
 
 #include <pthread.h>
 
 #define BP__HEAD_SIZE  sizeof(uint64_t) * 4
 
+/*
+ * Writers serialize on wlock and modify head.page, readers take no lock:
+ * they walk head.rpage, a read-only copy of the head that writers publish
+ * after every change and reclaim through the epochs.
+ */
 #define BP_TREE_PRIVATE         \
     BP_WRITER_PRIVATE           \
-    pthread_rwlock_t rwlock;    \
+    pthread_mutex_t wlock;      \
     bp__tree_head_t head;       \
-    bp_compare_cb compare_cb;
+    bp_compare_cb compare_cb;   \
+    bp__epoch_t epoch;          \
+    bp__cache_t cache;          \
+    bp__compact_t compact;
 
 typedef struct bp__tree_head_s bp__tree_head_t;
 
@@ -25,6 +36,10 @@ void bp__destroy(bp_db_t *tree);
 
 int bp__tree_read_head(bp__writer_t *w, void *data);
 int bp__tree_write_head(bp__writer_t *w, void *data);
+int bp__tree_publish_head(bp_db_t *t);
+void bp__tree_unpublish_head(bp_db_t *t);
+/* BP_OK with the head to read, or the error that left no head published */
+int bp__tree_enter(bp_db_t *t, bp__page_t **head, int *slot);
 
 int bp__default_compare_cb(const bp_key_t *a, const bp_key_t *b);
 int bp__default_filter_cb(void *arg, const bp_key_t *key);
@@ -37,6 +52,8 @@ struct bp__tree_head_s {
     uint64_t hash;
 
     bp__page_t *page;
+    bp__page_t *rpage;
+    int error; /* set when compaction could not publish a head again */
 };
 
 #ifdef __cplusplus
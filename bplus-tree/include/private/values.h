@@ -25,6 +25,12 @@ int bp__value_load(bp_db_t *t,
                    const uint64_t offset,
                    const uint64_t length,
                    bp_value_t *value);
+int bp__value_ref(bp_db_t *t,
+                  const uint64_t offset,
+                  const uint64_t length,
+                  const bp_key_t *key,
+                  bp_range_cb cb,
+                  void *arg);
 int bp__value_save(bp_db_t *t,
                    const bp_value_t *value,
                    const bp__kv_t *previous,
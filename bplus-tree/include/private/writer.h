@@ -11,9 +11,14 @@ extern "C" {
     int fd;                     \
     char *filename;             \
     uint64_t filesize;          \
+    bp__writer_map_t *map;      \
     char padding[BP_PADDING];
 
+/* uncompressed trees are read through a read-only mapping of the file */
+#define BP__MAP_MIN_SIZE (64 * 1024 * 1024)
+
 typedef struct bp__writer_s bp__writer_t;
+typedef struct bp__writer_map_s bp__writer_map_t;
 typedef int (*bp__writer_cb)(bp__writer_t *w, void *data);
 
 enum comp_type {
@@ -40,6 +45,11 @@ int bp__writer_write(bp__writer_t *w,
                      uint64_t *offset,
                      uint64_t *size);
 
+/* data in place in the mapping, NULL if it isn't mapped */
+const char *bp__writer_map(bp__writer_t *w,
+                           const uint64_t offset,
+                           const uint64_t size);
+
 int bp__writer_find(bp__writer_t *w,
                     const enum comp_type comp,
                     const uint64_t size,
@@ -47,6 +57,17 @@ int bp__writer_find(bp__writer_t *w,
                     bp__writer_cb seek,
                     bp__writer_cb miss);
 
+/*
+ * The mapping is replaced by a larger one once the file outgrows it.
+ * Readers may still be using older ones: they're only unmapped together
+ * with the file.
+ */
+struct bp__writer_map_s {
+    char *addr;
+    uint64_t size;
+    bp__writer_map_t *prev;
+};
+
 struct bp__writer_s {
     BP_WRITER_PRIVATE
 };
@@ -1,5 +1,6 @@
 #include <stdlib.h> /* malloc */
 #include <string.h> /* strlen */
+#include <sched.h> /* sched_yield */
 
 #include "bplus.h"
 #include "private/utils.h"
@@ -8,31 +9,49 @@ int bp_open(bp_db_t *tree, const char* filename)
 {
     int ret;
 
-    ret = pthread_rwlock_init(&tree->rwlock, NULL) ? BP_ERWLOCK : BP_OK;
+    ret = pthread_mutex_init(&tree->wlock, NULL) ? BP_EMUTEX : BP_OK;
     if (ret != BP_OK) return ret;
 
+    bp__epoch_init(&tree->epoch);
+
+    ret = bp__cache_create(&tree->cache);
+    if (ret != BP_OK) goto fatal;
+
+    ret = bp__compact_init(tree);
+    if (ret != BP_OK) goto fatal;
+
     ret = bp__writer_create((bp__writer_t*) tree, filename);
     if (ret != BP_OK) goto fatal;
 
     tree->head.page = NULL;
+    tree->head.rpage = NULL;
+    tree->head.error = BP_OK;
 
     ret = bp__init(tree);
     if (ret != BP_OK) goto fatal;
 
+    /* space amplification is measured against the size at open */
+    tree->compact.live_size = tree->filesize;
+
     return BP_OK;
 
 fatal:
-    pthread_rwlock_destroy(&tree->rwlock);
+    bp__cache_destroy(tree, &tree->cache);
+    pthread_mutex_destroy(&tree->wlock);
     return ret;
 }
 
 int bp_close(bp_db_t *tree)
 {
-    pthread_rwlock_wrlock(&tree->rwlock);
+    /* a background compaction needs the write lock to finish */
+    bp__compact_destroy(tree);
+
+    pthread_mutex_lock(&tree->wlock);
     bp__destroy(tree);
-    pthread_rwlock_unlock(&tree->rwlock);
+    bp__cache_destroy(tree, &tree->cache);
+    pthread_mutex_unlock(&tree->wlock);
 
-    pthread_rwlock_destroy(&tree->rwlock);
+    pthread_mutex_destroy(&tree->wlock);
     return BP_OK;
 }
 
@@ -53,6 +72,9 @@ int bp__init(bp_db_t *tree)
     if (ret == BP_OK) {
         /* set default compare function */
         bp_set_compare_cb(tree, bp__default_compare_cb);
+
+        /* let readers in */
+        ret = bp__tree_publish_head(tree);
     }
 
     return ret;
@@ -65,17 +87,45 @@ void bp__destroy(bp_db_t *tree)
         bp__page_destroy(tree, tree->head.page);
         tree->head.page = NULL;
     }
+
+    /* there are no readers left: either closing or compacting */
+    if (tree->head.rpage != NULL) {
+        bp__page_destroy(tree, tree->head.rpage);
+        tree->head.rpage = NULL;
+    }
+    bp__epoch_reclaim(tree, 1);
 }
 
 int bp_get(bp_db_t *tree, const bp_key_t* key, bp_value_t *value)
 {
-    int ret;
+    int ret, slot;
+    bp__page_t *head;
+
+    ret = bp__tree_enter(tree, &head, &slot);
+    if (ret != BP_OK) return ret;
+
+    ret = bp__page_get(tree, head, key, value);
+
+    bp__epoch_exit(&tree->epoch, slot);
+
+    return ret;
+}
+
+
+int bp_get_ref(bp_db_t *tree,
+               const bp_key_t *key,
+               bp_range_cb cb,
+               void *arg)
+{
+    int ret, slot;
+    bp__page_t *head;
 
-    pthread_rwlock_rdlock(&tree->rwlock);
+    ret = bp__tree_enter(tree, &head, &slot);
+    if (ret != BP_OK) return ret;
 
-    ret = bp__page_get(tree, tree->head.page, key, value);
+    ret = bp__page_get_ref(tree, head, key, cb, arg);
 
-    pthread_rwlock_unlock(&tree->rwlock);
+    bp__epoch_exit(&tree->epoch, slot);
 
     return ret;
 }
@@ -101,16 +151,17 @@ int bp_update(bp_db_t *tree,
               void *arg)
 {
     int ret;
-    printf("Before lock\n");
-    pthread_rwlock_wrlock(&tree->rwlock);
-    printf("Is the code reaching here then?\n");
+    pthread_mutex_lock(&tree->wlock);
     ret = bp__page_insert(tree, tree->head.page, key, value, update_cb, arg);
     if (ret == BP_OK) {
         ret = bp__tree_write_head((bp__writer_t*) tree, NULL);
     }
+    if (ret == BP_OK) {
+        ret = bp__tree_publish_head(tree);
+        bp__compact_maybe_start(tree);
+    }
 
-    pthread_rwlock_unlock(&tree->rwlock);
-    printf("After lcok\n");
+    pthread_mutex_unlock(&tree->wlock);
     return ret;
 }
 
@@ -126,7 +177,7 @@ int bp_bulk_update(bp_db_t *tree,
     bp_value_t* values_iter = (bp_value_t *) *values;
     uint64_t left = count;
 
-    pthread_rwlock_wrlock(&tree->rwlock);
+    pthread_mutex_lock(&tree->wlock);
 
     ret = bp__page_bulk_insert(tree,
                                tree->head.page,
@@ -139,8 +190,12 @@ int bp_bulk_update(bp_db_t *tree,
     if (ret == BP_OK) {
         ret =  bp__tree_write_head((bp__writer_t *) tree, NULL);
     }
+    if (ret == BP_OK) {
+        ret = bp__tree_publish_head(tree);
+        bp__compact_maybe_start(tree);
+    }
 
-    pthread_rwlock_unlock(&tree->rwlock);
+    pthread_mutex_unlock(&tree->wlock);
 
     return ret;
 }
@@ -168,14 +223,18 @@ int bp_removev(bp_db_t *tree,
 {
     int ret;
 
-    pthread_rwlock_wrlock(&tree->rwlock);
+    pthread_mutex_lock(&tree->wlock);
 
     ret = bp__page_remove(tree, tree->head.page, key, remove_cb, arg);
     if (ret == BP_OK) {
         ret = bp__tree_write_head((bp__writer_t *) tree, NULL);
     }
+    if (ret == BP_OK) {
+        ret = bp__tree_publish_head(tree);
+        bp__compact_maybe_start(tree);
+    }
 
-    pthread_rwlock_unlock(&tree->rwlock);
+    pthread_mutex_unlock(&tree->wlock);
 
     return ret;
 }
@@ -185,47 +244,6 @@ int bp_remove(bp_db_t *tree, const bp_key_t *key)
     return bp_removev(tree, key, NULL, NULL);
 }
 
-int bp_compact(bp_db_t *tree)
-{
-    int ret;
-    char *compacted_name;
-    bp_db_t compacted;
-
-    /* get name of compacted database (prefixed with .compact) */
-    ret = bp__writer_compact_name((bp__writer_t *) tree, &compacted_name);
-    if (ret != BP_OK) return ret;
-
-    /* open it */
-    ret = bp_open(&compacted, compacted_name);
-    free(compacted_name);
-    if (ret != BP_OK) return ret;
-
-    /* destroy stub head page */
-    bp__page_destroy(&compacted, compacted.head.page);
-
-    pthread_rwlock_rdlock(&tree->rwlock);
-
-    /* clone source tree's head page */
-    ret = bp__page_clone(&compacted, tree->head.page, &compacted.head.page);
-
-    pthread_rwlock_unlock(&tree->rwlock);
-
-    /* copy all pages starting from head */
-    ret = bp__page_copy(tree, &compacted, compacted.head.page);
-    if (ret != BP_OK) return ret;
-
-    ret = bp__tree_write_head((bp__writer_t *) &compacted, NULL);
-    if (ret != BP_OK) return ret;
-
-    pthread_rwlock_wrlock(&tree->rwlock);
-
-    ret = bp__writer_compact_finalize((bp__writer_t *) tree,
-                                      (bp__writer_t *) &compacted);
-    pthread_rwlock_unlock(&tree->rwlock);
-
-    return ret;
-}
-
 int bp_get_filtered_range(bp_db_t *tree,
                           const bp_key_t *start,
                           const bp_key_t *end,
@@ -233,19 +251,21 @@ int bp_get_filtered_range(bp_db_t *tree,
                           bp_range_cb cb,
                           void *arg)
 {
-    int ret;
+    int ret, slot;
+    bp__page_t *head;
 
-    pthread_rwlock_rdlock(&tree->rwlock);
+    ret = bp__tree_enter(tree, &head, &slot);
+    if (ret != BP_OK) return ret;
 
     ret = bp__page_get_range(tree,
-                             tree->head.page,
+                             head,
                              start,
                              end,
                              filter,
                              cb,
                              arg);
 
-    pthread_rwlock_unlock(&tree->rwlock);
+    bp__epoch_exit(&tree->epoch, slot);
 
     return ret;
 }
@@ -294,14 +314,12 @@ int bp_updates(bp_db_t *tree,
     BP__STOVAL(key, bkey);
     BP__STOVAL(value, bvalue);
 
-    printf("Is the code reaching here?\n");
     return bp_update(tree, &bkey, &bvalue, update_cb, arg);
 }
 
 
 int bp_sets(bp_db_t *tree, const char *key, const char *value)
 {
-    printf("Tree is: %p\n", tree);
     return bp_updates(tree, key, value, NULL, NULL);
 }
 
@@ -409,13 +427,19 @@ void bp_set_compare_cb(bp_db_t *tree, bp_compare_cb cb)
 }
 
 
+void bp_cache_stats(bp_db_t *tree, uint64_t *hits, uint64_t *misses)
+{
+    bp__cache_stats(&tree->cache, hits, misses);
+}
+
+
 int bp_fsync(bp_db_t *tree)
 {
     int ret;
 
-    pthread_rwlock_wrlock(&tree->rwlock);
+    pthread_mutex_lock(&tree->wlock);
     ret = bp__writer_fsync((bp__writer_t *) tree);
-    pthread_rwlock_unlock(&tree->rwlock);
+    pthread_mutex_unlock(&tree->wlock);
 
     return ret;
 }
@@ -488,6 +512,61 @@ int bp__tree_write_head(bp__writer_t *w, void *data)
     return ret;
 }
 
+int bp__tree_publish_head(bp_db_t *t)
+{
+    int ret;
+    bp__page_t *rpage, *old;
+
+    /* head.page keeps changing under the writers, readers get a copy */
+    ret = bp__page_clone(t, t->head.page, &rpage);
+    if (ret != BP_OK) return ret;
+
+    old = __atomic_exchange_n(&t->head.rpage, rpage, __ATOMIC_SEQ_CST);
+    if (old == NULL) return BP_OK;
+
+    /*
+     * The write itself went through: if old can't be queued for
+     * reclamation a reader may still hold it, so leak it instead.
+     */
+    bp__epoch_retire(t, old);
+
+    return BP_OK;
+}
+
+void bp__tree_unpublish_head(bp_db_t *t)
+{
+    bp__page_t *old;
+
+    /* readers wait in bp__tree_enter until a head is published again */
+    old = __atomic_exchange_n(&t->head.rpage, NULL, __ATOMIC_SEQ_CST);
+    bp__epoch_synchronize(&t->epoch);
+
+    if (old != NULL) bp__page_destroy(t, old);
+    bp__epoch_reclaim(t, 1);
+
+    /* cached offsets point into the file that is about to be replaced */
+    bp__cache_clear(t, &t->cache);
+}
+
+int bp__tree_enter(bp_db_t *t, bp__page_t **head, int *slot)
+{
+    int ret;
+
+    for (;;) {
+        *slot = bp__epoch_enter(&t->epoch);
+        *head = __atomic_load_n(&t->head.rpage, __ATOMIC_SEQ_CST);
+        if (*head != NULL) return BP_OK;
+        bp__epoch_exit(&t->epoch, *slot);
+
+        /* compaction failed to reopen the file, there won't be a head */
+        ret = __atomic_load_n(&t->head.error, __ATOMIC_ACQUIRE);
+        if (ret != BP_OK) return ret;
+
+        /* compaction is swapping the file */
+        sched_yield();
+    }
+}
+
 int bp__default_compare_cb(const bp_key_t *a, const bp_key_t *b)
 {
     uint32_t len = a->length < b->length ? a->length : b->length;
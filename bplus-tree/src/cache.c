@@ -0,0 +1,238 @@
+#include <stdlib.h> /* malloc, free */
+#include <assert.h> /* assert */
+
+#include "bplus.h"
+#include "private/cache.h"
+#include "private/pages.h"
+#include "private/utils.h"
+
+static inline bp__cache_shard_t *bp__cache_shard(bp__cache_t *c,
+                                                 const uint64_t offset,
+                                                 int32_t **bucket)
+{
+    uint64_t hash = bp__compute_hashl(offset);
+    bp__cache_shard_t *shard = &c->shards[hash % BP__CACHE_SHARDS];
+
+    *bucket = &shard->buckets[(hash >> 32) % BP__CACHE_BUCKETS];
+    return shard;
+}
+
+/* under the shard lock */
+static bp__cache_entry_t *bp__cache_find(bp__cache_shard_t *shard,
+                                         int32_t *bucket,
+                                         const uint64_t offset)
+{
+    for (int32_t i = *bucket; i != -1; i = shard->entries[i].next) {
+        if (shard->entries[i].offset == offset) return &shard->entries[i];
+    }
+    return NULL;
+}
+
+/* takes a reference unless the last one is already gone */
+static bp__page_t *bp__cache_ref(bp__page_t *page)
+{
+    uint32_t refs = __atomic_load_n(&page->refs, __ATOMIC_RELAXED);
+
+    do {
+        if (refs == 0) return NULL;
+    } while (!__atomic_compare_exchange_n(&page->refs,
+                                          &refs,
+                                          refs + 1,
+                                          1,
+                                          __ATOMIC_ACQUIRE,
+                                          __ATOMIC_RELAXED));
+    return page;
+}
+
+static void bp__cache_unlink(bp__cache_t *c,
+                             bp__cache_shard_t *shard,
+                             const int32_t index)
+{
+    int32_t *bucket;
+    int32_t *link;
+
+    bp__cache_shard(c, shard->entries[index].offset, &bucket);
+    for (link = bucket; *link != index; link = &shard->entries[*link].next) {
+        assert(*link != -1);
+    }
+    /* a lookup standing on index can still follow its next */
+    __atomic_store_n(link, shard->entries[index].next, __ATOMIC_RELEASE);
+}
+
+static void bp__cache_reset_shard(bp__cache_shard_t *shard)
+{
+    for (int i = 0; i < BP__CACHE_BUCKETS; i++) {
+        shard->buckets[i] = -1;
+    }
+    for (int i = 0; i < BP__CACHE_SHARD_PAGES; i++) {
+        shard->entries[i].page = NULL;
+        shard->entries[i].next = -1;
+        shard->entries[i].referenced = 0;
+    }
+    shard->hand = 0;
+    shard->retired = NULL;
+}
+
+int bp__cache_create(bp__cache_t *c)
+{
+    c->shards = malloc(sizeof(*c->shards) * BP__CACHE_SHARDS);
+    if (c->shards == NULL) return BP_EALLOC;
+
+    for (int i = 0; i < BP__CACHE_SHARDS; i++) {
+        if (pthread_mutex_init(&c->shards[i].lock, NULL)) {
+            while (--i >= 0) pthread_mutex_destroy(&c->shards[i].lock);
+            free(c->shards);
+            c->shards = NULL;
+            return BP_EMUTEX;
+        }
+        c->shards[i].hits = 0;
+        c->shards[i].misses = 0;
+        bp__cache_reset_shard(&c->shards[i]);
+    }
+
+    return BP_OK;
+}
+
+void bp__cache_destroy(bp_db_t *t, bp__cache_t *c)
+{
+    if (c->shards == NULL) return;
+
+    bp__cache_clear(t, c);
+    for (int i = 0; i < BP__CACHE_SHARDS; i++) {
+        pthread_mutex_destroy(&c->shards[i].lock);
+    }
+    free(c->shards);
+    c->shards = NULL;
+}
+
+void bp__cache_clear(bp_db_t *t, bp__cache_t *c)
+{
+    for (int i = 0; i < BP__CACHE_SHARDS; i++) {
+        bp__cache_shard_t *shard = &c->shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+        for (int j = 0; j < BP__CACHE_SHARD_PAGES; j++) {
+            if (shard->entries[j].page != NULL) {
+                bp__page_destroy(t, shard->entries[j].page);
+            }
+        }
+        bp__epoch_reclaim_on(t, &shard->retired, 1);
+        bp__cache_reset_shard(shard);
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+bp__page_t *bp__cache_get(bp__cache_t *c, const uint64_t offset)
+{
+    int32_t *bucket;
+    bp__cache_shard_t *shard = bp__cache_shard(c, offset, &bucket);
+    bp__cache_entry_t *entry = NULL;
+    bp__page_t *page = NULL;
+    int32_t i = __atomic_load_n(bucket, __ATOMIC_ACQUIRE);
+
+    /*
+     * Entries may be reused under us, so a walk can stray into another
+     * bucket or miss: a miss only costs a load and bp__cache_put finds
+     * the entry under the lock. The epoch keeps any page reached alive.
+     */
+    for (int n = 0; i != -1 && n < BP__CACHE_SHARD_PAGES; n++) {
+        entry = &shard->entries[i];
+        if (__atomic_load_n(&entry->offset, __ATOMIC_RELAXED) == offset) {
+            page = __atomic_load_n(&entry->page, __ATOMIC_ACQUIRE);
+            if (page != NULL && page->offset == offset) page = bp__cache_ref(page);
+            else page = NULL;
+            break;
+        }
+        i = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (page != NULL) {
+        if (!__atomic_load_n(&entry->referenced, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&entry->referenced, 1, __ATOMIC_RELAXED);
+        }
+        __atomic_add_fetch(&shard->hits, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(&shard->misses, 1, __ATOMIC_RELAXED);
+    }
+
+    return page;
+}
+
+bp__page_t *bp__cache_put(bp_db_t *t, bp__cache_t *c, bp__page_t *page)
+{
+    int32_t *bucket;
+    bp__cache_shard_t *shard = bp__cache_shard(c, page->offset, &bucket);
+    bp__cache_entry_t *entry;
+    bp__page_t *cached;
+    bp__retired_t *retired;
+    int32_t victim;
+
+    pthread_mutex_lock(&shard->lock);
+
+    /* another reader may have loaded it meanwhile */
+    entry = bp__cache_find(shard, bucket, page->offset);
+    if (entry != NULL) {
+        cached = entry->page;
+        __atomic_add_fetch(&cached->refs, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&shard->lock);
+
+        bp__page_destroy(t, page);
+        return cached;
+    }
+
+    /* CLOCK: give referenced entries a second chance */
+    for (;;) {
+        victim = shard->hand;
+        shard->hand = (shard->hand + 1) % BP__CACHE_SHARD_PAGES;
+        entry = &shard->entries[victim];
+
+        if (entry->page == NULL) break;
+        if (__atomic_load_n(&entry->referenced, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&entry->referenced, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        retired = malloc(sizeof(*retired));
+        if (retired == NULL) {
+            /* leave the cache as it is, the caller's page stays private */
+            pthread_mutex_unlock(&shard->lock);
+            return page;
+        }
+
+        /*
+         * Lookups may still be reaching the victim: the cache's reference
+         * is dropped once they left, readers holding one of their own
+         * free it on their bp__page_destroy
+         */
+        bp__cache_unlink(c, shard, victim);
+        cached = entry->page;
+        __atomic_store_n(&entry->page, NULL, __ATOMIC_RELEASE);
+        bp__epoch_retire_on(&t->epoch, &shard->retired, retired, cached);
+        break;
+    }
+    bp__epoch_reclaim_on(t, &shard->retired, 0);
+
+    /* one reference for the cache, one for the caller */
+    __atomic_store_n(&page->refs, 2, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->offset, page->offset, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->referenced, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->next, *bucket, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->page, page, __ATOMIC_RELEASE);
+    __atomic_store_n(bucket, victim, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return page;
+}
+
+void bp__cache_stats(bp__cache_t *c, uint64_t *hits, uint64_t *misses)
+{
+    *hits = 0;
+    *misses = 0;
+    if (c->shards == NULL) return;
+
+    for (int i = 0; i < BP__CACHE_SHARDS; i++) {
+        *hits += __atomic_load_n(&c->shards[i].hits, __ATOMIC_RELAXED);
+        *misses += __atomic_load_n(&c->shards[i].misses, __ATOMIC_RELAXED);
+    }
+}
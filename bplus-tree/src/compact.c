@@ -0,0 +1,450 @@
+#include <stdlib.h> /* malloc, free */
+#include <string.h> /* memset */
+#include <unistd.h> /* usleep */
+#include <time.h> /* clock_gettime */
+
+#include "bplus.h"
+#include "private/compact.h"
+#include "private/pages.h"
+#include "private/utils.h"
+
+/* old page offset -> offset and config of its copy */
+typedef struct bp__compact_map_s {
+    uint64_t capacity;
+    uint64_t count;
+    uint64_t *keys; /* offset + 1, 0 marks a free slot */
+    uint64_t *offsets;
+    uint64_t *configs;
+} bp__compact_map_t;
+
+typedef struct bp__compact_run_s {
+    bp_db_t *source;
+    bp_db_t *target;
+    bp__compact_map_t map;
+    int background;
+    uint64_t chunk;
+    uint64_t pages;
+} bp__compact_run_t;
+
+static double bp__compact_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int bp__compact_map_init(bp__compact_map_t *map, uint64_t capacity)
+{
+    map->capacity = capacity;
+    map->count = 0;
+    map->keys = calloc(capacity, sizeof(*map->keys));
+    map->offsets = malloc(capacity * sizeof(*map->offsets));
+    map->configs = malloc(capacity * sizeof(*map->configs));
+    if (map->keys == NULL || map->offsets == NULL || map->configs == NULL) {
+        free(map->keys);
+        free(map->offsets);
+        free(map->configs);
+        return BP_EALLOC;
+    }
+    return BP_OK;
+}
+
+static void bp__compact_map_destroy(bp__compact_map_t *map)
+{
+    free(map->keys);
+    free(map->offsets);
+    free(map->configs);
+}
+
+static uint64_t *bp__compact_map_slot(bp__compact_map_t *map,
+                                      const uint64_t offset)
+{
+    uint64_t i = bp__compute_hashl(offset) & (map->capacity - 1);
+
+    while (map->keys[i] != 0 && map->keys[i] != offset + 1) {
+        i = (i + 1) & (map->capacity - 1);
+    }
+    return &map->keys[i];
+}
+
+static int bp__compact_map_find(bp__compact_map_t *map,
+                                const uint64_t offset,
+                                uint64_t *new_offset,
+                                uint64_t *new_config)
+{
+    uint64_t *slot = bp__compact_map_slot(map, offset);
+    if (*slot == 0) return 0;
+
+    *new_offset = map->offsets[slot - map->keys];
+    *new_config = map->configs[slot - map->keys];
+    return 1;
+}
+
+static int bp__compact_map_insert(bp__compact_map_t *map,
+                                  const uint64_t offset,
+                                  const uint64_t new_offset,
+                                  const uint64_t new_config)
+{
+    int ret;
+    uint64_t *slot;
+
+    /* keep the load under 1/2 */
+    if (2 * (map->count + 1) > map->capacity) {
+        bp__compact_map_t bigger;
+
+        ret = bp__compact_map_init(&bigger, map->capacity * 2);
+        if (ret != BP_OK) return ret;
+
+        for (uint64_t i = 0; i < map->capacity; i++) {
+            if (map->keys[i] == 0) continue;
+            slot = bp__compact_map_slot(&bigger, map->keys[i] - 1);
+            *slot = map->keys[i];
+            bigger.offsets[slot - bigger.keys] = map->offsets[i];
+            bigger.configs[slot - bigger.keys] = map->configs[i];
+        }
+        bigger.count = map->count;
+
+        bp__compact_map_destroy(map);
+        *map = bigger;
+    }
+
+    slot = bp__compact_map_slot(map, offset);
+    *slot = offset + 1;
+    map->offsets[slot - map->keys] = new_offset;
+    map->configs[slot - map->keys] = new_config;
+    map->count++;
+
+    return BP_OK;
+}
+
+/*
+ * Copies the page at offset and everything below it that has not been
+ * copied yet. Values are always copied with their page: leaves that
+ * writers changed get new copies of their unchanged values too.
+ */
+static int bp__compact_copy(bp__compact_run_t *run,
+                            const uint64_t offset,
+                            const uint64_t config,
+                            uint64_t *new_offset,
+                            uint64_t *new_config)
+{
+    int ret;
+    bp__page_t *page;
+
+    if (bp__compact_map_find(&run->map, offset, new_offset, new_config)) {
+        return BP_OK;
+    }
+
+    ret = bp__page_load(run->source, offset, config, &page);
+    if (ret != BP_OK) return ret;
+
+    for (uint64_t i = 0; i < page->length; i++) {
+        if (page->type == kPage) {
+            ret = bp__compact_copy(run,
+                                   page->keys[i].offset,
+                                   page->keys[i].config,
+                                   &page->keys[i].offset,
+                                   &page->keys[i].config);
+        } else {
+            bp_value_t value;
+
+            ret = bp__page_load_value(run->source, page, i, &value);
+            if (ret != BP_OK) break;
+
+            ret = bp__value_save(run->target,
+                                 &value,
+                                 NULL,
+                                 &page->keys[i].offset,
+                                 &page->keys[i].config);
+            free(value.value);
+        }
+        if (ret != BP_OK) break;
+    }
+
+    if (ret == BP_OK) ret = bp__page_save(run->target, page);
+    if (ret == BP_OK) {
+        *new_offset = page->offset;
+        *new_config = page->config;
+        ret = bp__compact_map_insert(&run->map, offset, page->offset, page->config);
+    }
+    bp__page_destroy(run->source, page);
+    if (ret != BP_OK) return ret;
+
+    run->pages++;
+
+    /* leave some disk bandwidth to the writers */
+    if (run->background && ++run->chunk == BP__COMPACT_CHUNK) {
+        run->chunk = 0;
+        usleep(BP__COMPACT_PAUSE_US);
+    }
+
+    return BP_OK;
+}
+
+/* copies the current tree, returns the size writers appended meanwhile */
+static int bp__compact_round(bp__compact_run_t *run,
+                             uint64_t *new_offset,
+                             uint64_t *new_config,
+                             uint64_t *appended)
+{
+    int ret;
+    uint64_t offset, config, size;
+    bp_db_t *t = run->source;
+
+    pthread_mutex_lock(&t->wlock);
+    offset = t->head.offset;
+    config = t->head.config;
+    size = t->filesize;
+    pthread_mutex_unlock(&t->wlock);
+
+    ret = bp__compact_copy(run, offset, config, new_offset, new_config);
+    if (ret != BP_OK) return ret;
+
+    *appended = __atomic_load_n(&t->filesize, __ATOMIC_ACQUIRE) - size;
+    return BP_OK;
+}
+
+int bp__compact_run(bp_db_t *t, const int background)
+{
+    int ret;
+    char *compacted_name;
+    bp_db_t compacted;
+    bp__compact_run_t run;
+    uint64_t offset, config, appended, copied;
+    double start, stall;
+
+    start = bp__compact_now();
+
+    /* get name of compacted database (prefixed with .compact) */
+    ret = bp__writer_compact_name((bp__writer_t *) t, &compacted_name);
+    if (ret != BP_OK) return ret;
+
+    /* open it */
+    ret = bp_open(&compacted, compacted_name);
+    free(compacted_name);
+    if (ret != BP_OK) return ret;
+
+    /* destroy stub head page, the copied one replaces it */
+    bp__page_destroy(&compacted, compacted.head.page);
+    compacted.head.page = NULL;
+    bp_set_compare_cb(&compacted, t->compare_cb);
+
+    run.source = t;
+    run.target = &compacted;
+    run.background = background;
+    run.chunk = 0;
+    run.pages = 0;
+    ret = bp__compact_map_init(&run.map, 1024);
+    if (ret != BP_OK) goto fatal;
+
+    /* copy, then catch up with the writers while they keep going */
+    for (int round = 0; round < BP__COMPACT_ROUNDS; round++) {
+        ret = bp__compact_round(&run, &offset, &config, &appended);
+        if (ret != BP_OK) goto fatal;
+        if (appended <= BP__COMPACT_CATCHUP_SIZE) break;
+    }
+
+    /* last round and switch-over, writers wait */
+    pthread_mutex_lock(&t->wlock);
+    stall = bp__compact_now();
+    run.background = 0;
+
+    ret = bp__compact_copy(&run, t->head.offset, t->head.config, &offset, &config);
+    if (ret == BP_OK) {
+        ret = bp__page_load(&compacted, offset, config, &compacted.head.page);
+    }
+    if (ret == BP_OK) {
+        compacted.head.page->is_head = 1;
+        ret = bp__tree_write_head((bp__writer_t *) &compacted, NULL);
+    }
+    if (ret != BP_OK) {
+        pthread_mutex_unlock(&t->wlock);
+        goto fatal;
+    }
+    copied = compacted.filesize;
+
+    /* readers must be done with the old file before it is replaced */
+    bp__tree_unpublish_head(t);
+
+    ret = bp__writer_compact_finalize((bp__writer_t *) t,
+                                      (bp__writer_t *) &compacted);
+    /* the tree could not be reopened: fail the readers waiting for a head */
+    if (__atomic_load_n(&t->head.rpage, __ATOMIC_RELAXED) == NULL) {
+        __atomic_store_n(&t->head.error,
+                         ret != BP_OK ? ret : BP_EFILE,
+                         __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_lock(&t->compact.lock);
+    t->compact.live_size = t->filesize;
+    t->compact.stats.runs++;
+    t->compact.stats.copied_bytes = copied;
+    t->compact.stats.copied_pages = run.pages;
+    t->compact.stats.duration = bp__compact_now() - start;
+    t->compact.stats.stall = bp__compact_now() - stall;
+    t->compact.stats.throughput = copied / t->compact.stats.duration;
+    pthread_mutex_unlock(&t->compact.lock);
+
+    pthread_mutex_unlock(&t->wlock);
+    bp__compact_map_destroy(&run.map);
+
+    return ret;
+
+fatal:
+    bp__compact_map_destroy(&run.map);
+    compacted_name = compacted.filename;
+    compacted.filename = NULL;
+    bp_close(&compacted);
+    unlink(compacted_name);
+    free(compacted_name);
+    return ret;
+}
+
+static void *bp__compact_thread(void *arg)
+{
+    bp_db_t *t = (bp_db_t *) arg;
+    int ret = bp__compact_run(t, 1);
+
+    pthread_mutex_lock(&t->compact.lock);
+    t->compact.result = ret;
+    t->compact.finished = 1;
+    pthread_mutex_unlock(&t->compact.lock);
+
+    return NULL;
+}
+
+/*
+ * compact.lock held: reaps a finished background compaction.
+ * Threads are only joined here, under the lock, so never twice.
+ */
+static void bp__compact_join(bp_db_t *t)
+{
+    if (t->compact.state != kCompactThread || !t->compact.finished) return;
+
+    pthread_join(t->compact.thread, NULL);
+    t->compact.state = kCompactIdle;
+}
+
+/* compact.lock held */
+static int bp__compact_spawn(bp_db_t *t)
+{
+    bp__compact_join(t);
+    if (t->compact.state != kCompactIdle) return BP_ECOMPACT_EXISTS;
+
+    t->compact.finished = 0;
+    if (pthread_create(&t->compact.thread, NULL, bp__compact_thread, t)) {
+        return BP_EALLOC;
+    }
+    t->compact.state = kCompactThread;
+    return BP_OK;
+}
+
+int bp__compact_init(bp_db_t *t)
+{
+    if (pthread_mutex_init(&t->compact.lock, NULL)) return BP_EMUTEX;
+
+    t->compact.state = kCompactIdle;
+    t->compact.finished = 0;
+    t->compact.result = BP_OK;
+    t->compact.auto_amp = 0;
+    t->compact.live_size = 0;
+    memset(&t->compact.stats, 0, sizeof(t->compact.stats));
+
+    return BP_OK;
+}
+
+void bp__compact_destroy(bp_db_t *t)
+{
+    bp_compact_wait(t);
+    pthread_mutex_destroy(&t->compact.lock);
+}
+
+void bp__compact_maybe_start(bp_db_t *t)
+{
+    uint64_t live_size;
+
+    pthread_mutex_lock(&t->compact.lock);
+    live_size = t->compact.live_size;
+    if (live_size < BP__COMPACT_MIN_SIZE) live_size = BP__COMPACT_MIN_SIZE;
+
+    if (t->compact.auto_amp != 0 &&
+        t->filesize > t->compact.auto_amp * live_size) {
+        /* no-op while a compaction is running */
+        bp__compact_spawn(t);
+    }
+    pthread_mutex_unlock(&t->compact.lock);
+}
+
+int bp_compact(bp_db_t *tree)
+{
+    int ret;
+
+    pthread_mutex_lock(&tree->compact.lock);
+    bp__compact_join(tree);
+    if (tree->compact.state != kCompactIdle) {
+        pthread_mutex_unlock(&tree->compact.lock);
+        return BP_ECOMPACT_EXISTS;
+    }
+    tree->compact.state = kCompactSync;
+    pthread_mutex_unlock(&tree->compact.lock);
+
+    ret = bp__compact_run(tree, 0);
+
+    pthread_mutex_lock(&tree->compact.lock);
+    tree->compact.state = kCompactIdle;
+    pthread_mutex_unlock(&tree->compact.lock);
+
+    return ret;
+}
+
+int bp_compact_start(bp_db_t *tree)
+{
+    int ret;
+
+    pthread_mutex_lock(&tree->compact.lock);
+    ret = bp__compact_spawn(tree);
+    pthread_mutex_unlock(&tree->compact.lock);
+
+    return ret;
+}
+
+int bp_compact_wait(bp_db_t *tree)
+{
+    int ret;
+
+    for (;;) {
+        pthread_mutex_lock(&tree->compact.lock);
+        if (tree->compact.state != kCompactThread) {
+            pthread_mutex_unlock(&tree->compact.lock);
+            return BP_OK;
+        }
+        if (tree->compact.finished) {
+            bp__compact_join(tree);
+            ret = tree->compact.result;
+            pthread_mutex_unlock(&tree->compact.lock);
+            return ret;
+        }
+        pthread_mutex_unlock(&tree->compact.lock);
+
+        /* the thread needs the lock to finish */
+        usleep(1000);
+    }
+}
+
+void bp_set_auto_compact(bp_db_t *tree, double max_space_amp)
+{
+    pthread_mutex_lock(&tree->compact.lock);
+    tree->compact.auto_amp = max_space_amp;
+    pthread_mutex_unlock(&tree->compact.lock);
+}
+
+void bp_compact_stats(bp_db_t *tree, bp_compact_stats_t *stats)
+{
+    pthread_mutex_lock(&tree->compact.lock);
+    *stats = tree->compact.stats;
+    stats->file_size = __atomic_load_n(&tree->filesize, __ATOMIC_ACQUIRE);
+    stats->live_size = tree->compact.live_size;
+    stats->space_amp = stats->live_size == 0 ?
+                       1 : (double) stats->file_size / stats->live_size;
+    pthread_mutex_unlock(&tree->compact.lock);
+}
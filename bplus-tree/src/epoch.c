@@ -0,0 +1,132 @@
+#include <stdlib.h> /* malloc, free */
+#include <sched.h> /* sched_yield */
+
+#include "bplus.h"
+#include "private/epoch.h"
+#include "private/pages.h"
+
+/* each thread starts probing at its own slot */
+static uint32_t bp__epoch_next_hint = 0;
+static __thread int bp__epoch_hint = -1;
+
+void bp__epoch_init(bp__epoch_t *e)
+{
+    /* 0 marks free slots, epochs start at 1 */
+    e->global = 1;
+    for (int i = 0; i < BP__EPOCH_SLOTS; i++) {
+        e->slots[i].epoch = 0;
+    }
+    e->retired = NULL;
+}
+
+int bp__epoch_enter(bp__epoch_t *e)
+{
+    uint64_t free_slot, epoch;
+    int slot, probed = 0;
+
+    if (bp__epoch_hint == -1) {
+        bp__epoch_hint = __atomic_fetch_add(&bp__epoch_next_hint,
+                                            1,
+                                            __ATOMIC_RELAXED) % BP__EPOCH_SLOTS;
+    }
+
+    for (slot = bp__epoch_hint;; slot = (slot + 1) % BP__EPOCH_SLOTS) {
+        /* more readers than slots: let the ones inside leave */
+        if (++probed > BP__EPOCH_SLOTS) {
+            sched_yield();
+            probed = 1;
+        }
+        if (__atomic_load_n(&e->slots[slot].epoch, __ATOMIC_RELAXED) != 0) {
+            continue;
+        }
+        free_slot = 0;
+        epoch = __atomic_load_n(&e->global, __ATOMIC_SEQ_CST);
+        if (__atomic_compare_exchange_n(&e->slots[slot].epoch,
+                                        &free_slot,
+                                        epoch,
+                                        0,
+                                        __ATOMIC_SEQ_CST,
+                                        __ATOMIC_RELAXED)) {
+            return slot;
+        }
+    }
+}
+
+void bp__epoch_exit(bp__epoch_t *e, const int slot)
+{
+    __atomic_store_n(&e->slots[slot].epoch, 0, __ATOMIC_RELEASE);
+}
+
+/* oldest epoch that a reader announces, UINT64_MAX if there are none */
+static uint64_t bp__epoch_min_active(bp__epoch_t *e)
+{
+    uint64_t min = UINT64_MAX, epoch;
+
+    for (int i = 0; i < BP__EPOCH_SLOTS; i++) {
+        epoch = __atomic_load_n(&e->slots[i].epoch, __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch < min) min = epoch;
+    }
+
+    return min;
+}
+
+void bp__epoch_retire_on(bp__epoch_t *e,
+                         bp__retired_t **list,
+                         bp__retired_t *r,
+                         bp__page_t *page)
+{
+    /*
+     * page is already unpublished: readers that announce an epoch
+     * after the bump below can only load its replacement
+     */
+    r->page = page;
+    r->epoch = __atomic_fetch_add(&e->global, 1, __ATOMIC_SEQ_CST);
+    r->next = *list;
+    *list = r;
+}
+
+int bp__epoch_retire(bp_db_t *t, bp__page_t *page)
+{
+    bp__retired_t *r = malloc(sizeof(*r));
+    if (r == NULL) return BP_EALLOC;
+
+    bp__epoch_retire_on(&t->epoch, &t->epoch.retired, r, page);
+    bp__epoch_reclaim(t, 0);
+
+    return BP_OK;
+}
+
+void bp__epoch_reclaim(bp_db_t *t, const int all)
+{
+    bp__epoch_reclaim_on(t, &t->epoch.retired, all);
+}
+
+void bp__epoch_reclaim_on(bp_db_t *t, bp__retired_t **list, const int all)
+{
+    uint64_t min;
+    bp__retired_t **link = list;
+
+    if (*list == NULL) return;
+    min = all ? UINT64_MAX : bp__epoch_min_active(&t->epoch);
+
+    while (*link != NULL) {
+        bp__retired_t *r = *link;
+
+        if (r->epoch < min) {
+            *link = r->next;
+            bp__page_destroy(t, r->page);
+            free(r);
+        } else {
+            link = &r->next;
+        }
+    }
+}
+
+void bp__epoch_synchronize(bp__epoch_t *e)
+{
+    uint64_t epoch = __atomic_fetch_add(&e->global, 1, __ATOMIC_SEQ_CST);
+
+    while (bp__epoch_min_active(e) <= epoch) {
+        sched_yield();
+    }
+}
@@ -4,6 +4,7 @@
 
 #include "bplus.h"
 #include "private/pages.h"
+#include "private/cache.h"
 #include "private/utils.h"
 
 int bp__page_create(bp_db_t *t,
@@ -39,6 +40,7 @@ int bp__page_create(bp_db_t *t,
 
     p->buff_ = NULL;
     p->is_head = 0;
+    p->refs = 0;
 
     *page = p;
     return BP_OK;
@@ -46,6 +48,12 @@ int bp__page_create(bp_db_t *t,
 
 void bp__page_destroy(bp_db_t *t, bp__page_t *page)
 {
+    /* cached pages are shared, the last reference frees them */
+    if (__atomic_load_n(&page->refs, __ATOMIC_ACQUIRE) != 0 &&
+        __atomic_sub_fetch(&page->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+
     /* Free all keys */
     for (uint64_t i = 0; i < page->length; i++) {
         if (page->keys[i].allocated) {
@@ -93,14 +101,19 @@ int bp__page_read(bp_db_t *t, bp__page_t *page)
     bp__writer_t *w = (bp__writer_t *) t;
 
     char *buff = NULL;
+    int mapped;
 
     /* Read page size and leaf flag */
     size = page->config >> 1;
     page->type = page->config & 1 ? kLeaf : kPage;
 
-    /* Read page data */
-    ret = bp__writer_read(w, kCompressed, page->offset, &size, (void**) &buff);
-    if (ret != BP_OK) return ret;
+    /* Decode in place from the mapping, or read a copy of page data */
+    buff = (char *) bp__writer_map(w, page->offset, size);
+    mapped = buff != NULL;
+    if (!mapped) {
+        ret = bp__writer_read(w, kCompressed, page->offset, &size, (void**) &buff);
+        if (ret != BP_OK) return ret;
+    }
 
     /* Parse data */
     i = 0;
@@ -121,7 +134,8 @@ int bp__page_read(bp_db_t *t, bp__page_t *page)
     if (page->buff_ != NULL) {
         free(page->buff_);
     }
-    page->buff_ = buff;
+    /* keys point into the mapping, which outlives the page */
+    page->buff_ = mapped ? NULL : buff;
 
     return BP_OK;
 }
@@ -149,6 +163,25 @@ int bp__page_load(bp_db_t *t,
     return BP_OK;
 }
 
+int bp__page_load_shared(bp_db_t *t,
+                         const uint64_t offset,
+                         const uint64_t config,
+                         bp__page_t **page)
+{
+    int ret;
+    bp__page_t *new_page;
+
+    *page = bp__cache_get(&t->cache, offset);
+    if (*page != NULL) return BP_OK;
+
+    ret = bp__page_load(t, offset, config, &new_page);
+    if (ret != BP_OK) return ret;
+
+    *page = bp__cache_put(t, &t->cache, new_page);
+
+    return BP_OK;
+}
+
 int bp__page_save(bp_db_t *t, bp__page_t *page)
 {
     int ret;
@@ -295,11 +328,12 @@ int bp__page_search(bp_db_t *t,
         assert(i > 0);
         if (cmp != 0) i--;
 
-        if (type == kLoad) {
-            ret = bp__page_load(t,
-                                page->keys[i].offset,
-                                page->keys[i].config,
-                                &child);
+        if (type != kNotLoad) {
+            ret = (type == kLoad ? bp__page_load : bp__page_load_shared)(
+                t,
+                page->keys[i].offset,
+                page->keys[i].config,
+                &child);
             if (ret != BP_OK) return ret;
 
             result->child = child;
@@ -320,7 +354,7 @@ int bp__page_get(bp_db_t *t,
 {
     int ret;
     bp__page_search_res_t res;
-    ret = bp__page_search(t, page, key, kLoad, &res);
+    ret = bp__page_search(t, page, key, kLoadShared, &res);
     if (ret != BP_OK) return ret;
 
     if (res.child == NULL) {
@@ -335,6 +369,34 @@ int bp__page_get(bp_db_t *t,
     }
 }
 
+int bp__page_get_ref(bp_db_t *t,
+                     bp__page_t *page,
+                     const bp_key_t *key,
+                     bp_range_cb cb,
+                     void *arg)
+{
+    int ret;
+    bp__page_search_res_t res;
+    ret = bp__page_search(t, page, key, kLoadShared, &res);
+    if (ret != BP_OK) return ret;
+
+    if (res.child == NULL) {
+        if (res.cmp != 0) return BP_ENOTFOUND;
+
+        return bp__value_ref(t,
+                             page->keys[res.index].offset,
+                             page->keys[res.index].config,
+                             (bp_key_t *) &page->keys[res.index],
+                             cb,
+                             arg);
+    } else {
+        ret = bp__page_get_ref(t, res.child, key, cb, arg);
+        bp__page_destroy(t, res.child);
+        res.child = NULL;
+        return ret;
+    }
+}
+
 int bp__page_get_range(bp_db_t *t,
                        bp__page_t *page,
                        const bp_key_t *start,
@@ -369,10 +431,10 @@ int bp__page_get_range(bp_db_t *t,
             /* load child page and apply range get to it */
             bp__page_t* child;
 
-            ret = bp__page_load(t,
-                                page->keys[i].offset,
-                                page->keys[i].config,
-                                &child);
+            ret = bp__page_load_shared(t,
+                                       page->keys[i].offset,
+                                       page->keys[i].config,
+                                       &child);
             if (ret != BP_OK) return ret;
 
             ret = bp__page_get_range(t, child, start, end, filter, cb, arg);
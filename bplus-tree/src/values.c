@@ -14,8 +14,23 @@ int bp__value_load(bp_db_t *t,
 {
     int ret;
     char* buff;
+    const char *mapped;
     uint64_t buff_len = length;
 
+    /* copy straight out of the mapping if there's one */
+    mapped = bp__writer_map((bp__writer_t *) t, offset, length);
+    if (mapped != NULL) {
+        value->value = malloc(length - 16);
+        if (value->value == NULL) return BP_EALLOC;
+
+        value->_prev_offset = ntohll(*(uint64_t *) (mapped));
+        value->_prev_length = ntohll(*(uint64_t *) (mapped + 8));
+        memcpy(value->value, mapped + 16, length - 16);
+        value->length = length - 16;
+
+        return BP_OK;
+    }
+
     /* read data from disk first */
     ret = bp__writer_read((bp__writer_t*) t,
                           kCompressed,
@@ -44,6 +59,39 @@ int bp__value_load(bp_db_t *t,
 }
 
 
+int bp__value_ref(bp_db_t *t,
+                  const uint64_t offset,
+                  const uint64_t length,
+                  const bp_key_t *key,
+                  bp_range_cb cb,
+                  void *arg)
+{
+    int ret;
+    bp_value_t value;
+    const char *mapped;
+
+    mapped = bp__writer_map((bp__writer_t *) t, offset, length);
+    if (mapped == NULL) {
+        /* compressed or not mapped: hand over a copy */
+        ret = bp__value_load(t, offset, length, &value);
+        if (ret != BP_OK) return ret;
+
+        cb(arg, key, &value);
+        free(value.value);
+        return BP_OK;
+    }
+
+    value._prev_offset = ntohll(*(uint64_t *) (mapped));
+    value._prev_length = ntohll(*(uint64_t *) (mapped + 8));
+    value.value = (char *) mapped + 16;
+    value.length = length - 16;
+
+    cb(arg, key, &value);
+
+    return BP_OK;
+}
+
+
 int bp__value_save(bp_db_t *t,
                    const bp_value_t *value,
                    const bp__kv_t *previous,
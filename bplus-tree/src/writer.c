@@ -3,13 +3,50 @@
 #include "private/compressor.h"
 
 #include <fcntl.h> /* open */
-#include <unistd.h> /* close, write, read */
+#include <unistd.h> /* close, write, read, unlink */
 #include <sys/stat.h> /* S_IWUSR, S_IRUSR */
+#include <sys/mman.h> /* mmap, munmap */
 #include <stdlib.h> /* malloc, free */
 #include <stdio.h> /* sprintf */
 #include <string.h> /* memset */
 #include <errno.h> /* errno */
 
+/* map at least twice the current file, so that remaps are rare */
+static int bp__writer_remap(bp__writer_t *w)
+{
+    bp__writer_map_t *map;
+    uint64_t size = w->filesize * 2;
+    if (size < BP__MAP_MIN_SIZE) size = BP__MAP_MIN_SIZE;
+
+    map = malloc(sizeof(*map));
+    if (map == NULL) return BP_EALLOC;
+
+    map->addr = mmap(NULL, (size_t) size, PROT_READ, MAP_SHARED, w->fd, 0);
+    if (map->addr == MAP_FAILED) {
+        free(map);
+        return BP_EFILE;
+    }
+    map->size = size;
+    map->prev = w->map;
+
+    __atomic_store_n(&w->map, map, __ATOMIC_RELEASE);
+
+    return BP_OK;
+}
+
+static void bp__writer_unmap(bp__writer_t *w)
+{
+    bp__writer_map_t *map = w->map;
+
+    while (map != NULL) {
+        bp__writer_map_t *prev = map->prev;
+        munmap(map->addr, (size_t) map->size);
+        free(map);
+        map = prev;
+    }
+    w->map = NULL;
+}
+
 int bp__writer_create(bp__writer_t *w, const char *filename)
 {
     off_t filesize;
@@ -35,6 +72,15 @@ int bp__writer_create(bp__writer_t *w, const char *filename)
     /* Nullify padding to shut up valgrind */
     memset(&w->padding, 0, sizeof(w->padding));
 
+    /*
+     * Compressed data has to be copied out anyway; without a mapping
+     * reads simply fall back to pread
+     */
+    w->map = NULL;
+#if BP_USE_SNAPPY != 1
+    bp__writer_remap(w);
+#endif
+
     return BP_OK;
 
 error:
@@ -44,6 +90,7 @@ error:
 
 int bp__writer_destroy(bp__writer_t *w)
 {
+    bp__writer_unmap(w);
     free(w->filename);
     w->filename = NULL;
     if (close(w->fd)) return BP_EFILE;
@@ -77,7 +124,7 @@ int bp__writer_compact_name(bp__writer_t *w, char **compact_name)
 
 int bp__writer_compact_finalize(bp__writer_t *s, bp__writer_t *t)
 {
-    int ret;
+    int ret, renamed = BP_OK;
     char *name, *compacted_name;
 
     /* save filename and prevent freeing it */
@@ -91,12 +138,17 @@ int bp__writer_compact_finalize(bp__writer_t *s, bp__writer_t *t)
     ret = bp_close((bp_db_t *) t);
     if (ret != BP_OK) goto fatal;
 
-    if (rename(compacted_name, name) != 0) return BP_EFILERENAME;
+    if (rename(compacted_name, name) != 0) {
+        /* the source file is untouched: reopen it and drop the copy */
+        unlink(compacted_name);
+        renamed = BP_EFILERENAME;
+    }
 
     /* reopen source tree */
     ret = bp__writer_create(s, name);
     if (ret != BP_OK) goto fatal;
     ret = bp__init((bp_db_t *) s);
+    if (ret == BP_OK) ret = renamed;
 
 fatal:
     free(compacted_name);
@@ -114,7 +166,10 @@ int bp__writer_read(bp__writer_t *w,
     ssize_t bytes_read;
     char *cdata;
 
-    if (w->filesize < offset + *size) return BP_EFILEREAD_OOB;
+    /* readers don't hold the write lock, filesize only grows */
+    if (__atomic_load_n(&w->filesize, __ATOMIC_ACQUIRE) < offset + *size) {
+        return BP_EFILEREAD_OOB;
+    }
 
     /* Ignore empty reads */
     if (*size == 0) {
@@ -178,7 +233,7 @@ int bp__writer_write(bp__writer_t *w,
     if (padding != sizeof(w->padding)) {
         written = write(w->fd, &w->padding, (size_t) padding);
         if ((uint32_t) written != padding) return BP_EFILEWRITE;
-        w->filesize += padding;
+        __atomic_store_n(&w->filesize, w->filesize + padding, __ATOMIC_RELEASE);
     }
 
     /* Ignore empty writes */
@@ -213,11 +268,28 @@ int bp__writer_write(bp__writer_t *w,
 
     /* change offset */
     *offset = w->filesize;
-    w->filesize += written;
+    __atomic_store_n(&w->filesize, w->filesize + written, __ATOMIC_RELEASE);
+
+    /* a failed remap only sends readers of the new data to pread */
+    if (w->map != NULL && w->filesize > w->map->size) bp__writer_remap(w);
 
     return BP_OK;
 }
 
+const char *bp__writer_map(bp__writer_t *w,
+                           const uint64_t offset,
+                           const uint64_t size)
+{
+    bp__writer_map_t *map = __atomic_load_n(&w->map, __ATOMIC_ACQUIRE);
+
+    if (map == NULL || map->size < offset + size) return NULL;
+    if (__atomic_load_n(&w->filesize, __ATOMIC_ACQUIRE) < offset + size) {
+        return NULL;
+    }
+
+    return map->addr + offset;
+}
+
 int bp__writer_find(bp__writer_t*w,
                     const enum comp_type comp,
                     const uint64_t size,
@@ -1,5 +1,9 @@
 #include "test.h"
 
+void copy_cb(void* arg, const bp_key_t* key, const bp_value_t* value) {
+  memcpy(arg, value->value, value->length);
+}
+
 TEST_START("basic benchmark", "basic-bench")
 
   const int num = 500000;
@@ -36,6 +40,17 @@ TEST_START("basic benchmark", "basic-bench")
       free(value1);
     }
     BENCH_END(read, start + delta)
+
+    BENCH_START(read_ref, start + delta)
+    for (i = 0; i < start + delta; i++) {
+      bp_key_t bkey;
+      char value1[value_len];
+
+      bkey.value = keys[i];
+      bkey.length = strlen(keys[i]) + 1;
+      bp_get_ref(&db, &bkey, copy_cb, value1);
+    }
+    BENCH_END(read_ref, start + delta)
   }
 
   BENCH_START(compact, 0)
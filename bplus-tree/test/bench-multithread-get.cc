@@ -1,7 +1,7 @@
 #include "test.h"
 
 const int num = 100000;
-const int rnum = 4;
+const int rnum = 8;
 static char* keys[num];
 
 void* reader_thread(void* db_) {
@@ -30,13 +30,23 @@ TEST_START("multi-threaded get benchmark", "mt-get-bench")
                (const char**) keys,
                (const char**) keys);
 
-  BENCH_START(get, rnum * num)
-  for (i = 0; i < rnum; i++) {
-    pthread_create(&readers[i], NULL, reader_thread, (void*) &db);
-  }
+  /* readers take no lock: throughput should grow with their count */
+  for (int n = 1; n <= rnum; n *= 2) {
+    fprintf(stdout, "%d reader(s)\n", n);
+
+    BENCH_START(get, n * num)
+    for (i = 0; i < n; i++) {
+      pthread_create(&readers[i], NULL, reader_thread, (void*) &db);
+    }
 
-  for (i = 0; i < rnum; i++) {
-    pthread_join(readers[i], NULL);
+    for (i = 0; i < n; i++) {
+      pthread_join(readers[i], NULL);
+    }
+    BENCH_END(get, n * num)
   }
-  BENCH_END(get, rnum * num)
+
+  uint64_t hits, misses;
+  bp_cache_stats(&db, &hits, &misses);
+  fprintf(stdout, "page cache : %llu hits, %llu misses\n",
+          (unsigned long long) hits, (unsigned long long) misses);
 TEST_END("multi-threaded get benchmark", "mt-get-bench")
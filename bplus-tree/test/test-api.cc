@@ -7,6 +7,12 @@ int update_cb(void* arg, const bp_value_t* previous, const bp_value_t* curr) {
   return 1;
 }
 
+void ref_cb(void* arg, const bp_key_t* key, const bp_value_t* value) {
+  char* expected = (char*) arg;
+  assert(strcmp(value->value, expected) == 0);
+  expected[0] = 0;
+}
+
 int remove_cb(void* arg, const bp_value_t* value) {
   char* expected = (char*) arg;
   return strcmp(value->value, expected) == 0;
@@ -49,6 +55,11 @@ TEST_START("API test", "api")
     free(result);
   }
 
+  /* leaves are shared by the gets above through the page cache */
+  uint64_t hits, misses;
+  bp_cache_stats(&db, &hits, &misses);
+  assert(misses > 0 && hits > misses);
+
   /* overwrite every key */
   for (i = 0; i < n; i++) {
     sprintf(key, "some key %d", i);
@@ -101,6 +112,10 @@ TEST_START("API test", "api")
     assert(bp_get(&db, &kkey, &result) == BP_OK);
     assert(strcmp(result.value, expected) == 0);
 
+    /* same value, handed over without a copy */
+    assert(bp_get_ref(&db, &kkey, ref_cb, (void*) expected) == BP_OK);
+    assert(expected[0] == 0);
+
     /* previous should be not available after compaction */
     assert(bp_get_previous(&db, &result, &previous) == BP_ENOTFOUND);
 
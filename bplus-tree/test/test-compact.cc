@@ -0,0 +1,87 @@
+#include "test.h"
+#include <pthread.h>
+
+const int items = 5000;
+const int passes = 4;
+
+void* test_writer(void* db_) {
+  bp_db_t* db = (bp_db_t*) db_;
+
+  char key[20];
+  char val[40];
+
+  /* keeps writing while the background compaction copies the tree */
+  for (int i = 0; i < items; i++) {
+    sprintf(key, "%d", i);
+    sprintf(val, "during compaction %d", i);
+    assert(bp_sets(db, key, val) == BP_OK);
+  }
+
+  return NULL;
+}
+
+TEST_START("background compaction test", "compact")
+
+  char key[20];
+  char val[40];
+  char* result;
+  bp_compact_stats_t stats;
+  pthread_t writer;
+
+  /* overwrite every key a few times to leave garbage behind */
+  for (int j = 0; j < passes; j++) {
+    for (int i = 0; i < items; i++) {
+      sprintf(key, "%d", i);
+      sprintf(val, "pass %d value %d", j, i);
+      assert(bp_sets(&db, key, val) == BP_OK);
+    }
+  }
+
+  bp_compact_stats(&db, &stats);
+  assert(stats.runs == 0);
+  uint64_t before = stats.file_size;
+
+  assert(bp_compact_start(&db) == BP_OK);
+  assert(pthread_create(&writer, NULL, test_writer, (void*) &db) == 0);
+  assert(pthread_join(writer, NULL) == 0);
+  assert(bp_compact_wait(&db) == BP_OK);
+
+  /* no write may get lost in the switch-over */
+  for (int i = 0; i < items; i++) {
+    sprintf(key, "%d", i);
+    sprintf(val, "during compaction %d", i);
+    assert(bp_gets(&db, key, &result) == BP_OK);
+    assert(strcmp(result, val) == 0);
+    free(result);
+  }
+
+  bp_compact_stats(&db, &stats);
+  assert(stats.runs == 1);
+  assert(stats.copied_pages > 0 && stats.throughput > 0);
+  assert(stats.stall <= stats.duration);
+  assert(stats.live_size < before);
+
+  /* the compacted tree survives a reopen */
+  assert(bp_close(&db) == BP_OK);
+  assert(bp_open(&db, __db_file) == BP_OK);
+  assert(bp_gets(&db, "0", &result) == BP_OK);
+  assert(strcmp(result, "during compaction 0") == 0);
+  free(result);
+
+  /* writers start compactions on their own once the file grows enough */
+  bp_compact_stats(&db, &stats);
+  assert(stats.runs == 0);
+  bp_set_auto_compact(&db, 2);
+  for (int j = 0; stats.runs == 0; j++) {
+    assert(j < 100);
+    for (int i = 0; i < items; i++) {
+      sprintf(key, "%d", i);
+      sprintf(val, "auto pass %d value %d", j, i);
+      assert(bp_sets(&db, key, val) == BP_OK);
+    }
+    assert(bp_compact_wait(&db) == BP_OK);
+    bp_compact_stats(&db, &stats);
+  }
+  bp_set_auto_compact(&db, 0);
+
+TEST_END("background compaction test", "compact")
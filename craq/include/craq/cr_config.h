@@ -11,15 +11,19 @@
 #include <od_network_context.h>
 
 
-#define CR_HEAD_NODE 0
-#define CR_TAIL_NODE (MACHINE_NUM - 1)
+// The keys are partitioned over CR_CHAIN_NUM chains. Chain c starts at
+// machine c and goes through c + 1, c + 2, ... to its tail c - 1 (mod
+// MACHINE_NUM): every machine heads one chain and tails another, and every
+// chain propagates to the next machine and acks to the previous one.
+// 1 is the single chain of the original CRAQ, 0 -> MACHINE_NUM - 1
+#define CR_CHAIN_NUM MACHINE_NUM
 
 
-
-#define QP_NUM 3
+#define QP_NUM 4
 #define PREP_QP_ID 0
 #define ACK_QP_ID 1
 #define R_QP_ID 2
+#define R_REP_QP_ID 3
 
 
 #define CR_TRACE_BATCH SESSIONS_PER_THREAD
@@ -38,25 +42,30 @@
 
 
 
-/// Non head nodes need to send-fifos for prepares
-/// one for the chain propagation and one to send to the head
-#define CHAIN_PREP_FIFO_ID 0
-#define STEER_TO_HEAD_FIFO_ID 1
+/// Prepares are sent from two send-fifos per chain: one for the
+/// propagation to the next node and one to steer writes to the head
+#define CHAIN_PREP_FIFO_ID(chain) (chain)
+#define STEER_TO_HEAD_FIFO_ID(chain) (CR_CHAIN_NUM + (chain))
+#define CR_PREP_FIFO_NUM (2 * CR_CHAIN_NUM)
 
 /*------------------------------------------------
  * ----------------KVS----------------------------
  * ----------------------------------------------*/
 #define MICA_VALUE_SIZE (VALUE_SIZE + (FIND_PADDING_CUST_ALIGN(VALUE_SIZE, 32)))
-#define MICA_OP_SIZE_ (32 + ((MICA_VALUE_SIZE)))
+#define MICA_OP_SIZE_ (40 + (2 * (MICA_VALUE_SIZE)))
 #define MICA_OP_PADDING_SIZE  (FIND_PADDING(MICA_OP_SIZE_))
 #define MICA_OP_SIZE  (MICA_OP_SIZE_ + MICA_OP_PADDING_SIZE)
 
 
 struct mica_op {
   uint8_t value[MICA_VALUE_SIZE];
+  // The last committed copy this node has seen, kept while the key is
+  // CR_INV, so that the tail only needs to confirm its version
+  uint8_t c_value[MICA_VALUE_SIZE];
   struct key key;
   seqlock_t seqlock;
   uint64_t version;
+  uint64_t c_version;
   uint8_t state;
   uint8_t unused[3];
   uint32_t key_id; // strictly for debug
@@ -77,12 +86,20 @@ typedef enum op_state {INVALID, SEMIVALID,
 
 typedef enum {NOT_USED, CR_LOCAL_PREP, STEERED_PREP, CHAIN_PREP} source_t;
 
+// What a node knows of a CR_INV key when it asks the tail for its version
+typedef struct cr_read_info {
+  mica_op_t *kv_ptr;
+  uint64_t version; // of the dirty copy, already in the value_to_read
+  uint64_t c_version; // of the clean copy
+} cr_read_info_t;
+
 typedef struct cr_r_rob {
   bool seen_larger_g_id;
   uint8_t opcode;
   mica_key_t key;
   //uint8_t value[VALUE_SIZE]; //
   uint8_t *value_to_read;
+  mica_op_t *kv_ptr;
   uint32_t state;
   uint32_t log_no;
   uint32_t val_len;
@@ -124,7 +141,8 @@ typedef struct ptrs_to_prep {
 
 // A data structute that keeps track of the outstanding writes
 typedef struct cr_ctx {
-  // reorder buffers
+  // reorder buffers, one per chain: the writes of a chain are acked in
+  // order, and its reads are answered in order by its tail
   fifo_t *w_rob;
   fifo_t *r_rob;
   //fifo_t *loc_w_rob; //points in the w_rob
@@ -142,10 +160,11 @@ typedef struct cr_ctx {
 
   fifo_t *buf_reads;
 
-  uint64_t inserted_w_id;
-  uint64_t committed_w_id;
-  uint64_t inserted_r_id;
-  uint64_t committed_r_id;
+  // per chain
+  uint64_t inserted_w_id[CR_CHAIN_NUM];
+  uint64_t committed_w_id[CR_CHAIN_NUM];
+  uint64_t inserted_r_id[CR_CHAIN_NUM];
+  uint64_t committed_r_id[CR_CHAIN_NUM];
 
   uint32_t *index_to_req_array; // [SESSIONS_PER_THREAD]
   bool *stalled;
@@ -12,10 +12,10 @@ static inline void cr_checks_and_stats_on_bcasting_preps(context_t *ctx)
   cr_ctx_t *cr_ctx = (cr_ctx_t *) ctx->appl_ctx;
   per_qp_meta_t *qp_meta = &ctx->qp_meta[PREP_QP_ID];
 
-  bool steer_to_head = ctx->ctx_tmp->counter == STEER_TO_HEAD_FIFO_ID;
-  uint8_t fifo_i = steer_to_head ?
-                   (uint8_t) STEER_TO_HEAD_FIFO_ID :
-                   (uint8_t) CHAIN_PREP_FIFO_ID;
+  // ctx_send_unicasts passes the send-fifo being pulled
+  uint8_t fifo_i = (uint8_t) ctx->ctx_tmp->counter;
+  uint8_t chain = (uint8_t) (fifo_i % CR_CHAIN_NUM);
+  bool steer_to_head = fifo_i == STEER_TO_HEAD_FIFO_ID(chain);
   fifo_t *send_fifo = &qp_meta->send_fifo[fifo_i];
 
   // Create the broadcast messages
@@ -36,7 +36,7 @@ static inline void cr_checks_and_stats_on_bcasting_preps(context_t *ctx)
     uint32_t backward_ptr = fifo_get_pull_backward_ptr(send_fifo);
     for (uint16_t i = 0; i < coalesce_num; i++) {
       if (!steer_to_head) {
-        cr_w_rob_t *w_rob = (cr_w_rob_t *) get_fifo_slot_mod(cr_ctx->w_rob, backward_ptr + i);
+        cr_w_rob_t *w_rob = (cr_w_rob_t *) get_fifo_slot_mod(&cr_ctx->w_rob[chain], backward_ptr + i);
         if (ENABLE_ASSERTIONS) assert(w_rob->w_state == VALID);
         w_rob->w_state = SENT;
       }
@@ -8,25 +8,50 @@
 
 #include <cr_config.h>
 
-static inline bool is_head(context_t *ctx)
+// The keys are already hashed, so the bucket spreads them over the chains
+static inline uint8_t cr_key_chain(mica_key_t *key)
 {
-  return  ctx->m_id == CR_HEAD_NODE;
+  return (uint8_t) (key->bkt % CR_CHAIN_NUM);
 }
 
-static inline bool is_tail(context_t *ctx)
+static inline uint8_t cr_chain_head(uint8_t chain)
 {
-  return  ctx->m_id == CR_TAIL_NODE;
+  return chain;
 }
 
-static inline bool is_middle(context_t *ctx)
+static inline uint8_t cr_chain_tail(uint8_t chain)
 {
-  return ctx->m_id != CR_TAIL_NODE && ctx->m_id != CR_HEAD_NODE;
+  return (uint8_t) ((chain + MACHINE_NUM - 1) % MACHINE_NUM);
+}
+
+static inline bool is_head(context_t *ctx, uint8_t chain)
+{
+  return  ctx->m_id == cr_chain_head(chain);
+}
+
+static inline bool is_tail(context_t *ctx, uint8_t chain)
+{
+  return  ctx->m_id == cr_chain_tail(chain);
+}
+
+static inline bool is_middle(context_t *ctx, uint8_t chain)
+{
+  return !is_tail(ctx, chain) && !is_head(ctx, chain);
+}
+
+// The chain of a local write (a trace op) or of a prep
+static inline uint8_t cr_source_chain(void *source,
+                                      uint32_t source_flag)
+{
+  return source_flag == CR_LOCAL_PREP ?
+         cr_key_chain(&((ctx_trace_op_t *) source)->key) :
+         cr_key_chain(&((cr_prep_t *) source)->key);
 }
 
 static inline uint8_t get_key_owner(context_t *ctx,
                                     mica_key_t key)
 {
-  return CR_HEAD_NODE;
+  return cr_chain_head(cr_key_chain(&key));
 }
 
 static inline uint8_t get_fifo_i(context_t *ctx,
@@ -6,6 +6,7 @@
 #define ODYSSEY_CR_INLINE_UTIL_H
 
 #include <od_netw_func.h>
+#include <od_sched.h>
 #include "cr_debug_util.h"
 #include "cr_kvs_util.h"
 #include "cr_generic_util.h"
@@ -20,7 +21,8 @@ static inline bool filter_remote_writes(context_t *ctx,
   if (rm_id == ctx->m_id) return false;
   else {
     od_insert_mes(ctx, PREP_QP_ID, sizeof(cr_prep_t), 1,
-                  false, op, CR_LOCAL_PREP, STEER_TO_HEAD_FIFO_ID);
+                  false, op, CR_LOCAL_PREP,
+                  STEER_TO_HEAD_FIFO_ID(cr_key_chain(&op->key)));
   }
   return true;
 }
@@ -80,14 +82,12 @@ static inline void cr_batch_from_trace_to_KVS(context_t *ctx)
 ////---------------------------------------------------------------------------*/
 
 static inline void cr_apply_writes(context_t *ctx,
+                                   fifo_t *w_rob_fifo,
                                    uint32_t pull_ptr,
                                    uint32_t write_num)
 {
-  cr_ctx_t *cr_ctx = (cr_ctx_t *) ctx->appl_ctx;
-
-
   for (int w_i = 0; w_i < write_num; ++w_i) {
-    cr_w_rob_t *w_rob = (cr_w_rob_t *) get_fifo_slot_mod(cr_ctx->w_rob, pull_ptr + w_i);
+    cr_w_rob_t *w_rob = (cr_w_rob_t *) get_fifo_slot_mod(w_rob_fifo, pull_ptr + w_i);
     if (ENABLE_ASSERTIONS) {
       assert(w_rob->version > 0);
       assert(w_rob != NULL);
@@ -113,27 +113,31 @@ static inline void cr_apply_writes(context_t *ctx,
 
 static inline void cr_commit_writes(context_t *ctx)
 {
-  uint16_t write_num = 0;
   cr_ctx_t *cr_ctx = (cr_ctx_t *) ctx->appl_ctx;
 
-  cr_w_rob_t *w_rob = (cr_w_rob_t *) get_fifo_pull_slot(cr_ctx->w_rob);
-  uint32_t starting_pull_ptr = cr_ctx->w_rob->pull_ptr;
-  while (w_rob->w_state == READY) {
-    
-    w_rob->w_state = SEMI_INVALID;
-    __builtin_prefetch(&w_rob->kv_ptr->seqlock, 0, 0);
-    if (w_rob->owner_m_id == ctx->m_id)
-      cr_free_session(ctx, w_rob->sess_id);
-
-    fifo_incr_pull_ptr(cr_ctx->w_rob);
-    fifo_decrem_capacity(cr_ctx->w_rob);
-    w_rob = (cr_w_rob_t *) get_fifo_pull_slot(cr_ctx->w_rob);
-    write_num++;
-  }
+  // The tail of a chain never fills its w_rob, the loop just finds it empty
+  for (uint8_t chain = 0; chain < CR_CHAIN_NUM; chain++) {
+    uint16_t write_num = 0;
+    fifo_t *w_rob_fifo = &cr_ctx->w_rob[chain];
+    cr_w_rob_t *w_rob = (cr_w_rob_t *) get_fifo_pull_slot(w_rob_fifo);
+    uint32_t starting_pull_ptr = w_rob_fifo->pull_ptr;
+    while (w_rob->w_state == READY) {
+
+      w_rob->w_state = SEMI_INVALID;
+      __builtin_prefetch(&w_rob->kv_ptr->seqlock, 0, 0);
+      if (w_rob->owner_m_id == ctx->m_id)
+        cr_free_session(ctx, w_rob->sess_id);
+
+      fifo_incr_pull_ptr(w_rob_fifo);
+      fifo_decrem_capacity(w_rob_fifo);
+      w_rob = (cr_w_rob_t *) get_fifo_pull_slot(w_rob_fifo);
+      write_num++;
+    }
 
-  if (write_num > 0) {
-    cr_ctx->ptrs_to_ops->op_num = write_num;
-    cr_apply_writes(ctx, starting_pull_ptr, write_num);
+    if (write_num > 0) {
+      cr_ctx->ptrs_to_ops->op_num = write_num;
+      cr_apply_writes(ctx, w_rob_fifo, starting_pull_ptr, write_num);
+    }
   }
 }
 
@@ -144,7 +148,8 @@ static inline void cr_commit_writes(context_t *ctx)
 
 static inline void cr_fill_w_rob(context_t *ctx,
                                  cr_prep_t *prep,
-                                 cr_w_rob_t *w_rob)
+                                 cr_w_rob_t *w_rob,
+                                 uint8_t chain)
 {
   if (ENABLE_ASSERTIONS) {
     assert(w_rob->w_state == SEMIVALID);
@@ -152,12 +157,12 @@ static inline void cr_fill_w_rob(context_t *ctx,
   cr_ctx_t *cr_ctx = (cr_ctx_t *) ctx->appl_ctx;
   w_rob->w_state = VALID;
   w_rob->sess_id = prep->sess_id;
-  w_rob->l_id = cr_ctx->inserted_w_id;
+  w_rob->l_id = cr_ctx->inserted_w_id[chain];
 
   if (DEBUG_WRITES)
-    my_printf(cyan, "W_rob insert sess %u write %lu, w_rob_i %u\n",
-              w_rob->sess_id, w_rob->l_id,
-              cr_ctx->w_rob->push_ptr);
+    my_printf(cyan, "W_rob insert sess %u write %lu, chain %u, w_rob_i %u\n",
+              w_rob->sess_id, w_rob->l_id, chain,
+              cr_ctx->w_rob[chain].push_ptr);
 
 }
 
@@ -177,7 +182,8 @@ static inline void cr_fill_prep_from_op(context_t *ctx,
 static inline void cr_fill_prep_and_w_rob(context_t *ctx,
                                           cr_prep_t *prep, void *source,
                                           cr_w_rob_t *w_rob,
-                                          source_t source_flag)
+                                          source_t source_flag,
+                                          uint8_t chain)
 {
   cr_ctx_t *cr_ctx = (cr_ctx_t *) ctx->appl_ctx;
   ctx_trace_op_t *op = (ctx_trace_op_t *) source;
@@ -185,21 +191,21 @@ static inline void cr_fill_prep_and_w_rob(context_t *ctx,
     case CR_LOCAL_PREP:
       prep->version = w_rob->version;
       cr_fill_prep_from_op(ctx, prep, op);
-      w_rob->owner_m_id = CR_HEAD_NODE;
+      w_rob->owner_m_id = ctx->m_id;
       if (ENABLE_ASSERTIONS) {
-        assert(is_head(ctx));
+        assert(is_head(ctx, chain));
         assert (prep->m_id == ctx->m_id);
         assert(cr_ctx->stalled[op->session_id]);
       }
       break;
     case STEERED_PREP: // HEAD handles a steered prep
-      if (ENABLE_ASSERTIONS) assert(is_head(ctx));
+      if (ENABLE_ASSERTIONS) assert(is_head(ctx, chain));
       memcpy(prep, source, sizeof(cr_prep_t));
       prep->version = w_rob->version;
       w_rob->owner_m_id = prep->m_id;
       break;
     case CHAIN_PREP: //  Middle nodes propagate preps
-      if (ENABLE_ASSERTIONS) assert(is_middle(ctx));
+      if (ENABLE_ASSERTIONS) assert(is_middle(ctx, chain));
       memcpy(prep, source, sizeof(cr_prep_t));
       w_rob->version = prep->version;
       w_rob->owner_m_id = prep->m_id;
@@ -208,7 +214,7 @@ static inline void cr_fill_prep_and_w_rob(context_t *ctx,
     case NOT_USED:
     default: if (ENABLE_ASSERTIONS) assert(false);
   }
-  cr_fill_w_rob(ctx, prep, w_rob);
+  cr_fill_w_rob(ctx, prep, w_rob, chain);
 }
 
 
@@ -217,32 +223,34 @@ static inline void cr_insert_prep_help(context_t *ctx, void* prep_ptr,
                                        void *source, uint32_t source_flag)
 {
   per_qp_meta_t *qp_meta = &ctx->qp_meta[PREP_QP_ID];
-  bool steer_to_head = source_flag == CR_LOCAL_PREP && !is_head(ctx);
+  uint8_t chain = cr_source_chain(source, source_flag);
+  bool steer_to_head = source_flag == CR_LOCAL_PREP && !is_head(ctx, chain);
 
   uint8_t fifo_i = steer_to_head ?
-                   (uint8_t) STEER_TO_HEAD_FIFO_ID : (uint8_t) CHAIN_PREP_FIFO_ID;
+                   (uint8_t) STEER_TO_HEAD_FIFO_ID(chain) :
+                   (uint8_t) CHAIN_PREP_FIFO_ID(chain);
 
   fifo_t *send_fifo = &qp_meta->send_fifo[fifo_i];
 
   cr_ctx_t *cr_ctx = (cr_ctx_t *) ctx->appl_ctx;
   cr_prep_t *prep = (cr_prep_t *) prep_ptr;
 
-  fifo_t *working_fifo = cr_ctx->w_rob;
+  fifo_t *working_fifo = &cr_ctx->w_rob[chain];
   cr_w_rob_t *w_rob = (cr_w_rob_t *) get_fifo_push_slot(working_fifo);
   slot_meta_t *slot_meta = get_fifo_slot_meta_push(send_fifo);
 
   if (steer_to_head) {
     cr_fill_prep_from_op(ctx, prep, source);
     if (ENABLE_ASSERTIONS) {
-      assert(slot_meta->rm_id == CR_HEAD_NODE);
-      assert(!is_head(ctx));
+      assert(slot_meta->rm_id == cr_chain_head(chain));
+      assert(!is_head(ctx, chain));
     }
   }
   else {
-    cr_fill_prep_and_w_rob(ctx, prep, source, w_rob, (source_t) source_flag);
+    cr_fill_prep_and_w_rob(ctx, prep, source, w_rob, (source_t) source_flag, chain);
     if (ENABLE_ASSERTIONS) {
-      assert(slot_meta->rm_id == ctx->m_id + 1);
-      assert(ctx->m_id != CR_TAIL_NODE);
+      assert(slot_meta->rm_id == cr_ctx->next_node);
+      assert(!is_tail(ctx, chain));
     }
   }
 
@@ -250,14 +258,14 @@ static inline void cr_insert_prep_help(context_t *ctx, void* prep_ptr,
   prep_mes->coalesce_num = (uint8_t) slot_meta->coalesce_num;
   // If it's the first message give it an lid
   if (slot_meta->coalesce_num == 1) {
-    prep_mes->l_id = cr_ctx->inserted_w_id;
+    prep_mes->l_id = cr_ctx->inserted_w_id[chain];
     if (!steer_to_head) fifo_set_push_backward_ptr(send_fifo, working_fifo->push_ptr);
   }
 
   if (!steer_to_head) {
     if (source_flag == CR_LOCAL_PREP) fifo_increm_capacity(working_fifo);
     fifo_incr_push_ptr(working_fifo);
-    cr_ctx->inserted_w_id++;
+    cr_ctx->inserted_w_id[chain]++;
   }
 }
 
@@ -266,11 +274,16 @@ static inline void cr_insert_read_help(context_t *ctx, void *r_ptr,
                                        void *source, uint32_t source_flag)
 {
   cr_ctx_t *cr_ctx = (cr_ctx_t *) ctx->appl_ctx;
-  cr_r_rob_t *r_rob = (cr_r_rob_t *) get_fifo_push_slot(cr_ctx->r_rob);
   ctx_trace_op_t *op = source;
+  uint8_t chain = cr_key_chain(&op->key);
+  fifo_t *r_rob_fifo = &cr_ctx->r_rob[chain];
+  cr_r_rob_t *r_rob = (cr_r_rob_t *) get_fifo_push_slot(r_rob_fifo);
   cr_read_t *read = (cr_read_t *) r_ptr;
-  r_rob->version = ctx->ctx_tmp->counter;
-  read->version = r_rob->version;
+  cr_read_info_t *r_info = (cr_read_info_t *) ctx->ctx_tmp->generic_ptr;
+  r_rob->version = r_info->version;
+  r_rob->kv_ptr = r_info->kv_ptr;
+  read->version = r_info->version;
+  read->c_version = r_info->c_version;
   read->key = op->key;
 
   r_rob->value_to_read = op->value_to_read;
@@ -280,25 +293,26 @@ static inline void cr_insert_read_help(context_t *ctx, void *r_ptr,
     assert(r_rob->state == INVALID);
   }
   r_rob->state = VALID;
-  r_rob->l_id = cr_ctx->inserted_r_id;
+  r_rob->l_id = cr_ctx->inserted_r_id[chain];
 
   per_qp_meta_t *qp_meta = &ctx->qp_meta[R_QP_ID];
-  fifo_t* send_fifo = qp_meta->send_fifo;
+  fifo_t* send_fifo = &qp_meta->send_fifo[chain];
   slot_meta_t *slot_meta = get_fifo_slot_meta_push(send_fifo);
   cr_r_mes_t *r_mes = (cr_r_mes_t *) get_fifo_push_slot(send_fifo);
   if (ENABLE_ASSERTIONS) {
     assert(r_ptr == (void *)&r_mes->read[slot_meta->coalesce_num - 1]);
+    assert(slot_meta->rm_id == cr_chain_tail(chain));
   }
 
   if (slot_meta->coalesce_num == 1) {
     r_mes->l_id = r_rob->l_id;
-    fifo_set_push_backward_ptr(send_fifo, cr_ctx->r_rob->push_ptr);
+    fifo_set_push_backward_ptr(send_fifo, r_rob_fifo->push_ptr);
   }
   r_mes->coalesce_num = (uint8_t) slot_meta->coalesce_num;
-  
-  fifo_incr_push_ptr(cr_ctx->r_rob);
-  fifo_increm_capacity(cr_ctx->r_rob);
-  cr_ctx->inserted_r_id++;
+
+  fifo_incr_push_ptr(r_rob_fifo);
+  fifo_increm_capacity(r_rob_fifo);
+  cr_ctx->inserted_r_id[chain]++;
 }
 
 static inline void cr_fill_r_rep(cr_read_t *read, 
@@ -312,6 +326,7 @@ static inline void cr_fill_r_rep(cr_read_t *read,
   do {
     debug_stalling_on_lock(&debug_cntr, "filling r_rep", t_id);
     if (read->version == kv_ptr->version) r_rep->opcode = VERSION_EQUAL;
+    else if (read->c_version == kv_ptr->version) r_rep->opcode = VERSION_CLEAN;
     else {
       memcpy(r_rep->value, kv_ptr->value, (size_t) VALUE_SIZE);
       r_rep->version = kv_ptr->version;
@@ -323,7 +338,7 @@ static inline void cr_insert_r_rep_help(context_t *ctx, void *r_rep_ptr,
                                         void *source, uint32_t op_i)
 {
   cr_ctx_t *cr_ctx = (cr_ctx_t *) ctx->appl_ctx;
-  per_qp_meta_t *qp_meta = &ctx->qp_meta[R_QP_ID];
+  per_qp_meta_t *qp_meta = &ctx->qp_meta[R_REP_QP_ID];
   fifo_t *send_fifo = qp_meta->send_fifo;
   cr_ptrs_to_op_t *ptrs_to_r = cr_ctx->ptrs_to_ops;
   cr_r_mes_t *r_mes = cr_ctx->ptrs_to_ops->ptr_to_mes[op_i];
@@ -341,6 +356,8 @@ static inline void cr_insert_r_rep_help(context_t *ctx, void *r_rep_ptr,
   cr_r_rep_mes_t *r_rep_mes = (cr_r_rep_mes_t *) get_fifo_push_slot(send_fifo);
   if (slot_meta->coalesce_num == 1) {
     r_rep_mes->l_id = r_mes->l_id;
+    // the reads of a message are all of one chain, so are their replies
+    r_rep_mes->chain = cr_key_chain(&read->key);
     slot_meta->rm_id = r_mes->m_id;
   }
   r_rep_mes->coalesce_num = (uint8_t) slot_meta->coalesce_num;
@@ -353,12 +370,13 @@ static inline void cr_insert_r_rep_help(context_t *ctx, void *r_rep_ptr,
 static inline void cr_send_preps_helper(context_t *ctx)
 {
   cr_checks_and_stats_on_bcasting_preps(ctx);
-  if (is_head(ctx)) ctx_refill_recvs(ctx, PREP_QP_ID);
+  // every node heads a chain and receives the writes steered to it
+  ctx_refill_recvs(ctx, PREP_QP_ID);
 }
 
 static inline void cr_send_r_reps_helper(context_t *ctx)
 {
-  per_qp_meta_t *qp_meta = &ctx->qp_meta[R_QP_ID];
+  per_qp_meta_t *qp_meta = &ctx->qp_meta[R_REP_QP_ID];
   fifo_t *send_fifo = qp_meta->send_fifo;
   cr_r_rep_mes_t *r_rep_mes = (cr_r_rep_mes_t *) get_fifo_pull_slot(send_fifo);
   slot_meta_t *slot_meta = get_fifo_slot_meta_pull(send_fifo);
@@ -398,20 +416,23 @@ static inline bool cr_prepare_handler(context_t *ctx)
   cr_prep_mes_t *prep_mes = (cr_prep_mes_t *) &incoming_preps[recv_fifo->pull_ptr].prepare;
 
   uint8_t coalesce_num = prep_mes->coalesce_num;
+  uint8_t chain = prep_mes->chain;
+  bool tail = is_tail(ctx, chain);
 
-  fifo_t *w_rob_fifo = cr_ctx->w_rob;
+  fifo_t *w_rob_fifo = &cr_ctx->w_rob[chain];
   bool preps_fit_in_w_rob =
     w_rob_fifo->capacity + coalesce_num <= CR_PREP_POLL_LIMIT;
 
   if (!preps_fit_in_w_rob) return false;
 
-  if (!is_tail(ctx))
+  if (!tail)
     fifo_increase_capacity(w_rob_fifo, coalesce_num);
 
   cr_check_polled_prep_and_print(ctx, prep_mes);
 
-  if (is_tail(ctx))
-    ctx_ack_insert(ctx, ACK_QP_ID, coalesce_num,  prep_mes->l_id, cr_ctx->prev_node);
+  // the ack slots are per chain, all of them go to the previous node
+  if (tail)
+    ctx_ack_insert(ctx, ACK_QP_ID, coalesce_num,  prep_mes->l_id, chain);
 
   cr_ptrs_to_op_t *ptrs_to_prep = cr_ctx->ptrs_to_ops;
   if (qp_meta->polled_messages == 0) ptrs_to_prep->op_num = 0;
@@ -440,34 +461,37 @@ static inline bool cr_ack_handler(context_t *ctx)
   ctx_ack_mes_t *ack = (ctx_ack_mes_t *) &incoming_acks[recv_fifo->pull_ptr].ack;
   uint32_t ack_num = ack->ack_num;
   uint64_t l_id = ack->l_id;
-  uint64_t pull_lid = cr_ctx->committed_w_id; // l_id at the pull pointer
+  uint8_t chain = ack->m_id; // acks carry the chain in place of the sender
+  fifo_t *w_rob_fifo = &cr_ctx->w_rob[chain];
+  uint64_t pull_lid = cr_ctx->committed_w_id[chain]; // l_id at the pull pointer
 
 
   if (ENABLE_ASSERTIONS) {
-    if ((cr_ctx->w_rob->capacity == 0) ||
+    assert(chain < CR_CHAIN_NUM);
+    if ((w_rob_fifo->capacity == 0) ||
         (pull_lid >= l_id && (pull_lid - l_id) >= ack_num)) {
       assert(false);
       return true;
     }
   }
   //printf("Receiving %u acks for %lu \n", ack->ack_num, ack->l_id);
-  if (is_middle(ctx))
-    ctx_ack_insert(ctx, ACK_QP_ID, ack->ack_num,  ack->l_id, cr_ctx->prev_node);
+  if (is_middle(ctx, chain))
+    ctx_ack_insert(ctx, ACK_QP_ID, ack->ack_num,  ack->l_id, chain);
 
   for (uint16_t ack_i = 0; ack_i < ack_num; ack_i++) {
-    cr_w_rob_t *w_rob = (cr_w_rob_t *) get_fifo_slot_mod(cr_ctx->w_rob, l_id + ack_i);
+    cr_w_rob_t *w_rob = (cr_w_rob_t *) get_fifo_slot_mod(w_rob_fifo, l_id + ack_i);
     if (ENABLE_ASSERTIONS) {
       if (w_rob->w_state != SENT) {
         printf("Wrob_state %u w_rob id %u w_rob l_id %lu/%lu, ack_i %u, committed id %lu\n",
                w_rob->w_state, w_rob->id, w_rob->l_id, ack->l_id + ack_i,
-               ack_i, cr_ctx->committed_w_id);
+               ack_i, cr_ctx->committed_w_id[chain]);
         assert(false);
       }
       assert(w_rob->l_id == l_id + ack_i);
     }
     w_rob->w_state = READY;
   }
-  cr_ctx->committed_w_id += ack_num;
+  cr_ctx->committed_w_id[chain] += ack_num;
 
   return true;
 }
@@ -514,20 +538,22 @@ static inline bool cr_r_handler(context_t *ctx)
 static inline bool cr_r_rep_handler(context_t *ctx)
 {
   cr_ctx_t *cr_ctx = (cr_ctx_t *) ctx->appl_ctx;
-  per_qp_meta_t *qp_meta = &ctx->qp_meta[R_QP_ID];
+  per_qp_meta_t *qp_meta = &ctx->qp_meta[R_REP_QP_ID];
   fifo_t *recv_fifo = qp_meta->recv_fifo;
   volatile cr_r_rep_mes_ud_t *incoming_r_reps =
     (volatile cr_r_rep_mes_ud_t *) recv_fifo->fifo;
   cr_r_rep_mes_t *r_rep_mes = (cr_r_rep_mes_t *)
     &incoming_r_reps[recv_fifo->pull_ptr].r_rep_mes;
-  fifo_t *r_rob_fifo = cr_ctx->r_rob;
+  uint8_t chain = r_rep_mes->chain;
+  fifo_t *r_rob_fifo = &cr_ctx->r_rob[chain];
   if (DEBUG_READ_REPS)
-    my_printf(cyan, "WRKR %u: RECEIVING R_REP: l_id %u/%lu, coalesce_num %u address %p \n",
-              ctx->t_id, r_rep_mes->l_id, cr_ctx->inserted_r_id,
+    my_printf(cyan, "WRKR %u: RECEIVING R_REP: chain %u, l_id %u/%lu, coalesce_num %u address %p \n",
+              ctx->t_id, chain, r_rep_mes->l_id, cr_ctx->inserted_r_id[chain],
               r_rep_mes->coalesce_num, (void*) r_rep_mes);
   if (ENABLE_ASSERTIONS) {
+    assert(chain < CR_CHAIN_NUM);
     assert(r_rob_fifo->capacity > 0);
-    assert(r_rep_mes->l_id == cr_ctx->committed_r_id);
+    assert(r_rep_mes->l_id == cr_ctx->committed_r_id[chain]);
   }
 
   uint16_t byte_ptr = R_REP_MES_HEADER;
@@ -540,7 +566,8 @@ static inline bool cr_r_rep_handler(context_t *ctx)
                 ctx->t_id, r_rep_i, r_rep_mes->coalesce_num,
                 r_rep->opcode, r_rob->sess_id, byte_ptr,
                 (void *) r_rep);
-    check_state_with_allowed_flags(3, r_rep->opcode, VERSION_DIFF, VERSION_EQUAL);
+    check_state_with_allowed_flags(4, r_rep->opcode, VERSION_DIFF,
+                                   VERSION_EQUAL, VERSION_CLEAN);
     if (ENABLE_ASSERTIONS) {
       assert(r_rob->state == VALID);
       assert(r_rob->l_id == r_rep_mes->l_id + r_rep_i);
@@ -549,10 +576,14 @@ static inline bool cr_r_rep_handler(context_t *ctx)
       byte_ptr += R_REP_BIG_SIZE;
       memcpy(r_rob->value_to_read, r_rep->value, VALUE_SIZE);
     }
-    else
+    else {
       byte_ptr += R_REP_SMALL_SIZE;
+      // on VERSION_EQUAL the value_to_read already holds the dirty copy
+      if (r_rep->opcode == VERSION_CLEAN)
+        cr_read_clean_copy(ctx, r_rob->kv_ptr, r_rob->value_to_read);
+    }
 
-    cr_ctx->committed_r_id++;
+    cr_ctx->committed_r_id[chain]++;
     cr_ctx->stalled[r_rob->sess_id] = false;
     cr_ctx->all_sessions_stalled = false;
     r_rob->state = INVALID;
@@ -570,38 +601,43 @@ static inline bool cr_r_rep_handler(context_t *ctx)
 ////---------------------------------------------------------------------------*/
 
 
-static inline void cr_main_loop(context_t *ctx)
+static bool cr_stage_trace(context_t *ctx, uint16_t unused)
 {
-  if (ctx->t_id == 0) my_printf(yellow, "CR main loop \n");
-
-
-  while(true) {
-
-    cr_batch_from_trace_to_KVS(ctx);
-
-    //
-    ctx_send_unicasts(ctx, PREP_QP_ID);
-
-    //
-    ctx_poll_incoming_messages(ctx, PREP_QP_ID);
-
-    //
-    od_send_acks(ctx, ACK_QP_ID);
-
-    //
-    ctx_poll_incoming_messages(ctx, ACK_QP_ID);
+  cr_batch_from_trace_to_KVS(ctx);
+  return true;
+}
 
-    if (CR_REMOTE_READS) {
-      ctx_send_unicasts(ctx, R_QP_ID);
-      ctx_poll_incoming_messages(ctx, R_QP_ID);
-    }
+static bool cr_stage_commit_writes(context_t *ctx, uint16_t unused)
+{
+  cr_commit_writes(ctx);
+  return true;
+}
 
-    //
-    if (ctx->m_id != CR_TAIL_NODE) {
-      cr_commit_writes(ctx);
+static inline od_sched_t *cr_create_sched(context_t *ctx)
+{
+  od_sched_t *sched = od_sched_create(ctx);
+  od_sched_add(sched, "trace", cr_stage_trace, 0, OD_STAGE_ALWAYS);
+  od_sched_add(sched, "send-preps", od_stage_send_unicasts, PREP_QP_ID, OD_STAGE_ALWAYS);
+  od_sched_add(sched, "poll-preps", od_stage_poll, PREP_QP_ID, OD_STAGE_BACKOFF);
+  od_sched_add(sched, "send-acks", od_stage_send_acks, ACK_QP_ID, OD_STAGE_ALWAYS);
+  od_sched_add(sched, "poll-acks", od_stage_poll, ACK_QP_ID, OD_STAGE_BACKOFF);
+  if (CR_REMOTE_READS) {
+    od_sched_add(sched, "send-reads", od_stage_send_unicasts, R_QP_ID, OD_STAGE_ALWAYS);
+    od_sched_add(sched, "poll-reads", od_stage_poll, R_QP_ID, OD_STAGE_BACKOFF);
+    od_sched_add(sched, "send-r-reps", od_stage_send_unicasts, R_REP_QP_ID, OD_STAGE_ALWAYS);
+    od_sched_add(sched, "poll-r-reps", od_stage_poll, R_REP_QP_ID, OD_STAGE_BACKOFF);
+  }
+  od_sched_add(sched, "commit", cr_stage_commit_writes, 0, OD_STAGE_ALWAYS);
+  return sched;
+}
 
-    }
+static inline void cr_main_loop(context_t *ctx)
+{
+  if (ctx->t_id == 0) my_printf(yellow, "CR main loop \n");
+  od_sched_t *sched = cr_create_sched(ctx);
 
+  while(true) {
+    od_sched_run(ctx, sched);
   }
 }
 
@@ -39,23 +39,49 @@ static inline void cr_insert_buffered_op(context_t *ctx,
 }
 
 
+// Called under the seqlock, before a write makes the key CR_INV
+static inline void cr_keep_clean_copy(mica_op_t *kv_ptr)
+{
+  if (kv_ptr->state != CR_V) return;
+  memcpy(kv_ptr->c_value, kv_ptr->value, VALUE_SIZE);
+  kv_ptr->c_version = kv_ptr->version;
+}
+
+// The clean copy of a key, at least as recent as the one a read was issued with
+static inline void cr_read_clean_copy(context_t *ctx,
+                                      mica_op_t *kv_ptr,
+                                      uint8_t *value_to_read)
+{
+  uint32_t debug_cntr = 0;
+  uint64_t tmp_lock = read_seqlock_lock_free(&kv_ptr->seqlock);
+  do {
+    debug_stalling_on_lock(&debug_cntr, "clean read", ctx->t_id);
+    memcpy(value_to_read, kv_ptr->state == CR_V ? kv_ptr->value : kv_ptr->c_value,
+           (size_t) VALUE_SIZE);
+  } while (!(check_seqlock_lock_free(&kv_ptr->seqlock, &tmp_lock)));
+}
+
 static inline void cr_rem_prep(context_t *ctx,
                                mica_op_t *kv_ptr,
                                cr_prep_t *prep)
 {
 
+  uint8_t chain = cr_key_chain(&prep->key);
   if (ENABLE_ASSERTIONS)
-    assert(!is_head(ctx));
+    assert(!is_head(ctx, chain));
 
   lock_seqlock(&kv_ptr->seqlock);
   if (prep->version > kv_ptr->version) {
-    if (ctx->m_id != CR_TAIL_NODE) kv_ptr->state = CR_INV;
+    if (!is_tail(ctx, chain)) {
+      cr_keep_clean_copy(kv_ptr);
+      kv_ptr->state = CR_INV;
+    }
     kv_ptr->version = prep->version;
     memcpy(kv_ptr->value, prep->value, VALUE_SIZE);
   }
   unlock_seqlock(&kv_ptr->seqlock);
 
-  if (is_tail(ctx)) {
+  if (is_tail(ctx, chain)) {
     if (ctx->m_id == prep->m_id) {
       cr_free_session(ctx, prep->sess_id);
     }
@@ -73,10 +99,11 @@ static inline void cr_head_write(context_t *ctx,
                        ((ctx_trace_op_t *) source)->value_to_write :
                        ((cr_prep_t *) source)->value;
   if (ENABLE_ASSERTIONS)
-    assert(is_head(ctx));
+    assert(is_head(ctx, cr_source_chain(source, source_flag)));
 
   lock_seqlock(&kv_ptr->seqlock);
   {
+    cr_keep_clean_copy(kv_ptr);
     kv_ptr->state = CR_INV;
     kv_ptr->version++;
     w_rob->version = kv_ptr->version;
@@ -98,8 +125,9 @@ static inline void cr_loc_or_rem_write_or_prep(context_t *ctx,
                                                source_t source_flag)
 {
   cr_ctx_t *cr_ctx = (cr_ctx_t *) ctx->appl_ctx;
+  uint8_t chain = cr_source_chain(source, source_flag);
   cr_w_rob_t *w_rob = (cr_w_rob_t *)
-    get_fifo_push_slot(cr_ctx->w_rob);
+    get_fifo_push_slot(&cr_ctx->w_rob[chain]);
 
   switch (source_flag) {
     case CR_LOCAL_PREP:
@@ -113,14 +141,14 @@ static inline void cr_loc_or_rem_write_or_prep(context_t *ctx,
     default: if (ENABLE_ASSERTIONS) assert(false);
   }
 
-  if (ctx->m_id != CR_TAIL_NODE) {
+  if (!is_tail(ctx, chain)) {
     if (ENABLE_ASSERTIONS) assert(w_rob->w_state == INVALID);
     //w_rob->owner_m_id = m_id;
     w_rob->kv_ptr = kv_ptr;
     w_rob->w_state = SEMIVALID;
 
     od_insert_mes(ctx, PREP_QP_ID, sizeof(cr_prep_t), 1,
-                  false, source, source_flag, CHAIN_PREP_FIFO_ID);
+                  false, source, source_flag, CHAIN_PREP_FIFO_ID(chain));
   }
   //else printf("Reached Tail node \n");
 }
@@ -138,7 +166,7 @@ static inline void cr_loc_read(context_t *ctx,
   }
   bool success = false;
   uint32_t debug_cntr = 0;
-  uint64_t version;
+  cr_read_info_t r_info = {.kv_ptr = kv_ptr};
   uint64_t tmp_lock = read_seqlock_lock_free(&kv_ptr->seqlock);
   do {
     debug_stalling_on_lock(&debug_cntr, "local read", ctx->t_id);
@@ -147,7 +175,8 @@ static inline void cr_loc_read(context_t *ctx,
       success = true;
     }
     else if (CR_REMOTE_READS) {
-      version = kv_ptr->version;
+      r_info.version = kv_ptr->version;
+      r_info.c_version = kv_ptr->c_version;
       memcpy(op->value_to_read, kv_ptr->value, (size_t) VALUE_SIZE);
     }
   } while (!(check_seqlock_lock_free(&kv_ptr->seqlock, &tmp_lock)));
@@ -161,9 +190,10 @@ static inline void cr_loc_read(context_t *ctx,
   }
   else {
     if (CR_REMOTE_READS) {
-      ctx->ctx_tmp->counter = version;
+      ctx->ctx_tmp->generic_ptr = &r_info;
       od_insert_mes(ctx, R_QP_ID, sizeof(cr_read_t),
-                    (uint32_t) R_REP_BIG_SIZE, false, op, NOT_USED, 0);
+                    (uint32_t) R_REP_BIG_SIZE, false, op, NOT_USED,
+                    cr_key_chain(&op->key));
     }
     else
       cr_insert_buffered_op(ctx, kv_ptr, op);
@@ -252,7 +282,8 @@ static inline void cr_KVS_batch_op_preps(context_t *ctx)
   for(op_i = 0; op_i < op_num; op_i++) {
     od_KVS_check_key(kv_ptr[op_i], preps[op_i]->key, op_i);
     cr_loc_or_rem_write_or_prep(ctx, kv_ptr[op_i], preps[op_i],
-                                is_head(ctx) ? STEERED_PREP : CHAIN_PREP);
+                                is_head(ctx, cr_key_chain(&preps[op_i]->key)) ?
+                                STEERED_PREP : CHAIN_PREP);
   }
 }
 
@@ -284,7 +315,7 @@ static inline void cr_KVS_batch_op_reads(context_t *ctx)
     od_KVS_check_key(kv_ptr[op_i], read->key, op_i);
     if (ENABLE_ASSERTIONS) assert(read->opcode == KVS_OP_GET);
 
-    od_insert_mes(ctx, R_QP_ID, R_REP_SMALL_SIZE, 0,
+    od_insert_mes(ctx, R_REP_QP_ID, R_REP_SMALL_SIZE, 0,
                   !ptrs_to_r->coalesce[op_i],
                   (void *) kv_ptr[op_i], op_i, 0);
 
@@ -10,8 +10,9 @@
 #define PREP_COALESCE 8
 #define R_COALESCE 20
 
-#define MAX_PREP_WRS (1 + ((2 *MACHINE_NUM * SESSIONS_PER_THREAD ) / PREP_COALESCE))
-#define CR_PREP_MES_HEADER 12 // opcode(1), coalesce_num(1) l_id (8)
+// a partly filled message per send-fifo on top of the full ones
+#define MAX_PREP_WRS (CR_PREP_FIFO_NUM + ((2 *MACHINE_NUM * SESSIONS_PER_THREAD ) / PREP_COALESCE))
+#define CR_PREP_MES_HEADER 12 // opcode(1), coalesce_num(1) l_id (8), m_id(1), chain(1)
 
 
 typedef struct cr_prepare {
@@ -29,7 +30,7 @@ typedef struct cr_prep_message {
   uint8_t opcode;
   uint8_t coalesce_num;
   uint8_t m_id;
-  uint8_t unused;
+  uint8_t chain; // the l_id is of this chain
   cr_prep_t prepare[PREP_COALESCE];
 } __attribute__((__packed__)) cr_prep_mes_t;
 
@@ -49,12 +50,12 @@ typedef struct cr_prep_message_ud_req {
 
 #define CR_RECV_R_WRS (REM_MACH_NUM * SESSIONS_PER_THREAD) // TODO divide by coalesce
 #define CR_INCOMING_R (REM_MACH_NUM * SESSIONS_PER_THREAD)
-#define CR_R_WRS (1 + (SESSIONS_PER_THREAD / R_COALESCE))
+#define CR_R_WRS (CR_CHAIN_NUM + (SESSIONS_PER_THREAD / R_COALESCE))
 
 #define CR_R_BUF_SLOTS (CR_RECV_R_WRS)
 
 // READ REPLIES --
-#define R_REP_MES_HEADER (9) //l_id 8 , coalesce_num 1
+#define R_REP_MES_HEADER (10) //l_id 8 , coalesce_num 1, chain 1
 #define R_REP_BIG_SIZE (VALUE_SIZE + 8 + 1) // version + opcode
 #define R_REP_SMALL_SIZE 1
 #define R_REP_MES_SIZE (R_REP_MES_HEADER + (R_COALESCE * R_REP_BIG_SIZE))
@@ -75,12 +76,17 @@ typedef struct cr_prep_message_ud_req {
 #define R_REP_FIFO_SIZE (CR_RECV_R_WRS * R_COALESCE)
 
 
+// The tail answers a read with the version it has committed: VERSION_EQUAL
+// and VERSION_CLEAN mean it matches the dirty or the clean copy of the reader,
+// which then serves its own copy. Only VERSION_DIFF carries the value
 #define VERSION_EQUAL 21
 #define VERSION_DIFF 22
+#define VERSION_CLEAN 23
 //
 typedef struct cr_read {
   struct key key;
   uint64_t version;
+  uint64_t c_version;
   uint8_t opcode;
   uint8_t unused;
 } __attribute__((__packed__)) cr_read_t;
@@ -113,6 +119,7 @@ typedef struct cr_r_rep_big {
 typedef struct r_rep_message {
   uint64_t l_id;
   uint8_t coalesce_num;
+  uint8_t chain; // the l_id is of this chain
   cr_r_rep_big_t r_rep[MAX_R_REP_COALESCE];
 } __attribute__((__packed__)) cr_r_rep_mes_t;
 
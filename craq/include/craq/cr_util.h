@@ -16,6 +16,9 @@ void cr_stats(stats_ctx_t *ctx);
 static void cr_static_assert_compile_parameters()
 {
 
+  // the acks of a chain are sent from the ack slot of its id
+  static_assert(CR_CHAIN_NUM > 0 && CR_CHAIN_NUM <= MACHINE_NUM, "");
+
   emphatic_print(green, "CRAQ");
 
 }
@@ -42,17 +45,15 @@ static void cr_qp_meta_mfs(context_t *ctx)
 
   mfs[ACK_QP_ID].recv_handler = cr_ack_handler;
 
-  if (ctx->m_id == CR_TAIL_NODE) {
-    mfs[R_QP_ID].insert_helper = cr_insert_r_rep_help;
-    mfs[R_QP_ID].recv_handler = cr_r_handler;
-    mfs[R_QP_ID].send_helper = cr_send_r_reps_helper;
-    mfs[R_QP_ID].recv_kvs = cr_KVS_batch_op_reads;
-  }
-  else {
-    mfs[R_QP_ID].insert_helper = cr_insert_read_help;
-    mfs[R_QP_ID].recv_handler = cr_r_rep_handler;
+  // Every node is the tail of a chain, serving its reads,
+  // and sends the reads of the other chains to their tails
+  mfs[R_QP_ID].insert_helper = cr_insert_read_help;
+  mfs[R_QP_ID].recv_handler = cr_r_handler;
+  mfs[R_QP_ID].recv_kvs = cr_KVS_batch_op_reads;
 
-  }
+  mfs[R_REP_QP_ID].insert_helper = cr_insert_r_rep_help;
+  mfs[R_REP_QP_ID].recv_handler = cr_r_rep_handler;
+  mfs[R_REP_QP_ID].send_helper = cr_send_r_reps_helper;
 
 
   ctx_set_qp_meta_mfs(ctx, mfs);
@@ -66,31 +67,34 @@ static void cr_init_send_fifos(context_t *ctx)
   ctx_ack_mes_t *ack_send_buf = (ctx_ack_mes_t *) ctx->qp_meta[ACK_QP_ID].send_fifo->fifo; //calloc(MACHINE_NUM, sizeof(ctx_ack_mes_t));
   assert(ctx->qp_meta[ACK_QP_ID].send_fifo->max_byte_size == CTX_ACK_SIZE * MACHINE_NUM);
   memset(ack_send_buf, 0, ctx->qp_meta[ACK_QP_ID].send_fifo->max_byte_size);
+  // The ack slot i acks the chain i to the previous node, the m_id carries the chain
   for (int i = 0; i < MACHINE_NUM; i++) {
-    ack_send_buf[i].m_id = (uint8_t) machine_id;
+    ack_send_buf[i].m_id = (uint8_t) i;
     ack_send_buf[i].opcode = OP_ACK;
   }
   //
+  assert(ctx->qp_meta[PREP_QP_ID].send_fifo_num == CR_PREP_FIFO_NUM);
   for (int fifo_i = 0; fifo_i < ctx->qp_meta[PREP_QP_ID].send_fifo_num; ++fifo_i) {
     cr_prep_mes_t *preps = (cr_prep_mes_t *) ctx->qp_meta[PREP_QP_ID].send_fifo[fifo_i].fifo;
+    uint8_t chain = (uint8_t) (fifo_i % CR_CHAIN_NUM);
     for (int i = 0; i < CR_PREP_FIFO_SIZE; i++) {
 
       ctx->qp_meta[PREP_QP_ID].send_fifo[fifo_i].slot_meta[i].rm_id =
-        fifo_i == CHAIN_PREP_FIFO_ID ?
-        (uint8_t) (ctx->m_id + 1) :  (uint8_t) CR_HEAD_NODE;
+        fifo_i == CHAIN_PREP_FIFO_ID(chain) ?
+        (uint8_t) ((ctx->m_id + 1) % MACHINE_NUM) :  cr_chain_head(chain);
       preps[i].opcode = KVS_OP_PUT;
       preps[i].m_id = ctx->m_id;
-      for (uint16_t j = 0; j < PREP_COALESCE; j++) {
-      }
+      preps[i].chain = chain;
     }
   }
 
-  if (ctx->m_id != CR_TAIL_NODE) {
-    cr_r_mes_t *r_mes = (cr_r_mes_t *) ctx->qp_meta[R_QP_ID].send_fifo->fifo;
+  assert(ctx->qp_meta[R_QP_ID].send_fifo_num == CR_CHAIN_NUM);
+  for (int fifo_i = 0; fifo_i < CR_CHAIN_NUM; ++fifo_i) {
+    cr_r_mes_t *r_mes = (cr_r_mes_t *) ctx->qp_meta[R_QP_ID].send_fifo[fifo_i].fifo;
     for (int i = 0; i < R_FIFO_SIZE; i++) {
 
-      ctx->qp_meta[R_QP_ID].send_fifo->slot_meta[i].rm_id =
-        (uint8_t) CR_TAIL_NODE;
+      ctx->qp_meta[R_QP_ID].send_fifo[fifo_i].slot_meta[i].rm_id =
+        cr_chain_tail((uint8_t) fifo_i);
       r_mes[i].m_id = ctx->m_id;
       for (uint16_t j = 0; j < R_COALESCE; j++) {
         r_mes[i].read[j].opcode = KVS_OP_GET;
@@ -108,7 +112,7 @@ static void cr_init_qp_meta(context_t *ctx)
   create_per_qp_meta(&qp_meta[PREP_QP_ID], MAX_PREP_WRS,
                      MAX_RECV_PREP_WRS, SEND_UNI_REQ_RECV_UNI_REQ, RECV_REQ,
                      ACK_QP_ID,
-                     2, 2, PREP_BUF_SLOTS,
+                     CR_PREP_FIFO_NUM, REM_MACH_NUM, PREP_BUF_SLOTS,
                      sizeof(cr_prep_mes_ud_t), sizeof(cr_prep_mes_t), false, false,
                      0, 0, CR_PREP_FIFO_SIZE,
                      0, CR_PREP_MES_HEADER,
@@ -119,22 +123,23 @@ static void cr_init_qp_meta(context_t *ctx)
                      PREP_QP_ID, REM_MACH_NUM,
                      REM_MACH_NUM, 5);
 
-  if (ctx->m_id == CR_TAIL_NODE)
-    create_per_qp_meta(&qp_meta[R_QP_ID], CR_R_REP_WRS,
-                       CR_RECV_R_WRS, SEND_UNI_REP_LDR_RECV_UNI_REQ, RECV_REQ,
-                       R_QP_ID,
-                       REM_MACH_NUM, REM_MACH_NUM, CR_R_BUF_SLOTS,
-                       sizeof(cr_r_mes_ud_t), sizeof(cr_r_rep_mes_t), false, false,
-                       0, CR_TAIL_NODE, R_REP_FIFO_SIZE, 0, R_REP_MES_HEADER,
-                       "send r_Reps", "recv reads");
-  else
-    create_per_qp_meta(&qp_meta[R_QP_ID], CR_R_WRS,
-                       CR_RECV_R_REP_WRS, SEND_UNI_REQ_RECV_LDR_REP, RECV_REPLY,
-                       R_QP_ID, 1, 1, CR_RECV_R_REP_WRS,
-                       sizeof(cr_r_rep_mes_ud_t), sizeof(cr_r_mes_t), false, false,
-                       0, CR_TAIL_NODE, R_FIFO_SIZE,
-                       0, CR_R_MES_HEADER,
-                       "send reads", "recv read_replies");
+  // a send-fifo of reads per chain, to the tail of the chain
+  create_per_qp_meta(&qp_meta[R_QP_ID], CR_R_WRS,
+                     CR_RECV_R_WRS, SEND_UNI_REQ_RECV_UNI_REQ, RECV_REQ,
+                     R_REP_QP_ID,
+                     CR_CHAIN_NUM, REM_MACH_NUM, CR_R_BUF_SLOTS,
+                     sizeof(cr_r_mes_ud_t), sizeof(cr_r_mes_t), false, false,
+                     0, 0, R_FIFO_SIZE,
+                     0, CR_R_MES_HEADER,
+                     "send reads", "recv reads");
+
+  create_per_qp_meta(&qp_meta[R_REP_QP_ID], CR_R_REP_WRS,
+                     CR_RECV_R_REP_WRS, SEND_UNI_REP_RECV_UNI_REP, RECV_REPLY,
+                     R_QP_ID,
+                     REM_MACH_NUM, REM_MACH_NUM, CR_RECV_R_REP_WRS,
+                     sizeof(cr_r_rep_mes_ud_t), sizeof(cr_r_rep_mes_t), false, false,
+                     0, 0, R_REP_FIFO_SIZE, 0, R_REP_MES_HEADER,
+                     "send r_reps", "recv read_replies");
 
 
 
@@ -147,7 +152,7 @@ static void* set_up_cr_ctx(context_t *ctx)
 {
   cr_ctx_t* cr_ctx = (cr_ctx_t*) calloc(1,sizeof(cr_ctx_t));
 
-  cr_ctx->w_rob = fifo_constructor(CR_W_ROB_SIZE, sizeof(cr_w_rob_t), false, 0, 1);
+  cr_ctx->w_rob = fifo_constructor(CR_W_ROB_SIZE, sizeof(cr_w_rob_t), false, 0, CR_CHAIN_NUM);
 
   cr_ctx->index_to_req_array = (uint32_t *) calloc(SESSIONS_PER_THREAD, sizeof(uint32_t));
   cr_ctx->stalled = (bool *) malloc(SESSIONS_PER_THREAD * sizeof(bool));
@@ -158,20 +163,31 @@ static void* set_up_cr_ctx(context_t *ctx)
   cr_ctx->buf_reads = fifo_constructor(2 * SESSIONS_PER_THREAD, sizeof(cr_buf_op_t), false, 0, 1);
 
   for (int i = 0; i < SESSIONS_PER_THREAD; i++) cr_ctx->stalled[i] = false;
+  for (uint8_t chain = 0; chain < CR_CHAIN_NUM; chain++) {
     for (uint32_t i = 0; i < CR_W_ROB_SIZE; i++) {
-      cr_w_rob_t *w_rob = get_fifo_slot(cr_ctx->w_rob, i);
+      cr_w_rob_t *w_rob = get_fifo_slot(&cr_ctx->w_rob[chain], i);
       w_rob->w_state = INVALID;
       w_rob->id = (uint16_t) i;
+    }
   }
-  cr_ctx->prev_node = (uint8_t) (ctx->m_id - 1);
-  cr_ctx->next_node = (uint8_t) (ctx->m_id + 1);
+  cr_ctx->prev_node = (uint8_t) ((ctx->m_id + MACHINE_NUM - 1) % MACHINE_NUM);
+  cr_ctx->next_node = (uint8_t) ((ctx->m_id + 1) % MACHINE_NUM);
+
+  // All chains ack to the previous node: point the ack slots of the chains to it
+  per_qp_meta_t *ack_qp_meta = &ctx->qp_meta[ACK_QP_ID];
+  for (uint8_t chain = 0; chain < CR_CHAIN_NUM; chain++) {
+    ack_qp_meta->send_wr[chain].wr.ud.ah =
+      rem_qp[cr_ctx->prev_node][ctx->t_id][ACK_QP_ID].ah;
+    ack_qp_meta->send_wr[chain].wr.ud.remote_qpn =
+      (uint32_t) rem_qp[cr_ctx->prev_node][ctx->t_id][ACK_QP_ID].qpn;
+  }
+
   cr_ctx->ptrs_to_ops = calloc(1, sizeof(cr_ptrs_to_op_t));
   cr_ctx->ptrs_to_ops->ops = calloc(CR_MAX_INCOMING_PREP, sizeof(void*));
   cr_ctx->ptrs_to_ops->ptr_to_mes = calloc(CR_MAX_INCOMING_PREP, sizeof(void*));
   cr_ctx->ptrs_to_ops->coalesce = calloc(CR_MAX_INCOMING_PREP, sizeof(bool));
-  if (ctx->m_id != CR_TAIL_NODE)
-    cr_ctx->r_rob = fifo_constructor(SESSIONS_PER_THREAD,
-                                     sizeof(cr_r_rob_t), false, 0, 1);
+  cr_ctx->r_rob = fifo_constructor(SESSIONS_PER_THREAD,
+                                   sizeof(cr_r_rob_t), false, 0, CR_CHAIN_NUM);
 
   if (!ENABLE_CLIENTS)
     cr_ctx->trace = trace_init(ctx->t_id);
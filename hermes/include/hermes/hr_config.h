@@ -9,8 +9,6 @@
 #include "od_fifo.h"
 #include <hr_messages.h>
 #include <od_network_context.h>
-#include "splinterdb.h"
-#include "bplus.h"
 
 #define HR_W_ROB_SIZE SESSIONS_PER_THREAD
 #define HR_TRACE_BATCH SESSIONS_PER_THREAD
@@ -31,21 +29,28 @@
  * ----------------KVS----------------------------
  * ----------------------------------------------*/
 #define MICA_VALUE_SIZE (VALUE_SIZE + (FIND_PADDING_CUST_ALIGN(VALUE_SIZE, 32)))
-#define MICA_OP_SIZE_  (32 + ((MICA_VALUE_SIZE)))
+#define MICA_OP_SIZE_  (32 + (2 * (MICA_VALUE_SIZE)))
 #define MICA_OP_PADDING_SIZE  (FIND_PADDING(MICA_OP_SIZE_))
 #define MICA_OP_SIZE  (MICA_OP_SIZE_ + MICA_OP_PADDING_SIZE)
 
 
 typedef enum{HR_V = 0, HR_INV, HR_INV_T, HR_W} key_state_t;
+// The trees keep the state in a kvs_env_t: these are the kinds of the
+// deltas that hr_env_merge applies to it
+typedef enum{HR_ENV_LOC_W = 1, HR_ENV_REM_INV, HR_ENV_COMMIT} hr_env_kind_t;
 
 struct mica_op {
   uint8_t value[MICA_VALUE_SIZE];
+  uint8_t c_value[MICA_VALUE_SIZE]; // the committed value, while c_readable
   struct key key;
   seqlock_t seqlock;
   uint64_t version;
   uint8_t m_id;
   uint8_t state;
-  uint8_t unused[2];
+  // Set while a write of this machine is pending and its client has not been
+  // signaled: reads are linearized before it and return c_value
+  uint8_t c_readable;
+  uint8_t unused;
   uint32_t key_id; // strictly for debug
   uint8_t padding[MICA_OP_PADDING_SIZE];
 };
@@ -77,6 +82,7 @@ typedef struct w_rob {
   uint64_t version;
   uint64_t l_id; // TODO not needed
   mica_op_t *kv_ptr;
+  mica_key_t key; // the trees have no kv_ptr, the commit is sent by key
 
   uint16_t sess_id;
   uint16_t id;
@@ -86,8 +92,6 @@ typedef struct w_rob {
   uint8_t acks_seen;
   uint8_t val_len;
   bool inv_applied;
-  splinterdb* spl_handle;
-  bp_db_t* tree;
 } hr_w_rob_t;
 
 typedef struct buf_op {
@@ -95,13 +99,28 @@ typedef struct buf_op {
   //mica_key_t key;
   //uint8_t *value_ptr;
   mica_op_t *kv_ptr;
-  splinterdb *spl_handle;
   //uint16_t sess_id;
   //uint8_t opcode;
-  // BtDb *bt;
-  bp_db_t* tree;
 } buf_op_t;
 
+// A read of a key that is being written waits here for the write to commit.
+// A session has one op outstanding, so the waiting reads are indexed by
+// session, and chained per key so that a commit wakes its own readers.
+#define HR_READ_WAIT_BKTS 64
+#define HR_NO_WAITER UINT16_MAX
+
+typedef struct hr_read_wait {
+  ctx_trace_op_t op;
+  mica_op_t *kv_ptr;
+  uint16_t next; // next waiter of the bucket
+} hr_read_wait_t;
+
+typedef struct hr_read_waits {
+  hr_read_wait_t *waits; // [SESSIONS_PER_THREAD]
+  uint16_t parked_num;
+  uint16_t bkt_head[HR_READ_WAIT_BKTS]; // by key.bkt
+} hr_read_waits_t;
+
 typedef struct rep_ops {
   buf_op_t *prim_ops;
   buf_op_t *sec_ops;
@@ -127,11 +146,15 @@ typedef struct hr_ctx {
   hr_resp_t *resp;
 
   fifo_t *buf_ops;
+  hr_read_waits_t read_waits; // MICA only, the trees buffer reads in buf_ops
 
   uint64_t *inserted_w_id;
   uint64_t *committed_w_id;
 
   uint32_t *index_to_req_array; // [SESSIONS_PER_THREAD]
+  // Writes that found their key in flight and were merged into the buffered
+  // write of another session: chained from that session, HR_NO_WAITER ends
+  uint16_t *merged_next; // [SESSIONS_PER_THREAD]
   bool *stalled;
 
   bool all_sessions_stalled;
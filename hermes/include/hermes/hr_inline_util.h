@@ -10,8 +10,6 @@
 #include "od_network_context.h"
 #include "hr_kvs_util.h"
 #include "hr_debug_util.h"
-#include "splinterdb.h"
-#include "bplus.h"
 
 
 
@@ -39,6 +37,6 @@ bool hr_commit_handler(context_t *ctx);
 ////------------------------------MAIN LOOP -----------------------------
 ////---------------------------------------------------------------------------*/
 
-_Noreturn void hr_main_loop(context_t *ctx, kvs_t *kvs);
+_Noreturn void hr_main_loop(context_t *ctx);
 
 #endif //ODYSSEY_HR_INLINE_UTIL_H
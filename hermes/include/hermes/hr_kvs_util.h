@@ -9,22 +9,20 @@
 #include <od_netw_func.h>
 #include "od_kvs.h"
 #include "hr_config.h"
-#include "splinterdb.h"
-#include "bplus.h"
+#include "od_kvs_backend.h"
 
 
-void hr_KVS_batch_op_trace(context_t *ctx, uint16_t op_num, kvs_t* kvs);
+void hr_KVS_batch_op_trace(context_t *ctx, uint16_t op_num);
 
-void hr_KVS_batch_op_invs(context_t *ctx, kvs_t* kvs);
+void hr_KVS_batch_op_invs(context_t *ctx);
 
-void hr_sdb_batch_op_invs(context_t *ctx, splinterdb *spl_handle);
-// TODO: fix
-void hr_sdb_batch_op_trace(context_t *ctx, uint16_t op_num, splinterdb *spl_handle);
-// void hr_bt_batch_op_trace(context_t *ctx, uint16_t op_num, BtDb *bt);
-void hr_bt_batch_op_trace(context_t *ctx, uint16_t op_num, bp_db_t* tree);
+void hr_KVS_batch_op_commits(context_t *ctx, hr_w_rob_t **ptrs_to_w_rob,
+                             uint16_t write_num);
 
-// void hr_bt_batch_op_invs(context_t *ctx, BtDb *bt);
-// TODO: fix
-void hr_bt_batch_op_invs(context_t *ctx, bp_db_t* tree);
+// Retries the waiting reads of keys that a commit of another worker validated
+void hr_poll_parked_reads(context_t *ctx);
+
+bool hr_env_merge(kvs_env_t *cur, const kvs_env_t *delta);
+void hr_mica_init(mica_op_t *kv_ptr, const kvs_op_t *op);
 
 #endif //ODYSSEY_HR_KVS_UTIL_H
@@ -11,14 +11,12 @@
 #include <hr_inline_util.h>
 #include "../../../odlib/include/trace/od_trace_util.h"
 #include "od_init_func.h"
-#include "splinterdb.h"
-# include "bplus.h"
 
 void hr_stats(stats_ctx_t *ctx);
 
 
 void hr_init_functionality(int argc, char *argv[]);
-void hr_init_qp_meta(context_t *ctx, kvs_t* kvs);
+void hr_init_qp_meta(context_t *ctx);
 void* set_up_hr_ctx(context_t *ctx);
 
 
@@ -5,14 +5,6 @@
 #include "hr_kvs_util.h"
 #include <stdio.h>
 #include <string.h>
-#include "bplus.h"
-#include "default_data_config.h"
-#include "splinterdb.h"
-
-#define DB_FILE_NAME    "splinterdb_intro_db"
-#define USER_MAX_KEY_SIZE ((int)100)
-#define DB_FILE_SIZE_MB 1024 // Size of SplinterDB device; Fixed when created
-#define CACHE_SIZE_MB   64   // Size of cache; can be changed across boots
 
 ///* ---------------------------------------------------------------------------
 ////------------------------------ HELPERS -----------------------------
@@ -43,6 +35,7 @@ static inline void init_w_rob_on_loc_inv(context_t *ctx,
     }
     w_rob->version = new_version;
     w_rob->kv_ptr = kv_ptr;
+    w_rob->key = op->key;
     w_rob->val_len = op->val_len;
     w_rob->sess_id = op->session_id;
     w_rob->w_state = SEMIVALID;
@@ -55,32 +48,6 @@ static inline void init_w_rob_on_loc_inv(context_t *ctx,
     fifo_increm_capacity(hr_ctx->loc_w_rob);
 }
 
-#if USE_SPLINTERDB
-
-static inline void sdb_init_w_rob_on_loc_inv(context_t *ctx, splinterdb* spl_handle,
-                                        ctx_trace_op_t *op, uint64_t new_version, uint32_t write_i) {
-    hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
-    hr_w_rob_t *w_rob = (hr_w_rob_t *)
-            get_fifo_push_relative_slot(hr_ctx->loc_w_rob, write_i);
-    if (ENABLE_ASSERTIONS) {
-        assert(w_rob->w_state == INVALID);
-        w_rob->l_id = hr_ctx->inserted_w_id[ctx->m_id];
-    }
-    w_rob->version = new_version;
-    w_rob->spl_handle = spl_handle;
-    w_rob->val_len = op->val_len;
-    w_rob->sess_id = op->session_id;
-    w_rob->w_state = SEMIVALID;
-    if (ENABLE_ASSERTIONS)
-        assert(hr_ctx->stalled[w_rob->sess_id]);
-    if (DEBUG_INVS)
-        my_printf(cyan, "W_rob insert sess %u write %lu, w_rob_i %u\n",
-                  w_rob->sess_id, w_rob->l_id,
-                  hr_ctx->loc_w_rob->push_ptr);
-    fifo_increm_capacity(hr_ctx->loc_w_rob);
-}
-
-#endif /* if USE_SPLINTERDB */
 
 static inline void init_w_rob_on_rem_inv(context_t *ctx,
                                          mica_op_t *kv_ptr,
@@ -110,44 +77,46 @@ static inline void init_w_rob_on_rem_inv(context_t *ctx,
         w_rob->version = inv->version;
         w_rob->m_id = inv_mes->m_id;
         w_rob->kv_ptr = kv_ptr;
+        w_rob->key = inv->key;
     }
     fifo_incr_push_ptr(&hr_ctx->w_rob[inv_mes->m_id]);
 }
 
-#if USE_SPLINTERDB
-
-static inline void sdb_init_w_rob_on_rem_inv(context_t * ctx, splinterdb* spl_handle,
-                                             hr_inv_mes_t *inv_mes, hr_inv_t *inv) {
+// A write to a key that already has a write waiting in buf_ops is merged
+// into it: the buffered write takes the newer value, and the session
+// completes along with it, when its INV commits
+static inline bool hr_merge_buffered_write(context_t *ctx,
+                                           mica_op_t *kv_ptr,
+                                           ctx_trace_op_t *op)
+{
     hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
-    hr_w_rob_t *w_rob = (hr_w_rob_t *)
-            get_fifo_push_slot(&hr_ctx->w_rob[inv_mes->m_id]);
-    if (DEBUG_INVS)
-        my_printf(cyan, "W_rob %u for inv from %u with l_id %lu -->%lu, inserted w_id = %u\n",
-                  w_rob->id,  inv_mes->m_id, inv_mes->l_id,
-                  inv_mes->l_id + inv_mes->coalesce_num,
-                  hr_ctx->inserted_w_id[inv_mes->m_id]);
-    if (ENABLE_ASSERTIONS) {
-        assert(w_rob->w_state == INVALID);
-        w_rob->l_id = hr_ctx->inserted_w_id[inv_mes->m_id];
-    }
-    w_rob->w_state = VALID;
-    w_rob->inv_applied = true;
-    hr_ctx->inserted_w_id[inv_mes->m_id]++;
-    // w_rob capacity is already incremented when polling
-    // to achieve back pressure at polling
-    w_rob->version = inv->version;
-    w_rob->m_id = inv_mes->m_id;
-    w_rob->spl_handle = spl_handle;
-    fifo_incr_push_ptr(&hr_ctx->w_rob[inv_mes->m_id]);
+    for (uint32_t op_i = 0; op_i < hr_ctx->buf_ops->capacity; ++op_i) {
+        buf_op_t *buf_op = (buf_op_t *) get_fifo_pull_relative_slot(hr_ctx->buf_ops, op_i);
+        if (buf_op->op.opcode != KVS_OP_PUT || buf_op->kv_ptr != kv_ptr) continue;
+        // the trees have no kv_ptr
+        if (kv_ptr == NULL && memcmp(&buf_op->op.key, &op->key, KEY_SIZE) != 0) continue;
+        uint16_t lead_sess = buf_op->op.session_id;
+        if (ENABLE_ASSERTIONS) assert(lead_sess != op->session_id);
+        buf_op->op.value_to_write = op->value_to_write;
+        hr_ctx->index_to_req_array[op->session_id] = op->index_to_req_array;
+        // the op may carry merged writes of its own
+        uint16_t last_sess = op->session_id;
+        while (hr_ctx->merged_next[last_sess] != HR_NO_WAITER)
+            last_sess = hr_ctx->merged_next[last_sess];
+        hr_ctx->merged_next[last_sess] = hr_ctx->merged_next[lead_sess];
+        hr_ctx->merged_next[lead_sess] = op->session_id;
+        return true;
+    }
+    return false;
 }
 
-#endif /* if USE_SPLINTERDB */
 static inline void insert_buffered_op(context_t *ctx,
                                       mica_op_t *kv_ptr,
                                       ctx_trace_op_t *op,
                                       bool inv)
 {
     hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
+    if (inv && hr_merge_buffered_write(ctx, kv_ptr, op)) return;
     buf_op_t *buf_op = (buf_op_t *) get_fifo_push_slot(hr_ctx->buf_ops);
     buf_op->op.opcode = op->opcode;
     buf_op->op.key = op->key;
@@ -167,26 +136,103 @@ static inline void insert_buffered_op(context_t *ctx,
     fifo_increm_capacity(hr_ctx->buf_ops);
 }
 
-#if USE_SPLINTERDB
+static inline void hr_insert_local_inv(context_t *ctx,
+                                       mica_op_t *kv_ptr,
+                                       ctx_trace_op_t *op,
+                                       uint64_t new_version,
+                                       uint32_t *write_i)
+{
+    init_w_rob_on_loc_inv(ctx, kv_ptr, op, new_version, *write_i);
+    if (INSERT_WRITES_FROM_KVS)
+        od_insert_mes(ctx, INV_QP_ID, (uint32_t) INV_SIZE, 1, false, op, 0, 0);
+    else {
+        hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
+        hr_ctx->ptrs_to_inv->ptr_to_ops[*write_i] = (hr_inv_t *) op;
+        (*write_i)++;
+    }
+}
 
-static inline void sdb_insert_buffered_ops(context_t *ctx, splinterdb* spl_handle, ctx_trace_op_t *op, bool inv) {
+static inline void hr_complete_read(context_t *ctx,
+                                    ctx_trace_op_t *op)
+{
     hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
-    buf_op_t *buf_op = (buf_op_t *) get_fifo_push_slot(hr_ctx->buf_ops);
-    buf_op->op.opcode = op->opcode;
-    buf_op->op.key = op->key;
-    buf_op->op.session_id = op->session_id;
-    buf_op->op.index_to_req_array = op->index_to_req_array;
-    buf_op->spl_handle = spl_handle;
-    if (inv) {
-        buf_op->op.value_to_write = op->value_to_write;
-    } else {
-        buf_op->op.value_to_read = op->value_to_read;
+    signal_completion_to_client(op->session_id, op->index_to_req_array, ctx->t_id);
+    hr_ctx->all_sessions_stalled = false;
+    hr_ctx->stalled[op->session_id] = false;
+}
+
+///* ---------------------------------------------------------------------------
+////------------------------------ PARKED READS -----------------------------
+////---------------------------------------------------------------------------*/
+// A local read of a key that is not valid is served the committed value if
+// the pending write is this machine's own and not yet completed; otherwise
+// it parks in read_waits until a commit flips the key back to HR_V.
+
+// Copies the value a read may return, if any
+static inline bool hr_read_value(context_t *ctx,
+                                 mica_op_t *kv_ptr,
+                                 uint8_t *value_to_read)
+{
+    bool success = false;
+    uint32_t debug_cntr = 0;
+    uint64_t tmp_lock = read_seqlock_lock_free(&kv_ptr->seqlock);
+    do {
+        debug_stalling_on_lock(&debug_cntr, "local read", ctx->t_id);
+        success = true;
+        if (kv_ptr->state == HR_V)
+            memcpy(value_to_read, kv_ptr->value, (size_t) VALUE_SIZE);
+        else if (__atomic_load_n(&kv_ptr->c_readable, __ATOMIC_ACQUIRE))
+            memcpy(value_to_read, kv_ptr->c_value, (size_t) VALUE_SIZE);
+        else success = false;
+    } while (!(check_seqlock_lock_free(&kv_ptr->seqlock, &tmp_lock)));
+    return success;
+}
+
+static inline void hr_park_read(context_t *ctx,
+                                mica_op_t *kv_ptr,
+                                ctx_trace_op_t *op)
+{
+    hr_read_waits_t *rw = &((hr_ctx_t *) ctx->appl_ctx)->read_waits;
+    uint16_t sess_id = op->session_id;
+    uint32_t b = kv_ptr->key.bkt % HR_READ_WAIT_BKTS;
+    hr_read_wait_t *wait = &rw->waits[sess_id];
+    wait->op.opcode = op->opcode;
+    wait->op.key = op->key;
+    wait->op.session_id = sess_id;
+    wait->op.index_to_req_array = op->index_to_req_array;
+    wait->op.value_to_read = op->value_to_read;
+    wait->kv_ptr = kv_ptr;
+    wait->next = rw->bkt_head[b];
+    rw->bkt_head[b] = sess_id;
+    rw->parked_num++;
+    if (ENABLE_ASSERTIONS) assert(rw->parked_num <= SESSIONS_PER_THREAD);
+}
+
+// Retries the reads of bucket @b; of @kv_ptr only, unless it is NULL
+static inline void hr_retry_parked_reads(context_t *ctx, uint32_t b,
+                                         mica_op_t *kv_ptr)
+{
+    hr_read_waits_t *rw = &((hr_ctx_t *) ctx->appl_ctx)->read_waits;
+    uint16_t *link = &rw->bkt_head[b];
+    while (*link != HR_NO_WAITER) {
+        hr_read_wait_t *wait = &rw->waits[*link];
+        if ((kv_ptr == NULL || wait->kv_ptr == kv_ptr) &&
+            hr_read_value(ctx, wait->kv_ptr, wait->op.value_to_read)) {
+            *link = wait->next;
+            rw->parked_num--;
+            hr_complete_read(ctx, &wait->op);
+        }
+        else link = &wait->next;
     }
-    fifo_incr_push_ptr(hr_ctx->buf_ops);
-    fifo_increm_capacity(hr_ctx->buf_ops);
 }
 
-#endif /* if USE_SPLINTERDB */
+static inline void hr_wake_readers(context_t *ctx, mica_op_t *kv_ptr)
+{
+    hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
+    if (hr_ctx->read_waits.parked_num == 0) return;
+    hr_retry_parked_reads(ctx, kv_ptr->key.bkt % HR_READ_WAIT_BKTS, kv_ptr);
+}
+
 ///* ---------------------------------------------------------------------------
 ////------------------------------ REQ PROCESSING -----------------------------
 ////---------------------------------------------------------------------------*/
@@ -206,6 +252,10 @@ static inline void hr_local_inv(context_t *ctx,
             //! todo: values are written here
             if (kv_ptr->state != HR_W &&
                 kv_ptr->state != HR_INV_T) {
+                // Until the write completes, reads may go before it
+                kv_ptr->c_readable = kv_ptr->state == HR_V;
+                if (kv_ptr->c_readable)
+                    memcpy(kv_ptr->c_value, kv_ptr->value, VALUE_SIZE);
                 kv_ptr->state = HR_W;
                 kv_ptr->version++;
                 new_version = kv_ptr->version;
@@ -218,120 +268,13 @@ static inline void hr_local_inv(context_t *ctx,
     }
 
     if (success) {
-        init_w_rob_on_loc_inv(ctx, kv_ptr, op, new_version, *write_i);
-        if (INSERT_WRITES_FROM_KVS)
-            od_insert_mes(ctx, INV_QP_ID, (uint32_t) INV_SIZE, 1, false, op, 0, 0);
-        else {
-            hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
-            hr_ctx->ptrs_to_inv->ptr_to_ops[*write_i] = (hr_inv_t *) op;
-            (*write_i)++;
-        }
+        hr_insert_local_inv(ctx, kv_ptr, op, new_version, write_i);
     }
     else {
         insert_buffered_op(ctx, kv_ptr, op, true);
     }
 }
 
-#if USE_SPLINTERDB
-static inline void stbetree_insert(context_t *ctx, splinterdb* spl_handle, ctx_trace_op_t *op, uint64_t new_version,
-                                   uint32_t *write_i) {
-    bool success = false;
-    char *val1 = (char*) (op->value_to_write);
-    char* val2 = (char*) (op->value_to_write);
-    slice key   = slice_create((size_t)strlen(val1), val1);
-    slice value = slice_create((size_t)strlen(val2), val2);
-    //! insert
-    splinterdb_insert(spl_handle, key, value);
-    success = true;
-    if (success) {
-        //! something is happening here
-        sdb_init_w_rob_on_loc_inv(ctx, spl_handle, op, 0, *write_i);
-        if (INSERT_WRITES_FROM_KVS)
-            od_insert_mes(ctx, INV_QP_ID, (uint32_t) INV_SIZE, 1, false, op, 0, 0);
-        else {
-            hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
-            hr_ctx->ptrs_to_inv->ptr_to_ops[*write_i] = (hr_inv_t *) op;
-            (*write_i)++;
-        }
-    } else {
-        sdb_insert_buffered_ops(ctx, spl_handle, op, true);
-    }
-}
-
-//! Own API for range queries. SpliterDB provides a basic impl
-//! for range queries having no upper bound. This impl
-//! requires an upper bound.
-int splinterdb_range_query(splinterdb* spl_handle, uint8_t* range_start, uint8_t* range_end) {
-  //! Implementing our own range query API. Cool stuff!
-  //! Pointer to iterator
-  splinterdb_iterator *it = NULL;
-  //! Create slices for our start and end keys.
-  char start[4], end[4];
-  void* end_ptr;
-  sprintf(start, "%hhn", range_start);
-  slice start_slice, end_slice;
-  if (range_end == NULL) {
-    //! no upper bound. Iterate over all keys;
-    start_slice = slice_create((size_t)strlen(start), start);
-    //! not creating any slice for upper bound.
-    end_ptr == NULL;
-  } else {
-    sprintf(end, "%hhn", range_end);
-    start_slice = slice_create((size_t)strlen(start), start);
-    end_slice = slice_create((size_t)strlen(end), end);
-  }
-  end_ptr = &end;
-  int rc = splinterdb_iterator_init(spl_handle, &it, start_slice);
-  uint32_t count = 0;
-  //! Use implementation of iterator from SplinterDB example.
-  //! Now we add upper bound as well.
-  for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
-    if (end_ptr != NULL) {
-      //! check if we reached our upper bound;
-      slice key, value;
-      splinterdb_iterator_get_current(it, &key, &value);
-      char* data = slice_data(value);
-      //! If we reached our upper bound, break.
-      if (strcmp(data, end) == 0) {
-        count++;
-        break;
-      } 
-    }
-    else count++;    
-  }
-  rc = splinterdb_iterator_status(it);
-  assert(rc == 0);
-  splinterdb_iterator_deinit(it);
-  return rc;
-}
-
-
-
-static inline void stbetree_read(context_t *ctx, splinterdb* spl_handle, ctx_trace_op_t *op) {
-    bool success = false;
-    if (ENABLE_ASSERTIONS) {
-        assert(op->value_to_read != NULL);
-        assert(spl_handle != NULL);
-    }
-    splinterdb_lookup_result result;
-    splinterdb_lookup_result_init(spl_handle, &result, 0, NULL);
-    char key[4];
-    sprintf(key, "%hhn", op->value_to_read);
-    slice key_slice = slice_create((size_t)strlen(key), key);
-    int rc = splinterdb_lookup(spl_handle, key_slice, &result);
-    //! handling scenarios where key does or does not exist
-    success == !rc ? true : false;
-    //! if we succeed
-    if (success) {
-        hr_ctx_t *hr_ctx = (hr_ctx_t*) ctx->appl_ctx;
-        signal_completion_to_client(op->session_id, op->index_to_req_array, ctx->t_id);
-        hr_ctx->all_sessions_stalled = false;
-        hr_ctx->stalled[op->session_id] = false;
-    } else {
-        sdb_insert_buffered_ops(ctx, spl_handle, op, false);
-    }
-}
-#endif
 static inline void hr_rem_inv(context_t *ctx,
                               mica_op_t *kv_ptr,
                               hr_inv_mes_t *inv_mes,
@@ -350,6 +293,8 @@ static inline void hr_rem_inv(context_t *ctx,
                 kv_ptr->state = HR_INV;
             }
             else kv_ptr->state = HR_INV_T;
+            // The INV is acked right away, its write may complete any time
+            kv_ptr->c_readable = 0;
             kv_ptr->version = inv->version;
             kv_ptr->m_id = inv_mes->m_id;
             memcpy(kv_ptr->value, inv->value, VALUE_SIZE);
@@ -361,12 +306,6 @@ static inline void hr_rem_inv(context_t *ctx,
     init_w_rob_on_rem_inv(ctx, kv_ptr, inv_mes, inv, inv_applied);
 }
 
-#if USE_SPLINTERDB
-
-static inline void sdb_hr_rem_inv(context_t *ctx, splinterdb* spl_handle, hr_inv_mes_t* inv_mes, hr_inv_t *inv) {
-    sdb_init_w_rob_on_rem_inv(ctx, spl_handle, inv_mes, inv);
-}
-#endif /* if USE_SPLINTERDB */
 
 
 static inline void hr_loc_read(context_t *ctx,
@@ -377,24 +316,8 @@ static inline void hr_loc_read(context_t *ctx,
         assert(op->value_to_read != NULL);
         assert(kv_ptr != NULL);
     }
-    bool success = false;
-    uint32_t debug_cntr = 0;
-    uint64_t tmp_lock = read_seqlock_lock_free(&kv_ptr->seqlock);
-    do {
-        debug_stalling_on_lock(&debug_cntr, "local read", ctx->t_id);
-        if (kv_ptr->state == HR_V) {
-            memcpy(op->value_to_read, kv_ptr->value, (size_t) VALUE_SIZE);
-            success = true;
-        }
-    } while (!(check_seqlock_lock_free(&kv_ptr->seqlock, &tmp_lock)));
-
-    if (success) {
-        hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
-        signal_completion_to_client(op->session_id, op->index_to_req_array, ctx->t_id);
-        hr_ctx->all_sessions_stalled = false;
-        hr_ctx->stalled[op->session_id] = false;
-    }
-    else insert_buffered_op(ctx, kv_ptr, op, false);
+    if (hr_read_value(ctx, kv_ptr, op->value_to_read)) hr_complete_read(ctx, op);
+    else hr_park_read(ctx, kv_ptr, op);
 }
 
 //! todo
@@ -417,270 +340,228 @@ static inline void handle_trace_reqs(context_t *ctx,
     }
 }
 
-#if USE_SPLINTERDB
 
-static inline void handle_trace_reqs_stb(context_t *ctx, splinterdb *spl_handle, ctx_trace_op_t *op,
-                                         uint32_t *write_i, uint16_t op_i) {
-    if (op->opcode == KVS_OP_GET) {
-        stbetree_read(ctx, spl_handle, op);
-    } else if (op->opcode == KVS_OP_PUT) {
-        stbetree_insert(ctx, spl_handle, op, 0, write_i);
-    } else if (op->opcode == KVS_OP_RANGE) {
-        //! range queries go here.   
-        splinterdb_range_query(spl_handle, op->range_start, op->range_end);
-    } else if (ENABLE_ASSERTIONS) {
-        my_printf(red, "wrong Opcode in cache: %d, req %d \n", op->opcode, op_i);
-        assert(0);
+///* ---------------------------------------------------------------------------
+////------------------------------ TREE BACKENDS -----------------------------
+////---------------------------------------------------------------------------*/
+// The B+-tree and SplinterDB keep version, m_id and state in the kvs_env_t
+// of each key. The transitions of hr_local_inv, hr_rem_inv and apply_writes
+// are sent to the store as deltas and applied by hr_env_merge inside it:
+// a local write, a remote INV or a commit is a single read-modify-write of
+// the key, only a read looks the envelope up.
+
+#define HR_TREE_BATCH (2 * SESSIONS_PER_THREAD) // buffered + new trace ops
+
+// Runs under the lock of the key in the store, as hr_local_inv, hr_rem_inv
+// and apply_writes run under the seqlock of the key on MICA
+bool hr_env_merge(kvs_env_t *cur, const kvs_env_t *delta)
+{
+    compare_t comp = compare_flat_ts(delta->version, delta->m_id,
+                                     cur->version, cur->m_id);
+    switch (delta->kind) {
+        case HR_ENV_LOC_W:
+            // The version is picked here, from the stored one: two local
+            // writes to a key never share a timestamp
+            if (cur->state == HR_W || cur->state == HR_INV_T) return false;
+            cur->state = HR_W;
+            cur->version++;
+            cur->m_id = delta->m_id;
+            memcpy(cur->value, delta->value, VALUE_SIZE);
+            return true;
+        case HR_ENV_REM_INV:
+            if (comp != GREATER) return false;
+            cur->state = cur->state != HR_W ? HR_INV : HR_INV_T;
+            cur->version = delta->version;
+            cur->m_id = delta->m_id;
+            memcpy(cur->value, delta->value, VALUE_SIZE);
+            return true;
+        case HR_ENV_COMMIT:
+            if (comp != EQUAL || cur->state == HR_V) return false;
+            cur->state = HR_V;
+            return true;
+        default:
+            return od_kvs_lww_merge(cur, delta);
+    }
+}
+
+// A MICA PUT inserts a key as valid, at the op's version
+void hr_mica_init(mica_op_t *kv_ptr, const kvs_op_t *op)
+{
+    kv_ptr->version = op->version;
+    kv_ptr->m_id = op->m_id;
+    kv_ptr->state = HR_V;
+}
+
+static inline void hr_tree_loc_read(context_t *ctx,
+                                    kvs_op_t *kvs_op,
+                                    ctx_trace_op_t *op)
+{
+    // A read of a key that is not in the store still completes
+    if (kvs_op->resp == KVS_GET_SUCCESS) {
+        if (kvs_op->env->state != HR_V) {
+            insert_buffered_op(ctx, NULL, op, false);
+            return;
+        }
+        memcpy(op->value_to_read, kvs_op->env->value, (size_t) VALUE_SIZE);
+    }
+    hr_complete_read(ctx, op);
+}
+
+static inline void hr_tree_local_inv(context_t *ctx,
+                                     ctx_trace_op_t *op,
+                                     kvs_op_t *update,
+                                     kvs_env_t *delta)
+{
+    memset(delta, 0, KVS_ENV_SIZE);
+    delta->m_id = ctx->m_id;
+    delta->kind = HR_ENV_LOC_W;
+    memcpy(delta->value, op->value_to_write, VALUE_SIZE);
+    update->key = op->key;
+    update->env = delta;
+}
+
+// The INV of a local write is broadcast only once the store took its delta,
+// at the version it picked. A write to a key that is being written
+// (HR_W or HR_INV_T) is retried, as on MICA.
+static inline void hr_tree_insert_local_invs(context_t *ctx,
+                                             kvs_op_t *updates,
+                                             ctx_trace_op_t **update_ops,
+                                             uint16_t update_num,
+                                             uint32_t *write_i)
+{
+    for (uint16_t i = 0; i < update_num; i++) {
+        if (updates[i].resp != KVS_PUT_SUCCESS) {
+            insert_buffered_op(ctx, NULL, update_ops[i], true);
+            continue;
+        }
+        hr_insert_local_inv(ctx, NULL, update_ops[i], updates[i].env->version, write_i);
     }
 }
 
-inline void hr_sdb_batch_op_invs(context_t *ctx, splinterdb* spl_handle) {
+// Reads are looked up, writes go straight to the store as updates
+static inline void hr_tree_add_op(context_t *ctx, ctx_trace_op_t *op,
+                                  ctx_trace_op_t **ops, kvs_op_t *lookups,
+                                  uint16_t *lookup_num,
+                                  ctx_trace_op_t **update_ops, kvs_op_t *updates,
+                                  kvs_env_t *deltas, uint16_t *update_num)
+{
+    if (op->opcode == KVS_OP_GET) {
+        ops[*lookup_num] = op;
+        lookups[*lookup_num].key = op->key;
+        (*lookup_num)++;
+        return;
+    }
+    hr_tree_local_inv(ctx, op, &updates[*update_num], &deltas[*update_num]);
+    update_ops[*update_num] = op;
+    (*update_num)++;
+}
+
+static inline void hr_tree_batch_op_trace(context_t *ctx,
+                                          uint16_t op_num,
+                                          uint32_t *write_i)
+{
     hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
-    ptrs_to_inv_t *ptrs_to_inv = hr_ctx->ptrs_to_inv;
-    hr_inv_mes_t **inv_mes = hr_ctx->ptrs_to_inv->ptr_to_mes;
-    hr_inv_t **invs = ptrs_to_inv->ptr_to_ops;
-    uint16_t op_num = ptrs_to_inv->polled_invs;
-    uint16_t op_i;
-    if (ENABLE_ASSERTIONS) {
-        assert(invs != NULL);
-        assert(op_num > 0 && op_num <= MAX_INCOMING_INV);
+    ctx_trace_op_t *ops[HR_TREE_BATCH], *update_ops[HR_TREE_BATCH];
+    kvs_op_t lookups[HR_TREE_BATCH], updates[HR_TREE_BATCH], ranges[HR_TREE_BATCH];
+    kvs_env_t envs[HR_TREE_BATCH], deltas[HR_TREE_BATCH];
+    uint16_t lookup_num = 0, update_num = 0, range_num = 0;
+    uint32_t buf_ops_num = hr_ctx->buf_ops->capacity;
+    if (ENABLE_ASSERTIONS) assert(buf_ops_num + op_num <= HR_TREE_BATCH);
+
+    // Buffered ops go first, their slots are not reused by this batch
+    for (uint32_t op_i = 0; op_i < buf_ops_num; ++op_i) {
+        buf_op_t *buf_op = (buf_op_t *) get_fifo_pull_slot(hr_ctx->buf_ops);
+        check_state_with_allowed_flags(3, buf_op->op.opcode, KVS_OP_PUT, KVS_OP_GET);
+        hr_tree_add_op(ctx, &buf_op->op, ops, lookups, &lookup_num,
+                       update_ops, updates, deltas, &update_num);
+        fifo_incr_pull_ptr(hr_ctx->buf_ops);
+        fifo_decrem_capacity(hr_ctx->buf_ops);
     }
-    for (op_i = 0; op_i < op_num; op_i++) {
-        sdb_hr_rem_inv(ctx, spl_handle, inv_mes[op_i], invs[op_i]);
+    for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+        ctx_trace_op_t *op = &hr_ctx->ops[op_i];
+        if (op->opcode == KVS_OP_RANGE) {
+            memcpy(&ranges[range_num].key, op->range_start, KEY_SIZE);
+            memcpy(&ranges[range_num].range_end, op->range_end, KEY_SIZE);
+            ranges[range_num].value = NULL;
+            ops[HR_TREE_BATCH - 1 - range_num] = op;
+            range_num++;
+        }
+        else if (op->opcode == KVS_OP_GET || op->opcode == KVS_OP_PUT) {
+            hr_tree_add_op(ctx, op, ops, lookups, &lookup_num,
+                           update_ops, updates, deltas, &update_num);
+        }
+        else {
+            my_printf(red, "wrong Opcode in cache: %d, req %d \n", op->opcode, op_i);
+            assert(0);
+        }
+    }
+
+    for (uint16_t i = 0; i < lookup_num; i++) {
+        lookups[i].value = NULL;
+        lookups[i].env = &envs[i];
+    }
+    if (lookup_num > 0) od_kvs_batch_get(ctx->kvs, lookups, lookup_num);
+    for (uint16_t i = 0; i < lookup_num; i++)
+        hr_tree_loc_read(ctx, &lookups[i], ops[i]);
+    if (update_num > 0) {
+        od_kvs_batch_update(ctx->kvs, updates, update_num);
+        hr_tree_insert_local_invs(ctx, updates, update_ops, update_num, write_i);
+    }
+
+    if (range_num > 0) od_kvs_batch_range(ctx->kvs, ranges, range_num);
+    for (uint16_t i = 0; i < range_num; i++)
+        hr_complete_read(ctx, ops[HR_TREE_BATCH - 1 - i]);
+}
+
+static inline void hr_tree_batch_op_invs(context_t *ctx,
+                                         hr_inv_mes_t **inv_mes,
+                                         hr_inv_t **invs,
+                                         uint16_t op_num)
+{
+    kvs_op_t kvs_ops[MAX_INCOMING_INV];
+    kvs_env_t deltas[MAX_INCOMING_INV];
+    for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+        deltas[op_i].version = invs[op_i]->version;
+        deltas[op_i].m_id = inv_mes[op_i]->m_id;
+        deltas[op_i].kind = HR_ENV_REM_INV;
+        memcpy(deltas[op_i].value, invs[op_i]->value, VALUE_SIZE);
+        kvs_ops[op_i].key = invs[op_i]->key;
+        kvs_ops[op_i].env = &deltas[op_i];
+    }
+    od_kvs_batch_update(ctx->kvs, kvs_ops, op_num);
+    // The store reports a stale INV: its commit leaves the key untouched
+    for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+        init_w_rob_on_rem_inv(ctx, NULL, inv_mes[op_i], invs[op_i],
+                              kvs_ops[op_i].resp == KVS_PUT_SUCCESS);
     }
 }
-#endif /* if USE_SPLINTERDB */
-
-#if USE_BPLUS
-
-
-
-// Binding the Btree commands to the KVS
-
-// static inline void bt_init_w_rob_on_loc_inv(context_t *ctx, BtDb *bt,
-//                                          ctx_trace_op_t *op, uint64_t new_version, uint32_t write_i) {
-static inline void bt_init_w_rob_on_loc_inv(context_t *ctx, bp_db_t* tree,
-                                         ctx_trace_op_t *op, uint64_t new_version, uint32_t write_i) {
-     hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
-     hr_w_rob_t *w_rob = (hr_w_rob_t *)
-             get_fifo_push_relative_slot(hr_ctx->loc_w_rob, write_i);
-     if (ENABLE_ASSERTIONS) {
-         assert(w_rob->w_state == INVALID);
-         w_rob->l_id = hr_ctx->inserted_w_id[ctx->m_id];
-     }
-     w_rob->version = new_version;
-     w_rob->tree = tree;
-     w_rob->val_len = op->val_len;
-     w_rob->sess_id = op->session_id;
-     w_rob->w_state = SEMIVALID;
-     if (ENABLE_ASSERTIONS)
-         assert(hr_ctx->stalled[w_rob->sess_id]);
-     if (DEBUG_INVS)
-         my_printf(cyan, "W_rob insert sess %u write %lu, w_rob_i %u\n",
-                   w_rob->sess_id, w_rob->l_id,
-                   hr_ctx->loc_w_rob->push_ptr);
-     fifo_increm_capacity(hr_ctx->loc_w_rob);
- }
-
-//  static inline void bt_insert_buffered_ops(context_t *ctx, BtDb *bt, ctx_trace_op_t *op, bool inv) {
- static inline void bt_insert_buffered_ops(context_t *ctx, bp_db_t* tree, ctx_trace_op_t *op, bool inv) {
-     hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
-     buf_op_t *buf_op = (buf_op_t *) get_fifo_push_slot(hr_ctx->buf_ops);
-     buf_op->op.opcode = op->opcode;
-     buf_op->op.key = op->key;
-     buf_op->op.session_id = op->session_id;
-     buf_op->op.index_to_req_array = op->index_to_req_array;
-     buf_op->tree = tree;
-     if (inv) {
-         buf_op->op.value_to_write = op->value_to_write;
-     } else {
-         buf_op->op.value_to_read = op->value_to_read;
-     }
-     fifo_incr_push_ptr(hr_ctx->buf_ops);
-     fifo_increm_capacity(hr_ctx->buf_ops);
- }
-
- static inline void bt_insert(context_t *ctx, bp_db_t *tree, ctx_trace_op_t *op, uint64_t new_version,
-                                    uint32_t *write_i) {
-    bool success = false;
-    my_printf(yellow, "Values: %d\n", op->value_to_write);
-    char* key = (char*)(op->value_to_write);
-    char* value = (char*)(op->value_to_write);
-    printf("Initiating insert with key and value.\n");
-    int return_value_from_insert = bp_sets(tree, key, value);
-    printf("Done with insert.\n");
-    success = (return_value_from_insert == 0);
-     if (success) {
-         //! something is happening here
-         printf("Success.\n");
-         bt_init_w_rob_on_loc_inv(ctx, tree, op, 0, *write_i);
-         if (INSERT_WRITES_FROM_KVS)
-             od_insert_mes(ctx, INV_QP_ID, (uint32_t) INV_SIZE, 1, false, op, 0, 0);
-         else {
-             hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
-             hr_ctx->ptrs_to_inv->ptr_to_ops[*write_i] = (hr_inv_t *) op;
-             (*write_i)++;
-         }
-     } else {
-         bt_insert_buffered_ops(ctx, tree, op, true);
-     }
- }
-
-// Adding range query support for b+tree here
-
-
-static inline void bt_range_query(context_t *ctx, bp_db_t *tree, ctx_trace_op_t *op) {
-     bool success = false;
-     if (ENABLE_ASSERTIONS) {
-         assert(op->value_to_read != NULL);
-         assert(&tree != NULL);
-     }
-    char* start = (char*)(op->value_to_read);
-    char* end = (char*)(op->value_to_read + 16);
-    bp_range_cb cb_value;
-  int return_values_from_range_query = bp_get_ranges(tree, start, end, NULL, NULL);
-
-     //! handling scenarios where key does or does not exist
-    //  success = val == op->value_to_read ? false : true;
-    success = (return_values_from_range_query == 0);
-     //! if we succeed
-     if (success) {
-         hr_ctx_t *hr_ctx = (hr_ctx_t*) ctx->appl_ctx;
-         signal_completion_to_client(op->session_id, op->index_to_req_array, ctx->t_id);
-         hr_ctx->all_sessions_stalled = false;
-         hr_ctx->stalled[op->session_id] = false;
-     } else {
-         bt_insert_buffered_ops(ctx, tree, op, false);
-     }
- }
-
-
-
-//  static inline void bt_read(context_t *ctx, BtDb *bt, ctx_trace_op_t *op) {
- static inline void bt_read(context_t *ctx, bp_db_t *tree, ctx_trace_op_t *op) {
-     bool success = false;
-     if (ENABLE_ASSERTIONS) {
-         assert(op->value_to_read != NULL);
-         assert(&tree != NULL);
-     }
-    char* key = (char*)(op->value_to_read);
-    bp_value_t bp_value;
-    int return_value_from_read = bp_gets(tree, key, &bp_value);
-
-     //! handling scenarios where key does or does not exist
-    //  success = val == op->value_to_read ? false : true;
-    success = (return_value_from_read == 0);
-     //! if we succeed
-     if (success) {
-         hr_ctx_t *hr_ctx = (hr_ctx_t*) ctx->appl_ctx;
-         signal_completion_to_client(op->session_id, op->index_to_req_array, ctx->t_id);
-         hr_ctx->all_sessions_stalled = false;
-         hr_ctx->stalled[op->session_id] = false;
-     } else {
-         bt_insert_buffered_ops(ctx, tree, op, false);
-     }
- }
-
-//  static inline void handle_trace_reqs_bt(context_t *ctx, BtDb *bt, ctx_trace_op_t *op,
-//                                           uint32_t *write_i, uint16_t op_i) {
- static inline void handle_trace_reqs_bt(context_t *ctx, bp_db_t *tree, ctx_trace_op_t *op,
-                                          uint32_t *write_i, uint16_t op_i) {
-     if (op->opcode == KVS_OP_GET) {
-         bt_read(ctx, tree, op);
-     } else if (op->opcode == KVS_OP_PUT) {
-         bt_insert(ctx, tree, op, 0, write_i);
-     } else if (op->opcode == KVS_OP_RANGE) {
-        //call range query function here 
-        bt_range_query(ctx, tree, op);
-     } else if (ENABLE_ASSERTIONS) {
-         my_printf(red, "Wrong Opcode in cache: %d, req %d \n", op->opcode, op_i);
-         assert(0);
-     }
- }
-
-//  static inline void bt_init_w_rob_on_rem_inv(context_t * ctx, BtDb *bt,
-//                                               hr_inv_mes_t *inv_mes, hr_inv_t *inv) {
- static inline void bt_init_w_rob_on_rem_inv(context_t * ctx, bp_db_t* tree,
-                                              hr_inv_mes_t *inv_mes, hr_inv_t *inv) {
-     hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
-     hr_w_rob_t *w_rob = (hr_w_rob_t *)
-             get_fifo_push_slot(&hr_ctx->w_rob[inv_mes->m_id]);
-     if (DEBUG_INVS)
-         my_printf(cyan, "W_rob %u for inv from %u with l_id %lu -->%lu, inserted w_id = %u\n",
-                   w_rob->id,  inv_mes->m_id, inv_mes->l_id,
-                   inv_mes->l_id + inv_mes->coalesce_num,
-                   hr_ctx->inserted_w_id[inv_mes->m_id]);
-     if (ENABLE_ASSERTIONS) {
-         assert(w_rob->w_state == INVALID);
-         w_rob->l_id = hr_ctx->inserted_w_id[inv_mes->m_id];
-     }
-     w_rob->w_state = VALID;
-     w_rob->inv_applied = true;
-     hr_ctx->inserted_w_id[inv_mes->m_id]++;
-     // w_rob capacity is already incremented when polling
-     // to achieve back pressure at polling
-     
-      w_rob->version = inv->version;
-      w_rob->m_id = inv_mes->m_id;
-      w_rob->tree = tree;
-
-     fifo_incr_push_ptr(&hr_ctx->w_rob[inv_mes->m_id]);
- }
-
-//  static inline void bt_hr_rem_inv(context_t *ctx, BtDb *bt, hr_inv_mes_t* inv_mes, hr_inv_t *inv) {
- static inline void bt_hr_rem_inv(context_t *ctx, bp_db_t* tree, hr_inv_mes_t* inv_mes, hr_inv_t *inv) {
-     bt_init_w_rob_on_rem_inv(ctx, tree, inv_mes, inv);
- }
-
-//  inline void hr_bt_batch_op_trace(context_t *ctx, uint16_t op_num, BtDb *bt) {
- inline void hr_bt_batch_op_trace(context_t *ctx, uint16_t op_num, bp_db_t* tree) {
-     hr_ctx_t *hr_ctx = (hr_ctx_t*) ctx->appl_ctx;
-     ctx_trace_op_t *op = hr_ctx->ops;
-     uint16_t op_i;
-     uint32_t write_i = 0;
-     uint32_t buf_ops_num = hr_ctx->buf_ops->capacity;
-     if (ENABLE_ASSERTIONS) {
-         assert(op != NULL);
-         assert(op_num > 0 && op_num <= HR_TRACE_BATCH);
-     }
-     for (op_i = 0; op_i < buf_ops_num; ++op_i) {
-         buf_op_t *buf_op = (buf_op_t *) get_fifo_pull_slot(hr_ctx->buf_ops);
-         check_state_with_allowed_flags(3, buf_op->op.opcode, KVS_OP_PUT, KVS_OP_GET);
-         handle_trace_reqs_bt(ctx, tree, &buf_op->op, &write_i, op_i);
-         fifo_incr_pull_ptr(hr_ctx->buf_ops);
-         fifo_decrem_capacity(hr_ctx->buf_ops);
-     }
-     for (op_i = 0; op_i < op_num; op_i++) {
-         handle_trace_reqs_bt(ctx, tree, &op[op_i], &write_i, op_i);
-     }
-     if (!INSERT_WRITES_FROM_KVS)
-         hr_ctx->ptrs_to_inv->polled_invs = (uint16_t) write_i;
- }
-
-//  inline void hr_bt_batch_op_invs(context_t *ctx, BtDb *bt) {
- inline void hr_bt_batch_op_invs(context_t *ctx, bp_db_t* tree) {
-     hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
-     ptrs_to_inv_t *ptrs_to_inv = hr_ctx->ptrs_to_inv;
-     hr_inv_mes_t **inv_mes = hr_ctx->ptrs_to_inv->ptr_to_mes;
-     hr_inv_t **invs = ptrs_to_inv->ptr_to_ops;
-     uint16_t op_num = ptrs_to_inv->polled_invs;
-     uint16_t op_i;
-     if (ENABLE_ASSERTIONS) {
-         assert(invs != NULL);
-         assert(op_num > 0 && op_num <= MAX_INCOMING_INV);
-     }
-     for (op_i = 0; op_i < op_num; op_i++) {
-         bt_hr_rem_inv(ctx, tree, inv_mes[op_i], invs[op_i]);
-     }
- }
-#endif /* if USE_BPLUS */
+
+static inline void hr_tree_batch_op_commits(context_t *ctx,
+                                            hr_w_rob_t **ptrs_to_w_rob,
+                                            uint16_t write_num)
+{
+    kvs_op_t kvs_ops[HR_UPDATE_BATCH];
+    kvs_env_t deltas[HR_UPDATE_BATCH];
+    uint16_t op_num = 0;
+    for (uint16_t w_i = 0; w_i < write_num; w_i++) {
+        hr_w_rob_t *w_rob = ptrs_to_w_rob[w_i];
+        if (!w_rob->inv_applied) continue;
+        deltas[op_num].version = w_rob->version;
+        deltas[op_num].m_id = w_rob->m_id;
+        deltas[op_num].kind = HR_ENV_COMMIT;
+        kvs_ops[op_num].key = w_rob->key;
+        kvs_ops[op_num].env = &deltas[op_num];
+        op_num++;
+    }
+    if (op_num > 0) od_kvs_batch_update(ctx->kvs, kvs_ops, op_num);
+}
 
 
 ///* ---------------------------------------------------------------------------
 ////------------------------------ KVS_API -----------------------------
 ////---------------------------------------------------------------------------*/
 
-inline void hr_KVS_batch_op_trace(context_t *ctx, uint16_t op_num, kvs_t* kvs)
+inline void hr_KVS_batch_op_trace(context_t *ctx, uint16_t op_num)
 {
     hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
     ctx_trace_op_t *op = hr_ctx->ops;
@@ -691,91 +572,47 @@ inline void hr_KVS_batch_op_trace(context_t *ctx, uint16_t op_num, kvs_t* kvs)
         assert(op != NULL);
         assert(op_num > 0 && op_num <= HR_TRACE_BATCH);
     }
-#if USE_MICA
+    if (!od_kvs_is_mica(ctx->kvs)) {
+        hr_tree_batch_op_trace(ctx, op_num, &write_i);
+        if (!INSERT_WRITES_FROM_KVS)
+            hr_ctx->ptrs_to_inv->polled_invs = (uint16_t) write_i;
+        return;
+    }
+    mica_kv_t *mica = ctx->kvs->mica;
     unsigned int bkt[HR_TRACE_BATCH];
     struct mica_bkt *bkt_ptr[HR_TRACE_BATCH];
     unsigned int tag[HR_TRACE_BATCH];
     mica_op_t *kv_ptr[HR_TRACE_BATCH];	/* Ptr to KV item in log */
     for(op_i = 0; op_i < op_num; op_i++) {
-        KVS_locate_one_bucket(op_i, bkt, &op[op_i].key, bkt_ptr, tag, kv_ptr, KVS);
+        KVS_locate_one_bucket(op_i, bkt, &op[op_i].key, bkt_ptr, tag, kv_ptr, mica);
     }
-    KVS_locate_all_kv_pairs(op_num, tag, bkt_ptr, kv_ptr, KVS);
+    KVS_locate_all_kv_pairs(op_num, tag, bkt_ptr, kv_ptr, mica);
+    // Pull all buffered ops before handling them, so that a retried write
+    // cannot be merged into its own slot. The pulled slots are not reused by this batch
+    buf_op_t *buf_ops[HR_TRACE_BATCH];
+    if (ENABLE_ASSERTIONS) assert(buf_ops_num <= HR_TRACE_BATCH);
     for (op_i = 0; op_i < buf_ops_num; ++op_i) {
-        buf_op_t *buf_op = (buf_op_t *) get_fifo_pull_slot(hr_ctx->buf_ops);
-        check_state_with_allowed_flags(3, buf_op->op.opcode, KVS_OP_PUT, KVS_OP_GET);
-        // handle_trace_reqs_stb(ctx, spl_handle, &buf_op->op, &write_i, op_i);
-        handle_trace_reqs(ctx, buf_op->kv_ptr, &buf_op->op, &write_i, op_i);
+        buf_ops[op_i] = (buf_op_t *) get_fifo_pull_slot(hr_ctx->buf_ops);
         fifo_incr_pull_ptr(hr_ctx->buf_ops);
         fifo_decrem_capacity(hr_ctx->buf_ops);
     }
-    for(op_i = 0; op_i < op_num; op_i++) {
-        //! this is just checking for the keys
-        od_KVS_check_key(kv_ptr[op_i], op[op_i].key, op_i);
-        handle_trace_reqs(ctx, kv_ptr[op_i], &op[op_i], &write_i, op_i);
-    }
-#endif /* if USE_MICA */
-#if USE_BPLUS
-     for (op_i = 0; op_i < buf_ops_num; ++op_i) {
-         buf_op_t *buf_op = (buf_op_t *) get_fifo_pull_slot(hr_ctx->buf_ops);
-         check_state_with_allowed_flags(3, buf_op->op.opcode, KVS_OP_PUT, KVS_OP_GET, KVS_OP_RANGE);
-         handle_trace_reqs_bt(ctx, kvs->tree, &buf_op->op, &write_i, op_i);
-         fifo_incr_pull_ptr(hr_ctx->buf_ops);
-         fifo_decrem_capacity(hr_ctx->buf_ops);
-     }
-     for (op_i = 0; op_i < op_num; op_i++) {
-         handle_trace_reqs_bt(ctx, kvs->tree, &op[op_i], &write_i, op_i);
-     }
-#endif /* if USE_BPLUS */
-#if USE_SPLINTERDB
-  for (op_i = 0; op_i < buf_ops_num; ++op_i) {
-    buf_op_t *buf_op = (buf_op_t *) get_fifo_pull_slot(hr_ctx->buf_ops);
-    check_state_with_allowed_flags(3, buf_op->op.opcode, KVS_OP_PUT, KVS_OP_GET, KVS_OP_RANGE);
-    handle_trace_reqs_stb(ctx, kvs->spl_handle, &buf_op->op, &write_i, op_i);
-    // handle_trace_reqs(ctx, buf_op->kv_ptr, &buf_op->op, &write_i, op_i);
-    fifo_incr_pull_ptr(hr_ctx->buf_ops);
-    fifo_decrem_capacity(hr_ctx->buf_ops);
-  }
-  for (op_i = 0; op_i < op_num; op_i++) {
-    handle_trace_reqs_stb(ctx, kvs->spl_handle, &op[op_i], &write_i, op_i);
-  }
-#endif /* if USE_SPLINTERDB */
-  if (!INSERT_WRITES_FROM_KVS)
-    hr_ctx->ptrs_to_inv->polled_invs = (uint16_t) write_i;
-
-}
-
-#if USE_SPLINTERDB
-
-inline void hr_sdb_batch_op_trace(context_t *ctx, uint16_t op_num, splinterdb* spl_handle) {
-    hr_ctx_t *hr_ctx = (hr_ctx_t*) ctx->appl_ctx;
-    ctx_trace_op_t *op = hr_ctx->ops;
-    uint16_t op_i;
-    uint32_t write_i = 0;
-    uint32_t buf_ops_num = hr_ctx->buf_ops->capacity;
-    if (ENABLE_ASSERTIONS) {
-        assert(op != NULL);
-        assert(op_num > 0 && op_num <= HR_TRACE_BATCH);
-    }
     for (op_i = 0; op_i < buf_ops_num; ++op_i) {
-        buf_op_t *buf_op = (buf_op_t *) get_fifo_pull_slot(hr_ctx->buf_ops);
+        buf_op_t *buf_op = buf_ops[op_i];
         check_state_with_allowed_flags(3, buf_op->op.opcode, KVS_OP_PUT, KVS_OP_GET);
-        handle_trace_reqs_stb(ctx, spl_handle, &buf_op->op, &write_i, op_i);
-        // handle_trace_reqs(ctx, buf_op->kv_ptr, &buf_op->op, &write_i, op_i);
-        fifo_incr_pull_ptr(hr_ctx->buf_ops);
-        fifo_decrem_capacity(hr_ctx->buf_ops);
+        handle_trace_reqs(ctx, buf_op->kv_ptr, &buf_op->op, &write_i, op_i);
     }
-    for (op_i = 0; op_i < op_num; op_i++) {
-        handle_trace_reqs_stb(ctx, spl_handle, &op[op_i], &write_i, op_i);
+    for(op_i = 0; op_i < op_num; op_i++) {
+        od_KVS_check_key(kv_ptr[op_i], op[op_i].key, op_i);
+        handle_trace_reqs(ctx, kv_ptr[op_i], &op[op_i], &write_i, op_i);
     }
     if (!INSERT_WRITES_FROM_KVS)
         hr_ctx->ptrs_to_inv->polled_invs = (uint16_t) write_i;
 }
-#endif /* if USE_SPLINTERDB */
 
 
-inline void hr_KVS_batch_op_invs(context_t *ctx, kvs_t* kvs)
+inline void hr_KVS_batch_op_invs(context_t *ctx)
 {
-      hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
+    hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
     ptrs_to_inv_t *ptrs_to_inv = hr_ctx->ptrs_to_inv;
     hr_inv_mes_t **inv_mes = hr_ctx->ptrs_to_inv->ptr_to_mes;
     hr_inv_t **invs = ptrs_to_inv->ptr_to_ops;
@@ -785,30 +622,82 @@ inline void hr_KVS_batch_op_invs(context_t *ctx, kvs_t* kvs)
         assert(invs != NULL);
         assert(op_num > 0 && op_num <= MAX_INCOMING_INV);
     }
-#if USE_MICA
+    if (!od_kvs_is_mica(ctx->kvs)) {
+        hr_tree_batch_op_invs(ctx, inv_mes, invs, op_num);
+        return;
+    }
+    mica_kv_t *mica = ctx->kvs->mica;
     unsigned int bkt[MAX_INCOMING_INV];
     struct mica_bkt *bkt_ptr[MAX_INCOMING_INV];
     unsigned int tag[MAX_INCOMING_INV];
     mica_op_t *kv_ptr[MAX_INCOMING_INV];	/* Ptr to KV item in log */
     for(op_i = 0; op_i < op_num; op_i++) {
-        KVS_locate_one_bucket(op_i, bkt, &invs[op_i]->key, bkt_ptr, tag, kv_ptr, KVS);
+        KVS_locate_one_bucket(op_i, bkt, &invs[op_i]->key, bkt_ptr, tag, kv_ptr, mica);
     }
-    KVS_locate_all_kv_pairs(op_num, tag, bkt_ptr, kv_ptr, KVS);
+    KVS_locate_all_kv_pairs(op_num, tag, bkt_ptr, kv_ptr, mica);
 
     for(op_i = 0; op_i < op_num; op_i++) {
         od_KVS_check_key(kv_ptr[op_i], invs[op_i]->key, op_i);
         hr_rem_inv(ctx, kv_ptr[op_i], inv_mes[op_i], invs[op_i]);
     }
-#endif /* if USE_MICA */
-#if USE_BPLUS
-     for (op_i = 0; op_i < op_num; op_i++) {
-         bt_hr_rem_inv(ctx, kvs->tree, inv_mes[op_i], invs[op_i]);
-     }
-#endif /* if USE_BPLUS */
-#if USE_SPLINTERDB
-  for (op_i = 0; op_i < op_num; op_i++) {
-    sdb_hr_rem_inv(ctx, kvs->spl_handle, inv_mes[op_i], invs[op_i]);
-  }
-  #endif /* if USE_SPLINTERDB */
 }
 
+// Flips the committed keys back to HR_V
+inline void hr_KVS_batch_op_commits(context_t *ctx,
+                                    hr_w_rob_t **ptrs_to_w_rob,
+                                    uint16_t write_num)
+{
+    if (!od_kvs_is_mica(ctx->kvs)) {
+        hr_tree_batch_op_commits(ctx, ptrs_to_w_rob, write_num);
+        return;
+    }
+    for (int w_i = 0; w_i < write_num; ++w_i) {
+        hr_w_rob_t *w_rob = ptrs_to_w_rob[w_i];
+        if (w_rob->inv_applied) {
+            if (ENABLE_ASSERTIONS) {
+                assert(w_rob->version > 0);
+                assert(w_rob != NULL);
+            }
+            mica_op_t *kv_ptr = w_rob->kv_ptr;
+            lock_seqlock(&kv_ptr->seqlock);
+            {
+                if (ENABLE_ASSERTIONS) assert(kv_ptr->version > 0);
+                if (kv_ptr->version == w_rob->version &&
+                    kv_ptr->m_id == w_rob->m_id) {
+                    if (ENABLE_ASSERTIONS) {
+                        if (w_rob->m_id == ctx->m_id)
+                            assert(kv_ptr->state == HR_W);
+                        else
+                            assert(kv_ptr->state == HR_INV ||
+                                   kv_ptr->state == HR_INV_T);
+                    }
+                    kv_ptr->state = HR_V;
+                    kv_ptr->c_readable = 0;
+                }
+            }
+            unlock_seqlock(&kv_ptr->seqlock);
+            hr_wake_readers(ctx, kv_ptr);
+        }
+    }
+}
+
+// The commits of keys that are read here may be applied by any worker,
+// so the parked reads are also retried once per trace batch
+inline void hr_poll_parked_reads(context_t *ctx)
+{
+    hr_read_waits_t *rw = &((hr_ctx_t *) ctx->appl_ctx)->read_waits;
+    if (rw->parked_num == 0) return;
+    for (uint32_t b = 0; b < HR_READ_WAIT_BKTS; b++) {
+        uint16_t sess_id = rw->bkt_head[b];
+        // only the buckets with a read that can now go through
+        while (sess_id != HR_NO_WAITER) {
+            mica_op_t *kv_ptr = rw->waits[sess_id].kv_ptr;
+            if (kv_ptr->state == HR_V ||
+                __atomic_load_n(&kv_ptr->c_readable, __ATOMIC_RELAXED)) {
+                hr_retry_parked_reads(ctx, b, NULL);
+                break;
+            }
+            sess_id = rw->waits[sess_id].next;
+        }
+    }
+}
@@ -3,18 +3,11 @@
 //
 
 #include "hr_inline_util.h"
+#include "od_sched.h"
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 
-#include "default_data_config.h"
-#include "splinterdb.h"
-
-#define DB_FILE_NAME    "splinterdb_intro_db"
-#define USER_MAX_KEY_SIZE ((int)100)
-#define DB_FILE_SIZE_MB 1024 // Size of SplinterDB device; Fixed when created
-#define CACHE_SIZE_MB   64   // Size of cache; can be changed across boots
-
 static inline void fill_inv(hr_inv_t *inv,
                             ctx_trace_op_t *op,
                             hr_w_rob_t *w_rob)
@@ -28,7 +21,7 @@ static inline void fill_inv(hr_inv_t *inv,
 
 
 
-static inline void hr_batch_from_trace_to_KVS(context_t *ctx, kvs_t* kvs)
+static inline void hr_batch_from_trace_to_KVS(context_t *ctx)
 {
   hr_ctx_t *hr_ctx = (hr_ctx_t *) ctx->appl_ctx;
   ctx_trace_op_t *ops = hr_ctx->ops;
@@ -37,6 +30,7 @@ static inline void hr_batch_from_trace_to_KVS(context_t *ctx, kvs_t* kvs)
   uint16_t op_i = 0;
   int working_session = -1;
 
+  if (od_kvs_is_mica(ctx->kvs)) hr_poll_parked_reads(ctx);
   if (all_sessions_are_stalled(ctx, hr_ctx->all_sessions_stalled,
                                &hr_ctx->stalled_sessions_dbg_counter))
     return;
@@ -65,7 +59,7 @@ static inline void hr_batch_from_trace_to_KVS(context_t *ctx, kvs_t* kvs)
   }
   hr_ctx->last_session = (uint16_t) working_session;
   t_stats[ctx->t_id].total_reqs += op_i;
-    hr_KVS_batch_op_trace(ctx, op_i,  kvs);
+  hr_KVS_batch_op_trace(ctx, op_i);
   if (!INSERT_WRITES_FROM_KVS) {
     for (int i = 0; i < hr_ctx->ptrs_to_inv->polled_invs; ++i) {
       od_insert_mes(ctx, INV_QP_ID, (uint32_t) INV_SIZE, 1,
@@ -80,41 +74,6 @@ static inline void hr_batch_from_trace_to_KVS(context_t *ctx, kvs_t* kvs)
 ////------------------------------ COMMIT WRITES -----------------------------
 ////---------------------------------------------------------------------------*/
 
-static inline void apply_writes(context_t *ctx,
-                                hr_w_rob_t **ptrs_to_w_rob,
-                                uint16_t write_num)
-{
-  for (int w_i = 0; w_i < write_num; ++w_i) {
-    hr_w_rob_t *w_rob = ptrs_to_w_rob[w_i];
-    if (w_rob->inv_applied) {
-      if (ENABLE_ASSERTIONS) {
-        assert(w_rob->version > 0);
-        assert(w_rob != NULL);
-      }
-      mica_op_t *kv_ptr = w_rob->kv_ptr;
-      lock_seqlock(&kv_ptr->seqlock);
-      {
-        //assert(kv_ptr->m_id == w_rob->m_id);
-        if (ENABLE_ASSERTIONS) assert(kv_ptr->version > 0);
-        if (kv_ptr->version == w_rob->version &&
-            kv_ptr->m_id == w_rob->m_id) {
-          if (ENABLE_ASSERTIONS) {
-            if (w_rob->m_id == ctx->m_id)
-              assert(kv_ptr->state == HR_W);
-            else
-              assert(kv_ptr->state == HR_INV ||
-                     kv_ptr->state == HR_INV_T);
-          }
-          kv_ptr->state = HR_V;
-        }
-
-      }
-        kv_ptr->state = HR_V;
-      unlock_seqlock(&kv_ptr->seqlock);
-    }
-  }
-}
-
 static inline void complete_local_write(context_t * ctx,
                                         hr_w_rob_t *w_rob)
 {
@@ -126,10 +85,19 @@ static inline void complete_local_write(context_t * ctx,
     assert(hr_ctx->stalled[sess_id]);
   }
   w_rob->acks_seen = 0;
-  signal_completion_to_client(sess_id,
-                              hr_ctx->index_to_req_array[sess_id],
-                              ctx->t_id);
-  hr_ctx->stalled[sess_id] = false;
+  // Reads may no longer be served the value before this write
+  if (w_rob->kv_ptr != NULL)
+    __atomic_store_n(&w_rob->kv_ptr->c_readable, 0, __ATOMIC_RELEASE);
+  // the session's write carried the writes merged into it as well
+  while (sess_id != HR_NO_WAITER) {
+    uint16_t next_sess = hr_ctx->merged_next[sess_id];
+    hr_ctx->merged_next[sess_id] = HR_NO_WAITER;
+    signal_completion_to_client(sess_id,
+                                hr_ctx->index_to_req_array[sess_id],
+                                ctx->t_id);
+    hr_ctx->stalled[sess_id] = false;
+    sess_id = next_sess;
+  }
 }
 
 static inline void hr_commit_writes(context_t *ctx)
@@ -140,7 +108,8 @@ static inline void hr_commit_writes(context_t *ctx)
   for (int m_i = 0; m_i < MACHINE_NUM; ++m_i) {
     hr_w_rob_t *w_rob = (hr_w_rob_t *) get_fifo_pull_slot(&hr_ctx->w_rob[m_i]);
     while (w_rob->w_state == READY) {
-      __builtin_prefetch(&w_rob->kv_ptr->seqlock, 0, 0);
+      if (w_rob->kv_ptr != NULL)
+        __builtin_prefetch(&w_rob->kv_ptr->seqlock, 0, 0);
       w_rob->w_state = INVALID;
       if (ENABLE_ASSERTIONS)
         assert(write_num < HR_UPDATE_BATCH);
@@ -160,8 +129,7 @@ static inline void hr_commit_writes(context_t *ctx)
   }
 
   if (write_num > 0) {
-     //apply_writes(ctx, ptrs_to_w_rob, write_num);
-    // apply_writes(ctx, ptrs_to_w_rob, write_num);
+    hr_KVS_batch_op_commits(ctx, ptrs_to_w_rob, write_num);
     if (local_op_i > 0) {
       hr_ctx->all_sessions_stalled = false;
       ctx_insert_commit(ctx, COM_QP_ID, local_op_i, hr_ctx->committed_w_id[ctx->m_id]);
@@ -332,52 +300,40 @@ inline bool hr_commit_handler(context_t *ctx)
 }
 
 
-_Noreturn inline void hr_main_loop(context_t *ctx, kvs_t *kvs)
+///* ---------------------------------------------------------------------------
+////------------------------------MAIN LOOP -----------------------------
+////---------------------------------------------------------------------------*/
+static bool hr_stage_trace(context_t *ctx, uint16_t unused)
+{
+  hr_batch_from_trace_to_KVS(ctx);
+  return true;
+}
+
+static bool hr_stage_commit_writes(context_t *ctx, uint16_t unused)
+{
+  hr_commit_writes(ctx);
+  return true;
+}
+
+static od_sched_t *hr_create_sched(context_t *ctx)
+{
+  od_sched_t *sched = od_sched_create(ctx);
+  od_sched_add(sched, "trace", hr_stage_trace, 0, OD_STAGE_ALWAYS);
+  od_sched_add(sched, "send-invs", od_stage_send_broadcasts, INV_QP_ID, OD_STAGE_ALWAYS);
+  od_sched_add(sched, "poll-invs", od_stage_poll, INV_QP_ID, OD_STAGE_BACKOFF);
+  od_sched_add(sched, "send-acks", od_stage_send_acks, ACK_QP_ID, OD_STAGE_ALWAYS);
+  od_sched_add(sched, "poll-acks", od_stage_poll, ACK_QP_ID, OD_STAGE_BACKOFF);
+  od_sched_add(sched, "send-coms", od_stage_send_broadcasts, COM_QP_ID, OD_STAGE_ALWAYS);
+  od_sched_add(sched, "poll-coms", od_stage_poll, COM_QP_ID, OD_STAGE_BACKOFF);
+  od_sched_add(sched, "commit", hr_stage_commit_writes, 0, OD_STAGE_ALWAYS);
+  return sched;
+}
+
+_Noreturn inline void hr_main_loop(context_t *ctx)
 {
-  // TODO: based on if def, change parameter to functions.
-  assert (USE_BPLUS == 1 || USE_SPLINTERDB == 1 || USE_MICA == 1);
   if (ctx->t_id == 0) my_printf(yellow, "Hermes main loop \n");
-#if ENABLE_METRICS
-  
-  char * file_path;
-#if USE_BPLUS
-  file_path= "/mnt/mydisk/stats/bplus/stats_90_%d.txt"; 
-#endif /* if USE_BPLUS */
-#if USE_SPLINTERDB
-  file_path = "/mnt/mydisk/stats/splinterdb/stats_90_%d.txt";
-#endif /* if USE_SPLINTERDB */
-#if USE_MICA
-  file_path = "/mnt/mydisk/stats/mica/stats_90_%d.txt";     
-#endif /* if 0 */
-  struct timespec start, end;
-  char file_name[100];
-    sprintf(file_name, file_path, ctx->t_id);
-    FILE *file = fopen(file_name, "w+");
-    if (file == NULL) {
-        fprintf(stderr, "Unable to open file for writing\n");
-        return;
-    }
-  #endif /* if ENABLE_METRICS */
+  od_sched_t *sched = hr_create_sched(ctx);
   while(true) {
-#if ENABLE_METRICS
-    
-    clock_gettime(CLOCK_REALTIME, &start);
-    #endif /* if ENABLE_METRICS */
-    hr_batch_from_trace_to_KVS(ctx, kvs);
-#if ENABLE_METRICS
-    	  clock_gettime(CLOCK_REALTIME, &end);
-    #endif
-    ctx_send_broadcasts(ctx, INV_QP_ID);
-    ctx_poll_incoming_messages(ctx, INV_QP_ID);
-    od_send_acks(ctx, ACK_QP_ID);
-    ctx_poll_incoming_messages(ctx, ACK_QP_ID);
-    ctx_send_broadcasts(ctx, COM_QP_ID);
-    ctx_poll_incoming_messages(ctx, COM_QP_ID);
-    hr_commit_writes(ctx);
-#if ENABLE_METRICS
-    
-      double elapsed_time = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
-      fprintf(file, "%d : %e\n", ctx->t_id, elapsed_time);
-    #endif /* if ENABLE_METRICS */
+    od_sched_run(ctx, sched);
   }
 }
@@ -3,8 +3,6 @@
 //
 
 #include "hr_util.h"
-#include "splinterdb.h"
-#include "bplus.h"
 
 void hr_static_assert_compile_parameters()
 {
@@ -19,6 +17,8 @@ void hr_init_functionality(int argc, char *argv[])
   od_generic_init_globals(QP_NUM);
   //hr_init_globals();
   od_handle_program_inputs(argc, argv);
+  od_kvs_set_env_merge(hr_env_merge);
+  od_kvs_set_mica_init(hr_mica_init);
 }
 
 
@@ -52,14 +52,14 @@ void hr_init_send_fifos(context_t *ctx)
 
 }
 
-void hr_qp_meta_mfs(context_t *ctx, kvs_t* kvs)
+void hr_qp_meta_mfs(context_t *ctx)
 {
   mf_t *mfs = calloc(QP_NUM, sizeof(mf_t));
 
   mfs[INV_QP_ID].recv_handler = inv_handler;
   mfs[INV_QP_ID].send_helper = send_invs_helper;
   mfs[INV_QP_ID].insert_helper = insert_inv_help;
-  mfs[INV_QP_ID].recv_kvs = hr_KVS_batch_op_invs; 
+  mfs[INV_QP_ID].recv_kvs = hr_KVS_batch_op_invs;
   mfs[ACK_QP_ID].recv_handler = ack_handler;
   mfs[ACK_QP_ID].send_helper = send_acks_helper;
 
@@ -79,7 +79,7 @@ void hr_qp_meta_mfs(context_t *ctx, kvs_t* kvs)
   free(mfs);
 }
 
-void hr_init_qp_meta(context_t *ctx, kvs_t* kvs)
+void hr_init_qp_meta(context_t *ctx)
 {
   per_qp_meta_t *qp_meta = ctx->qp_meta;
   create_per_qp_meta(&qp_meta[INV_QP_ID], MAX_INV_WRS,
@@ -105,7 +105,7 @@ void hr_init_qp_meta(context_t *ctx, kvs_t* kvs)
                      "send commits", "recv commits");
 
 
-  hr_qp_meta_mfs(ctx, kvs);
+  hr_qp_meta_mfs(ctx);
   hr_init_send_fifos(ctx);
 }
 
@@ -127,9 +127,16 @@ void* set_up_hr_ctx(context_t *ctx)
   hr_ctx->ops = (ctx_trace_op_t *) calloc((size_t) HR_TRACE_BATCH, sizeof(ctx_trace_op_t));
 
   hr_ctx->buf_ops = fifo_constructor(2 * SESSIONS_PER_THREAD, sizeof(buf_op_t), false, 0, 1);
+  hr_ctx->read_waits.waits = calloc(SESSIONS_PER_THREAD, sizeof(hr_read_wait_t));
+  for (int i = 0; i < HR_READ_WAIT_BKTS; i++)
+    hr_ctx->read_waits.bkt_head[i] = HR_NO_WAITER;
 
 
-  for (int i = 0; i < SESSIONS_PER_THREAD; i++) hr_ctx->stalled[i] = false;
+  hr_ctx->merged_next = (uint16_t *) malloc(SESSIONS_PER_THREAD * sizeof(uint16_t));
+  for (int i = 0; i < SESSIONS_PER_THREAD; i++) {
+    hr_ctx->stalled[i] = false;
+    hr_ctx->merged_next[i] = HR_NO_WAITER;
+  }
 
   for (uint8_t m_id = 0; m_id < MACHINE_NUM; ++m_id) {
     for (uint32_t i = 0; i < HR_PENDING_WRITES; i++) {
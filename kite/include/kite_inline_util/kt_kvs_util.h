@@ -844,8 +844,6 @@ static inline void KVS_batch_op_first_read_round(uint16_t op_num, uint16_t t_id,
 // Send an isolated write to the kvs-no batching
 static inline void KVS_isolated_op(int t_id, write_t *write)
 {
-  int j;	/* I is batch index */
-
   unsigned int bkt;
   struct mica_bkt *bkt_ptr;
   unsigned int tag;
@@ -857,28 +855,8 @@ static inline void KVS_isolated_op(int t_id, write_t *write)
 //  trace_op_t *op = (trace_op_t*) (((void *) write) - 3);
   //print_key((struct key *) write->key);
   //printf("op bkt %u\n", op->key.bkt);
-  bkt = write->key.bkt & KVS->bkt_mask;
-  bkt_ptr = &KVS->ht_index[bkt];
-  tag = write->key.tag;
-  kv_ptr = NULL;
-
-  for(j = 0; j < 8; j++) {
-    if(bkt_ptr->slots[j].in_use == 1 &&
-       bkt_ptr->slots[j].tag == tag) {
-      uint64_t log_offset = bkt_ptr->slots[j].offset &
-                            KVS->log_mask;
-      /*
-               * We can interpret the log entry as mica_op, even though it
-               * may not contain the full MICA_MAX_VALUE value.
-               */
-      kv_ptr = (mica_op_t *) &KVS->ht_log[log_offset];
-      /* Detect if the head has wrapped around for this index entry */
-      if(KVS->log_head - bkt_ptr->slots[j].offset >= KVS->log_cap) {
-        kv_ptr = NULL;	/* If so, we mark it "not found" */
-      }
-      break;
-    }
-  }
+  KVS_locate_one_bucket(0, &bkt, &write->key, &bkt_ptr, &tag, &kv_ptr, KVS);
+  KVS_locate_one_kv_pair(0, &tag, &bkt_ptr, &kv_ptr, KVS);
 
   // the following variables used to validate atomicity between a lock-free r_rep of an object
   if(kv_ptr != NULL) {
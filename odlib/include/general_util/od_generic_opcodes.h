@@ -58,6 +58,7 @@ typedef enum {
   KVS_LOCAL_GET_SUCCESS = 123,
   KVS_GET_OP_BUFFER = 124,
   KVS_PUT_OP_BUFFER = 125,
+  KVS_DELETE_SUCCESS = 126,
   KVS_MISS = 130
 } resp_type_t;
 
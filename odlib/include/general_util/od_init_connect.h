@@ -25,6 +25,8 @@ static int spawn_stats_thread() {
   } else{
     core = num_threads + 1;
   }
+  // Machines share the host's cores when running over the loopback transport
+  if (ENABLE_LOOPBACK) core = (int) (machine_id % sysconf(_SC_NPROCESSORS_ONLN));
   CPU_SET(core, &cpus_stats);
   my_printf(yellow, "Creating stats thread at core %d\n", core);
   pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpus_stats);
@@ -92,103 +94,16 @@ static void get_qps_from_all_other_machines(context_t *ctx)
 }
 
 
-#define BASE_SOCKET_PORT 8080
-
-// Machines with id higher than 0 connect with machine-id 0.
-// First they sent it their qps-attrs and then receive everyone's
-static void set_up_qp_attr_client(int qp_num)
+// One all-gather through the rendezvous gives every machine the qp attributes
+// of all workers; machine 0 serves it in TCP mode
+static void exchange_qp_attrs(int qp_num)
 {
-  int sock = 0, valread;
-  struct sockaddr_in serv_addr;
-  if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0)
-  {
-    printf("\n Socket creation error \n");
-    assert(false);
-  }
-
-  serv_addr.sin_family = AF_INET;
-  serv_addr.sin_port = htons((uint16_t)(BASE_SOCKET_PORT + machine_id - 1));
-
-  // Convert IPv4 and IPv6 addresses from text to binary form
-  if(inet_pton(AF_INET, remote_ips[0], &serv_addr.sin_addr) <= 0)
-  {
-    printf("\nInvalid address/ Address not supported \n");
-    assert(false);
-  }
-  uint32_t error_counter = 0;
-  while (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-    error_counter++;
-    if (error_counter == MILLION)
-      my_printf(red, "Stuck in loop: machine %d is trying to "
-                     "connect to socket to exchange qps \n", machine_id);
-  }
-
-  struct qp_attr *qp_attr_to_send = &all_qp_attr->wrkr_qp[machine_id][0][0];
-  size_t send_size = WORKERS_PER_MACHINE * qp_num * sizeof(struct qp_attr);
-  send(sock, qp_attr_to_send, send_size, 0);
-  struct qp_attr tmp[WORKERS_PER_MACHINE][qp_num];
-  memcpy(tmp, qp_attr_to_send, send_size);
-  //printf("Attributes sent\n");
-  size_t recv_size = sizeof(qp_attr_t) * MACHINE_NUM * WORKERS_PER_MACHINE * qp_num;
-  valread = (int) recv(sock, all_qp_attr->buf, recv_size, MSG_WAITALL);
-  assert(valread == recv_size);
-  int cmp = memcmp(qp_attr_to_send, qp_attr_to_send, send_size);
-  assert(cmp == 0);
-  //printf("Received all attributes, capacity %ld \n", sizeof(all_qp_attr_t));
-}
-
-// Machine 0 acts as a "server"; it receives all qp attributes,
-// and broadcasts them to everyone
-static void set_up_qp_attr_server(int qp_num)
-{
-  int server_fd[REM_MACH_NUM], new_socket[REM_MACH_NUM], valread;
-  struct sockaddr_in address;
-  int opt = 1;
-  int addrlen = sizeof(address);
-
-  for (int rm_i = 0; rm_i < REM_MACH_NUM; rm_i++) {
-    // Creating socket file descriptor
-    if ((server_fd[rm_i] = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-      printf("socket failed \n");
-      assert(false);
-    }
-
-    // Forcefully attaching socket to the port 8080
-    if (setsockopt(server_fd[rm_i], SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT,
-                   &opt, sizeof(opt))) {
-      printf("setsockopt \n");
-      assert(false);
-    }
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons((uint16_t)(BASE_SOCKET_PORT + rm_i));
-
-    // Forcefully attaching socket to the port 8080
-    if (bind(server_fd[rm_i], (struct sockaddr *) &address,
-             sizeof(address)) < 0) {
-      printf("bind failed \n");
-      assert(false);
-    }
-     //printf("Succesful bind \n");
-    if (listen(server_fd[rm_i], 3) < 0) {
-      printf("listen");
-      assert(false);
-    }
-     //printf("Succesful listen \n");
-    if ((new_socket[rm_i] = accept(server_fd[rm_i], (struct sockaddr *) &address,
-                                   (socklen_t *) &addrlen)) < 0) {
-      //printf("accept");
-    }
-     //printf("Successful accept \n");
-    size_t recv_size = WORKERS_PER_MACHINE * qp_num * sizeof(struct qp_attr);
-    valread = (int) recv(new_socket[rm_i], &all_qp_attr->wrkr_qp[rm_i + 1][0][0], recv_size, MSG_WAITALL);
-    assert(valread == recv_size);
-    //printf("Server received qp_attributes from machine %u capacity %ld \n",
-    //       rm_i + 1, recv_size);
-  }
-  size_t send_size = sizeof(qp_attr_t) * MACHINE_NUM * WORKERS_PER_MACHINE * qp_num;
-  for (int rm_i = 0; rm_i < REM_MACH_NUM; rm_i++) {
-    send(new_socket[rm_i], all_qp_attr->buf, send_size, 0);
+  size_t slot_size = WORKERS_PER_MACHINE * qp_num * sizeof(qp_attr_t);
+  const char *server_ip = machine_id == 0 ? local_ip : remote_ips[0];
+  if (hrd_rendezvous_all_gather(all_qp_attr->buf, slot_size,
+                                machine_id, MACHINE_NUM, server_ip) != 0) {
+    my_printf(red, "Machine %d could not exchange qp attributes \n", machine_id);
+    exit(-1);
   }
 }
 
@@ -217,14 +132,31 @@ static void fill_qps(context_t *ctx)
   atomic_fetch_add_explicit(&workers_with_filled_qp_attr, 1, memory_order_seq_cst);
 }
 
+// Loopback: each worker waits for the rings of its peers in shared memory
+// and addresses them by qpn alone, there are no qp attributes to exchange
+static void get_qps_from_loopback_peers(context_t *ctx)
+{
+  hrd_lb_connect(ctx->cb);
+  for (int m_i = 0; m_i < MACHINE_NUM; m_i++) {
+    if (m_i == machine_id) continue;
+    for (int qp_i = 0; qp_i < ctx->qp_num; qp_i++) {
+      rem_qp[m_i][ctx->t_id][qp_i].ah = NULL;
+      rem_qp[m_i][ctx->t_id][qp_i].qpn = (int) hrd_lb_qpn(m_i, ctx->t_id, qp_i);
+    }
+  }
+}
+
 // All workers both use this to establish connections
 static void setup_connections(context_t *ctx)
 {
+  if (ENABLE_LOOPBACK) {
+    get_qps_from_loopback_peers(ctx);
+    return;
+  }
   fill_qps(ctx);
   if (ctx->t_id == 0) {
     while(workers_with_filled_qp_attr != WORKERS_PER_MACHINE);
-    if (machine_id == 0) set_up_qp_attr_server(ctx->qp_num);
-    else set_up_qp_attr_client(ctx->qp_num);
+    exchange_qp_attrs(ctx->qp_num);
     get_qps_from_all_other_machines(ctx);
   }
 }
@@ -9,6 +9,9 @@
 #include "od_stats.h"
 #include <getopt.h>
 #include "od_kvs.h"
+#include "od_kvs_backend.h"
+#include "od_trace_util.h"
+#include "od_workload.h"
 
 static void od_generic_static_assert_compile_parameters()
 {
@@ -48,7 +51,7 @@ static void od_handle_program_inputs(int argc, char **argv)
   bqr_read_buffer_size = 0;
 
   int c;
-  char *tmp_ip;
+  char *tmp_ip, *convert_trace_path = NULL;
   static struct option opts[] = {
     { .name = "bqr-buffer-size",	.has_arg = 1, .val = 'B' },
     { .name = "bqr-is-remote",	    .has_arg = 1, .val = 'R' },
@@ -57,12 +60,19 @@ static void od_handle_program_inputs(int argc, char **argv)
     { .name = "is-roce",			.has_arg = 1, .val = 'r' },
     { .name = "all-ips",       .has_arg = 1, .val ='a'},
     { .name = "device_name",			.has_arg = 1, .val = 'd'},
+    { .name = "kvs",			.has_arg = 1, .val = 'k'},
+    { .name = "convert-trace",	.has_arg = 1, .val = 'T'},
+    { .name = "workload",			.has_arg = 1, .val = 'W'},
+    { .name = "dist",			.has_arg = 1, .val = 'D'},
+    { .name = "zipf",			.has_arg = 1, .val = 'z'},
+    { .name = "scan-len",			.has_arg = 1, .val = 'S'},
+    { .name = "records",			.has_arg = 1, .val = 'K'},
     { 0 }
   };
 
   /* Parse and check arguments */
   while(true) {
-    c = getopt_long(argc, argv, "R:B:M:w:t:b:N:n:c:u:m:p:r:i:l:x", opts, NULL);
+    c = getopt_long(argc, argv, "R:B:M:w:t:b:N:n:c:u:m:p:r:i:l:k:T:W:D:z:S:K:x", opts, NULL);
     if(c == -1) {
       break;
     }
@@ -88,12 +98,44 @@ static void od_handle_program_inputs(int argc, char **argv)
       case 'd':
         dev_name = optarg;
         break;
+      case 'k':
+        kvs_backend = od_kvs_backend_from_str(optarg);
+        break;
+      case 'T':
+        convert_trace_path = optarg;
+        break;
+      case 'W':
+        od_wl_set_workload(optarg);
+        break;
+      case 'D':
+        od_wl_set_dist(optarg);
+        break;
+      case 'z':
+        wl_cfg.zipf_theta = atof(optarg);
+        break;
+      case 'S':
+        wl_cfg.scan_len = (uint32_t) atoi(optarg);
+        break;
+      case 'K':
+        wl_cfg.record_num = (uint32_t) atoi(optarg);
+        break;
       default:
         printf("Invalid argument %d\n", c);
         assert(false);
     }
   }
   if(write_ratio == -1) write_ratio = WRITE_RATIO;
+  if (kvs_backend != MICA_KVS && !KVS_PROT_HAS_BACKENDS) {
+    my_printf(red, "This protocol only runs on the %s kvs \n",
+              od_kvs_backend_name(MICA_KVS));
+    exit(EXIT_FAILURE);
+  }
+  od_wl_init();
+  // Offline: turn the text traces into a binary trace and exit
+  if (convert_trace_path != NULL) {
+    od_trace_convert(convert_trace_path);
+    exit(EXIT_SUCCESS);
+  }
   if (machine_id == -1) assert(false);
   assert(machine_id < MACHINE_NUM);
   assert(!(is_roce == 1 && ENABLE_MULTICAST));
@@ -163,14 +205,10 @@ static void od_generic_init_globals(int qp_num)
 
   /* Latency Measurements initializations */
   if (MEASURE_LATENCY) {
-    // the last latency bucket is to capture possible outliers (> than LATENCY_MAX)
-    memset(&latency_count, 0, sizeof(struct latency_counters));
-    latency_count.requests = (uint32_t **) calloc(LATENCY_TYPE_NUM, sizeof(uint32_t*));
-    for (int req_i = 0; req_i < LATENCY_TYPE_NUM; ++req_i) {
-      latency_count.requests[req_i] = (uint32_t *) calloc(LATENCY_BUCKETS + 1, sizeof(uint32_t));
-    }
-    latency_count.max_req_lat = calloc(LATENCY_TYPE_NUM, sizeof(uint32_t));
-    latency_count.req_meas_num = calloc(LATENCY_TYPE_NUM, sizeof(uint32_t));
+    // the last latency bucket also captures the outliers (> 2^LATENCY_MAX_BITS ns)
+    latency_count = (struct latency_counters *)
+      memalign(64, TOTAL_THREADS * sizeof(struct latency_counters));
+    memset(latency_count, 0, TOTAL_THREADS * sizeof(struct latency_counters));
   }
 }
 
@@ -232,7 +270,10 @@ static void od_spawn_threads(struct thread_params *param_arr, uint16_t t_id, cha
                              void *(*__start_routine) (void *), bool *occupied_cores)
 {
   param_arr[t_id].id = t_id < WORKERS_PER_MACHINE ? t_id : t_id - WORKERS_PER_MACHINE;
-  int core = pin_thread(t_id); // + 8 + t_id * 20;
+  // Machines share the host's cores when running over the loopback transport
+  int core = ENABLE_LOOPBACK ?
+             (int) ((machine_id * TOTAL_THREADS + t_id) % sysconf(_SC_NPROCESSORS_ONLN)) :
+             pin_thread(t_id); // + 8 + t_id * 20;
   my_printf(yellow, "Creating %s thread %d at core %d \n", node_purpose, param_arr[t_id].id, core);
   CPU_ZERO(pinned_hw_threads);
   CPU_SET(core, pinned_hw_threads);
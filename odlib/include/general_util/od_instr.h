@@ -0,0 +1,103 @@
+//
+// Per-worker instrumentation of the main-loop stages and of the QPs
+//
+
+#ifndef OD_INSTR_H
+#define OD_INSTR_H
+
+#include "od_top.h"
+
+/*
+ * Each worker owns one od_instr_t slot of w_instr[] and is its only writer,
+ * so counting is a plain increment on a line no other core writes.
+ * The stats thread snapshots the slots every print and exports the deltas:
+ * per stage the runs, idle runs, skipped iterations, rdtsc cycles and a
+ * log2(cycles) histogram of the runs; per QP the messages and bytes sent,
+ * the credit stalls, the polls of the recv CQ, the polls that came back empty
+ * and the messages received.
+ */
+
+#define INSTR_HIST_BUCKETS 32 // bucket b holds the runs of [2^b, 2^(b+1)) cycles
+#define INSTR_MAX_QPS 8
+
+typedef struct od_qp_instr {
+  uint64_t sent_mes;
+  uint64_t sent_bytes;
+  uint64_t credit_stalls; // send attempts that found messages but no credits
+  uint64_t polls;
+  uint64_t empty_polls;
+  uint64_t recv_mes;
+} __attribute__ ((aligned (64))) od_qp_instr_t;
+
+typedef struct od_stage_instr {
+  uint64_t runs;
+  uint64_t idle_runs;
+  uint64_t skipped;
+  uint64_t cycles;
+  uint64_t hist[INSTR_HIST_BUCKETS];
+} __attribute__ ((aligned (64))) od_stage_instr_t;
+
+typedef struct od_instr {
+  od_qp_instr_t qp[INSTR_MAX_QPS];
+  od_stage_instr_t stage[SCHED_MAX_STAGES];
+  // set up once, before the worker enters its main loop
+  uint16_t qp_num;
+  uint16_t stage_num;
+  const char *qp_name[INSTR_MAX_QPS];
+  const char *stage_name[SCHED_MAX_STAGES];
+} __attribute__ ((aligned (64))) od_instr_t;
+
+extern od_instr_t w_instr[WORKERS_PER_MACHINE];
+
+od_instr_t *od_instr_register_qps(uint16_t t_id, uint16_t qp_num,
+                                  const char **qp_name);
+void od_instr_register_stage(od_instr_t *instr, uint16_t st_i,
+                             const char *name);
+/* Called by the stats thread every print, @seconds since the previous one */
+void od_instr_collect(double seconds);
+
+/* ---------------------------------------------------------------------------
+//------------------------------ COUNTING --------------------------------
+//---------------------------------------------------------------------------*/
+
+static forceinline void od_instr_sent(od_instr_t *instr, uint16_t qp_id,
+                                      uint32_t mes_num, uint64_t bytes)
+{
+  if (!ENABLE_INSTRUMENTATION) return;
+  instr->qp[qp_id].sent_mes += mes_num;
+  instr->qp[qp_id].sent_bytes += bytes;
+}
+
+static forceinline void od_instr_credit_stall(od_instr_t *instr, uint16_t qp_id)
+{
+  if (ENABLE_INSTRUMENTATION) instr->qp[qp_id].credit_stalls++;
+}
+
+static forceinline void od_instr_polled(od_instr_t *instr, uint16_t qp_id,
+                                        uint32_t recv_mes)
+{
+  if (!ENABLE_INSTRUMENTATION) return;
+  od_qp_instr_t *qp = &instr->qp[qp_id];
+  qp->polls++;
+  if (recv_mes == 0) qp->empty_polls++;
+  qp->recv_mes += recv_mes;
+}
+
+static forceinline void od_instr_stage_skipped(od_instr_t *instr, uint16_t st_i)
+{
+  if (ENABLE_INSTRUMENTATION) instr->stage[st_i].skipped++;
+}
+
+static forceinline void od_instr_stage_ran(od_instr_t *instr, uint16_t st_i,
+                                           uint64_t cycles, bool busy)
+{
+  if (!ENABLE_INSTRUMENTATION) return;
+  od_stage_instr_t *stage = &instr->stage[st_i];
+  uint32_t bucket = 63 - (uint32_t) __builtin_clzll(cycles | 1);
+  stage->runs++;
+  stage->cycles += cycles;
+  stage->hist[MIN(bucket, INSTR_HIST_BUCKETS - 1)]++;
+  if (!busy) stage->idle_runs++;
+}
+
+#endif //OD_INSTR_H
@@ -27,25 +27,68 @@ static inline char *latency_req_to_str(req_type_t rt)
       return "READ_REQ";
     case RMW_REQ:
       return "RMW_REQ";
+    case RANGE_REQ:
+      return "RANGE_REQ";
     default: assert(false);
   }
 }
 
 
-//Add latency to histogram (in microseconds)
-static inline void bookkeep_latency(uint64_t useconds, req_type_t rt)
+static inline uint32_t latency_bucket(uint64_t nseconds)
 {
+  if (nseconds < (1 << LATENCY_SUB_BITS)) return (uint32_t) nseconds;
+  uint32_t msb = 63 - (uint32_t) __builtin_clzll(nseconds);
+  uint32_t shift = msb - LATENCY_SUB_BITS + 1;
+  uint32_t bucket = shift * LATENCY_HALF_SUB + (uint32_t) (nseconds >> shift);
+  return MIN(bucket, LATENCY_BUCKETS - 1);
+}
+
+// Highest latency (in ns) that falls in the @bucket
+static inline uint64_t latency_bucket_to_ns(uint32_t bucket)
+{
+  if (bucket < (1 << LATENCY_SUB_BITS)) return bucket;
+  uint32_t shift = bucket / LATENCY_HALF_SUB - 1;
+  uint64_t sub_bucket = bucket - shift * LATENCY_HALF_SUB;
+  return ((sub_bucket + 1) << shift) - 1;
+}
+
+//Add latency to the histogram of the thread (in nanoseconds)
+static inline void bookkeep_latency(uint64_t nseconds, req_type_t rt, uint16_t t_id)
+{
+  check_state_with_allowed_flags(7, rt, RELEASE_REQ, ACQUIRE_REQ, READ_REQ,
+                                 WRITE_REQ, RMW_REQ, RANGE_REQ);
+  if (ENABLE_ASSERTIONS) assert(t_id < TOTAL_THREADS);
+  latency_hist_t *hist = &latency_count[t_id].hist[rt];
+  latency_count[t_id].total_measurements++;
+  hist->count++;
+  if (nseconds > hist->max_ns) hist->max_ns = nseconds;
+  hist->buckets[latency_bucket(nseconds)]++;
+}
 
-  check_state_with_allowed_flags(6, rt, RELEASE_REQ, ACQUIRE_REQ, READ_REQ, WRITE_REQ, RMW_REQ);
-  latency_count.total_measurements++;
-  latency_count.req_meas_num[rt]++;
-  if (useconds > latency_count.max_req_lat[rt])
-    latency_count.max_req_lat[rt] = (uint32_t) useconds;
+// Adds the histograms of all threads for @rt into @merged
+static inline void merge_latency_hists(latency_hist_t *merged, req_type_t rt)
+{
+  memset(merged, 0, sizeof(latency_hist_t));
+  for (uint16_t t_i = 0; t_i < TOTAL_THREADS; t_i++) {
+    latency_hist_t *hist = &latency_count[t_i].hist[rt];
+    merged->count += hist->count;
+    merged->max_ns = MAX(merged->max_ns, hist->max_ns);
+    for (uint32_t b_i = 0; b_i < LATENCY_BUCKETS; b_i++)
+      merged->buckets[b_i] += hist->buckets[b_i];
+  }
+}
 
-  if (useconds > MAX_LATENCY)
-    latency_count.requests[rt][LATENCY_BUCKETS]++;
-  else
-    latency_count.requests[rt][useconds / (MAX_LATENCY / LATENCY_BUCKETS)]++;
+// Latency (in ns) under which @percentile % of the measurements fall
+static inline uint64_t latency_percentile(latency_hist_t *hist, double percentile)
+{
+  if (hist->count == 0) return 0;
+  uint64_t target = (uint64_t) (hist->count * percentile / 100.0), seen = 0;
+  if (target == 0) target = 1;
+  for (uint32_t b_i = 0; b_i < LATENCY_BUCKETS; b_i++) {
+    seen += hist->buckets[b_i];
+    if (seen >= target) return MIN(latency_bucket_to_ns(b_i), hist->max_ns);
+  }
+  return hist->max_ns;
 }
 
 
@@ -56,20 +99,16 @@ static inline void report_latency(latency_info_t* latency_info)
 {
   struct timespec end;
   clock_gettime(CLOCK_MONOTONIC, &end);
-  uint64_t useconds = (uint64_t)((end.tv_sec - latency_info->start.tv_sec) * MILLION) +
-                 ((end.tv_nsec - latency_info->start.tv_nsec) / 1000);  //(end.tv_nsec - start->tv_nsec) / 1000;
-  //if (ENABLE_ASSERTIONS) assert(useconds > 0);
+  uint64_t nseconds = (uint64_t) ((end.tv_sec - latency_info->start.tv_sec) * BILLION) +
+                      (end.tv_nsec - latency_info->start.tv_nsec);
 
   if (DEBUG_LATENCY) {
-    printf("Latency of a req of type %s is %lu us, sess %u , measured reqs: %lu \n",
+    printf("Latency of a req of type %s is %lu ns, sess %u , measured reqs: %lu \n",
            latency_req_to_str(latency_info->measured_req_flag),
-           useconds, latency_info->measured_sess_id,
-           (latency_count.total_measurements + 1));
-    //if (useconds > 1000)
-
-
+           nseconds, latency_info->measured_sess_id,
+           (latency_count[latency_info->t_id].total_measurements + 1));
   }
-  bookkeep_latency(useconds, latency_info->measured_req_flag);
+  bookkeep_latency(nseconds, latency_info->measured_req_flag, latency_info->t_id);
   latency_info->measured_req_flag = NO_REQ;
 }
 
@@ -88,6 +127,8 @@ static inline req_type_t map_opcodes_to_req_type(uint8_t opcode)
     case COMPARE_AND_SWAP_WEAK:
     case COMPARE_AND_SWAP_STRONG:
       return RMW_REQ;
+    case KVS_OP_RANGE:
+      return RANGE_REQ;
     default: if (ENABLE_ASSERTIONS) assert(false);
   }
 }
@@ -101,6 +142,7 @@ static inline void start_measurement(latency_info_t* latency_info, uint32_t sess
 
   latency_info->measured_req_flag = map_opcodes_to_req_type(opcode);
   latency_info->measured_sess_id = sess_id;
+  latency_info->t_id = t_id;
   if (DEBUG_LATENCY)
     my_printf(green, "Measuring a req , opcode %s, sess_id %u,  flag %s op_i %d \n",
   					 opcode_to_str(opcode), sess_id, latency_req_to_str(latency_info->measured_req_flag),
@@ -14,8 +14,14 @@
 #include <od_sizes.h>
 
 
-#define MAX_LATENCY 400 //in us
-#define LATENCY_BUCKETS 200 //latency accuracy
+// Latencies are kept in ns, in log-linear (HDR-style) histograms: values
+// below 2^LATENCY_SUB_BITS get a bucket each and every power of two above is
+// split in LATENCY_HALF_SUB linear buckets, i.e. < 1.6% error up to
+// 2^LATENCY_MAX_BITS ns (~68 s)
+#define LATENCY_SUB_BITS 7
+#define LATENCY_MAX_BITS 36
+#define LATENCY_HALF_SUB (1 << (LATENCY_SUB_BITS - 1))
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 2) * LATENCY_HALF_SUB)
 
 // Store statistics from the workers, for the stats thread to use
 typedef struct thread_stats t_stats_t;
@@ -56,14 +62,16 @@ typedef enum {
   WRITE_REQ = 2,
   READ_REQ = 3,
   RMW_REQ = 4,
+  RANGE_REQ = 5,
   NO_REQ
 } req_type_t;
 
-#define LATENCY_TYPE_NUM 5
+#define LATENCY_TYPE_NUM 6
 
 typedef struct latency_flags {
   req_type_t measured_req_flag;
   uint32_t measured_sess_id;
+  uint16_t t_id; // the thread that measures, picks its latency_count slot
   //struct key* key_to_measure;
   struct timespec start;
 } latency_info_t;
@@ -71,14 +79,17 @@ typedef struct latency_flags {
 
 
 
-struct latency_counters {
+typedef struct latency_hist {
+  uint64_t count;
+  uint64_t max_ns;
+  uint64_t buckets[LATENCY_BUCKETS];
+} latency_hist_t;
 
-  uint32_t** requests;
+// One per thread, only the owning thread records into it
+struct latency_counters {
+  latency_hist_t hist[LATENCY_TYPE_NUM];
   uint64_t total_measurements;
-  uint32_t *max_req_lat;
-  uint32_t *req_meas_num;
-
-};
+} __attribute__ ((aligned (64)));
 
 
 struct local_latency {
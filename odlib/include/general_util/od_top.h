@@ -35,13 +35,6 @@
 #include <stdbool.h>
 
 #include "od_top_prot_sel.h"
-#include "default_data_config.h"
-#include "splinterdb.h"
-#include "bplus.h"
-#define DB_FILE_NAME    "splinterdb_intro_db"
-#define USER_MAX_KEY_SIZE ((int)100)
-#define DB_FILE_SIZE_MB 1024 // Size of SplinterDB device; Fixed when created
-#define CACHE_SIZE_MB   64   // Size of cache; can be changed across boots
 
 // Stats thread
 _Noreturn void *print_stats(void*);
@@ -88,14 +81,14 @@ typedef struct key mica_key_t;
 
 // CORE CONFIGURATION
 #define MACHINE_NUM 5
-#define ENABLE_METRICS 0
-#define USE_MICA 1 
-#define USE_BPLUS 0
-#define USE_SPLINTERDB 0
+#define KVS_BACKEND MICA_KVS // default store, can be changed at startup with --kvs
+// Only Hermes reaches its store through ctx->kvs, the other protocols run on MICA
+#define KVS_PROT_HAS_BACKENDS (COMPILED_SYSTEM == hermes_sys)
 #define WORKERS_PER_MACHINE 8
 #define SESSIONS_PER_THREAD 1
 #define WRITE_RATIO 100 //Warning write ratio is given out of a 1000, e.g 10 means 10/1000 i.e. 1%
 #define RANGE_RATIO 900
+#define RANGE_LEN 10 // number of keys a range query is expected to cover
 #define RMW_RATIO 1000// this is out of 1000, e.g. 10 means 1%
 #define ENABLE_MULTICAST_ 0
 
@@ -143,6 +136,10 @@ typedef struct key mica_key_t;
 
 #define ENABLE_RMWS (1 && (COMPILED_SYSTEM == kite_sys || COMPILED_SYSTEM == paxos_sys ))
 #define FEED_FROM_TRACE 0 // used to enable skew++
+// With FEED_FROM_TRACE, the binary trace written by --convert-trace is mmap'd
+// once and shared by all threads; the text traces are parsed only without it
+#define TRACE_DIR "/../../../traces/current-splited-traces/" // relative to the cwd
+#define TRACE_BIN_NAME "trace_a_0.%d.bin" // %d is SKEW_EXPONENT_A
 // RMW TRACE
 #define ENABLE_NO_CONFLICT_RMW 0 // each session access its own  key
 #define ENABLE_ALL_CONFLICT_RMW 0 // all threads do rmws to one key (0)
@@ -173,6 +170,24 @@ typedef struct key mica_key_t;
 
 
 #define ENABLE_ADAPTIVE_INLINING 0 // This did not help
+// Broadcasts hold a lone, partly filled message for up to COALESCE_BUDGET_NS
+// so that more messages coalesce into it, and ss_batch follows the fill ratio
+// of the sent messages: it shrinks when they go out full (heavy load) to
+// spread the signaled polls, and grows back when they go out half-empty
+#define ENABLE_ADAPTIVE_COALESCING 1
+#define COALESCE_BUDGET_NS 1000
+#define COALESCE_HIGH_FILL 750 // per mille of the send slot
+#define COALESCE_LOW_FILL 400 // per mille of the send slot
+// Main loops that run on od_sched (od_sched.h) skip the stages that came back
+// idle for up to SCHED_MAX_BACKOFF iterations
+#define ENABLE_SCHED_BACKOFF 1
+#define SCHED_MAX_BACKOFF 16
+#define SCHED_MAX_STAGES 16
+// Per-worker rdtsc counters of the stages and the QPs (od_instr.h); the stats
+// thread prints them and appends them to INSTR_EXPORT_FILE ("" to not export)
+#define ENABLE_INSTRUMENTATION 1
+#define SHOW_INSTR_STATS 1
+#define INSTR_EXPORT_FILE "od_instr_m%d.csv" // %d is the machine id
 /*-------------------------------------------------
 -----------------DEBUGGING-------------------------
 --------------------------------------------------*/
@@ -268,6 +283,28 @@ enum {
 #define MULTICAST_TESTING_ 0
 #define MULTICAST_TESTING (ENABLE_MULTICAST == 1 ? MULTICAST_TESTING_ : 0)
 
+/*-------------------------------------------------
+	-----------------LOOPBACK-------------------------
+--------------------------------------------------*/
+// Emulate the UD transport over shared memory: all MACHINE_NUM machines
+// run as processes on one host (bin/run-loopback.sh), no RDMA NIC needed
+#define ENABLE_LOOPBACK 0
+#define LOOPBACK_SHM_NAME "/odyssey_lb_m%u_w%u" // one segment per worker
+static_assert(!(ENABLE_LOOPBACK && ENABLE_MULTICAST), "Loopback does not emulate multicast");
+
+/*-------------------------------------------------
+	-----------------RENDEZVOUS-------------------------
+--------------------------------------------------*/
+// QP attributes are all-gathered once at start-up: every machine connects to
+// machine 0 concurrently (TCP), or, when all machines share a host, drops its
+// attributes in RENDEZVOUS_DIR and waits for everyone else's
+#define RENDEZVOUS_TCP 0
+#define RENDEZVOUS_FILE 1
+#define RENDEZVOUS_MODE RENDEZVOUS_TCP
+#define RENDEZVOUS_PORT 8080
+#define RENDEZVOUS_DIR "/tmp/odyssey_rendezvous"
+#define RENDEZVOUS_TIMEOUT_S 120 // give up if a machine has not shown up by then
+#define RENDEZVOUS_RETRY_MS 10
 
 
 
@@ -318,12 +355,13 @@ extern atomic_uint_fast32_t workers_with_filled_qp_attr;
 extern atomic_bool qps_are_set_up;
 extern FILE* client_log[CLIENTS_PER_MACHINE];
 extern uint64_t time_approx;
-extern struct latency_counters latency_count;
+extern struct latency_counters *latency_count; // [TOTAL_THREADS]
 extern c_stats_t c_stats[CLIENTS_PER_MACHINE];
 
 typedef struct trace_command {
   uint8_t opcode;
   uint8_t key_hash[8];
+  uint8_t range_end_hash[8]; // KVS_OP_RANGE: inclusive upper bound, key_hash is the lower
   uint32_t key_id;
 } trace_t;
 
@@ -402,14 +440,16 @@ typedef struct quorum_info {
 } quorum_info_t;
 
 
-typedef struct kvs_wrapper {
-#if USE_BPLUS
-  bp_db_t* tree;
-#endif         
-#if USE_SPLINTERDB
-  splinterdb* spl_handle;
-#endif
-} kvs_t;/* if USE_SPLINTERDB */
+// The store that backs the protocols, see od_kvs_backend.h
+typedef enum {
+  MICA_KVS = 0,
+  BPLUS_KVS,
+  SPLINTERDB_KVS,
+  KVS_BACKEND_NUM
+} kvs_backend_t;
+
+typedef struct kvs_wrapper kvs_t;
+extern kvs_backend_t kvs_backend;
 
 //////////////////////////////////////////////////////
 /////////////~~~~CLIENT STRUCTS~~~~~~/////////////////////////
@@ -0,0 +1,255 @@
+#ifndef ODYSSEY_OD_KVS_BACKEND_H
+#define ODYSSEY_OD_KVS_BACKEND_H
+
+#include "od_kvs.h"
+#include "od_city.h"
+#include "splinterdb.h"
+#include "bplus.h"
+
+/* ---------------------------------------------------------------------------
+//------------------------------ KVS BACKENDS -----------------------------
+//---------------------------------------------------------------------------*/
+// Every store that can back a protocol (MICA, the B+-tree, SplinterDB)
+// implements the same batched entry points. The store is picked at startup
+// (--kvs) and each worker gets a kvs_t that it reaches through ctx->kvs.
+
+#define KVS_MAX_BATCH 1024 // max ops MICA resolves in one batched call
+
+#define BPLUS_FILE_NAME "/mnt/mydisk/Odyssey/bplus.bp"
+// The tree is append-only: compact it in the background once its file
+// grows past this many times its live size
+#define BPLUS_MAX_SPACE_AMP 4
+
+// One SplinterDB instance is shared by all workers of a machine
+#define SPL_DB_FILE_NAME "splinterdb_intro_db"
+#define SPL_MAX_KEY_SIZE ((int)100)
+#define SPL_DB_FILE_SIZE_MB 1024 // Size of SplinterDB device; Fixed when created
+#define SPL_CACHE_SIZE_MB   512  // Size of the shared cache; can be changed across boots
+#define SPL_MEMTABLE_BG_THREADS 1 // ~1 per 10 inserting threads
+#define SPL_NORMAL_BG_THREADS 2 // compactions and filter building
+#define SPL_ASYNC_INFLIGHT 32 // lookups that a worker keeps in flight in a batch
+#define SPL_KEY_LOCKS 4096 // stripes that serialize the updates of a key, power of 2
+// How batch gets look keys up: SPL_GETS_BATCHED resolves them in one trunk
+// walk, SPL_GETS_ASYNC keeps SPL_ASYNC_INFLIGHT of them waiting on the device,
+// SPL_GETS_AUTO picks async only if the dataset outgrows SPL_CACHE_SIZE_MB,
+// as with the default sizes every lookup hits in the cache
+#define SPL_GETS_BATCHED 0
+#define SPL_GETS_ASYNC 1
+#define SPL_GETS_AUTO 2
+#define SPL_GETS SPL_GETS_AUTO
+
+/* ---------------------------------------------------------------------------
+//------------------------------ VALUE ENVELOPE -----------------------------
+//---------------------------------------------------------------------------*/
+// The trees have no mica_op_t to keep per-key protocol metadata in: they
+// store every value in an envelope that carries its Lamport clock and a
+// protocol-defined state. Protocols change an envelope through batch_update,
+// which hands a delta envelope to the registered merge function in a single
+// read-modify-write inside the store.
+typedef struct kvs_env {
+  uint64_t version;
+  uint8_t m_id;
+  uint8_t state; // protocol defined, e.g. key_state_t in Hermes
+  uint8_t kind; // deltas only: which update this is, see kvs_env_merge_t
+  uint8_t unused[5];
+  uint8_t value[VALUE_SIZE];
+} kvs_env_t;
+
+#define KVS_ENV_SIZE (sizeof(kvs_env_t))
+#define KVS_ENV_LWW 0 // kind of the deltas that od_kvs_lww_merge understands
+
+// Applies delta onto cur and returns true if cur changed.
+// It runs inside the store, under the lock of the key, so it must only
+// depend on its two inputs; an update whose delta it rejects fails.
+typedef bool (*kvs_env_merge_t)(kvs_env_t *cur, const kvs_env_t *delta);
+
+// Default merge: the delta replaces cur if its (version, m_id) is greater
+bool od_kvs_lww_merge(kvs_env_t *cur, const kvs_env_t *delta);
+// Protocols that keep a state machine in the envelope register their merge
+// in their init_functionality, before any store is opened
+void od_kvs_set_env_merge(kvs_env_merge_t merge);
+extern kvs_env_merge_t kvs_env_merge;
+
+
+// One op of a batch.
+// GET: value is where the value is copied to; if env is set the whole
+//      envelope is copied there as well (trees only).
+// PUT/APPLY_REMOTE: value is what gets written, a missing key is inserted.
+// UPDATE: env is the delta that is merged into the stored envelope (trees only);
+//         if the merge took it, env comes back holding the merged envelope.
+// DELETE: only the key is read.
+// A NULL value only resolves the key: on MICA the located mica_op_t is
+// returned in kv_ptr, so that protocols can run their own seqlock-protected
+// state machines on it.
+typedef struct kvs_op {
+  mica_key_t key;
+  mica_key_t range_end; // RANGE: inclusive upper bound, key is the lower bound
+  uint8_t *value;
+  kvs_env_t *env;
+  mica_op_t *kv_ptr; // MICA only
+  uint64_t version; // PUT/APPLY_REMOTE: Lamport clock of the value (trees keep it)
+  uint32_t range_cnt; // RANGE: number of keys found
+  uint32_t key_id; // PUT: kept in the mica_op_t of an inserted key, strictly for debug
+  uint8_t m_id; // PUT/APPLY_REMOTE: the machine that issued the write
+  uint8_t resp; // resp_type_t
+} kvs_op_t;
+
+// A MICA PUT that inserts a key passes the new mica_op_t, with its key,
+// key_id and value set, to this hook, which fills in the protocol metadata
+// (e.g. version, m_id and state) from the op. Protocols register it in their
+// init_functionality, as with the merge; by default it stays zeroed, as in
+// the populated keys.
+typedef void (*kvs_mica_init_t)(mica_op_t *kv_ptr, const kvs_op_t *op);
+void od_kvs_set_mica_init(kvs_mica_init_t init);
+extern kvs_mica_init_t kvs_mica_init;
+
+typedef void (*kvs_batch_t)(kvs_t *, kvs_op_t *, uint16_t);
+typedef void (*kvs_thread_t)(kvs_t *);
+typedef void (*kvs_init_t)(void);
+
+typedef struct kvs_mfs {
+  const char *name;
+  kvs_batch_t batch_get;
+  kvs_batch_t batch_put;
+  kvs_batch_t batch_range;
+  kvs_batch_t batch_apply_remote;
+  kvs_batch_t batch_update; // NULL on MICA, protocols use their mica_op_t
+  kvs_batch_t batch_delete;
+  kvs_init_t init; // once per process, before the workers are spawned
+  kvs_thread_t open;
+  kvs_thread_t close;
+} kvs_mfs_t;
+
+struct kvs_wrapper {
+  kvs_backend_t type;
+  const kvs_mfs_t *mfs;
+  uint16_t t_id;
+  mica_kv_t *mica;
+  bp_db_t *tree;
+  splinterdb *spl_handle;
+  struct spl_async_slot *spl_slots; // SPL_ASYNC_INFLIGHT async lookups
+  splinterdb_lookup_result *spl_results; // SPLINTERDB_MAX_BATCH batched lookups
+};
+
+extern const kvs_mfs_t mica_kvs_mfs;
+extern const kvs_mfs_t bplus_kvs_mfs;
+extern const kvs_mfs_t splinterdb_kvs_mfs;
+
+kvs_backend_t od_kvs_backend_from_str(const char *name);
+const char *od_kvs_backend_name(kvs_backend_t type);
+
+// Called by main, after the program inputs are parsed
+void od_kvs_init();
+// Called by each worker, returns the handle to the store selected at startup
+kvs_t *od_kvs_open(uint16_t t_id);
+void od_kvs_close(kvs_t *kvs);
+
+
+/* ---------------------------------------------------------------------------
+//------------------------------ KEY ENCODING -----------------------------
+//---------------------------------------------------------------------------*/
+// The trees store a mica_key_t as its 8 bytes read as a uint64 and written
+// big-endian: byte order (memcmp) is then the numeric order of the key,
+// which is what range queries walk. Values are always kvs_env_ts.
+
+static inline uint64_t od_kvs_key_to_u64(const mica_key_t *key)
+{
+  uint64_t k;
+  memcpy(&k, key, KEY_SIZE);
+  return k;
+}
+
+static inline void od_kvs_u64_to_key(uint64_t k, mica_key_t *key)
+{
+  memcpy(key, &k, KEY_SIZE);
+}
+
+static inline void od_kvs_encode_u64(uint64_t k, uint8_t *enc_key)
+{
+  uint64_t be = __builtin_bswap64(k);
+  memcpy(enc_key, &be, KEY_SIZE);
+}
+
+static inline void od_kvs_encode_key(const mica_key_t *key, uint8_t *enc_key)
+{
+  od_kvs_encode_u64(od_kvs_key_to_u64(key), enc_key);
+}
+
+// The key that the KVS is populated with for key_id, same as MICA
+static inline uint64_t od_kvs_key_of_id(uint32_t key_id)
+{
+  return CityHash128((char *) &key_id, 4).second;
+}
+
+// Keys are uniformly spread hashes: an inclusive range that starts at
+// start is expected to cover range_len of the KVS_NUM_KEYS keys
+static inline void od_kvs_range_end(const mica_key_t *start, mica_key_t *end,
+                                    uint32_t range_len)
+{
+  uint64_t k = od_kvs_key_to_u64(start);
+  uint64_t span = (UINT64_MAX / KVS_NUM_KEYS) * range_len;
+  od_kvs_u64_to_key(k > UINT64_MAX - span ? UINT64_MAX : k + span, end);
+}
+
+// Fills keys with the KVS_NUM_KEYS keys of the dataset, sorted
+void od_kvs_sorted_dataset_keys(uint64_t *keys);
+
+
+static inline bool od_kvs_is_mica(kvs_t *kvs)
+{
+  return kvs->type == MICA_KVS;
+}
+
+static inline void od_kvs_check_batch(kvs_t *kvs, kvs_op_t *ops,
+                                      uint16_t op_num)
+{
+  if (ENABLE_ASSERTIONS) {
+    assert(kvs != NULL && kvs->mfs != NULL);
+    assert(ops != NULL);
+  }
+}
+
+static inline void od_kvs_batch_get(kvs_t *kvs, kvs_op_t *ops,
+                                    uint16_t op_num)
+{
+  od_kvs_check_batch(kvs, ops, op_num);
+  kvs->mfs->batch_get(kvs, ops, op_num);
+}
+
+static inline void od_kvs_batch_put(kvs_t *kvs, kvs_op_t *ops,
+                                    uint16_t op_num)
+{
+  od_kvs_check_batch(kvs, ops, op_num);
+  kvs->mfs->batch_put(kvs, ops, op_num);
+}
+
+static inline void od_kvs_batch_range(kvs_t *kvs, kvs_op_t *ops,
+                                      uint16_t op_num)
+{
+  od_kvs_check_batch(kvs, ops, op_num);
+  kvs->mfs->batch_range(kvs, ops, op_num);
+}
+
+static inline void od_kvs_batch_apply_remote(kvs_t *kvs, kvs_op_t *ops,
+                                             uint16_t op_num)
+{
+  od_kvs_check_batch(kvs, ops, op_num);
+  kvs->mfs->batch_apply_remote(kvs, ops, op_num);
+}
+
+static inline void od_kvs_batch_update(kvs_t *kvs, kvs_op_t *ops,
+                                       uint16_t op_num)
+{
+  od_kvs_check_batch(kvs, ops, op_num);
+  if (ENABLE_ASSERTIONS) assert(kvs->mfs->batch_update != NULL);
+  kvs->mfs->batch_update(kvs, ops, op_num);
+}
+
+static inline void od_kvs_batch_delete(kvs_t *kvs, kvs_op_t *ops,
+                                       uint16_t op_num)
+{
+  od_kvs_check_batch(kvs, ops, op_num);
+  kvs->mfs->batch_delete(kvs, ops, op_num);
+}
+
+#endif //ODYSSEY_OD_KVS_BACKEND_H
@@ -66,6 +66,31 @@ hrd_ctrl_blk_t* hrd_ctrl_blk_init(int local_hid,
 
 int hrd_ctrl_blk_destroy(hrd_ctrl_blk_t *cb);
 
+/*
+ * Loopback transport (ENABLE_LOOPBACK): the control block gets datagram QPs
+ * and CQs that live in shared memory instead of a NIC. ibv_post_send(),
+ * ibv_post_recv() and ibv_poll_cq() dispatch through the context ops, so
+ * callers use the same verbs as with RDMA.
+ */
+hrd_ctrl_blk_t* hrd_lb_ctrl_blk_init(int local_hid, int machine_id,
+									 int num_dgram_qps, int dgram_buf_size,
+									 int *recv_q_depth, int *send_q_depth,
+									 uint32_t *recv_size);
+int hrd_lb_ctrl_blk_destroy(hrd_ctrl_blk_t *cb);
+/* Blocks until the same worker of every other machine has its QPs up */
+void hrd_lb_connect(hrd_ctrl_blk_t *cb);
+struct ibv_mr *hrd_lb_reg_mr(void *buf, uint32_t size);
+uint32_t hrd_lb_qpn(int machine_id, int worker_id, int qp_id);
+
+/*
+ * Rendezvous (RENDEZVOUS_MODE): all-gather of one @slot_size blob per machine.
+ * @buf holds @machine_num consecutive slots, the caller fills its own.
+ * Machine 0 serves the TCP rendezvous at @server_ip. Returns 0 once every slot
+ * is filled, -1 if some machine did not show up within RENDEZVOUS_TIMEOUT_S.
+ */
+int hrd_rendezvous_all_gather(void *buf, size_t slot_size, int machine_id,
+							  int machine_num, const char *server_ip);
+
 /* Debug */
 void hrd_ibv_devinfo(void);
 
@@ -109,6 +134,7 @@ hrd_poll_cq(struct ibv_cq *cq, int num_comps, struct ibv_wc *wc)
 
 static inline struct ibv_mr* register_buffer(struct ibv_pd *pd, void* buf, uint32_t size)
 {
+	if (ENABLE_LOOPBACK) return hrd_lb_reg_mr(buf, size);
 	int ib_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ |
 				   IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_ATOMIC;
 	struct ibv_mr* mr = ibv_reg_mr(pd,(char *)buf, size, ib_flags);
@@ -168,6 +194,8 @@ void green_printf(const char *format, ...);
 void cyan_printf(const char *format, ...);
 void hrd_get_formatted_time(char *timebuf);
 void hrd_nano_sleep(int ns);
+/* TSC frequency, measured once against CLOCK_MONOTONIC */
+double hrd_get_cycles_per_ns(void);
 char *hrd_getenv(const char *name);
 
 #endif /* HRD_H */
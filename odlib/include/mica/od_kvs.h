@@ -12,111 +12,275 @@
 #include <od_debug_util.h>
 
 #include "od_kvs_prot_sel.h"
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 
-#define KVS_NUM_BKTS (8 * 1024 * 1024)
+/* Initial index, it doubles as keys get inserted: a 1 GB log of entries of
+ * 64 B or more holds at most 16M keys, so KVS_MAX_BKTS is 4 doublings away */
+#define KVS_NUM_BKTS (1024 * 1024)
+#define KVS_MAX_BKTS (16 * 1024 * 1024) /* A 1 GB index */
 #define KVS_LOG_CAP  (1024 * 1024 * 1024)
 
 
 
 
-#define MICA_LOG_BITS 40
+#define MICA_LOG_BITS 32
 #define MICA_INDEX_SHM_KEY 1185
 #define MICA_LOG_SHM_KEY 2185
 
+#define MICA_BKT_SLOTS 8
+#define MICA_CHAIN_SLOT (MICA_BKT_SLOTS - 1)
+#define MICA_TAG_BITS (64 - MICA_LOG_BITS - 1)
+/* The last slot of a full bucket links its overflow bucket: its offset is the
+ * signed 32-bit distance in buckets to it, as reused overflow buckets may come
+ * before the bucket they extend. Key tags are 30 bits, so they never match it. */
+#define MICA_CHAIN_TAG ((1U << MICA_TAG_BITS) - 1)
+#define MICA_OVF_BKTS_DIV 8 /* An index has num_bkts / 8 overflow buckets */
+#define MICA_RESIZE_LOAD 2 /* Keys per bucket that start a doubling of the index */
+#define MICA_MIGRATE_STEP 64 /* Buckets an insert or a delete moves to the new index */
+/* A deleted log entry, an unlinked overflow bucket or a migrated index is
+ * reused or freed only after this long, so that workers that reached it
+ * before can finish with it */
+#define MICA_RECLAIM_GRACE_MS 1000
+/* Compare the 8 tags of a bucket with one AVX-512 or AVX2 compare, if the CPU has it */
+#define MICA_ENABLE_SIMD_MATCH 1
+
 
 
 struct mica_slot {
 	uint32_t in_use	:1;
-	uint32_t tag	:(64 - MICA_LOG_BITS - 1);
+	uint32_t tag	:MICA_TAG_BITS;
 	uint64_t offset	:MICA_LOG_BITS;
 };
 
 struct mica_bkt {
-	struct mica_slot slots[8];
+	struct mica_slot slots[MICA_BKT_SLOTS];
 };
 
+typedef struct mica_log_free {
+	uint64_t offset;
+	uint64_t retired_at;	/* rdtsc of the delete */
+} mica_log_free_t;
+
+/*
+ * Readers never lock. Inserts and deletes serialize on the lock of the kvs
+ * and publish a slot with a single 8-byte store.
+ * To double the index, a new one is published with @old pointing to the
+ * current one. Every insert or delete then moves MICA_MIGRATE_STEP buckets
+ * of @old into it and advances @migrated: keys of buckets below @migrated are
+ * looked up in the new index, the rest in @old, which is left intact and freed
+ * MICA_RECLAIM_GRACE_MS after the migration ends.
+ * A delete that empties an overflow bucket unlinks it from its chain; it is
+ * handed out again once MICA_RECLAIM_GRACE_MS have passed.
+ * An insert that finds no overflow bucket fails, and starts a doubling if none
+ * is under way. The new index has twice the overflow buckets of @old, so the
+ * migration itself only runs short of them if inserts used them up; it then
+ * stops at the bucket that does not fit rather than move part of it, until
+ * deletes give overflow buckets back.
+ */
+typedef struct mica_index {
+	struct mica_bkt *bkts;	/* @num_bkts buckets, then the overflow buckets */
+	uint32_t num_bkts;
+	uint32_t bkt_mask;	/* Mask down from a mica_key's @bkt to a bucket */
+	uint32_t ovf_num;	/* Overflow buckets after the first @num_bkts */
+	uint32_t ovf_used;
+	int shm_key;
+	uint32_t migrated;	/* Buckets of @old that have been moved here */
+	struct mica_index *old;	/* The index being migrated into this one */
+	/* Unlinked overflow buckets, oldest first, in a ring of @ovf_num:
+	 * @offset is the bucket */
+	mica_log_free_t *ovf_free;
+	uint32_t ovf_free_head;
+	uint32_t ovf_free_num;
+	uint64_t retired_at;	/* rdtsc of the end of the migration out of it */
+	struct mica_index *next_retired;
+} mica_index_t;
+
 typedef struct  {
-	struct mica_bkt *ht_index;
+	mica_index_t *index;
 	uint8_t *ht_log;
 
 	/* Metadata */
 	int instance_id;	/* ID of this MICA instance. Used for shm keys */
 	int node_id;
 
-	int num_bkts;	/* Number of buckets requested by user */
-	int bkt_mask;	/* Mask down from a mica_key's @bkt to a bucket */
-
-	uint64_t log_cap;	/* Capacity of circular log in bytes */
+	uint64_t log_cap;	/* Capacity of the log in bytes */
 	uint64_t log_mask;	/* Mask down from a slot's @offset to a log offset */
-
-	/* State */
-	uint64_t log_head;
+	uint64_t reclaim_grace;	/* MICA_RECLAIM_GRACE_MS in cycles */
+
+	/* State, written under @lock */
+	seqlock_t lock;
+	uint64_t log_head;	/* Log entries past it have never been used */
+	uint64_t num_keys;
+	mica_index_t *retired;	/* Migrated indexes, newest first, freed after the grace */
+	/* Deleted log entries, oldest first, in a ring that grows on demand */
+	mica_log_free_t *free_ring;
+	uint32_t free_cap;
+	uint32_t free_head;
+	uint32_t free_num;
 
 	/* Stats */
 	long long num_get_op;	/* Number of GET requests executed */
 	long long num_put_op;	/* Number of PUT requests executed */
 	long long num_get_fail;	/* Number of GET requests failed */
-	long long num_put_fail;	/* Number of GET requests failed */
-	long long num_insert_op;	/* Number of PUT requests executed */
-	long long num_index_evictions; /* Number of entries evicted from index */
+	long long num_put_fail;	/* Number of inserts that found no room */
+	long long num_insert_op;	/* Number of keys inserted */
+	long long num_delete_op;	/* Number of keys deleted */
+	long long num_resizes;	/* Number of times the index doubled */
 } mica_kv_t;
 
 extern mica_kv_t *KVS;
 
+typedef enum {
+	MICA_MATCH_SCALAR = 0,
+	MICA_MATCH_AVX2,
+	MICA_MATCH_AVX512
+} mica_match_isa_t;
+
+/* Picked by mica_init() */
+extern mica_match_isa_t mica_match_isa;
+
 
 
 void custom_mica_init(int kvs_id);
 void custom_mica_populate_fixed_len(mica_kv_t *, int n, int val_len);
+/* Online inserts and deletes, safe to call from any worker.
+ * mica_insert() returns the entry of the key, which is @op copied to the log
+ * if the key is new, or NULL if the store is full. */
+mica_op_t *mica_insert(mica_kv_t *kvs, mica_op_t *op);
+bool mica_delete(mica_kv_t *kvs, mica_key_t *key);
 
 
 /* ---------------------------------------------------------------------------
 //------------------------------ KVS UTILITY GENERIC -----------------------------
 //---------------------------------------------------------------------------*/
 
+// 16 bits of tag and 14 of server: readers stop at the first tag that matches,
+// so an insert fails if its tag is taken by another key of the bucket
+static inline uint32_t mica_key_tag(struct key *key)
+{
+	return key->tag | ((uint32_t) (key->server & 0x3FFF) << 16);
+}
+
+// The bucket of a key, in the old index if its bucket has not been migrated yet
+static inline struct mica_bkt *mica_key_bkt(mica_kv_t *kvs, struct key *key,
+																						uint *bkt)
+{
+	mica_index_t *index = __atomic_load_n(&kvs->index, __ATOMIC_ACQUIRE);
+	mica_index_t *old = __atomic_load_n(&index->old, __ATOMIC_ACQUIRE);
+	if (unlikely(old != NULL)) {
+		uint old_bkt = key->bkt & old->bkt_mask;
+		if (old_bkt >= __atomic_load_n(&index->migrated, __ATOMIC_ACQUIRE)) {
+			*bkt = old_bkt;
+			return &old->bkts[old_bkt];
+		}
+	}
+	*bkt = key->bkt & index->bkt_mask;
+	return &index->bkts[*bkt];
+}
+
+/* ---------------------------------------------------------------------------
+//------------------------------ TAG MATCHING -----------------------------
+//---------------------------------------------------------------------------*/
+// A bucket is one 64-byte line. The low 32 bits of a slot are in_use | tag << 1
+// (checked in mica_init), so a slot in use with @tag is one 32-bit compare.
+// The matchers return a mask with bit j set if slot j matches.
+
+static forceinline uint32_t mica_slot_word(uint32_t tag)
+{
+	return (tag << 1) | 1;
+}
+
+static forceinline uint32_t mica_bkt_match_scalar(struct mica_bkt *bkt, uint32_t tag)
+{
+	uint32_t word = mica_slot_word(tag), match = 0;
+	for (uint8_t j = 0; j < MICA_BKT_SLOTS; j++) {
+		uint64_t slot = __atomic_load_n((uint64_t *) &bkt->slots[j], __ATOMIC_RELAXED);
+		match |= (uint32_t) ((uint32_t) slot == word) << j;
+	}
+	return match;
+}
+
+#ifdef __x86_64__
+__attribute__((target("avx2")))
+static inline uint32_t mica_bkt_match_avx2(struct mica_bkt *bkt, uint32_t tag)
+{
+	const __m256i low = _mm256_set1_epi64x(0xFFFFFFFF);
+	const __m256i word = _mm256_set1_epi64x(mica_slot_word(tag));
+	__m256i lo = _mm256_loadu_si256((__m256i *) &bkt->slots[0]);
+	__m256i hi = _mm256_loadu_si256((__m256i *) &bkt->slots[4]);
+	lo = _mm256_cmpeq_epi64(_mm256_and_si256(lo, low), word);
+	hi = _mm256_cmpeq_epi64(_mm256_and_si256(hi, low), word);
+	return (uint32_t) _mm256_movemask_pd(_mm256_castsi256_pd(lo)) |
+				 (uint32_t) _mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4;
+}
+
+__attribute__((target("avx512f")))
+static inline uint32_t mica_bkt_match_avx512(struct mica_bkt *bkt, uint32_t tag)
+{
+	__m512i slots = _mm512_loadu_si512((void *) bkt);
+	slots = _mm512_and_si512(slots, _mm512_set1_epi64(0xFFFFFFFF));
+	return _mm512_cmpeq_epi64_mask(slots, _mm512_set1_epi64(mica_slot_word(tag)));
+}
+#endif
+
+static forceinline uint32_t mica_bkt_match(struct mica_bkt *bkt, uint32_t tag)
+{
+#ifdef __x86_64__
+	switch (mica_match_isa) {
+		case MICA_MATCH_AVX512:
+			return mica_bkt_match_avx512(bkt, tag);
+		case MICA_MATCH_AVX2:
+			return mica_bkt_match_avx2(bkt, tag);
+		default: break;
+	}
+#endif
+	return mica_bkt_match_scalar(bkt, tag);
+}
 
 // Locate the buckets for the requested keys
 static inline void KVS_locate_one_bucket(uint16_t op_i, uint *bkt, struct key *op_key,
 																				 struct mica_bkt **bkt_ptr, uint *tag,
 																				 mica_op_t **kv_ptr, mica_kv_t *KVS)
 {
-	bkt[op_i] = op_key->bkt & KVS->bkt_mask;
-	bkt_ptr[op_i] = &KVS->ht_index[bkt[op_i]];
+	bkt_ptr[op_i] = mica_key_bkt(KVS, op_key, &bkt[op_i]);
 //  printf("bkt %u \n", bkt[op_i]);
 	__builtin_prefetch(bkt_ptr[op_i], 0, 0);
-	tag[op_i] = op_key->tag;
+	tag[op_i] = mica_key_tag(op_key);
 	kv_ptr[op_i] = NULL;
 }
 
 // Locate the buckets for the requested keys
 
-// Locate a kv_pair inside a bucket: used in a loop for all kv-pairs
+// Locate a kv_pair inside a bucket and its overflow chain: used in a loop for all kv-pairs
 static inline void KVS_locate_one_kv_pair(int op_i, uint *tag, struct mica_bkt **bkt_ptr,
 																					mica_op_t **kv_ptr, mica_kv_t *KVS)
 {
-	for(uint8_t j = 0; j < 8; j++) {
-		if(bkt_ptr[op_i]->slots[j].in_use == 1 &&
-			 bkt_ptr[op_i]->slots[j].tag == tag[op_i] ) {
-
-
-			uint64_t log_offset = bkt_ptr[op_i]->slots[j].offset &
-														KVS->log_mask;
+	struct mica_bkt *bkt = bkt_ptr[op_i];
+	struct mica_slot slot;
+	while (true) {
+		uint32_t match = mica_bkt_match(bkt, tag[op_i]);
+		if (likely(match != 0)) {
+			/* A slot is published with one store: reload the matching one with
+			 * one load, and probe again if a writer changed it in between */
+			__atomic_load(&bkt->slots[__builtin_ctz(match)], &slot, __ATOMIC_ACQUIRE);
+			if (unlikely(slot.in_use == 0 || slot.tag != tag[op_i])) continue;
+			uint64_t log_offset = slot.offset & KVS->log_mask;
 			/*
-               * We can interpret the log entry as mica_op, even though it
-               * may not contain the full MICA_MAX_VALUE value.
-               */
+			 * We can interpret the log entry as mica_op, even though it
+			 * may not contain the full MICA_MAX_VALUE value.
+			 */
 			kv_ptr[op_i] = (mica_op_t *) &KVS->ht_log[log_offset];
 
 			/* Small values (1--64 bytes) can span 2 kvs lines */
 			__builtin_prefetch(kv_ptr[op_i], 0, 0);
 			__builtin_prefetch((uint8_t *) kv_ptr[op_i] + 64, 0, 0);
-
-			/* Detect if the head has wrapped around for this index entry */
-			if(KVS->log_head - bkt_ptr[op_i]->slots[j].offset >= KVS->log_cap) {
-				kv_ptr[op_i] = NULL;	/* If so, we mark it "not found" */
-			}
-
-			break;
+			return;
 		}
+		__atomic_load(&bkt->slots[MICA_CHAIN_SLOT], &slot, __ATOMIC_ACQUIRE);
+		if (likely(slot.in_use == 0 || slot.tag != MICA_CHAIN_TAG)) return;
+		bkt += (int32_t) slot.offset;
 	}
 }
 
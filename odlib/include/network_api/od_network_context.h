@@ -12,6 +12,7 @@
 #include "od_fifo.h"
 #include "od_generic_inline_util.h"
 #include "od_templates.h"
+#include "od_instr.h"
 typedef struct context context_t;
 
 typedef void (*insert_helper_t) (context_t *, void*, void *, uint32_t);
@@ -85,6 +86,12 @@ typedef struct per_qp_meta {
   uint8_t leader_m_id; // if there exist
 
   uint32_t ss_batch;
+  // adaptive coalescing: ss_batch moves in [min_ss_batch, max_ss_batch]
+  uint32_t min_ss_batch;
+  uint32_t max_ss_batch; // the send q was sized for it
+  uint32_t fill_ratio; // per mille, moving average over the sent messages
+  uint64_t hold_start; // cycles, 0 when no message is held
+  uint64_t hold_budget; // cycles
 
   // flow control
   uint16_t max_credits;
@@ -157,7 +164,9 @@ typedef struct context {
   rdma_context_t *rdma_ctx;
   char* local_ip;
   void* appl_ctx;
+  kvs_t *kvs; // the store selected at startup, see od_kvs_backend.h
   ctx_tmp_t* ctx_tmp;
+  od_instr_t *instr; // this worker's slot of w_instr
 } context_t;
 
 static void check_ctx(context_t *ctx)
@@ -0,0 +1,80 @@
+//
+// Busy-poll scheduler for the worker main loops
+//
+
+#ifndef ODYSSEY_OD_SCHED_H
+#define ODYSSEY_OD_SCHED_H
+
+#include "od_netw_func.h"
+
+/*
+ * A protocol registers the stages of its main loop once and then calls
+ * od_sched_run() in its while(true).
+ * A stage returns true if it did work or still has work queued up.
+ * A stage that comes back idle is skipped for the next 1, 2, 4 ..
+ * SCHED_MAX_BACKOFF iterations, until it finds work again, so that empty CQs
+ * stop being polled on every iteration. Stages added with OD_STAGE_ALWAYS
+ * (e.g. the trace injection, or sends, whose empty check is as cheap as a
+ * skip) run on every iteration.
+ * Every stage accounts its runs and cycles in the worker's od_instr_t.
+ */
+
+typedef bool (*od_stage_fn_t)(context_t *ctx, uint16_t arg);
+
+typedef enum {
+  OD_STAGE_BACKOFF = 0,
+  OD_STAGE_ALWAYS = 1
+} od_stage_flag_t;
+
+typedef struct od_stage {
+  od_stage_fn_t fn;
+  uint16_t arg;
+  od_stage_flag_t flag;
+  const char *name;
+  uint32_t backoff; // iterations to skip after the next idle run
+  uint32_t skip; // iterations left to skip
+} od_stage_t;
+
+typedef struct od_sched {
+  od_instr_t *instr;
+  uint16_t stage_num;
+  uint64_t iters;
+  od_stage_t stage[SCHED_MAX_STAGES];
+} od_sched_t;
+
+od_sched_t *od_sched_create(context_t *ctx);
+void od_sched_add(od_sched_t *sched, const char *name,
+                  od_stage_fn_t fn, uint16_t arg, od_stage_flag_t flag);
+
+/* The generic stages of the network API, arg is the qp_id */
+bool od_stage_send_broadcasts(context_t *ctx, uint16_t qp_id);
+bool od_stage_send_unicasts(context_t *ctx, uint16_t qp_id);
+bool od_stage_poll(context_t *ctx, uint16_t qp_id);
+bool od_stage_send_acks(context_t *ctx, uint16_t qp_id);
+
+static forceinline void od_sched_run(context_t *ctx, od_sched_t *sched)
+{
+  for (uint16_t st_i = 0; st_i < sched->stage_num; st_i++) {
+    od_stage_t *stage = &sched->stage[st_i];
+    if (ENABLE_SCHED_BACKOFF && stage->skip > 0) {
+      stage->skip--;
+      od_instr_stage_skipped(ctx->instr, st_i);
+      continue;
+    }
+
+    uint64_t start = ENABLE_INSTRUMENTATION ? (uint64_t) hrd_get_cycles() : 0;
+    bool busy = stage->fn(ctx, stage->arg);
+    if (ENABLE_INSTRUMENTATION)
+      od_instr_stage_ran(ctx->instr, st_i, (uint64_t) hrd_get_cycles() - start, busy);
+
+    if (busy || stage->flag == OD_STAGE_ALWAYS) stage->backoff = 0;
+    else {
+      stage->backoff = stage->backoff == 0 ? 1 :
+                       MIN(2 * stage->backoff, SCHED_MAX_BACKOFF);
+      stage->skip = stage->backoff;
+    }
+  }
+  sched->iters++;
+}
+
+#endif //ODYSSEY_OD_SCHED_H
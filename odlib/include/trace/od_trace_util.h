@@ -8,12 +8,38 @@
 #include "od_top.h"
 #include "od_city.h"
 
-
+/*
+ * Binary trace (TRACE_BIN_NAME): the header, then part_num + 1 partition
+ * offsets, then, from a 64-byte boundary, the trace_t records with the keys
+ * already hashed and the opcodes drawn. Partition g holds the trace of global
+ * thread g (GET_GLOBAL_T_ID) and ends with a NOP record, i.e. it is a
+ * ready-to-use trace_t array inside the read-only mapping.
+ */
+#define OD_TRACE_BIN_MAGIC 0x31525459444fULL // "ODYTR1"
+#define OD_TRACE_BIN_VERSION 1
+
+typedef struct od_trace_bin_hdr {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t rec_size; // sizeof(trace_t) of the writer
+  uint32_t part_num;
+  int32_t write_ratio; // the opcodes were drawn with
+  uint64_t rec_num; // over all partitions, including their NOPs
+  uint64_t part_offset[]; // in records, part_num + 1 entries
+} od_trace_bin_hdr_t;
+
+static inline uint64_t od_trace_bin_recs_start(uint32_t part_num)
+{
+  uint64_t hdr_size = sizeof(od_trace_bin_hdr_t) + (part_num + 1) * sizeof(uint64_t);
+  return (hdr_size + 63) & ~63ULL;
+}
 
 // Initiialize the trace
 trace_t* trace_init(uint16_t t_id);
 
-
+// Parses the text traces of all WORKER_NUM threads into a binary trace at
+// @out_path (--convert-trace), with the opcodes drawn as trace_init would
+void od_trace_convert(const char *out_path);
 
 
 
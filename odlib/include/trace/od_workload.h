@@ -0,0 +1,82 @@
+//
+// Workload generator of the manufactured traces
+//
+
+#ifndef OD_WORKLOAD_H
+#define OD_WORKLOAD_H
+
+#include "od_top.h"
+#include "od_hrd.h"
+
+/*
+ * Without --workload, the trace keeps the compile-time mix (WRITE_RATIO
+ * or --write-ratio, RANGE_RATIO, RMW_RATIO, SC_RATIO).
+ * --workload a..f selects one of the YCSB core mixes instead.
+ * Keys are drawn uniformly, zipfian (YCSB's generator, theta --zipf) or
+ * "latest" (zipfian over the keys this thread inserted most recently) from
+ * [0, --records), and --dist overrides the distribution of the mix.
+ * Every thread draws from its own generator: a hrd_fastrand() seed, with the
+ * zipf constants computed once per process.
+ */
+
+typedef enum {
+  OD_DIST_UNIFORM = 0,
+  OD_DIST_ZIPF,
+  OD_DIST_LATEST,
+  OD_DIST_NUM
+} od_key_dist_t;
+
+typedef enum {
+  OD_WL_READ = 0,
+  OD_WL_UPDATE,
+  OD_WL_INSERT,
+  OD_WL_SCAN,
+  OD_WL_RMW // read-modify-write
+} od_wl_op_t;
+
+// An operation mix, per mille of the ops
+typedef struct od_workload {
+  const char *name;
+  uint16_t read;
+  uint16_t update;
+  uint16_t insert;
+  uint16_t scan;
+  uint16_t rmw;
+  od_key_dist_t dist;
+} od_workload_t;
+
+typedef struct od_wl_cfg {
+  const od_workload_t *mix; // NULL for the compile-time mix
+  od_key_dist_t dist;
+  bool dist_is_set; // by --dist, overrides the dist of the mix
+  double zipf_theta;
+  uint32_t scan_len; // scans cover 1..scan_len keys
+  uint32_t record_num;
+} od_wl_cfg_t;
+
+extern od_wl_cfg_t wl_cfg;
+
+typedef struct od_wl_gen {
+  uint64_t seed;
+  uint32_t insert_head; // the key this thread inserted last
+} od_wl_gen_t;
+
+/* Command line, called from od_handle_program_inputs */
+void od_wl_set_workload(const char *name);
+void od_wl_set_dist(const char *name);
+/* After the inputs are parsed: checks them and precomputes the distributions */
+void od_wl_init(void);
+
+void od_wl_gen_init(od_wl_gen_t *gen, uint32_t g_t_id);
+od_wl_op_t od_wl_next_op(od_wl_gen_t *gen);
+uint32_t od_wl_next_key(od_wl_gen_t *gen);
+uint32_t od_wl_next_insert_key(od_wl_gen_t *gen);
+uint32_t od_wl_next_scan_len(od_wl_gen_t *gen);
+const char *od_wl_dist_name(od_key_dist_t dist);
+
+static inline uint32_t od_wl_rand(od_wl_gen_t *gen, uint32_t bound)
+{
+  return hrd_fastrand(&gen->seed) % bound;
+}
+
+#endif //OD_WORKLOAD_H
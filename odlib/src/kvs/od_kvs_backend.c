@@ -0,0 +1,97 @@
+#include "od_kvs_backend.h"
+
+
+static const kvs_mfs_t *kvs_backend_mfs[KVS_BACKEND_NUM] = {
+  [MICA_KVS] = &mica_kvs_mfs,
+  [BPLUS_KVS] = &bplus_kvs_mfs,
+  [SPLINTERDB_KVS] = &splinterdb_kvs_mfs,
+};
+
+kvs_backend_t od_kvs_backend_from_str(const char *name)
+{
+  for (int i = 0; i < KVS_BACKEND_NUM; ++i) {
+    if (strcmp(name, kvs_backend_mfs[i]->name) == 0)
+      return (kvs_backend_t) i;
+  }
+  my_printf(red, "Unknown kvs %s, use one of: ", name);
+  for (int i = 0; i < KVS_BACKEND_NUM; ++i)
+    my_printf(red, "%s ", kvs_backend_mfs[i]->name);
+  my_printf(red, "\n");
+  exit(EXIT_FAILURE);
+}
+
+const char *od_kvs_backend_name(kvs_backend_t type)
+{
+  assert(type < KVS_BACKEND_NUM);
+  return kvs_backend_mfs[type]->name;
+}
+
+kvs_env_merge_t kvs_env_merge = od_kvs_lww_merge;
+
+bool od_kvs_lww_merge(kvs_env_t *cur, const kvs_env_t *delta)
+{
+  if (compare_flat_ts(delta->version, delta->m_id,
+                      cur->version, cur->m_id) != GREATER)
+    return false;
+  cur->version = delta->version;
+  cur->m_id = delta->m_id;
+  cur->state = delta->state;
+  memcpy(cur->value, delta->value, VALUE_SIZE);
+  return true;
+}
+
+void od_kvs_set_env_merge(kvs_env_merge_t merge)
+{
+  assert(merge != NULL);
+  kvs_env_merge = merge;
+}
+
+static void od_kvs_mica_zero_init(mica_op_t *kv_ptr, const kvs_op_t *op) {}
+
+kvs_mica_init_t kvs_mica_init = od_kvs_mica_zero_init;
+
+void od_kvs_set_mica_init(kvs_mica_init_t init)
+{
+  assert(init != NULL);
+  kvs_mica_init = init;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+void od_kvs_sorted_dataset_keys(uint64_t *keys)
+{
+  for (uint32_t key_id = 0; key_id < KVS_NUM_KEYS; key_id++)
+    keys[key_id] = od_kvs_key_of_id(key_id);
+  qsort(keys, KVS_NUM_KEYS, sizeof(uint64_t), cmp_u64);
+}
+
+void od_kvs_init()
+{
+  assert(kvs_backend < KVS_BACKEND_NUM);
+  if (kvs_backend_mfs[kvs_backend]->init != NULL)
+    kvs_backend_mfs[kvs_backend]->init();
+}
+
+kvs_t *od_kvs_open(uint16_t t_id)
+{
+  assert(kvs_backend < KVS_BACKEND_NUM);
+  kvs_t *kvs = (kvs_t *) calloc(1, sizeof(kvs_t));
+  kvs->type = kvs_backend;
+  kvs->mfs = kvs_backend_mfs[kvs_backend];
+  kvs->t_id = t_id;
+  kvs->mfs->open(kvs);
+  if (t_id == 0)
+    my_printf(green, "Worker %u uses the %s kvs \n", t_id, kvs->mfs->name);
+  return kvs;
+}
+
+void od_kvs_close(kvs_t *kvs)
+{
+  if (kvs == NULL) return;
+  kvs->mfs->close(kvs);
+  free(kvs);
+}
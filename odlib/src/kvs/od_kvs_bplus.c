@@ -0,0 +1,214 @@
+#include "od_kvs_backend.h"
+
+// The B+-tree keys are big-endian encoded mica_key_ts (see od_kvs_encode_key)
+// and its values are kvs_env_ts.
+
+#define BPLUS_POPULATE_BATCH K_64
+
+// Opened once by main and shared by all workers: gets take no lock,
+// writers serialize inside the tree
+static bp_db_t bplus_shared_tree;
+
+static inline void bplus_fill_key(bp_key_t *bkey, uint8_t *enc_key,
+                                  mica_key_t *key)
+{
+  od_kvs_encode_key(key, enc_key);
+  bkey->length = KEY_SIZE;
+  bkey->value = (char *) enc_key;
+}
+
+// The envelope points into the tree's file mapping: copy out what the op asks for
+static void bplus_get_cb(void *arg, const bp_key_t *key,
+                         const bp_value_t *value)
+{
+  kvs_op_t *op = (kvs_op_t *) arg;
+  if (ENABLE_ASSERTIONS) assert(value->length == KVS_ENV_SIZE);
+  const kvs_env_t *env = (const kvs_env_t *) value->value;
+  if (op->value != NULL) memcpy(op->value, env->value, VALUE_SIZE);
+  if (op->env != NULL) memcpy(op->env, env, KVS_ENV_SIZE);
+}
+
+static void bplus_batch_get(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    kvs_op_t *op = &ops[op_i];
+    uint8_t enc_key[KEY_SIZE];
+    bp_key_t bkey;
+    bplus_fill_key(&bkey, enc_key, &op->key);
+    op->resp = bp_get_ref(kvs->tree, &bkey, bplus_get_cb, op) == BP_OK ?
+               KVS_GET_SUCCESS : KVS_MISS;
+  }
+}
+
+static void bplus_batch_put(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  kvs_env_t env = {0};
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    kvs_op_t *op = &ops[op_i];
+    if (ENABLE_ASSERTIONS) assert(op->value != NULL);
+    uint8_t enc_key[KEY_SIZE];
+    bp_key_t bkey;
+    bp_value_t bvalue = {.length = KVS_ENV_SIZE, .value = (char *) &env};
+    env.version = op->version;
+    env.m_id = op->m_id;
+    memcpy(env.value, op->value, VALUE_SIZE);
+    bplus_fill_key(&bkey, enc_key, &op->key);
+    op->resp = bp_set(kvs->tree, &bkey, &bvalue) == BP_OK ?
+               KVS_PUT_SUCCESS : KVS_MISS;
+  }
+}
+
+typedef struct bplus_merge_arg {
+  kvs_env_t *merged; // the buffer that bp_update stores
+  const kvs_env_t *delta;
+} bplus_merge_arg_t;
+
+// Runs under the tree's write lock, between loading the stored envelope
+// and saving the new one: returning 0 keeps the stored envelope.
+static int bplus_merge_cb(void *arg, const bp_value_t *previous,
+                          const bp_value_t *value)
+{
+  bplus_merge_arg_t *m_arg = (bplus_merge_arg_t *) arg;
+  if (ENABLE_ASSERTIONS) assert(previous->length == KVS_ENV_SIZE);
+  memcpy(m_arg->merged, previous->value, KVS_ENV_SIZE);
+  return kvs_env_merge(m_arg->merged, m_arg->delta);
+}
+
+// On success the merged envelope is copied to merged_out, if set
+static inline uint8_t bplus_update_one(kvs_t *kvs, mica_key_t *key,
+                                       const kvs_env_t *delta,
+                                       kvs_env_t *merged_out)
+{
+  uint8_t enc_key[KEY_SIZE];
+  bp_key_t bkey;
+  kvs_env_t merged = {0};
+  bplus_merge_arg_t m_arg = {.merged = &merged, .delta = delta};
+  bp_value_t bvalue = {.length = KVS_ENV_SIZE, .value = (char *) &merged};
+  bplus_fill_key(&bkey, enc_key, key);
+  // A key that is not in the tree gets the delta merged into an empty envelope
+  kvs_env_merge(&merged, delta);
+  int ret = bp_update(kvs->tree, &bkey, &bvalue, bplus_merge_cb, &m_arg);
+  if (ret == BP_OK) {
+    if (merged_out != NULL) memcpy(merged_out, &merged, KVS_ENV_SIZE);
+    return KVS_PUT_SUCCESS;
+  }
+  return ret == BP_EUPDATECONFLICT ? EMPTY : KVS_MISS;
+}
+
+// An op whose delta the merge rejects comes back with resp EMPTY,
+// one that it takes with the merged envelope in its env
+static void bplus_batch_update(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    kvs_op_t *op = &ops[op_i];
+    if (ENABLE_ASSERTIONS) assert(op->env != NULL);
+    op->resp = bplus_update_one(kvs, &op->key, op->env, op->env);
+  }
+}
+
+static void bplus_range_cb(void *arg, const bp_key_t *key,
+                           const bp_value_t *value)
+{
+  (*(uint32_t *) arg)++;
+}
+
+static void bplus_batch_range(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    kvs_op_t *op = &ops[op_i];
+    uint8_t enc_start[KEY_SIZE], enc_end[KEY_SIZE];
+    bp_key_t start, end;
+    bplus_fill_key(&start, enc_start, &op->key);
+    bplus_fill_key(&end, enc_end, &op->range_end);
+    op->range_cnt = 0;
+    int ret = bp_get_range(kvs->tree, &start, &end, bplus_range_cb, &op->range_cnt);
+    op->resp = ret == BP_OK ? KVS_GET_SUCCESS : KVS_MISS;
+  }
+}
+
+// Remote writes go through the registered merge, last writer wins by default
+static void bplus_batch_apply_remote(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  kvs_env_t delta = {0};
+  delta.kind = KVS_ENV_LWW;
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    kvs_op_t *op = &ops[op_i];
+    if (ENABLE_ASSERTIONS) assert(op->value != NULL);
+    delta.version = op->version;
+    delta.m_id = op->m_id;
+    memcpy(delta.value, op->value, VALUE_SIZE);
+    op->resp = bplus_update_one(kvs, &op->key, &delta, NULL);
+  }
+}
+
+static void bplus_batch_delete(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    kvs_op_t *op = &ops[op_i];
+    uint8_t enc_key[KEY_SIZE];
+    bp_key_t bkey;
+    bplus_fill_key(&bkey, enc_key, &op->key);
+    op->resp = bp_remove(kvs->tree, &bkey) == BP_OK ? KVS_DELETE_SUCCESS : KVS_MISS;
+  }
+}
+
+// Start every run from the same dataset that MICA holds
+static void bplus_kvs_init()
+{
+  bp_db_t *tree = &bplus_shared_tree;
+  unlink(BPLUS_FILE_NAME);
+  if (bp_open(tree, BPLUS_FILE_NAME) != BP_OK) {
+    my_printf(red, "Unable to create the B+-tree at %s \n", BPLUS_FILE_NAME);
+    exit(EXIT_FAILURE);
+  }
+  uint64_t *keys = (uint64_t *) malloc(KVS_NUM_KEYS * sizeof(uint64_t));
+  uint8_t *enc_keys = (uint8_t *) malloc(BPLUS_POPULATE_BATCH * KEY_SIZE);
+  bp_key_t *bkeys = (bp_key_t *) calloc(BPLUS_POPULATE_BATCH, sizeof(bp_key_t));
+  bp_value_t *bvalues = (bp_value_t *) calloc(BPLUS_POPULATE_BATCH, sizeof(bp_value_t));
+  kvs_env_t *env = (kvs_env_t *) calloc(1, KVS_ENV_SIZE);
+  od_kvs_sorted_dataset_keys(keys);
+
+  // bulk inserts expect sorted keys
+  for (uint32_t key_i = 0; key_i < KVS_NUM_KEYS; key_i += BPLUS_POPULATE_BATCH) {
+    uint32_t batch = MIN(BPLUS_POPULATE_BATCH, KVS_NUM_KEYS - key_i);
+    for (uint32_t b_i = 0; b_i < batch; b_i++) {
+      od_kvs_encode_u64(keys[key_i + b_i], &enc_keys[b_i * KEY_SIZE]);
+      bkeys[b_i].length = KEY_SIZE;
+      bkeys[b_i].value = (char *) &enc_keys[b_i * KEY_SIZE];
+      bvalues[b_i].length = KVS_ENV_SIZE;
+      bvalues[b_i].value = (char *) env;
+    }
+    const bp_key_t *keys_ptr = bkeys;
+    const bp_value_t *values_ptr = bvalues;
+    if (bp_bulk_set(tree, batch, &keys_ptr, &values_ptr) != BP_OK) {
+      my_printf(red, "Unable to populate the B+-tree at %s \n", BPLUS_FILE_NAME);
+      exit(EXIT_FAILURE);
+    }
+  }
+  my_printf(green, "Populated the B+-tree with %d keys \n", KVS_NUM_KEYS);
+  free(keys); free(enc_keys); free(bkeys); free(bvalues); free(env);
+  bp_set_auto_compact(tree, BPLUS_MAX_SPACE_AMP);
+}
+
+static void bplus_kvs_open(kvs_t *kvs)
+{
+  kvs->tree = &bplus_shared_tree;
+}
+
+static void bplus_kvs_close(kvs_t *kvs)
+{
+  kvs->tree = NULL;
+}
+
+const kvs_mfs_t bplus_kvs_mfs = {
+  .name = "bplus",
+  .batch_get = bplus_batch_get,
+  .batch_put = bplus_batch_put,
+  .batch_range = bplus_batch_range,
+  .batch_apply_remote = bplus_batch_apply_remote,
+  .batch_update = bplus_batch_update,
+  .batch_delete = bplus_batch_delete,
+  .init = bplus_kvs_init,
+  .open = bplus_kvs_open,
+  .close = bplus_kvs_close,
+};
@@ -0,0 +1,101 @@
+#include "od_kvs_backend.h"
+
+// MICA is a hash index: it can resolve keys in bulk, prefetching
+// the buckets first, but it has no notion of key order.
+
+static inline void mica_locate_batch(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  uint bkt[KVS_MAX_BATCH];
+  struct mica_bkt *bkt_ptr[KVS_MAX_BATCH];
+  uint tag[KVS_MAX_BATCH];
+  mica_op_t *kv_ptr[KVS_MAX_BATCH];
+  if (ENABLE_ASSERTIONS) assert(op_num <= KVS_MAX_BATCH);
+
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    KVS_locate_one_bucket(op_i, bkt, &ops[op_i].key, bkt_ptr, tag, kv_ptr, kvs->mica);
+  }
+  KVS_locate_all_kv_pairs(op_num, tag, bkt_ptr, kv_ptr, kvs->mica);
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    ops[op_i].kv_ptr = kv_ptr[op_i];
+    ops[op_i].resp = kv_ptr[op_i] == NULL ? KVS_MISS : EMPTY;
+  }
+}
+
+static void mica_batch_get(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  mica_locate_batch(kvs, ops, op_num);
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    kvs_op_t *op = &ops[op_i];
+    if (op->kv_ptr == NULL || op->value == NULL) continue;
+    KVS_local_read(op->kv_ptr, op->value, &op->resp, kvs->t_id);
+  }
+}
+
+// A key that is not in the store is inserted, in a zeroed mica_op_t
+static void mica_batch_put(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  mica_locate_batch(kvs, ops, op_num);
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    kvs_op_t *op = &ops[op_i];
+    if (op->value == NULL) continue;
+    if (op->kv_ptr == NULL) {
+      mica_op_t new_op;
+      memset(&new_op, 0, sizeof(mica_op_t));
+      new_op.key = op->key;
+      new_op.key_id = op->key_id;
+      memcpy(new_op.value, op->value, (size_t) VALUE_SIZE);
+      kvs_mica_init(&new_op, op);
+      op->kv_ptr = mica_insert(kvs->mica, &new_op);
+      if (op->kv_ptr == NULL) continue; // the store is full
+    }
+    KVS_write(op->kv_ptr, op->value);
+    op->resp = KVS_PUT_SUCCESS;
+  }
+}
+
+static void mica_batch_delete(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    ops[op_i].kv_ptr = NULL;
+    ops[op_i].resp = mica_delete(kvs->mica, &ops[op_i].key) ?
+                     KVS_DELETE_SUCCESS : KVS_MISS;
+  }
+}
+
+static void mica_batch_range(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    ops[op_i].range_cnt = 0;
+    ops[op_i].resp = KVS_MISS;
+  }
+}
+
+// Conflict resolution of remote writes is protocol specific, as each
+// protocol defines its own mica_op_t: only hand back the entries.
+static void mica_batch_apply_remote(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  mica_locate_batch(kvs, ops, op_num);
+}
+
+static void mica_kvs_open(kvs_t *kvs)
+{
+  // The index is shared by all workers, see custom_mica_init()
+  assert(KVS != NULL);
+  kvs->mica = KVS;
+}
+
+static void mica_kvs_close(kvs_t *kvs)
+{
+  kvs->mica = NULL;
+}
+
+const kvs_mfs_t mica_kvs_mfs = {
+  .name = "mica",
+  .batch_get = mica_batch_get,
+  .batch_put = mica_batch_put,
+  .batch_range = mica_batch_range,
+  .batch_apply_remote = mica_batch_apply_remote,
+  .batch_delete = mica_batch_delete,
+  .open = mica_kvs_open,
+  .close = mica_kvs_close,
+};
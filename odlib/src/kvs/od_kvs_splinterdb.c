@@ -0,0 +1,329 @@
+#include "od_kvs_backend.h"
+#include "default_data_config.h"
+
+// SplinterDB keys are big-endian encoded mica_key_ts (see od_kvs_encode_key),
+// compared lexicographically, and its values are kvs_env_ts.
+// Envelopes are only ever INSERTed: an update looks the envelope up, merges
+// its delta with kvs_env_merge and inserts the result, under the stripe of
+// the key in spl_key_locks, so that its caller learns whether the merge took
+// the delta before acting on it (e.g. before Hermes broadcasts an INV).
+
+static data_config spl_data_cfg;
+static splinterdb *spl_shared_handle = NULL;
+// Set from SPL_GETS: async lookups only pay off when lookups miss in the cache
+static bool spl_async_gets = false;
+static seqlock_t spl_key_locks[SPL_KEY_LOCKS];
+
+static inline slice spl_key_slice(uint8_t *enc_key, mica_key_t *key)
+{
+  od_kvs_encode_key(key, enc_key);
+  return slice_create(KEY_SIZE, (const void *) enc_key);
+}
+
+// An async lookup slot of a worker: op_i is the batch op it serves
+typedef struct spl_async_slot {
+  splinterdb_async_lookup *lookup;
+  splinterdb_lookup_result result;
+  int32_t op_i;
+} spl_async_slot_t;
+
+static inline void spl_complete_get(kvs_op_t *op,
+                                    splinterdb_lookup_result *result)
+{
+  if (!splinterdb_lookup_found(result)) {
+    op->resp = KVS_MISS;
+    return;
+  }
+  slice value;
+  splinterdb_lookup_result_value(result, &value);
+  if (ENABLE_ASSERTIONS) assert(slice_length(value) == KVS_ENV_SIZE);
+  const kvs_env_t *env = (const kvs_env_t *) slice_data(value);
+  if (op->value != NULL) memcpy(op->value, env->value, VALUE_SIZE);
+  if (op->env != NULL) memcpy(op->env, env, KVS_ENV_SIZE);
+  op->resp = KVS_GET_SUCCESS;
+}
+
+static inline void spl_start_get(kvs_t *kvs, spl_async_slot_t *slot,
+                                 kvs_op_t *ops, int32_t op_i)
+{
+  uint8_t enc_key[KEY_SIZE];
+  slot->op_i = op_i;
+  if (splinterdb_lookup_async_start(kvs->spl_handle,
+                                    spl_key_slice(enc_key, &ops[op_i].key),
+                                    &slot->result, slot->lookup) != 0) {
+    ops[op_i].resp = KVS_MISS;
+    slot->op_i = -1;
+  }
+}
+
+// All lookups of the batch are started up front, up to SPL_ASYNC_INFLIGHT
+// at a time: the ones that hit in the cache complete on the spot, the rest
+// complete as their pages arrive and free their slot for the next op.
+static void spl_async_batch_get(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  spl_async_slot_t *slots = kvs->spl_slots;
+  uint16_t next_op = 0, inflight = 0;
+  for (uint16_t s_i = 0; s_i < SPL_ASYNC_INFLIGHT; s_i++) {
+    slots[s_i].op_i = -1;
+    if (next_op < op_num) {
+      spl_start_get(kvs, &slots[s_i], ops, next_op++);
+      if (slots[s_i].op_i >= 0) inflight++;
+    }
+  }
+  while (inflight > 0) {
+    for (uint16_t s_i = 0; s_i < SPL_ASYNC_INFLIGHT; s_i++) {
+      spl_async_slot_t *slot = &slots[s_i];
+      if (slot->op_i < 0 ||
+          !splinterdb_lookup_async_poll(kvs->spl_handle, slot->lookup))
+        continue;
+      spl_complete_get(&ops[slot->op_i], &slot->result);
+      slot->op_i = -1;
+      inflight--;
+      if (next_op < op_num) {
+        spl_start_get(kvs, slot, ops, next_op++);
+        if (slot->op_i >= 0) inflight++;
+      }
+    }
+    if (inflight > 0) splinterdb_async_io_poll(kvs->spl_handle);
+  }
+}
+
+// The keys of a batch share the memtable lock and their trunk walk
+static void spl_sync_batch_get(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  for (uint16_t start = 0; start < op_num; start += SPLINTERDB_MAX_BATCH) {
+    uint16_t chunk = MIN(op_num - start, SPLINTERDB_MAX_BATCH);
+    uint8_t enc_keys[SPLINTERDB_MAX_BATCH][KEY_SIZE];
+    slice keys[SPLINTERDB_MAX_BATCH];
+    for (uint16_t i = 0; i < chunk; i++)
+      keys[i] = spl_key_slice(enc_keys[i], &ops[start + i].key);
+    if (splinterdb_lookup_batch(kvs->spl_handle, chunk, keys, kvs->spl_results) != 0) {
+      for (uint16_t i = 0; i < chunk; i++) ops[start + i].resp = KVS_MISS;
+      continue;
+    }
+    for (uint16_t i = 0; i < chunk; i++)
+      spl_complete_get(&ops[start + i], &kvs->spl_results[i]);
+  }
+}
+
+static void spl_batch_get(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  if (spl_async_gets) spl_async_batch_get(kvs, ops, op_num);
+  else spl_sync_batch_get(kvs, ops, op_num);
+}
+
+// Blind writes, SPLINTERDB_MAX_BATCH at a time
+static void spl_batch_put(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  for (uint16_t start = 0; start < op_num; start += SPLINTERDB_MAX_BATCH) {
+    uint16_t chunk = MIN(op_num - start, SPLINTERDB_MAX_BATCH);
+    uint8_t enc_keys[SPLINTERDB_MAX_BATCH][KEY_SIZE];
+    kvs_env_t envs[SPLINTERDB_MAX_BATCH];
+    slice keys[SPLINTERDB_MAX_BATCH], values[SPLINTERDB_MAX_BATCH];
+    for (uint16_t i = 0; i < chunk; i++) {
+      kvs_op_t *op = &ops[start + i];
+      if (ENABLE_ASSERTIONS) assert(op->value != NULL);
+      keys[i] = spl_key_slice(enc_keys[i], &op->key);
+      memset(&envs[i], 0, KVS_ENV_SIZE);
+      envs[i].version = op->version;
+      envs[i].m_id = op->m_id;
+      memcpy(envs[i].value, op->value, VALUE_SIZE);
+      values[i] = slice_create(KVS_ENV_SIZE, &envs[i]);
+    }
+    int rc = splinterdb_insert_batch(kvs->spl_handle, chunk, keys, values);
+    for (uint16_t i = 0; i < chunk; i++)
+      ops[start + i].resp = rc == 0 ? KVS_PUT_SUCCESS : KVS_MISS;
+  }
+}
+
+// On success the merged envelope is copied to merged_out, if set.
+// A key that is not in the store gets the delta merged into an empty envelope.
+static inline uint8_t spl_update_one(kvs_t *kvs, mica_key_t *mica_key,
+                                     const kvs_env_t *delta,
+                                     kvs_env_t *merged_out)
+{
+  splinterdb_lookup_result *result = &kvs->spl_results[0];
+  uint8_t enc_key[KEY_SIZE];
+  slice key = spl_key_slice(enc_key, mica_key);
+  kvs_env_t merged;
+  memset(&merged, 0, KVS_ENV_SIZE);
+  uint8_t resp = KVS_PUT_SUCCESS;
+  seqlock_t *lock = &spl_key_locks[mica_key->bkt & (SPL_KEY_LOCKS - 1)];
+  lock_seqlock(lock);
+  if (splinterdb_lookup(kvs->spl_handle, key, result) != 0) resp = KVS_MISS;
+  else {
+    if (splinterdb_lookup_found(result)) {
+      slice value;
+      splinterdb_lookup_result_value(result, &value);
+      if (ENABLE_ASSERTIONS) assert(slice_length(value) == KVS_ENV_SIZE);
+      memcpy(&merged, slice_data(value), KVS_ENV_SIZE);
+    }
+    if (!kvs_env_merge(&merged, delta)) resp = EMPTY;
+    else if (splinterdb_insert(kvs->spl_handle, key,
+                               slice_create(KVS_ENV_SIZE, &merged)) != 0)
+      resp = KVS_MISS;
+  }
+  unlock_seqlock(lock);
+  if (resp == KVS_PUT_SUCCESS && merged_out != NULL)
+    memcpy(merged_out, &merged, KVS_ENV_SIZE);
+  return resp;
+}
+
+// An op whose delta the merge rejects comes back with resp EMPTY,
+// one that it takes with the merged envelope in its env
+static void spl_batch_update(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    kvs_op_t *op = &ops[op_i];
+    if (ENABLE_ASSERTIONS) assert(op->env != NULL);
+    op->resp = spl_update_one(kvs, &op->key, op->env, op->env);
+  }
+}
+
+// SplinterDB iterators have no upper bound: stop once we walk past range_end
+static void spl_batch_range(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    kvs_op_t *op = &ops[op_i];
+    splinterdb_iterator *it = NULL;
+    uint8_t enc_start[KEY_SIZE], enc_end[KEY_SIZE];
+    od_kvs_encode_key(&op->range_end, enc_end);
+    op->range_cnt = 0;
+    int rc = splinterdb_iterator_init(kvs->spl_handle, &it,
+                                      spl_key_slice(enc_start, &op->key));
+    if (rc != 0) {
+      op->resp = KVS_MISS;
+      continue;
+    }
+    for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+      slice key, value;
+      splinterdb_iterator_get_current(it, &key, &value);
+      if (memcmp(slice_data(key), enc_end,
+                 MIN(slice_length(key), (uint64_t) KEY_SIZE)) > 0)
+        break;
+      op->range_cnt++;
+    }
+    rc = splinterdb_iterator_status(it);
+    splinterdb_iterator_deinit(it);
+    op->resp = rc == 0 ? KVS_GET_SUCCESS : KVS_MISS;
+  }
+}
+
+// Remote writes go through the registered merge, last writer wins by default
+static void spl_batch_apply_remote(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  kvs_env_t delta;
+  memset(&delta, 0, KVS_ENV_SIZE);
+  delta.kind = KVS_ENV_LWW;
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    kvs_op_t *op = &ops[op_i];
+    if (ENABLE_ASSERTIONS) assert(op->value != NULL);
+    delta.version = op->version;
+    delta.m_id = op->m_id;
+    memcpy(delta.value, op->value, VALUE_SIZE);
+    op->resp = spl_update_one(kvs, &op->key, &delta, NULL);
+  }
+}
+
+// Deletes are blind: a key that is not in the store also gets a tombstone
+static void spl_batch_delete(kvs_t *kvs, kvs_op_t *ops, uint16_t op_num)
+{
+  for (uint16_t op_i = 0; op_i < op_num; op_i++) {
+    uint8_t enc_key[KEY_SIZE];
+    int rc = splinterdb_delete(kvs->spl_handle, spl_key_slice(enc_key, &ops[op_i].key));
+    ops[op_i].resp = rc == 0 ? KVS_DELETE_SUCCESS : KVS_MISS;
+  }
+}
+
+// Created once by main: all workers share its cache and background threads
+static void spl_kvs_init()
+{
+  default_data_config_init(SPL_MAX_KEY_SIZE, &spl_data_cfg);
+  splinterdb_config cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.filename   = SPL_DB_FILE_NAME;
+  cfg.disk_size  = ((uint64) SPL_DB_FILE_SIZE_MB * 1024 * 1024);
+  cfg.cache_size = ((uint64) SPL_CACHE_SIZE_MB * 1024 * 1024);
+  cfg.data_cfg   = &spl_data_cfg;
+  cfg.num_memtable_bg_threads = SPL_MEMTABLE_BG_THREADS;
+  cfg.num_normal_bg_threads = SPL_NORMAL_BG_THREADS;
+  if (splinterdb_create(&cfg, &spl_shared_handle) != 0) {
+    my_printf(red, "Unable to create SplinterDB %s \n", SPL_DB_FILE_NAME);
+    exit(EXIT_FAILURE);
+  }
+  if (SPL_GETS == SPL_GETS_AUTO)
+    spl_async_gets = (uint64_t) KVS_NUM_KEYS * KVS_ENV_SIZE >
+                     (uint64_t) SPL_CACHE_SIZE_MB * 1024 * 1024;
+  else spl_async_gets = SPL_GETS == SPL_GETS_ASYNC;
+  my_printf(green, "Created SplinterDB %s, cache %d MB, bg threads %d/%d, %s lookups \n",
+            SPL_DB_FILE_NAME, SPL_CACHE_SIZE_MB,
+            SPL_MEMTABLE_BG_THREADS, SPL_NORMAL_BG_THREADS,
+            spl_async_gets ? "async" : "batched");
+
+  // Start from the same dataset that MICA holds
+  uint8_t enc_keys[SPLINTERDB_MAX_BATCH][KEY_SIZE];
+  slice keys[SPLINTERDB_MAX_BATCH], values[SPLINTERDB_MAX_BATCH];
+  kvs_env_t *env = (kvs_env_t *) calloc(1, KVS_ENV_SIZE);
+  for (uint32_t key_id = 0; key_id < KVS_NUM_KEYS; key_id += SPLINTERDB_MAX_BATCH) {
+    uint32_t chunk = MIN(KVS_NUM_KEYS - key_id, SPLINTERDB_MAX_BATCH);
+    for (uint32_t i = 0; i < chunk; i++) {
+      od_kvs_encode_u64(od_kvs_key_of_id(key_id + i), enc_keys[i]);
+      keys[i] = slice_create(KEY_SIZE, enc_keys[i]);
+      values[i] = slice_create(KVS_ENV_SIZE, env);
+    }
+    if (splinterdb_insert_batch(spl_shared_handle, chunk, keys, values) != 0) {
+      my_printf(red, "Unable to populate SplinterDB %s \n", SPL_DB_FILE_NAME);
+      exit(EXIT_FAILURE);
+    }
+  }
+  free(env);
+  my_printf(green, "Populated SplinterDB with %d keys \n", KVS_NUM_KEYS);
+}
+
+static void spl_kvs_open(kvs_t *kvs)
+{
+  assert(spl_shared_handle != NULL);
+  splinterdb_register_thread(spl_shared_handle);
+  kvs->spl_handle = spl_shared_handle;
+  kvs->spl_slots = (spl_async_slot_t *) calloc(SPL_ASYNC_INFLIGHT, sizeof(spl_async_slot_t));
+  for (uint16_t s_i = 0; s_i < SPL_ASYNC_INFLIGHT; s_i++) {
+    if (splinterdb_async_lookup_create(kvs->spl_handle, &kvs->spl_slots[s_i].lookup) != 0) {
+      my_printf(red, "Worker %u: unable to create SplinterDB async lookups \n", kvs->t_id);
+      exit(EXIT_FAILURE);
+    }
+    splinterdb_lookup_result_init(kvs->spl_handle, &kvs->spl_slots[s_i].result, 0, NULL);
+  }
+  kvs->spl_results = (splinterdb_lookup_result *)
+    calloc(SPLINTERDB_MAX_BATCH, sizeof(splinterdb_lookup_result));
+  for (uint16_t r_i = 0; r_i < SPLINTERDB_MAX_BATCH; r_i++)
+    splinterdb_lookup_result_init(kvs->spl_handle, &kvs->spl_results[r_i], 0, NULL);
+}
+
+static void spl_kvs_close(kvs_t *kvs)
+{
+  for (uint16_t s_i = 0; s_i < SPL_ASYNC_INFLIGHT; s_i++) {
+    splinterdb_lookup_result_deinit(&kvs->spl_slots[s_i].result);
+    splinterdb_async_lookup_destroy(kvs->spl_handle, kvs->spl_slots[s_i].lookup);
+  }
+  free(kvs->spl_slots);
+  kvs->spl_slots = NULL;
+  for (uint16_t r_i = 0; r_i < SPLINTERDB_MAX_BATCH; r_i++)
+    splinterdb_lookup_result_deinit(&kvs->spl_results[r_i]);
+  free(kvs->spl_results);
+  kvs->spl_results = NULL;
+  splinterdb_deregister_thread(kvs->spl_handle);
+  kvs->spl_handle = NULL;
+}
+
+const kvs_mfs_t splinterdb_kvs_mfs = {
+  .name = "splinterdb",
+  .batch_get = spl_batch_get,
+  .batch_put = spl_batch_put,
+  .batch_range = spl_batch_range,
+  .batch_apply_remote = spl_batch_apply_remote,
+  .batch_update = spl_batch_update,
+  .batch_delete = spl_batch_delete,
+  .init = spl_kvs_init,
+  .open = spl_kvs_open,
+  .close = spl_kvs_close,
+};
@@ -139,6 +139,7 @@ hrd_ctrl_blk_init(int local_hid, int port_index,
 int hrd_ctrl_blk_destroy(hrd_ctrl_blk_t *cb)
 {
 	int i;
+	if (ENABLE_LOOPBACK) return hrd_lb_ctrl_blk_destroy(cb);
   my_printf(red, "HRD: Destroying control block %d\n", cb->local_hid);
 
 	/* Destroy QPs and CQs. QPs must be destroyed before CQs. */
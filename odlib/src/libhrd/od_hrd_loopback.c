@@ -0,0 +1,459 @@
+#include "od_hrd.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Loopback transport: emulates the UD datagram QPs of a control block over
+ * shared memory, so that MACHINE_NUM machines can run as processes on one host.
+ *
+ * Every worker owns one shared memory segment (LOOPBACK_SHM_NAME) with a
+ * single-producer/single-consumer ring per (QP, sending machine). A send copies
+ * the payload into the ring of the destination QP; polling the recv CQ copies
+ * it into the next posted recv, behind a GRH_SIZE gap like a UD recv.
+ * Like UD, a message that finds its ring full is dropped; flow control is left
+ * to the protocols' credits. Signaled sends complete as soon as they are
+ * copied.
+ */
+
+#define HRD_LB_MAGIC 0x6f646c62 /* "odlb": the segment is initialized */
+#define HRD_LB_CACHE_LINE 64
+
+typedef struct hrd_lb_slot_hdr {
+	uint32_t len;
+	uint32_t imm_data;
+	uint32_t src_qpn;
+	uint32_t flags; /* IBV_WC_WITH_IMM */
+} hrd_lb_slot_hdr_t;
+
+typedef struct hrd_lb_ring {
+	atomic_uint_fast64_t tail; /* written by the sender only */
+	uint8_t pad0[HRD_LB_CACHE_LINE - sizeof(atomic_uint_fast64_t)];
+	atomic_uint_fast64_t head; /* written by the receiver only */
+	uint8_t pad1[HRD_LB_CACHE_LINE - sizeof(atomic_uint_fast64_t)];
+	uint32_t slot_num; /* power of 2 */
+	uint32_t slot_size;
+	uint64_t offset; /* of the first slot, from the start of the segment */
+	uint8_t pad2[HRD_LB_CACHE_LINE - 16];
+} hrd_lb_ring_t;
+
+typedef struct hrd_lb_seg {
+	atomic_int ready;
+	pid_t owner;
+	uint32_t num_qps;
+	uint64_t size;
+	uint8_t pad[HRD_LB_CACHE_LINE - 24];
+	hrd_lb_ring_t rings[]; /* [num_qps][MACHINE_NUM], indexed by the sender */
+} hrd_lb_seg_t;
+
+typedef struct hrd_lb_recv {
+	uint64_t wr_id;
+	uintptr_t addr;
+	uint32_t length;
+} hrd_lb_recv_t;
+
+typedef struct hrd_lb_dev hrd_lb_dev_t;
+typedef struct hrd_lb_qp hrd_lb_qp_t;
+
+typedef struct hrd_lb_cq {
+	struct ibv_cq cq; /* must be first: the verbs only see this */
+	hrd_lb_qp_t *qp;
+	bool is_send;
+	uint32_t signaled; /* send completions not polled yet */
+} hrd_lb_cq_t;
+
+struct hrd_lb_qp {
+	struct ibv_qp qp; /* must be first: the verbs only see this */
+	hrd_lb_dev_t *dev;
+	uint16_t qp_id;
+	hrd_lb_cq_t send_cq;
+	hrd_lb_cq_t recv_cq;
+
+	/* posted recvs, consumed in order */
+	hrd_lb_recv_t *recvs;
+	uint32_t recv_cap;
+	uint32_t recv_pull;
+	uint32_t recv_cnt;
+
+	uint16_t next_src; /* round-robin over the sending machines */
+	uint64_t dropped;
+};
+
+struct hrd_lb_dev {
+	struct ibv_context ctx; /* must be first: cb->ctx points to it */
+	int machine_id;
+	int worker_id;
+	int num_qps;
+	char name[64];
+	hrd_lb_seg_t *seg; /* our own rings */
+	hrd_lb_seg_t *peer[MACHINE_NUM]; /* the same worker on every machine */
+	hrd_lb_qp_t *qps;
+};
+
+static inline hrd_lb_ring_t *hrd_lb_ring(hrd_lb_seg_t *seg, uint16_t qp_id,
+										 int src_machine)
+{
+	return &seg->rings[qp_id * MACHINE_NUM + src_machine];
+}
+
+static inline uint8_t *hrd_lb_slot(hrd_lb_seg_t *seg, hrd_lb_ring_t *ring,
+								   uint64_t pos)
+{
+	return (uint8_t *) seg + ring->offset +
+		   (pos & (ring->slot_num - 1)) * ring->slot_size;
+}
+
+uint32_t hrd_lb_qpn(int machine_id, int worker_id, int qp_id)
+{
+	assert(machine_id < 256 && worker_id < 256 && qp_id < 256);
+	return (uint32_t) ((machine_id << 16) | (worker_id << 8) | qp_id);
+}
+
+struct ibv_mr *hrd_lb_reg_mr(void *buf, uint32_t size)
+{
+	struct ibv_mr *mr = calloc(1, sizeof(struct ibv_mr));
+	assert(mr != NULL);
+	mr->addr = buf;
+	mr->length = size;
+	return mr;
+}
+
+/*-----------------------------------------------------------------------
+ * ----------------------------VERBS-----------------------------------
+ * ----------------------------------------------------------------------- */
+
+static int hrd_lb_post_send(struct ibv_qp *ibv_qp, struct ibv_send_wr *wr,
+							struct ibv_send_wr **bad_wr)
+{
+	hrd_lb_qp_t *qp = (hrd_lb_qp_t *) ibv_qp;
+	hrd_lb_dev_t *dev = qp->dev;
+
+	for (; wr != NULL; wr = wr->next) {
+		uint32_t rm_id = wr->wr.ud.remote_qpn >> 16;
+		uint16_t rqp_id = (uint16_t) (wr->wr.ud.remote_qpn & 0xff);
+		uint32_t len = wr->num_sge > 0 ? wr->sg_list->length : 0;
+		if (ENABLE_ASSERTIONS) {
+			assert(wr->num_sge <= 1);
+			assert(rm_id < MACHINE_NUM && dev->peer[rm_id] != NULL);
+			assert(((wr->wr.ud.remote_qpn >> 8) & 0xff) == dev->worker_id);
+		}
+
+		hrd_lb_seg_t *seg = dev->peer[rm_id];
+		hrd_lb_ring_t *ring = hrd_lb_ring(seg, rqp_id, dev->machine_id);
+		uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+		if (tail - head == ring->slot_num) {
+			// UD drops what the receiver has no room for
+			if (ENABLE_ASSERTIONS && qp->dropped == 0)
+				my_printf(red, "Loopback: wrkr %d qp %u dropped a message to machine %u\n",
+						  dev->worker_id, qp->qp_id, rm_id);
+			qp->dropped++;
+		}
+		else {
+			uint8_t *slot = hrd_lb_slot(seg, ring, tail);
+			hrd_lb_slot_hdr_t *hdr = (hrd_lb_slot_hdr_t *) slot;
+			assert(sizeof(hrd_lb_slot_hdr_t) + len <= ring->slot_size);
+			hdr->len = len;
+			hdr->src_qpn = qp->qp.qp_num;
+			hdr->imm_data = wr->imm_data;
+			hdr->flags = wr->opcode == IBV_WR_SEND_WITH_IMM ? IBV_WC_WITH_IMM : 0;
+			if (len > 0)
+				memcpy(slot + sizeof(hrd_lb_slot_hdr_t),
+					   (void *) (uintptr_t) wr->sg_list->addr, len);
+			atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+		}
+
+		if (wr->send_flags & IBV_SEND_SIGNALED) qp->send_cq.signaled++;
+	}
+	*bad_wr = NULL;
+	return 0;
+}
+
+static int hrd_lb_post_recv(struct ibv_qp *ibv_qp, struct ibv_recv_wr *wr,
+							struct ibv_recv_wr **bad_wr)
+{
+	hrd_lb_qp_t *qp = (hrd_lb_qp_t *) ibv_qp;
+
+	for (; wr != NULL; wr = wr->next) {
+		if (qp->recv_cnt == qp->recv_cap) {
+			*bad_wr = wr;
+			return ENOMEM;
+		}
+		hrd_lb_recv_t *recv =
+			&qp->recvs[(qp->recv_pull + qp->recv_cnt) % qp->recv_cap];
+		recv->wr_id = wr->wr_id;
+		recv->addr = wr->sg_list->addr;
+		recv->length = wr->sg_list->length;
+		qp->recv_cnt++;
+	}
+	*bad_wr = NULL;
+	return 0;
+}
+
+static int hrd_lb_poll_recv_cq(hrd_lb_qp_t *qp, int num_entries,
+							   struct ibv_wc *wc)
+{
+	hrd_lb_seg_t *seg = qp->dev->seg;
+	int comps = 0;
+	uint16_t empty_rings = 0;
+
+	while (comps < num_entries && qp->recv_cnt > 0 &&
+		   empty_rings < MACHINE_NUM) {
+		hrd_lb_ring_t *ring = hrd_lb_ring(seg, qp->qp_id, qp->next_src);
+		MOD_INCR(qp->next_src, MACHINE_NUM);
+		uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+		if (head == atomic_load_explicit(&ring->tail, memory_order_acquire)) {
+			empty_rings++;
+			continue;
+		}
+		empty_rings = 0;
+
+		uint8_t *slot = hrd_lb_slot(seg, ring, head);
+		hrd_lb_slot_hdr_t *hdr = (hrd_lb_slot_hdr_t *) slot;
+		hrd_lb_recv_t *recv = &qp->recvs[qp->recv_pull];
+		struct ibv_wc *comp = &wc[comps];
+
+		memset(comp, 0, sizeof(struct ibv_wc));
+		comp->wr_id = recv->wr_id;
+		comp->opcode = IBV_WC_RECV;
+		comp->qp_num = qp->qp.qp_num;
+		comp->src_qp = hdr->src_qpn;
+		comp->imm_data = hdr->imm_data;
+		comp->wc_flags = hdr->flags;
+		comp->byte_len = GRH_SIZE + hdr->len;
+		if (GRH_SIZE + hdr->len > recv->length) comp->status = IBV_WC_LOC_LEN_ERR;
+		else {
+			comp->status = IBV_WC_SUCCESS;
+			if (hdr->len > 0)
+				memcpy((void *) (recv->addr + GRH_SIZE),
+					   slot + sizeof(hrd_lb_slot_hdr_t), hdr->len);
+		}
+		atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+		MOD_INCR(qp->recv_pull, qp->recv_cap);
+		qp->recv_cnt--;
+		comps++;
+	}
+	return comps;
+}
+
+static int hrd_lb_poll_cq(struct ibv_cq *ibv_cq, int num_entries,
+						  struct ibv_wc *wc)
+{
+	hrd_lb_cq_t *cq = (hrd_lb_cq_t *) ibv_cq;
+	if (!cq->is_send) return hrd_lb_poll_recv_cq(cq->qp, num_entries, wc);
+
+	int comps = MIN(num_entries, (int) cq->signaled);
+	for (int i = 0; i < comps; i++) {
+		memset(&wc[i], 0, sizeof(struct ibv_wc));
+		wc[i].status = IBV_WC_SUCCESS;
+		wc[i].opcode = IBV_WC_SEND;
+		wc[i].qp_num = cq->qp->qp.qp_num;
+	}
+	cq->signaled -= comps;
+	return comps;
+}
+
+/*-----------------------------------------------------------------------
+ * ----------------------------CONTROL BLOCK-----------------------------------
+ * ----------------------------------------------------------------------- */
+
+static void hrd_lb_seg_name(char *name, int machine_id, int worker_id)
+{
+	snprintf(name, 64, LOOPBACK_SHM_NAME, (uint32_t) machine_id,
+			 (uint32_t) worker_id);
+}
+
+/* Create our own segment, replacing whatever a previous run left behind */
+static hrd_lb_seg_t *hrd_lb_create_seg(hrd_lb_dev_t *dev, int *recv_q_depth,
+									   uint32_t *recv_size)
+{
+	uint32_t ring_num = (uint32_t) dev->num_qps * MACHINE_NUM;
+	uint64_t size = sizeof(hrd_lb_seg_t) + ring_num * sizeof(hrd_lb_ring_t);
+	uint32_t slot_num[dev->num_qps], slot_size[dev->num_qps];
+
+	for (int qp_i = 0; qp_i < dev->num_qps; qp_i++) {
+		// Credits never let a machine have more than a recv queue in flight
+		slot_num[qp_i] = 1;
+		while (slot_num[qp_i] < (uint32_t) recv_q_depth[qp_i]) slot_num[qp_i] <<= 1;
+		slot_size[qp_i] = (uint32_t) (sizeof(hrd_lb_slot_hdr_t) + recv_size[qp_i]);
+		slot_size[qp_i] = (slot_size[qp_i] + HRD_LB_CACHE_LINE - 1) &
+						  ~(HRD_LB_CACHE_LINE - 1);
+		size += (uint64_t) MACHINE_NUM * slot_num[qp_i] * slot_size[qp_i];
+	}
+
+	shm_unlink(dev->name);
+	int fd = shm_open(dev->name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	CPE(fd < 0, "Loopback: could not create the shared memory segment", errno);
+	CPE(ftruncate(fd, (off_t) size), "Loopback: could not size the segment", errno);
+	hrd_lb_seg_t *seg = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	CPE(seg == MAP_FAILED, "Loopback: could not map the segment", errno);
+	close(fd);
+
+	seg->owner = getpid();
+	seg->num_qps = (uint32_t) dev->num_qps;
+	seg->size = size;
+	uint64_t offset = sizeof(hrd_lb_seg_t) + ring_num * sizeof(hrd_lb_ring_t);
+	for (uint16_t qp_i = 0; qp_i < dev->num_qps; qp_i++) {
+		for (int m_i = 0; m_i < MACHINE_NUM; m_i++) {
+			hrd_lb_ring_t *ring = hrd_lb_ring(seg, qp_i, m_i);
+			atomic_init(&ring->tail, 0);
+			atomic_init(&ring->head, 0);
+			ring->slot_num = slot_num[qp_i];
+			ring->slot_size = slot_size[qp_i];
+			ring->offset = offset;
+			offset += (uint64_t) slot_num[qp_i] * slot_size[qp_i];
+		}
+	}
+	assert(offset == size);
+	atomic_store_explicit(&seg->ready, HRD_LB_MAGIC, memory_order_release);
+	return seg;
+}
+
+/* Map the segment of a peer once its (live) owner has initialized it */
+static hrd_lb_seg_t *hrd_lb_open_seg(const char *name)
+{
+	int fd = shm_open(name, O_RDWR, 0600);
+	if (fd < 0) return NULL;
+
+	struct stat st;
+	hrd_lb_seg_t *seg = NULL;
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(hrd_lb_seg_t)) {
+		seg = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE,
+				   MAP_SHARED, fd, 0);
+		if (seg == MAP_FAILED) seg = NULL;
+	}
+	close(fd);
+	if (seg == NULL) return NULL;
+
+	bool ready = atomic_load_explicit(&seg->ready, memory_order_acquire) == HRD_LB_MAGIC &&
+				 seg->size == (uint64_t) st.st_size;
+	// A segment whose owner is gone is left over from an older run
+	if (!ready || (kill(seg->owner, 0) != 0 && errno == ESRCH)) {
+		munmap(seg, (size_t) st.st_size);
+		return NULL;
+	}
+	return seg;
+}
+
+hrd_ctrl_blk_t* hrd_lb_ctrl_blk_init(int local_hid, int machine_id,
+									 int num_dgram_qps, int dgram_buf_size,
+									 int *recv_q_depth, int *send_q_depth,
+									 uint32_t *recv_size)
+{
+	assert(num_dgram_qps >= 1 && num_dgram_qps < 256);
+	assert(dgram_buf_size >= 0 && dgram_buf_size <= M_1024);
+
+	hrd_ctrl_blk_t *cb = (hrd_ctrl_blk_t *) calloc(1, sizeof(hrd_ctrl_blk_t));
+	hrd_lb_dev_t *dev = (hrd_lb_dev_t *) calloc(1, sizeof(hrd_lb_dev_t));
+	assert(cb != NULL && dev != NULL);
+
+	dev->machine_id = machine_id;
+	dev->worker_id = local_hid;
+	dev->num_qps = num_dgram_qps;
+	dev->ctx.ops.post_send = hrd_lb_post_send;
+	dev->ctx.ops.post_recv = hrd_lb_post_recv;
+	dev->ctx.ops.poll_cq = hrd_lb_poll_cq;
+	hrd_lb_seg_name(dev->name, machine_id, local_hid);
+
+	cb->local_hid = local_hid;
+	cb->numa_node_id = -1;
+	cb->dev_port_id = 1;
+	cb->ctx = &dev->ctx;
+	cb->num_dgram_qps = num_dgram_qps;
+	cb->dgram_buf_size = dgram_buf_size;
+	cb->dgram_buf_shm_key = -1;
+	cb->recv_q_depth = recv_q_depth;
+	cb->send_q_depth = send_q_depth;
+
+	dev->seg = hrd_lb_create_seg(dev, recv_q_depth, recv_size);
+	dev->peer[machine_id] = dev->seg;
+
+	dev->qps = (hrd_lb_qp_t *) calloc((size_t) num_dgram_qps, sizeof(hrd_lb_qp_t));
+	cb->dgram_qp = (struct ibv_qp **) malloc(num_dgram_qps * sizeof(struct ibv_qp *));
+	cb->dgram_send_cq = (struct ibv_cq **) malloc(num_dgram_qps * sizeof(struct ibv_cq *));
+	cb->dgram_recv_cq = (struct ibv_cq **) malloc(num_dgram_qps * sizeof(struct ibv_cq *));
+	assert(dev->qps != NULL && cb->dgram_qp != NULL &&
+		   cb->dgram_send_cq != NULL && cb->dgram_recv_cq != NULL);
+
+	for (int i = 0; i < num_dgram_qps; i++) {
+		hrd_lb_qp_t *qp = &dev->qps[i];
+		qp->dev = dev;
+		qp->qp_id = (uint16_t) i;
+		qp->qp.context = &dev->ctx;
+		qp->qp.qp_num = hrd_lb_qpn(machine_id, local_hid, i);
+		qp->qp.qp_type = IBV_QPT_UD;
+		qp->qp.state = IBV_QPS_RTS;
+		qp->send_cq.qp = qp;
+		qp->send_cq.is_send = true;
+		qp->send_cq.cq.context = &dev->ctx;
+		qp->send_cq.cq.cqe = send_q_depth[i];
+		qp->recv_cq.qp = qp;
+		qp->recv_cq.cq.context = &dev->ctx;
+		qp->recv_cq.cq.cqe = recv_q_depth[i];
+		qp->qp.send_cq = &qp->send_cq.cq;
+		qp->qp.recv_cq = &qp->recv_cq.cq;
+		qp->recv_cap = (uint32_t) recv_q_depth[i];
+		qp->recvs = (hrd_lb_recv_t *) calloc(qp->recv_cap, sizeof(hrd_lb_recv_t));
+		assert(qp->recvs != NULL);
+
+		cb->dgram_qp[i] = &qp->qp;
+		cb->dgram_send_cq[i] = &qp->send_cq.cq;
+		cb->dgram_recv_cq[i] = &qp->recv_cq.cq;
+	}
+
+	cb->dgram_buf = (volatile uint8_t *) memalign(4096, (size_t) dgram_buf_size);
+	assert(cb->dgram_buf != NULL);
+	memset((char *) cb->dgram_buf, 0, (size_t) dgram_buf_size);
+	cb->dgram_buf_mr = hrd_lb_reg_mr((void *) cb->dgram_buf, (uint32_t) dgram_buf_size);
+
+	free(recv_q_depth);
+	free(send_q_depth);
+	cb->recv_q_depth = NULL;
+	cb->send_q_depth = NULL;
+	return cb;
+}
+
+void hrd_lb_connect(hrd_ctrl_blk_t *cb)
+{
+	hrd_lb_dev_t *dev = (hrd_lb_dev_t *) cb->ctx;
+	char name[64];
+
+	for (int m_i = 0; m_i < MACHINE_NUM; m_i++) {
+		if (dev->peer[m_i] != NULL) continue;
+		hrd_lb_seg_name(name, m_i, dev->worker_id);
+		uint32_t waited = 0;
+		while ((dev->peer[m_i] = hrd_lb_open_seg(name)) == NULL) {
+			if (++waited % 10000 == 0 && dev->worker_id == 0)
+				my_printf(yellow, "Loopback: machine %d waiting for machine %d \n",
+						  dev->machine_id, m_i);
+			usleep(200);
+		}
+		assert(dev->peer[m_i]->num_qps == (uint32_t) dev->num_qps);
+	}
+}
+
+int hrd_lb_ctrl_blk_destroy(hrd_ctrl_blk_t *cb)
+{
+	hrd_lb_dev_t *dev = (hrd_lb_dev_t *) cb->ctx;
+
+	for (int m_i = 0; m_i < MACHINE_NUM; m_i++) {
+		if (dev->peer[m_i] != NULL && m_i != dev->machine_id)
+			munmap(dev->peer[m_i], dev->peer[m_i]->size);
+	}
+	shm_unlink(dev->name);
+	munmap(dev->seg, dev->seg->size);
+
+	for (int i = 0; i < dev->num_qps; i++) free(dev->qps[i].recvs);
+	free(dev->qps);
+	free(cb->dgram_qp);
+	free(cb->dgram_send_cq);
+	free(cb->dgram_recv_cq);
+	free(cb->dgram_buf_mr);
+	free((void *) cb->dgram_buf);
+	free(dev);
+	free(cb);
+	return 0;
+}
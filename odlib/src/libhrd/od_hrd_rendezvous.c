@@ -0,0 +1,379 @@
+#include "od_hrd.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+/*
+ * Rendezvous: a single all-gather of the per-machine QP attributes.
+ *
+ * TCP: machine 0 listens on RENDEZVOUS_PORT and serves all other machines
+ * concurrently, in whatever order they arrive. Each of them connects (retrying
+ * until machine 0 is up), sends a header and its slot, and receives all slots
+ * back in the same connection: one round trip once everyone is up. A machine
+ * that restarts simply reconnects and replaces its slot.
+ *
+ * File: for single-host runs, each machine renames its header and slot into
+ * RENDEZVOUS_DIR/m<id> and polls for the files of the others. Files left
+ * behind by processes that are no longer alive are ignored.
+ */
+
+#define HRD_RV_MAGIC 0x6f647276 /* "odrv" */
+
+typedef struct hrd_rv_hdr {
+	uint32_t magic;
+	uint32_t machine_id;
+	uint64_t slot_size;
+	int32_t pid; /* the writer of a rendezvous file must still be alive */
+	uint32_t pad;
+} hrd_rv_hdr_t;
+
+/* A connection machine 0 has accepted but not received a full slot from */
+typedef struct hrd_rv_conn {
+	int fd;
+	size_t got; /* bytes of header and slot received so far */
+	hrd_rv_hdr_t hdr;
+} hrd_rv_conn_t;
+
+static uint64_t hrd_rv_now_ms(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+static int hrd_rv_remaining_ms(uint64_t deadline)
+{
+	uint64_t now = hrd_rv_now_ms();
+	return now >= deadline ? 0 : (int) MIN(deadline - now, 1000);
+}
+
+static bool hrd_rv_hdr_is_valid(hrd_rv_hdr_t *hdr, size_t slot_size,
+								int machine_num)
+{
+	return hdr->magic == HRD_RV_MAGIC && hdr->machine_id < (uint32_t) machine_num &&
+		   hdr->slot_size == slot_size;
+}
+
+static void hrd_rv_print_missing(bool *have, int machine_num)
+{
+	my_printf(red, "HRD: rendezvous timed out, missing machines:");
+	for (int m_i = 0; m_i < machine_num; m_i++)
+		if (!have[m_i]) printf(" %d", m_i);
+	printf("\n");
+}
+
+/*-----------------------------------------------------------------------
+ * ----------------------------TCP-----------------------------------
+ * ----------------------------------------------------------------------- */
+
+/* Sockets are non-blocking; these only give up at the deadline */
+static int hrd_rv_send_all(int fd, const void *buf, size_t len, uint64_t deadline)
+{
+	size_t sent = 0;
+	while (sent < len) {
+		struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+		int timeout = hrd_rv_remaining_ms(deadline);
+		if (timeout == 0) return -1;
+		if (poll(&pfd, 1, timeout) <= 0) continue;
+		ssize_t ret = send(fd, (const uint8_t *) buf + sent, len - sent, MSG_NOSIGNAL);
+		if (ret < 0 && errno != EAGAIN && errno != EINTR) return -1;
+		if (ret > 0) sent += (size_t) ret;
+	}
+	return 0;
+}
+
+static int hrd_rv_recv_all(int fd, void *buf, size_t len, uint64_t deadline)
+{
+	size_t got = 0;
+	while (got < len) {
+		struct pollfd pfd = {.fd = fd, .events = POLLIN};
+		int timeout = hrd_rv_remaining_ms(deadline);
+		if (timeout == 0) return -1;
+		if (poll(&pfd, 1, timeout) <= 0) continue;
+		ssize_t ret = recv(fd, (uint8_t *) buf + got, len - got, 0);
+		if (ret == 0) return -1; /* the other side went away */
+		if (ret < 0 && errno != EAGAIN && errno != EINTR) return -1;
+		if (ret > 0) got += (size_t) ret;
+	}
+	return 0;
+}
+
+static int hrd_rv_connect(int fd, struct sockaddr_in *addr, uint64_t deadline)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	if (connect(fd, (struct sockaddr *) addr, sizeof(*addr)) == 0) return 0;
+	if (errno != EINPROGRESS) return -1;
+
+	struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+	int err = 0;
+	socklen_t err_len = sizeof(err);
+	if (poll(&pfd, 1, hrd_rv_remaining_ms(deadline)) <= 0) return -1;
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0 || err != 0)
+		return -1;
+	return 0;
+}
+
+/* Machines other than 0: retry until machine 0 answers with all slots */
+static int hrd_rv_join(uint8_t *buf, size_t slot_size, int machine_id,
+					   int machine_num, const char *server_ip, uint64_t deadline)
+{
+	struct sockaddr_in addr = {.sin_family = AF_INET,
+							   .sin_port = htons(RENDEZVOUS_PORT)};
+	if (inet_pton(AF_INET, server_ip, &addr.sin_addr) <= 0) {
+		my_printf(red, "HRD: invalid rendezvous address %s\n", server_ip);
+		return -1;
+	}
+
+	hrd_rv_hdr_t hdr = {.magic = HRD_RV_MAGIC, .machine_id = (uint32_t) machine_id,
+						.slot_size = slot_size, .pid = getpid()};
+	size_t total_size = (size_t) machine_num * slot_size;
+	uint8_t *own_slot = buf + (size_t) machine_id * slot_size;
+	uint8_t *all_slots = (uint8_t *) malloc(total_size);
+	int one = 1;
+	uint32_t tries = 0;
+	assert(all_slots != NULL);
+
+	while (hrd_rv_remaining_ms(deadline) > 0) {
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		assert(fd >= 0);
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		bool done = hrd_rv_connect(fd, &addr, deadline) == 0 &&
+					hrd_rv_send_all(fd, &hdr, sizeof(hdr), deadline) == 0 &&
+					hrd_rv_send_all(fd, own_slot, slot_size, deadline) == 0 &&
+					hrd_rv_recv_all(fd, all_slots, total_size, deadline) == 0;
+		close(fd);
+		if (done) {
+			memcpy(buf, all_slots, total_size);
+			free(all_slots);
+			return 0;
+		}
+		tries++;
+		if (tries % 1000 == 0)
+			my_printf(yellow, "HRD: machine %d waiting for the rendezvous at %s\n",
+					  machine_id, server_ip);
+		usleep(RENDEZVOUS_RETRY_MS * 1000);
+	}
+	my_printf(red, "HRD: machine %d got no rendezvous reply from %s\n",
+			  machine_id, server_ip);
+	free(all_slots);
+	return -1;
+}
+
+static void hrd_rv_drop_conn(hrd_rv_conn_t *pending, int *pending_num, int i)
+{
+	close(pending[i].fd);
+	pending[i] = pending[--(*pending_num)];
+}
+
+/* Machine 0: gathers the slots of all other machines, in any order */
+static int hrd_rv_serve(uint8_t *buf, size_t slot_size, int machine_num,
+						uint64_t deadline)
+{
+	int lfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	int one = 1;
+	assert(lfd >= 0);
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	struct sockaddr_in addr = {.sin_family = AF_INET,
+							   .sin_port = htons(RENDEZVOUS_PORT),
+							   .sin_addr.s_addr = INADDR_ANY};
+	if (bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+		listen(lfd, machine_num) < 0) {
+		my_printf(red, "HRD: can not listen on rendezvous port %d: %s\n",
+				  RENDEZVOUS_PORT, strerror(errno));
+		close(lfd);
+		return -1;
+	}
+
+	int max_pending = 2 * machine_num, pending_num = 0, missing = machine_num - 1;
+	hrd_rv_conn_t pending[max_pending];
+	struct pollfd pfds[max_pending + 1];
+	int done_fd[machine_num];
+	bool have[machine_num];
+	for (int m_i = 0; m_i < machine_num; m_i++) {
+		done_fd[m_i] = -1;
+		have[m_i] = m_i == 0;
+	}
+
+	while (missing > 0) {
+		int timeout = hrd_rv_remaining_ms(deadline);
+		if (timeout == 0) break;
+		pfds[0] = (struct pollfd) {.fd = lfd, .events = POLLIN};
+		for (int i = 0; i < pending_num; i++)
+			pfds[i + 1] = (struct pollfd) {.fd = pending[i].fd, .events = POLLIN};
+		if (poll(pfds, (nfds_t) pending_num + 1, timeout) <= 0) continue;
+
+		// Walk backwards, dropping a connection moves the last one in its place
+		for (int i = pending_num - 1; i >= 0; i--) {
+			if (pfds[i + 1].revents == 0) continue;
+			hrd_rv_conn_t *conn = &pending[i];
+			bool in_hdr = conn->got < sizeof(hrd_rv_hdr_t);
+			uint8_t *dst = in_hdr ? (uint8_t *) &conn->hdr + conn->got :
+							buf + conn->hdr.machine_id * slot_size +
+							(conn->got - sizeof(hrd_rv_hdr_t));
+			size_t want = in_hdr ? sizeof(hrd_rv_hdr_t) - conn->got :
+							slot_size + sizeof(hrd_rv_hdr_t) - conn->got;
+			ssize_t ret = recv(conn->fd, dst, want, 0);
+			if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EINTR)) {
+				hrd_rv_drop_conn(pending, &pending_num, i);
+				continue;
+			}
+			if (ret < 0) continue;
+			conn->got += (size_t) ret;
+
+			if (in_hdr && conn->got == sizeof(hrd_rv_hdr_t)) {
+				if (!hrd_rv_hdr_is_valid(&conn->hdr, slot_size, machine_num) ||
+					conn->hdr.machine_id == 0) {
+					my_printf(red, "HRD: dropping a malformed rendezvous request\n");
+					hrd_rv_drop_conn(pending, &pending_num, i);
+					continue;
+				}
+				// A machine that reconnects replaces its previous slot
+				uint32_t m_i = conn->hdr.machine_id;
+				if (have[m_i]) {
+					close(done_fd[m_i]);
+					done_fd[m_i] = -1;
+					have[m_i] = false;
+					missing++;
+				}
+			}
+			if (conn->got == sizeof(hrd_rv_hdr_t) + slot_size) {
+				uint32_t m_i = conn->hdr.machine_id;
+				done_fd[m_i] = conn->fd;
+				have[m_i] = true;
+				missing--;
+				pending[i] = pending[--pending_num];
+			}
+		}
+
+		if (pfds[0].revents != 0) {
+			int fd;
+			while ((fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+				if (pending_num == max_pending) {
+					close(fd);
+					continue;
+				}
+				setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+				pending[pending_num++] = (hrd_rv_conn_t) {.fd = fd, .got = 0};
+			}
+		}
+	}
+
+	int ret = 0;
+	if (missing > 0) {
+		hrd_rv_print_missing(have, machine_num);
+		ret = -1;
+	}
+	for (int m_i = 1; m_i < machine_num; m_i++) {
+		if (done_fd[m_i] < 0) continue;
+		if (ret == 0 &&
+			hrd_rv_send_all(done_fd[m_i], buf, machine_num * slot_size, deadline) != 0) {
+			my_printf(red, "HRD: could not send the rendezvous reply to machine %d\n", m_i);
+			ret = -1;
+		}
+		close(done_fd[m_i]);
+	}
+	for (int i = 0; i < pending_num; i++) close(pending[i].fd);
+	close(lfd);
+	return ret;
+}
+
+/*-----------------------------------------------------------------------
+ * ----------------------------FILE-----------------------------------
+ * ----------------------------------------------------------------------- */
+
+static bool hrd_rv_read_file(int m_i, uint8_t *slot, size_t slot_size,
+							 int machine_num)
+{
+	char path[128];
+	hrd_rv_hdr_t hdr;
+	bool ok = false;
+	snprintf(path, sizeof(path), "%s/m%d", RENDEZVOUS_DIR, m_i);
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	if (read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+		hrd_rv_hdr_is_valid(&hdr, slot_size, machine_num) &&
+		hdr.machine_id == (uint32_t) m_i &&
+		!(kill(hdr.pid, 0) < 0 && errno == ESRCH)) // left behind by a past run
+		ok = read(fd, slot, slot_size) == (ssize_t) slot_size;
+	close(fd);
+	return ok;
+}
+
+static int hrd_rv_file_all_gather(uint8_t *buf, size_t slot_size, int machine_id,
+								  int machine_num, uint64_t deadline)
+{
+	char path[128], tmp_path[128];
+	hrd_rv_hdr_t hdr = {.magic = HRD_RV_MAGIC, .machine_id = (uint32_t) machine_id,
+						.slot_size = slot_size, .pid = getpid()};
+	if (mkdir(RENDEZVOUS_DIR, 0777) < 0 && errno != EEXIST) {
+		my_printf(red, "HRD: can not create %s: %s\n", RENDEZVOUS_DIR, strerror(errno));
+		return -1;
+	}
+
+	// Readers must never see a half-written file
+	snprintf(path, sizeof(path), "%s/m%d", RENDEZVOUS_DIR, machine_id);
+	snprintf(tmp_path, sizeof(tmp_path), "%s/.m%d.%d", RENDEZVOUS_DIR,
+			 machine_id, getpid());
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0 ||
+		write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+		write(fd, buf + (size_t) machine_id * slot_size, slot_size) != (ssize_t) slot_size ||
+		rename(tmp_path, path) < 0) {
+		my_printf(red, "HRD: can not publish %s: %s\n", path, strerror(errno));
+		if (fd >= 0) close(fd);
+		unlink(tmp_path);
+		return -1;
+	}
+	close(fd);
+
+	bool have[machine_num];
+	int missing = machine_num - 1;
+	for (int m_i = 0; m_i < machine_num; m_i++) have[m_i] = m_i == machine_id;
+	while (true) {
+		for (int m_i = 0; m_i < machine_num; m_i++) {
+			if (have[m_i]) continue;
+			if (hrd_rv_read_file(m_i, buf + (size_t) m_i * slot_size, slot_size,
+								 machine_num)) {
+				have[m_i] = true;
+				missing--;
+			}
+		}
+		if (missing == 0) return 0;
+		if (hrd_rv_remaining_ms(deadline) == 0) {
+			hrd_rv_print_missing(have, machine_num);
+			return -1;
+		}
+		usleep(RENDEZVOUS_RETRY_MS * 1000);
+	}
+}
+
+int hrd_rendezvous_all_gather(void *buf, size_t slot_size, int machine_id,
+							  int machine_num, const char *server_ip)
+{
+	uint64_t start = hrd_rv_now_ms();
+	uint64_t deadline = start + RENDEZVOUS_TIMEOUT_S * 1000;
+	int ret;
+	assert(machine_id >= 0 && machine_id < machine_num);
+	if (machine_num == 1) return 0;
+
+	if (RENDEZVOUS_MODE == RENDEZVOUS_FILE)
+		ret = hrd_rv_file_all_gather((uint8_t *) buf, slot_size, machine_id,
+									 machine_num, deadline);
+	else if (machine_id == 0)
+		ret = hrd_rv_serve((uint8_t *) buf, slot_size, machine_num, deadline);
+	else
+		ret = hrd_rv_join((uint8_t *) buf, slot_size, machine_id, machine_num,
+						  server_ip, deadline);
+
+	if (ret == 0)
+		my_printf(green, "HRD: rendezvous of %d machines took %lu ms\n",
+				  machine_num, hrd_rv_now_ms() - start);
+	return ret;
+}
@@ -209,6 +209,8 @@ void* hrd_malloc_socket(int shm_key, int size, int socket_id)
 		printf("HRD: SHM malloc error: shmat() failed for key %d\n", shm_key);
 		exit(-1);
 	}
+	/* Private segments go away with the process */
+	if (shm_key == IPC_PRIVATE) shmctl(shmid, IPC_RMID, NULL);
 
 	/* Bind the buffer to this socket */
 	const unsigned long nodemask = (1 << socket_id);
@@ -277,10 +279,33 @@ void hrd_nano_sleep(int ns)
 	}
 }
 
+static double hrd_cycles_per_ns;
+static pthread_once_t hrd_cycles_once = PTHREAD_ONCE_INIT;
+
+static void hrd_measure_cycles_per_ns(void)
+{
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	long long start_cycles = hrd_get_cycles();
+	usleep(10000);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	long long end_cycles = hrd_get_cycles();
+	double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+	hrd_cycles_per_ns = (end_cycles - start_cycles) / ns;
+}
+
+double hrd_get_cycles_per_ns(void)
+{
+	pthread_once(&hrd_cycles_once, hrd_measure_cycles_per_ns);
+	return hrd_cycles_per_ns;
+}
+
 /* Get the LID of a port on the device specified by @ctx */
 uint16_t hrd_get_local_lid(struct ibv_context *ctx, int dev_port_id)
 {
 	assert(ctx != NULL && dev_port_id >= 1);
+	/* Loopback QPs are addressed by their qpn alone */
+	if (ENABLE_LOOPBACK) return 0;
 
 	struct ibv_port_attr attr;
 	if(ibv_query_port(ctx, dev_port_id, &attr)) {
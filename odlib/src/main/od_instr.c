@@ -0,0 +1,179 @@
+//
+// Per-worker instrumentation of the main-loop stages and of the QPs
+//
+
+#include "od_instr.h"
+#include "od_hrd.h"
+
+od_instr_t w_instr[WORKERS_PER_MACHINE];
+
+od_instr_t *od_instr_register_qps(uint16_t t_id, uint16_t qp_num,
+                                  const char **qp_name)
+{
+  assert(t_id < WORKERS_PER_MACHINE);
+  assert(qp_num <= INSTR_MAX_QPS);
+  od_instr_t *instr = &w_instr[t_id];
+  instr->qp_num = qp_num;
+  for (uint16_t qp_i = 0; qp_i < qp_num; qp_i++)
+    instr->qp_name[qp_i] = qp_name[qp_i];
+  return instr;
+}
+
+void od_instr_register_stage(od_instr_t *instr, uint16_t st_i,
+                             const char *name)
+{
+  assert(st_i < SCHED_MAX_STAGES);
+  instr->stage_name[st_i] = name;
+  instr->stage_num = (uint16_t) MAX(instr->stage_num, st_i + 1);
+}
+
+/* ---------------------------------------------------------------------------
+//------------------------------ COLLECTION --------------------------------
+//---------------------------------------------------------------------------*/
+
+// Upper bound, in ns, of the bucket that holds the @per_mille-th run
+static double od_instr_percentile_ns(const uint64_t *hist, uint64_t runs,
+                                     uint32_t per_mille)
+{
+  if (runs == 0) return 0;
+  uint64_t target = (runs * per_mille + 999) / 1000, seen = 0;
+  uint32_t b = 0;
+  for (; b < INSTR_HIST_BUCKETS - 1; b++) {
+    seen += hist[b];
+    if (seen >= target) break;
+  }
+  return (double) (2ULL << b) / hrd_get_cycles_per_ns();
+}
+
+static void od_instr_stage_delta(od_stage_instr_t *delta,
+                                 const od_stage_instr_t *curr,
+                                 const od_stage_instr_t *prev)
+{
+  delta->runs = curr->runs - prev->runs;
+  delta->idle_runs = curr->idle_runs - prev->idle_runs;
+  delta->skipped = curr->skipped - prev->skipped;
+  delta->cycles = curr->cycles - prev->cycles;
+  for (uint32_t b = 0; b < INSTR_HIST_BUCKETS; b++)
+    delta->hist[b] = curr->hist[b] - prev->hist[b];
+}
+
+static void od_instr_qp_delta(od_qp_instr_t *delta,
+                              const od_qp_instr_t *curr,
+                              const od_qp_instr_t *prev)
+{
+  delta->sent_mes = curr->sent_mes - prev->sent_mes;
+  delta->sent_bytes = curr->sent_bytes - prev->sent_bytes;
+  delta->credit_stalls = curr->credit_stalls - prev->credit_stalls;
+  delta->polls = curr->polls - prev->polls;
+  delta->empty_polls = curr->empty_polls - prev->empty_polls;
+  delta->recv_mes = curr->recv_mes - prev->recv_mes;
+}
+
+static FILE *od_instr_open_export(void)
+{
+  if (strlen(INSTR_EXPORT_FILE) == 0) return NULL;
+  char filename[128];
+  snprintf(filename, sizeof(filename), INSTR_EXPORT_FILE, machine_id);
+  FILE *fp = fopen(filename, "w");
+  if (fp == NULL) {
+    my_printf(red, "Could not open %s, instrumentation will not be exported \n", filename);
+    return NULL;
+  }
+  fprintf(fp, "# stage,print,t_id,name,runs,idle_runs,skipped,cycles,p50_ns,p99_ns\n");
+  fprintf(fp, "# qp,print,t_id,name,sent_mes,sent_bytes,credit_stalls,polls,empty_polls,recv_mes\n");
+  return fp;
+}
+
+// Prints the deltas since the previous call aggregated over the workers,
+// and exports them per worker
+void od_instr_collect(double seconds)
+{
+  static od_instr_t prev[WORKERS_PER_MACHINE];
+  static od_instr_t curr;
+  static od_instr_t aggr;
+  static FILE *export_fp = NULL;
+  static bool export_opened = false;
+  static uint32_t print_i = 0;
+
+  if (!export_opened) {
+    export_fp = od_instr_open_export();
+    export_opened = true;
+  }
+  memset(&aggr, 0, sizeof(od_instr_t));
+
+  for (uint16_t w_i = 0; w_i < WORKERS_PER_MACHINE; w_i++) {
+    memcpy(&curr, (void *) &w_instr[w_i], sizeof(od_instr_t));
+    if (curr.qp_num == 0) continue;
+    if (aggr.qp_num == 0) {
+      aggr.qp_num = curr.qp_num;
+      aggr.stage_num = curr.stage_num;
+      memcpy(aggr.qp_name, curr.qp_name, sizeof(curr.qp_name));
+      memcpy(aggr.stage_name, curr.stage_name, sizeof(curr.stage_name));
+    }
+
+    for (uint16_t st_i = 0; st_i < curr.stage_num; st_i++) {
+      od_stage_instr_t delta;
+      od_instr_stage_delta(&delta, &curr.stage[st_i], &prev[w_i].stage[st_i]);
+      od_stage_instr_t *all = &aggr.stage[st_i];
+      all->runs += delta.runs;
+      all->idle_runs += delta.idle_runs;
+      all->skipped += delta.skipped;
+      all->cycles += delta.cycles;
+      for (uint32_t b = 0; b < INSTR_HIST_BUCKETS; b++)
+        all->hist[b] += delta.hist[b];
+      if (export_fp != NULL)
+        fprintf(export_fp, "stage,%u,%u,%s,%lu,%lu,%lu,%lu,%.1f,%.1f\n",
+                print_i, w_i, curr.stage_name[st_i], delta.runs,
+                delta.idle_runs, delta.skipped, delta.cycles,
+                od_instr_percentile_ns(delta.hist, delta.runs, 500),
+                od_instr_percentile_ns(delta.hist, delta.runs, 990));
+    }
+
+    for (uint16_t qp_i = 0; qp_i < curr.qp_num; qp_i++) {
+      od_qp_instr_t delta;
+      od_instr_qp_delta(&delta, &curr.qp[qp_i], &prev[w_i].qp[qp_i]);
+      od_qp_instr_t *all = &aggr.qp[qp_i];
+      all->sent_mes += delta.sent_mes;
+      all->sent_bytes += delta.sent_bytes;
+      all->credit_stalls += delta.credit_stalls;
+      all->polls += delta.polls;
+      all->empty_polls += delta.empty_polls;
+      all->recv_mes += delta.recv_mes;
+      if (export_fp != NULL)
+        fprintf(export_fp, "qp,%u,%u,%s,%lu,%lu,%lu,%lu,%lu,%lu\n",
+                print_i, w_i, curr.qp_name[qp_i], delta.sent_mes,
+                delta.sent_bytes, delta.credit_stalls, delta.polls,
+                delta.empty_polls, delta.recv_mes);
+    }
+    prev[w_i] = curr;
+  }
+  print_i++;
+  if (export_fp != NULL) fflush(export_fp);
+  if (aggr.qp_num == 0 || !SHOW_INSTR_STATS) return;
+
+  uint64_t total_cycles = 0;
+  for (uint16_t st_i = 0; st_i < aggr.stage_num; st_i++)
+    total_cycles += aggr.stage[st_i].cycles;
+  if (total_cycles > 0) {
+    my_printf(cyan, "INSTR: stage  cycles%%  idle%%  skipped%%  p50(ns)  p99(ns) \n");
+    for (uint16_t st_i = 0; st_i < aggr.stage_num; st_i++) {
+      od_stage_instr_t *st = &aggr.stage[st_i];
+      printf("INSTR: %-12s %6.2f %6.2f %6.2f %8.1f %8.1f \n", aggr.stage_name[st_i],
+             100.0 * st->cycles / total_cycles,
+             st->runs == 0 ? 0 : 100.0 * st->idle_runs / st->runs,
+             st->runs + st->skipped == 0 ? 0 : 100.0 * st->skipped / (st->runs + st->skipped),
+             od_instr_percentile_ns(st->hist, st->runs, 500),
+             od_instr_percentile_ns(st->hist, st->runs, 990));
+    }
+  }
+
+  my_printf(cyan, "INSTR: qp  mes/s  MB/s  stalls/s  empty-polls%%  recv/s \n");
+  for (uint16_t qp_i = 0; qp_i < aggr.qp_num; qp_i++) {
+    od_qp_instr_t *qp = &aggr.qp[qp_i];
+    printf("INSTR: %-12s %.2f %.2f %.2f %6.2f %.2f \n", aggr.qp_name[qp_i],
+           qp->sent_mes / seconds, qp->sent_bytes / seconds / MILLION,
+           qp->credit_stalls / seconds,
+           qp->polls == 0 ? 0 : 100.0 * qp->empty_polls / qp->polls,
+           qp->recv_mes / seconds);
+  }
+}
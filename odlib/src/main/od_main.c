@@ -3,6 +3,7 @@
 //
 
 #include "od_kvs.h"
+#include "od_kvs_backend.h"
 
 
 #include "od_main_prot_sel.h"
@@ -15,7 +16,8 @@
 int bqr_read_buffer_size, bqr_is_remote;
 int is_roce, machine_id, num_threads;
 int write_ratio = WRITE_RATIO;
-struct latency_counters latency_count;
+kvs_backend_t kvs_backend = KVS_BACKEND;
+struct latency_counters *latency_count;
 t_stats_t t_stats[WORKERS_PER_MACHINE];
 c_stats_t c_stats[CLIENTS_PER_MACHINE];
 remote_qp_t ***rem_qp;  //[MACHINE_NUM][WORKERS_PER_MACHINE][QP_NUM];
@@ -33,6 +35,7 @@ atomic_uint_fast32_t workers_with_filled_qp_attr;
 int main(int argc, char *argv[])
 {
   appl_init_func(argc, argv);
+  od_kvs_init();
   struct thread_params *param_arr;
 
   num_threads =  WORKERS_PER_MACHINE;
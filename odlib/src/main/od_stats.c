@@ -5,6 +5,7 @@
 
 #include "od_stats_prot_sel.h"
 #include "od_latency_util.h"
+#include "od_instr.h"
 
 void print_latency_stats(void);
 
@@ -35,6 +36,7 @@ _Noreturn void *print_stats(void* no_arg)
     memcpy(ctx->curr_w_stats, (void *) t_stats, num_threads * (sizeof(struct thread_stats)));
 
     appl_stats(ctx);
+    if (ENABLE_INSTRUMENTATION) od_instr_collect(ctx->seconds);
 
 
 
@@ -54,7 +56,6 @@ _Noreturn void *print_stats(void* no_arg)
 void print_latency_stats(void)
 {
   FILE *latency_stats_fd;
-  int i = 0;
   char filename[128];
   char* path = "/users/sohamb/odyssey/build/results/latency";
   const char * workload[] = {
@@ -68,21 +69,38 @@ void print_latency_stats(void)
           workload[MEASURE_READ_LATENCY]);
 
   latency_stats_fd = fopen(filename, "w");
+  if (latency_stats_fd == NULL)
+    my_printf(red, "Could not open %s, latencies are only printed \n", filename);
 
+  latency_hist_t *merged = malloc(sizeof(latency_hist_t));
+  my_printf(cyan, "LATENCY (us): req  count  p50  p99  p99.9  p99.99  max \n");
   for (req_type_t req_t = RELEASE_REQ; req_t < LATENCY_TYPE_NUM; ++req_t) {
-    if (latency_count.req_meas_num[req_t] == 0) continue;
-    fprintf(latency_stats_fd, "#---------------- %s --------------\n", latency_req_to_str(req_t));
-    for(i = 0; i < LATENCY_BUCKETS; ++i) {
-      fprintf(latency_stats_fd, "%s: %d, %d\n",
-              latency_req_to_str(req_t),
-              i * (MAX_LATENCY / LATENCY_BUCKETS), latency_count.requests[req_t][i]);
+    merge_latency_hists(merged, req_t);
+    if (merged->count == 0) continue;
+    const char *req_str = latency_req_to_str(req_t);
+    printf("LATENCY: %-12s %lu %.2f %.2f %.2f %.2f %.2f \n", req_str, merged->count,
+           latency_percentile(merged, 50) / 1000.0,
+           latency_percentile(merged, 99) / 1000.0,
+           latency_percentile(merged, 99.9) / 1000.0,
+           latency_percentile(merged, 99.99) / 1000.0,
+           merged->max_ns / 1000.0);
+    if (latency_stats_fd == NULL) continue;
+
+    // the non-empty buckets, by their highest latency, in ns
+    fprintf(latency_stats_fd, "#---------------- %s --------------\n", req_str);
+    for (uint32_t b_i = 0; b_i < LATENCY_BUCKETS; ++b_i) {
+      if (merged->buckets[b_i] == 0) continue;
+      fprintf(latency_stats_fd, "%s: %lu, %lu\n", req_str,
+              latency_bucket_to_ns(b_i), merged->buckets[b_i]);
     }
-    fprintf(latency_stats_fd, "%s: -1, %d\n", latency_req_to_str(req_t),
-            latency_count.requests[req_t][LATENCY_BUCKETS]); //print outliers
-    fprintf(latency_stats_fd, "%s: max, %d\n",
-            latency_req_to_str(req_t),
-            latency_count.max_req_lat[req_t]); //print max
+    fprintf(latency_stats_fd, "%s: p50, %lu\n", req_str, latency_percentile(merged, 50));
+    fprintf(latency_stats_fd, "%s: p99, %lu\n", req_str, latency_percentile(merged, 99));
+    fprintf(latency_stats_fd, "%s: p99.9, %lu\n", req_str, latency_percentile(merged, 99.9));
+    fprintf(latency_stats_fd, "%s: p99.99, %lu\n", req_str, latency_percentile(merged, 99.99));
+    fprintf(latency_stats_fd, "%s: max, %lu\n", req_str, merged->max_ns);
   }
+  free(merged);
+  if (latency_stats_fd == NULL) return;
   fclose(latency_stats_fd);
 
   printf("Latency stats saved at %s\n", filename);
@@ -7,42 +7,10 @@
 #include <stdio.h>
 #include <string.h>
 
-#include "default_data_config.h"
-#include "splinterdb.h"
-#include "bplus.h"
-#define DB_FILE_NAME    "splinterdb_intro_db"
-#define USER_MAX_KEY_SIZE ((int)100)
-#define DB_FILE_SIZE_MB 1024 // Size of SplinterDB device; Fixed when created
-#define CACHE_SIZE_MB   64
+#include "od_kvs_backend.h"
 
 void *worker(void *arg)
 {
-  kvs_t *kvs = (kvs_t*)malloc(sizeof(kvs_t));
-#if USE_BPLUS
-  bp_db_t tree;
-  int ret = bp_open(&tree, "/mnt/mydisk/Odyssey/bplus.bp");
-  if (ret != 0) {
-      printf("Unable to create bplustree instance\n");
-      return;
-  }
-  printf("Successfully created Btree instance\n");
-  kvs->tree = &tree;
-#endif /* ifdef  USE_BPLUS */
-
-#if USE_SPLINTERDB
-  data_config splinter_data_cfg;
-  default_data_config_init(USER_MAX_KEY_SIZE, &splinter_data_cfg);
-  splinterdb_config splinterdb_cfg;
-  memset(&splinterdb_cfg, 0, sizeof(splinterdb_cfg));
-  splinterdb_cfg.filename   = DB_FILE_NAME;
-  splinterdb_cfg.disk_size  = (DB_FILE_SIZE_MB * 1024 * 1024);
-  splinterdb_cfg.cache_size = (CACHE_SIZE_MB * 1024 * 1024);
-  splinterdb_cfg.data_cfg   = &splinter_data_cfg;
-  splinterdb *spl_handle = NULL; // To a running SplinterDB instance
-  int rc = splinterdb_create(&splinterdb_cfg, &spl_handle);
-  printf("Created SplinterDB instance (worker), dbname '%s'.\n\n", DB_FILE_NAME);
-  kvs->spl_handle = spl_handle;
-#endif /* if USE_SPLINTERDB */
   struct thread_params params = *(struct thread_params *) arg;
   uint16_t t_id = (uint16_t) params.id;
 
@@ -57,9 +25,10 @@ void *worker(void *arg)
                               (uint16_t) params.id,
                               (uint16_t) QP_NUM,
                               local_ip);
- appl_init_qp_meta(ctx, kvs);
+  ctx->kvs = od_kvs_open(t_id);
+  appl_init_qp_meta(ctx);
 
- set_up_ctx(ctx);
+  set_up_ctx(ctx);
 
   /// Connect with other machines and exchange qp information
   setup_connections_and_spawn_stats_thread(ctx);
@@ -75,11 +44,8 @@ void *worker(void *arg)
       "%d sessions \n", t_id, SESSIONS_PER_THREAD);
 
   ///
-  main_loop(ctx, kvs);
-#if USE_BPLUS
-  
-    bp_close(&tree);
-  #endif /* if USE_BPLUS */
+  main_loop(ctx);
+  od_kvs_close(ctx->kvs);
 
   return NULL;
 }
@@ -9,6 +9,7 @@
 
 
 mica_kv_t *KVS;
+mica_match_isa_t mica_match_isa = MICA_MATCH_SCALAR;
 
 
 int is_power_of_2(int x)
@@ -59,18 +60,417 @@ inline void check_mica_op_t_allignement(mica_op_t *kv_ptr)
 //  }
 }
 
+/* ---------------------------------------------------------------------------
+//------------------------------ INDEX -----------------------------
+//---------------------------------------------------------------------------*/
+
+static mica_index_t *mica_index_alloc(int shm_key, uint32_t num_bkts, int node_id)
+{
+  assert(is_power_of_2(num_bkts) == 1 && num_bkts <= KVS_MAX_BKTS);
+  mica_index_t *index = calloc(1, sizeof(mica_index_t));
+  index->num_bkts = num_bkts;
+  index->bkt_mask = num_bkts - 1;	/* num_bkts is power of 2 */
+  index->ovf_num = MAX(num_bkts / MICA_OVF_BKTS_DIV, 1);
+  index->ovf_free = malloc(index->ovf_num * sizeof(mica_log_free_t));
+  index->shm_key = shm_key;
+  size_t size = (num_bkts + index->ovf_num) * sizeof(struct mica_bkt);
+  if (ENABLE_ASSERTIONS) {
+    my_printf(green, "asking for %lu MB for the buckets \n", size / (M_1));
+  }
+  index->bkts = (struct mica_bkt *) hrd_malloc_socket(shm_key, (int) size, node_id);
+  /* Initialize all entries to invalid */
+  memset(index->bkts, 0, size);
+  return index;
+}
+
+static void mica_index_free(mica_index_t *index)
+{
+  if (index->shm_key == IPC_PRIVATE) shmdt(index->bkts);
+  else hrd_free(index->shm_key, index->bkts);
+  free(index->ovf_free);
+  free(index);
+}
+
+static inline void mica_set_slot(struct mica_slot *slot, bool in_use,
+                                 uint32_t tag, uint64_t offset)
+{
+  struct mica_slot new_slot = {.in_use = in_use, .tag = tag, .offset = offset};
+  __atomic_store(slot, &new_slot, __ATOMIC_RELEASE);
+}
+
+// Only writers call it, under the lock: it sees the latest @migrated.
+// @owner is the index the bucket belongs to, overflow buckets come from it.
+static inline struct mica_bkt *mica_writer_bkt(mica_kv_t *kvs, struct key *key,
+                                               mica_index_t **owner)
+{
+  mica_index_t *index = kvs->index;
+  if (index->old != NULL) {
+    uint32_t old_bkt = key->bkt & index->old->bkt_mask;
+    if (old_bkt >= index->migrated) {
+      *owner = index->old;
+      return &index->old->bkts[old_bkt];
+    }
+  }
+  *owner = index;
+  return &index->bkts[key->bkt & index->bkt_mask];
+}
+
+static inline struct mica_bkt *mica_next_bkt(struct mica_bkt *bkt_ptr)
+{
+  struct mica_slot *chain = &bkt_ptr->slots[MICA_CHAIN_SLOT];
+  if (chain->in_use == 1 && chain->tag == MICA_CHAIN_TAG)
+    return bkt_ptr + (int32_t) chain->offset;
+  return NULL;
+}
+
+// The slot of @key in the chain of @bkt_ptr. Two keys of a chain must not
+// share a tag, as readers stop at the first match: @tag_taken reports it.
+static struct mica_slot *mica_find_slot(mica_kv_t *kvs, struct mica_bkt *bkt_ptr,
+                                        struct key *key, bool *tag_taken)
+{
+  uint32_t tag = mica_key_tag(key);
+  *tag_taken = false;
+  for (; bkt_ptr != NULL; bkt_ptr = mica_next_bkt(bkt_ptr)) {
+    for (int i = 0; i < MICA_BKT_SLOTS; i++) {
+      struct mica_slot *slot = &bkt_ptr->slots[i];
+      if (slot->in_use == 0 || slot->tag != tag) continue;
+      mica_op_t *kv_ptr = (mica_op_t *) &kvs->ht_log[slot->offset & kvs->log_mask];
+      if (memcmp(&kv_ptr->key, key, KEY_SIZE) == 0) return slot;
+      *tag_taken = true;
+    }
+  }
+  return NULL;
+}
+
+static inline void mica_set_link(struct mica_bkt *bkt_ptr, struct mica_bkt *next)
+{
+  mica_set_slot(&bkt_ptr->slots[MICA_CHAIN_SLOT], true, MICA_CHAIN_TAG,
+                (uint32_t) (int32_t) (next - bkt_ptr));
+}
+
+// An overflow bucket of @index: an unlinked one that no reader can still be
+// walking, or one never handed out. NULL if there is none.
+static struct mica_bkt *mica_ovf_alloc(mica_kv_t *kvs, mica_index_t *index)
+{
+  if (index->ovf_free_num > 0) {
+    mica_log_free_t *oldest = &index->ovf_free[index->ovf_free_head];
+    if ((uint64_t) hrd_get_cycles() - oldest->retired_at >= kvs->reclaim_grace) {
+      struct mica_bkt *ovf = &index->bkts[oldest->offset];
+      index->ovf_free_head = (index->ovf_free_head + 1) % index->ovf_num;
+      index->ovf_free_num--;
+      memset(ovf, 0, sizeof(struct mica_bkt)); // its link may still be set
+      return ovf;
+    }
+  }
+  if (index->ovf_used == index->ovf_num) return NULL;
+  return &index->bkts[index->num_bkts + index->ovf_used++];
+}
+
+// How many overflow buckets mica_ovf_alloc can hand out now, counting up to @want
+static uint32_t mica_ovf_avail(mica_kv_t *kvs, mica_index_t *index, uint32_t want)
+{
+  uint32_t avail = index->ovf_num - index->ovf_used;
+  uint64_t now = (uint64_t) hrd_get_cycles();
+  for (uint32_t i = 0; i < index->ovf_free_num && avail < want; i++) {
+    mica_log_free_t *entry = &index->ovf_free[(index->ovf_free_head + i) % index->ovf_num];
+    if (now - entry->retired_at < kvs->reclaim_grace) break;
+    avail++;
+  }
+  return avail;
+}
+
+static inline bool mica_bkt_empty(struct mica_bkt *bkt_ptr)
+{
+  for (int i = 0; i < MICA_CHAIN_SLOT; i++)
+    if (bkt_ptr->slots[i].in_use == 1) return false;
+  struct mica_slot *chain = &bkt_ptr->slots[MICA_CHAIN_SLOT];
+  return chain->in_use == 0 || chain->tag == MICA_CHAIN_TAG;
+}
+
+// Unlinks the overflow buckets of the chain of @bkt_ptr that deletes left
+// without keys. Readers may still be walking one, and follow its link on:
+// it is handed out again only after the grace.
+static void mica_ovf_release(mica_kv_t *kvs, mica_index_t *index,
+                             struct mica_bkt *bkt_ptr)
+{
+  struct mica_bkt *next;
+  while ((next = mica_next_bkt(bkt_ptr)) != NULL) {
+    if (!mica_bkt_empty(next)) {
+      bkt_ptr = next;
+      continue;
+    }
+    struct mica_bkt *after = mica_next_bkt(next);
+    if (after != NULL) mica_set_link(bkt_ptr, after);
+    else mica_set_slot(&bkt_ptr->slots[MICA_CHAIN_SLOT], false, 0, 0);
+    mica_log_free_t *entry =
+      &index->ovf_free[(index->ovf_free_head + index->ovf_free_num) % index->ovf_num];
+    entry->offset = (uint64_t) (next - index->bkts);
+    entry->retired_at = (uint64_t) hrd_get_cycles();
+    index->ovf_free_num++;
+  }
+}
+
+// Takes a free slot of the chain of @bkt_ptr, or links an overflow bucket to
+// it. Returns false if @index has run out of overflow buckets.
+static bool mica_put_slot(mica_kv_t *kvs, mica_index_t *index,
+                          struct mica_bkt *bkt_ptr, uint32_t tag, uint64_t offset)
+{
+  while (true) {
+    for (int i = 0; i < MICA_BKT_SLOTS; i++) {
+      if (bkt_ptr->slots[i].in_use == 0) {
+        mica_set_slot(&bkt_ptr->slots[i], true, tag, offset);
+        return true;
+      }
+    }
+    struct mica_bkt *next = mica_next_bkt(bkt_ptr);
+    if (next != NULL) {
+      bkt_ptr = next;
+      continue;
+    }
+    struct mica_bkt *ovf = mica_ovf_alloc(kvs, index);
+    if (ovf == NULL) return false;
+    /* The key of the last slot moves to the overflow bucket before the slot
+     * turns into the link: a reader finds it in either place */
+    struct mica_slot *last = &bkt_ptr->slots[MICA_CHAIN_SLOT];
+    mica_set_slot(&ovf->slots[0], true, last->tag, last->offset);
+    mica_set_slot(&ovf->slots[1], true, tag, offset);
+    mica_set_link(bkt_ptr, ovf);
+    return true;
+  }
+}
+
+// Publishes an index of twice the buckets, that the writers then fill in
+static bool mica_resize_start(mica_kv_t *kvs)
+{
+  mica_index_t *index = kvs->index;
+  if (index->old != NULL || index->num_bkts * 2 > KVS_MAX_BKTS) return false;
+  mica_index_t *new_index = mica_index_alloc(IPC_PRIVATE, index->num_bkts * 2,
+                                             kvs->node_id);
+  new_index->old = index;
+  __atomic_store_n(&kvs->index, new_index, __ATOMIC_RELEASE);
+  kvs->num_resizes++;
+  my_printf(yellow, "mica: Instance %d doubling its index to %u buckets, %lu keys \n",
+            kvs->instance_id, new_index->num_bkts, kvs->num_keys);
+  return true;
+}
+
+// Overflow buckets that @keys take in an empty chain: the head and every
+// overflow bucket but the last hold MICA_CHAIN_SLOT keys and a link
+static inline uint32_t mica_ovf_needed(uint32_t keys)
+{
+  if (keys <= MICA_BKT_SLOTS) return 0;
+  return (keys - MICA_BKT_SLOTS + MICA_CHAIN_SLOT - 1) / MICA_CHAIN_SLOT;
+}
+
+// Overflow buckets that the chain of @bkt_ptr of @old takes in @index, where
+// its keys split over two buckets that are still empty
+static uint32_t mica_split_ovf_needed(mica_kv_t *kvs, mica_index_t *index,
+                                      mica_index_t *old, struct mica_bkt *bkt_ptr)
+{
+  uint32_t keys[2] = {0, 0};
+  for (; bkt_ptr != NULL; bkt_ptr = mica_next_bkt(bkt_ptr)) {
+    for (int i = 0; i < MICA_BKT_SLOTS; i++) {
+      struct mica_slot *slot = &bkt_ptr->slots[i];
+      if (slot->in_use == 0 || slot->tag == MICA_CHAIN_TAG) continue;
+      mica_op_t *kv_ptr = (mica_op_t *) &kvs->ht_log[slot->offset & kvs->log_mask];
+      keys[(kv_ptr->key.bkt & index->bkt_mask) >= old->num_bkts]++;
+    }
+  }
+  return mica_ovf_needed(keys[0]) + mica_ovf_needed(keys[1]);
+}
+
+// Frees the indexes that were migrated out of more than the grace ago
+static void mica_index_reclaim(mica_kv_t *kvs)
+{
+  uint64_t now = (uint64_t) hrd_get_cycles();
+  mica_index_t **prev = &kvs->retired;
+  while (*prev != NULL) {
+    mica_index_t *index = *prev;
+    if (now - index->retired_at >= kvs->reclaim_grace) {
+      *prev = index->next_retired;
+      mica_index_free(index);
+    }
+    else prev = &index->next_retired;
+  }
+}
+
+// Moves up to @bkt_num buckets of the old index to the current one. A bucket
+// moves only if the current index has the overflow buckets that its keys
+// take, so that it is never left half-moved.
+static void mica_migrate(mica_kv_t *kvs, uint32_t bkt_num)
+{
+  if (kvs->retired != NULL) mica_index_reclaim(kvs);
+  mica_index_t *index = kvs->index;
+  mica_index_t *old = index->old;
+  if (old == NULL) return;
+  uint32_t end = (uint32_t) MIN((uint64_t) index->migrated + bkt_num, old->num_bkts);
+  for (uint32_t bkt = index->migrated; bkt < end; bkt++) {
+    uint32_t needed = mica_split_ovf_needed(kvs, index, old, &old->bkts[bkt]);
+    if (needed > 0 && mica_ovf_avail(kvs, index, needed) < needed) return;
+    for (struct mica_bkt *bkt_ptr = &old->bkts[bkt]; bkt_ptr != NULL;
+         bkt_ptr = mica_next_bkt(bkt_ptr)) {
+      for (int i = 0; i < MICA_BKT_SLOTS; i++) {
+        struct mica_slot *slot = &bkt_ptr->slots[i];
+        if (slot->in_use == 0 || slot->tag == MICA_CHAIN_TAG) continue;
+        mica_op_t *kv_ptr = (mica_op_t *) &kvs->ht_log[slot->offset & kvs->log_mask];
+        struct mica_bkt *new_bkt = &index->bkts[kv_ptr->key.bkt & index->bkt_mask];
+        mica_put_slot(kvs, index, new_bkt, slot->tag, slot->offset);
+      }
+    }
+    __atomic_store_n(&index->migrated, bkt + 1, __ATOMIC_RELEASE);
+  }
+  if (end < old->num_bkts) return;
+
+  __atomic_store_n(&index->old, NULL, __ATOMIC_RELEASE);
+  /* Readers may still walk @old: free it after the grace, as log entries */
+  old->retired_at = (uint64_t) hrd_get_cycles();
+  old->next_retired = kvs->retired;
+  kvs->retired = old;
+}
+
+/* ---------------------------------------------------------------------------
+//------------------------------ LOG -----------------------------
+//---------------------------------------------------------------------------*/
+// All entries are sizeof(mica_op_t): the log is carved from its head and a
+// deleted entry is reused once MICA_RECLAIM_GRACE_MS have passed.
+
+static void mica_log_retire(mica_kv_t *kvs, uint64_t offset, uint64_t retired_at)
+{
+  if (kvs->free_num == kvs->free_cap) {
+    uint32_t new_cap = MAX(2 * kvs->free_cap, 1024);
+    mica_log_free_t *ring = malloc(new_cap * sizeof(mica_log_free_t));
+    for (uint32_t i = 0; i < kvs->free_num; i++)
+      ring[i] = kvs->free_ring[(kvs->free_head + i) % kvs->free_cap];
+    free(kvs->free_ring);
+    kvs->free_ring = ring;
+    kvs->free_cap = new_cap;
+    kvs->free_head = 0;
+  }
+  mica_log_free_t *entry = &kvs->free_ring[(kvs->free_head + kvs->free_num) % kvs->free_cap];
+  entry->offset = offset;
+  entry->retired_at = retired_at;
+  kvs->free_num++;
+}
+
+static bool mica_log_alloc(mica_kv_t *kvs, uint64_t *offset)
+{
+  if (kvs->free_num > 0) {
+    mica_log_free_t *oldest = &kvs->free_ring[kvs->free_head];
+    if ((uint64_t) hrd_get_cycles() - oldest->retired_at >= kvs->reclaim_grace) {
+      *offset = oldest->offset;
+      kvs->free_head = (kvs->free_head + 1) % kvs->free_cap;
+      kvs->free_num--;
+      return true;
+    }
+  }
+  if (kvs->log_cap - kvs->log_head < sizeof(mica_op_t)) return false;
+  *offset = kvs->log_head;
+  kvs->log_head += sizeof(mica_op_t);
+  return true;
+}
+
+/* ---------------------------------------------------------------------------
+//------------------------------ INSERT/DELETE -----------------------------
+//---------------------------------------------------------------------------*/
+
+static mica_op_t *mica_insert_locked(mica_kv_t *kvs, mica_op_t *op)
+{
+  mica_migrate(kvs, MICA_MIGRATE_STEP);
+  bool tag_taken;
+  mica_index_t *owner;
+  struct mica_slot *slot = mica_find_slot(kvs, mica_writer_bkt(kvs, &op->key, &owner),
+                                          &op->key, &tag_taken);
+  if (slot != NULL)
+    return (mica_op_t *) &kvs->ht_log[slot->offset & kvs->log_mask];
+  if (unlikely(tag_taken)) return NULL;
+
+  if (kvs->num_keys >= (uint64_t) kvs->index->num_bkts * MICA_RESIZE_LOAD)
+    mica_resize_start(kvs);
+
+  uint64_t offset;
+  if (!mica_log_alloc(kvs, &offset)) return NULL;
+  mica_op_t *kv_ptr = (mica_op_t *) &kvs->ht_log[offset & kvs->log_mask];
+  /* Paste the key-value into the log, before the slot publishes it */
+  memcpy(kv_ptr, op, sizeof(mica_op_t));
+
+  struct mica_bkt *bkt_ptr = mica_writer_bkt(kvs, &op->key, &owner);
+  if (!mica_put_slot(kvs, owner, bkt_ptr, mica_key_tag(&op->key), offset)) {
+    /* Out of overflow buckets: fail the insert and double the index, if it is
+     * not doubling already. Later inserts succeed as the migration moves on. */
+    mica_resize_start(kvs);
+    mica_log_retire(kvs, offset, 0); // never published, reuse it right away
+    return NULL;
+  }
+  kvs->num_keys++;
+  kvs->num_insert_op++;
+  return kv_ptr;
+}
+
+mica_op_t *mica_insert(mica_kv_t *kvs, mica_op_t *op)
+{
+  assert(kvs != NULL);
+  assert(op != NULL);
+  lock_seqlock(&kvs->lock);
+  mica_op_t *kv_ptr = mica_insert_locked(kvs, op);
+  if (kv_ptr == NULL) kvs->num_put_fail++;
+  unlock_seqlock(&kvs->lock);
+  return kv_ptr;
+}
+
+bool mica_delete(mica_kv_t *kvs, mica_key_t *key)
+{
+  assert(kvs != NULL);
+  assert(key != NULL);
+  lock_seqlock(&kvs->lock);
+  mica_migrate(kvs, MICA_MIGRATE_STEP);
+  bool tag_taken;
+  mica_index_t *owner;
+  struct mica_bkt *bkt_ptr = mica_writer_bkt(kvs, key, &owner);
+  struct mica_slot *slot = mica_find_slot(kvs, bkt_ptr, key, &tag_taken);
+  if (slot != NULL) {
+    uint64_t offset = slot->offset;
+    mica_set_slot(slot, false, 0, 0);
+    mica_ovf_release(kvs, owner, bkt_ptr);
+    mica_log_retire(kvs, offset, (uint64_t) hrd_get_cycles());
+    kvs->num_keys--;
+    kvs->num_delete_op++;
+  }
+  unlock_seqlock(&kvs->lock);
+  return slot != NULL;
+}
+
+static const char *match_isa_names[] = {"scalar", "avx2", "avx512"};
+
+static void mica_select_tag_match(void)
+{
+  /* The matchers compare the low 32 bits of a slot */
+  struct mica_slot slot = {.in_use = 1, .tag = 0x1234567, .offset = 0xABCDEF};
+  uint64_t raw;
+  memcpy(&raw, &slot, sizeof(raw));
+  assert((uint32_t) raw == mica_slot_word(0x1234567));
+
+  mica_match_isa = MICA_MATCH_SCALAR;
+#ifdef __x86_64__
+  if (MICA_ENABLE_SIMD_MATCH) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) mica_match_isa = MICA_MATCH_AVX512;
+    else if (__builtin_cpu_supports("avx2")) mica_match_isa = MICA_MATCH_AVX2;
+  }
+#endif
+  my_printf(cyan, "mica: matching bucket tags with %s \n", match_isa_names[mica_match_isa]);
+}
+
 void mica_init(mica_kv_t *kvs, int instance_id,
                int node_id, int num_bkts, uint64_t log_cap)
 {
-  int i, j;
   /* Verify struct sizes */
   assert(sizeof(struct mica_slot) == 8);
   assert(sizeof(mica_op_t) % 64 == 0);
   assert(kvs != NULL);
   assert(node_id == 0 || node_id == 1);
-  /* 16 million buckets = a 1 GB index */
-  assert(is_power_of_2(num_bkts) == 1 && num_bkts <= M_16);
   assert(MICA_LOG_BITS >= 24);	/* Minimum log w_size = 16 MB */
+  assert(log_cap < (1ULL << MICA_LOG_BITS));
+  mica_select_tag_match();
 
   // my_printf(red, "mica: Initializing MICA instance %d.\n"
   // 	"NUMA node = %d, buckets = %d (w_size = %u B), log capacity = %d B.\n",
@@ -82,98 +482,37 @@ void mica_init(mica_kv_t *kvs, int instance_id,
   kvs->instance_id = instance_id;
   kvs->node_id = node_id;
 
-  kvs->num_bkts = num_bkts;
-  kvs->bkt_mask = num_bkts - 1;	/* num_bkts is power of 2 */
-
   kvs->log_cap = log_cap;
   kvs->log_mask = log_cap - 1;	/* log_cap is a power of 2 */
   kvs->log_head = 0;
+  kvs->reclaim_grace = (uint64_t) (MICA_RECLAIM_GRACE_MS * MILLION *
+                                   hrd_get_cycles_per_ns());
 
-  /* Alloc index and initialize all entries to invalid */
+  /* Alloc index */
   // printf("mica: Allocting hash table index for instance %d\n", instance_id);
-  int ht_index_key = MICA_INDEX_SHM_KEY + instance_id;
-  if (ENABLE_ASSERTIONS) {
-    my_printf(green, "asking for %lu MB for the buckets \n",
-              num_bkts * sizeof(struct mica_bkt) / (M_1));
-  }
-  kvs->ht_index = (struct mica_bkt *) hrd_malloc_socket(ht_index_key,
-                                                       num_bkts * sizeof(struct mica_bkt), node_id);
-
-  for(i = 0; i < num_bkts; i++) {
-    for(j = 0; j < 8; j++) {
-      kvs->ht_index[i].slots[j].in_use = 0;
-    }
-  }
+  // Machines that share a host over the loopback transport can not share keys
+  int ht_index_key = ENABLE_LOOPBACK ? IPC_PRIVATE : MICA_INDEX_SHM_KEY + instance_id;
+  kvs->index = mica_index_alloc(ht_index_key, (uint32_t) num_bkts, node_id);
 
   /* Alloc log */
 //	printf("mica: Allocting hash table log for instance %d\n", instance_id);
-  int ht_log_key = MICA_LOG_SHM_KEY + instance_id;
+  int ht_log_key = ENABLE_LOOPBACK ? IPC_PRIVATE : MICA_LOG_SHM_KEY + instance_id;
   if (ENABLE_ASSERTIONS) {
-    my_printf(green, "asking for %lu MB for the log  \n", num_bkts * sizeof(struct mica_bkt) / M_1);
+    my_printf(green, "asking for %lu MB for the log  \n", log_cap / M_1);
   }
   kvs->ht_log = (uint8_t *) hrd_malloc_socket(ht_log_key, log_cap, node_id);
 }
 
 void mica_insert_one(mica_kv_t *kvs, mica_op_t *op)
 {
-
-  assert(kvs != NULL);
-  assert(op != NULL);
-  int i;
-  unsigned int bkt = op->key.bkt & kvs->bkt_mask;
-  struct mica_bkt *bkt_ptr = &kvs->ht_index[bkt];
-  unsigned int tag = op->key.tag;
-
-  kvs->num_insert_op++;
-
-  /* Find a slot to use for this key. If there is a slot with the same
-   * tag as ours, we are sure to find it because the used slots are at
-   * the beginning of the 8-slot array. */
-  int slot_to_use = -1;
-  for(i = 0; i < 8; i++) {
-    if(bkt_ptr->slots[i].tag == tag || bkt_ptr->slots[i].in_use == 0) {
-      slot_to_use = i;
-      if (bkt_ptr->slots[i].in_use == 1) {
-        mica_op_t *evic_op = (mica_op_t *)
-          &kvs->ht_log[bkt_ptr->slots[i].offset & kvs->log_mask];
-        my_printf(yellow, "Key %u overwrites %u \n", op->key_id, evic_op->key_id);
-        assert(false);
-      }
-    }
-  }
-  bool evict_flag = false;
-  /* If no slot found, choose one to evict */
-  if(slot_to_use == -1) {
-    assert(false);
-    slot_to_use = tag & 7;	/* tag is ~ randomly distributed */
-    kvs->num_index_evictions++;
-    evict_flag = true;
-  }
-
-  /* Encode the empty slot */
-  bkt_ptr->slots[slot_to_use].in_use = 1;
-  bkt_ptr->slots[slot_to_use].offset = kvs->log_head;	/* Virtual head */
-  bkt_ptr->slots[slot_to_use].tag = tag;
-
-  /* Paste the key-value into the log */
-  uint8_t *log_ptr = &kvs->ht_log[kvs->log_head & kvs->log_mask];
-
-
-  size_t len_to_copy = sizeof(mica_op_t);
-
-  /* Ensure that we don't wrap around in the *virtual* log space even
-   * after 8-byte alignment below.*/
-  assert((1ULL << MICA_LOG_BITS) - kvs->log_head > len_to_copy + 8);
-  if (evict_flag) {
-    mica_op_t * evic_op = (mica_op_t *) log_ptr;
-    my_printf(red, "Evicting key:bkt %u, server %u, tag %u \n",
-              evic_op->key.bkt, evic_op->key.server, evic_op->key.tag);
+  mica_op_t *kv_ptr = mica_insert(kvs, op);
+  assert(kv_ptr != NULL);
+  if (kv_ptr->key_id != op->key_id) {
+    my_printf(yellow, "Key %u overwrites %u \n", op->key_id, kv_ptr->key_id);
     assert(false);
   }
-  memcpy(log_ptr, op, len_to_copy);
 
 #ifdef KITE
-  mica_op_t *kv_ptr = (mica_op_t *) log_ptr;
   assert(IS_ALIGNED(&kv_ptr->key, 64));
   assert(IS_ALIGNED(&kv_ptr->value, 64));
 
@@ -181,24 +520,8 @@ void mica_insert_one(mica_kv_t *kvs, mica_op_t *op)
 #endif
 
 #ifdef HERMES
-  mica_op_t *kv_ptr = (mica_op_t *) log_ptr;
   assert(IS_ALIGNED(kv_ptr, 64));
 #endif
-
-  kvs->log_head += len_to_copy;
-
-  /* Ensure that the key field of each log entry is 8-byte aligned. This
-   * makes subsequent comparisons during GETs faster. */
-  kvs->log_head = (kvs->log_head + 7) & ~7;
-
-  /* If we're close to overflowing in the physical log, wrap around to
-   * the beginning, but go forward in the virtual log. */
-  if(unlikely(kvs->log_cap - kvs->log_head <= MICA_OP_SIZE + 32)) {
-    kvs->log_head = (kvs->log_head + kvs->log_cap) & ~kvs->log_mask;
-    my_printf(red, "mica: Instance %d wrapping around. Wraps = %llu\n",
-              kvs->instance_id, kvs->log_head / kvs->log_cap);
-    assert(false);
-  }
 }
 
 
@@ -212,8 +535,7 @@ void custom_mica_init(int kvs_id) {
 
 void custom_mica_populate_fixed_len(mica_kv_t * kvs, int n, int val_len) {
   assert(n > 0);
-  /* This is needed for the eviction message below to make sense */
-  assert(kvs->num_insert_op == 0 && kvs->num_index_evictions == 0);
+  assert(kvs->num_insert_op == 0);
 
   mica_op_t *op = (mica_op_t *) calloc(1, sizeof(mica_op_t));
   unsigned long *op_key = (unsigned long *) &op->key;
@@ -242,6 +242,15 @@ int *get_send_q_depths(per_qp_meta_t* qp_meta, uint16_t qp_num)
   return send_q_depth;
 }
 
+uint32_t *get_recv_sizes(per_qp_meta_t* qp_meta, uint16_t qp_num)
+{
+  uint32_t *recv_size = (uint32_t *) malloc(qp_num * sizeof(uint32_t));
+  for (int i = 0; i < qp_num; ++i) {
+    recv_size[i] = qp_meta[i].recv_size;
+  }
+  return recv_size;
+}
+
 void set_up_ctx_mcast(context_t *ctx)
 {
   uint32_t *recv_q_depth = NULL;
@@ -393,6 +402,15 @@ void ctx_set_up_q_info(context_t *ctx)
   free(is_broadcast);
 }
 
+void ctx_set_up_instr(context_t *ctx)
+{
+  const char *qp_name[INSTR_MAX_QPS];
+  assert(ctx->qp_num <= INSTR_MAX_QPS);
+  for (int qp_i = 0; qp_i < ctx->qp_num; ++qp_i)
+    qp_name[qp_i] = ctx->qp_meta[qp_i].send_string;
+  ctx->instr = od_instr_register_qps(ctx->t_id, ctx->qp_num, qp_name);
+}
+
 void ctx_set_qp_meta_mfs(context_t *ctx,
                                 mf_t *mf)
 {
@@ -419,15 +437,26 @@ void set_up_ctx(context_t *ctx)
     ctx->total_recv_buf_size += ctx->qp_meta[qp_i].recv_buf_size;
   }
   if (ENABLE_ASSERTIONS && ctx->t_id == 0) printf("total size %u \n ", ctx->total_recv_buf_size);
-  hrd_ctrl_blk_t *cb =
-    hrd_ctrl_blk_init(ctx->t_id,	/* local_hid */
-                      0, -1, /* port_index, numa_node_id */
-                      0, 0,	/* #conn qps, uc */
-                      NULL, 0, -1,	/* prealloc conn recv_buf, recv_buf capacity, key */
-                      ctx->qp_num, ctx->total_recv_buf_size,	/* num_dgram_qps, dgram_buf_size */
-                      MASTER_SHM_KEY + ctx->t_id, /* key */
-                      get_recv_q_depths(ctx->qp_meta, ctx->qp_num),
-                      get_send_q_depths(ctx->qp_meta, ctx->qp_num)); /* Depth of the dgram RECV Q*/
+  hrd_ctrl_blk_t *cb;
+  if (ENABLE_LOOPBACK) {
+    uint32_t *recv_size = get_recv_sizes(ctx->qp_meta, ctx->qp_num);
+    cb = hrd_lb_ctrl_blk_init(ctx->t_id, ctx->m_id,
+                              ctx->qp_num, ctx->total_recv_buf_size,
+                              get_recv_q_depths(ctx->qp_meta, ctx->qp_num),
+                              get_send_q_depths(ctx->qp_meta, ctx->qp_num),
+                              recv_size);
+    free(recv_size);
+  }
+  else {
+    cb = hrd_ctrl_blk_init(ctx->t_id,	/* local_hid */
+                           0, -1, /* port_index, numa_node_id */
+                           0, 0,	/* #conn qps, uc */
+                           NULL, 0, -1,	/* prealloc conn recv_buf, recv_buf capacity, key */
+                           ctx->qp_num, ctx->total_recv_buf_size,	/* num_dgram_qps, dgram_buf_size */
+                           MASTER_SHM_KEY + ctx->t_id, /* key */
+                           get_recv_q_depths(ctx->qp_meta, ctx->qp_num),
+                           get_send_q_depths(ctx->qp_meta, ctx->qp_num)); /* Depth of the dgram RECV Q*/
+  }
 
   ctx->cb = cb;
   ctx->recv_buffer = (void*) cb->dgram_buf;
@@ -441,6 +470,7 @@ void set_up_ctx(context_t *ctx)
   init_ctx_recv_infos(ctx);
   ctx_prepost_recvs(ctx);
   ctx_set_up_q_info(ctx);
+  ctx_set_up_instr(ctx);
 
   check_ctx(ctx);
 }
@@ -93,6 +93,21 @@ void qp_meta_ss_batch_q_depth(per_qp_meta_t* qp_meta)
   qp_meta->recv_q_depth = qp_meta->recv_wr_num + 3;
 }
 
+// The adaptive ss_batch never grows past what the send q was sized for, and
+// never shrinks below the batch of messages formed before a post
+void qp_meta_set_up_coalescing(per_qp_meta_t* qp_meta)
+{
+  bool is_bcast = qp_meta->flow_type == SEND_BCAST_LDR_RECV_UNI ||
+                  qp_meta->flow_type == SEND_BCAST_RECV_UNI ||
+                  qp_meta->flow_type == SEND_BCAST_RECV_BCAST;
+  qp_meta->max_ss_batch = qp_meta->ss_batch;
+  qp_meta->min_ss_batch = MIN(qp_meta->ss_batch,
+                              is_bcast ? MAX_BCAST_BATCH + 2 : qp_meta->send_wr_num + 2);
+  qp_meta->fill_ratio = 0;
+  qp_meta->hold_start = 0;
+  qp_meta->hold_budget = (uint64_t) (COALESCE_BUDGET_NS * hrd_get_cycles_per_ns());
+}
+
 void qp_meta_set_strings(per_qp_meta_t* qp_meta,
                                 const char *send_string,
                                 const char *recv_string)
@@ -166,6 +181,7 @@ void create_per_qp_meta(per_qp_meta_t *qp_meta,
 
   qp_meta_set_strings(qp_meta, send_string, recv_string);
   qp_meta_ss_batch_q_depth(qp_meta);
+  qp_meta_set_up_coalescing(qp_meta);
 
   qp_meta_set_up_credits(qp_meta, credits);
 
@@ -47,6 +47,51 @@ forceinline void od_insert_mes(context_t *ctx, uint16_t qp_id,
 //------------------------------ BROADCASTS --------------------------------
 //---------------------------------------------------------------------------*/
 
+// A lone, partly filled message is held for up to hold_budget cycles,
+// so that the messages inserted meanwhile coalesce into it
+static inline bool ctx_hold_for_coalescing(per_qp_meta_t *qp_meta)
+{
+  fifo_t *send_fifo = qp_meta->send_fifo;
+  if (send_fifo->capacity > 1) {
+    qp_meta->hold_start = 0;
+    return false;
+  }
+  slot_meta_t *slot_meta = get_fifo_slot_meta_pull(send_fifo);
+  uint32_t avg_mes_size = (slot_meta->byte_size - send_fifo->mes_header) /
+                          slot_meta->coalesce_num;
+  if (slot_meta->byte_size + avg_mes_size > send_fifo->slot_size) return false;
+
+  uint64_t now = (uint64_t) hrd_get_cycles();
+  if (qp_meta->hold_start == 0) qp_meta->hold_start = now;
+  return now - qp_meta->hold_start < qp_meta->hold_budget;
+}
+
+// Fill ratio of the sent messages, as a moving average over the last ~8
+static inline void ctx_track_fill_ratio(per_qp_meta_t *qp_meta, uint32_t byte_size)
+{
+  uint32_t fill = (1000 * byte_size) / qp_meta->send_fifo->slot_size;
+  qp_meta->fill_ratio = ((7 * qp_meta->fill_ratio) + fill) / 8;
+}
+
+// ss_batch only changes right before a signaled send, when the previous
+// signaled send has already been polled; sent_tx restarts to keep them paired
+static inline void ctx_adapt_ss_batch(per_qp_meta_t *qp_meta, uint16_t t_id)
+{
+  if (qp_meta->sent_tx % qp_meta->ss_batch != 0) return;
+  uint32_t ss_batch = qp_meta->ss_batch;
+  if (qp_meta->fill_ratio >= COALESCE_HIGH_FILL)
+    ss_batch = MAX(ss_batch / 2, qp_meta->min_ss_batch);
+  else if (qp_meta->fill_ratio <= COALESCE_LOW_FILL)
+    ss_batch = MIN(ss_batch * 2, qp_meta->max_ss_batch);
+  if (ss_batch == qp_meta->ss_batch) return;
+
+  if (DEBUG_SS_BATCH)
+    my_printf(cyan, "Wrkr %u %s ss_batch %u -> %u, fill %u/1000 \n", t_id,
+              qp_meta->send_string, qp_meta->ss_batch, ss_batch, qp_meta->fill_ratio);
+  qp_meta->ss_batch = ss_batch;
+  qp_meta->sent_tx = 0;
+}
+
 static inline void ctx_forge_bcast_wr(context_t *ctx,
                                       uint16_t qp_id,
                                       uint16_t br_i)
@@ -57,6 +102,10 @@ static inline void ctx_forge_bcast_wr(context_t *ctx,
   fifo_t *send_fifo = qp_meta->send_fifo;
   send_sgl[br_i].length = get_fifo_slot_meta_pull(send_fifo)->byte_size;
   send_sgl[br_i].addr = (uintptr_t) get_fifo_pull_slot(send_fifo);
+  if (ENABLE_ADAPTIVE_COALESCING) {
+    ctx_track_fill_ratio(qp_meta, send_sgl[br_i].length);
+    ctx_adapt_ss_batch(qp_meta, ctx->t_id);
+  }
 
   form_bcast_links(&qp_meta->sent_tx, qp_meta->ss_batch, ctx->q_info, br_i,
                    qp_meta->send_wr, qp_meta->send_cq, qp_meta->send_string, ctx->t_id);
@@ -68,18 +117,24 @@ inline void ctx_send_broadcasts(context_t *ctx, uint16_t qp_id)
   per_qp_meta_t *qp_meta = &ctx->qp_meta[qp_id];
   per_qp_meta_t *recv_qp_meta = &ctx->qp_meta[qp_meta->recv_qp_id];
   uint16_t br_i = 0, mes_sent = 0, available_credits = 0;
+  uint64_t sent_bytes = 0;
   fifo_t *send_fifo = qp_meta->send_fifo;
   if (send_fifo->net_capacity == 0) return;
+  else if (ENABLE_ADAPTIVE_COALESCING && ctx_hold_for_coalescing(qp_meta)) return;
   else if (!check_bcast_credits(qp_meta->credits, ctx->q_info,
                                 &qp_meta->time_out_cnt,
                                 &available_credits, 1,
-                                ctx->t_id)) return;
+                                ctx->t_id)) {
+    od_instr_credit_stall(ctx->instr, qp_id);
+    return;
+  }
 
 
   while (send_fifo->net_capacity > 0 && mes_sent < available_credits) {
 
     qp_meta->mfs->send_helper(ctx);
     ctx_forge_bcast_wr(ctx, qp_id, br_i);
+    sent_bytes += qp_meta->send_sgl[br_i].length;
     fifo_send_from_pull_slot(send_fifo);
     br_i++;
     mes_sent++;
@@ -100,7 +155,13 @@ inline void ctx_send_broadcasts(context_t *ctx, uint16_t qp_id)
                                     qp_meta->send_qp, qp_meta->enable_inlining);
   }
   if (ENABLE_ASSERTIONS) assert(recv_qp_meta->recv_info->posted_recvs <= recv_qp_meta->recv_wr_num);
-  if (mes_sent > 0) decrease_credits(qp_meta->credits, ctx->q_info, mes_sent);
+  if (mes_sent > 0) {
+    decrease_credits(qp_meta->credits, ctx->q_info, mes_sent);
+    qp_meta->hold_start = 0;
+    // every broadcast goes out once per active remote machine
+    od_instr_sent(ctx->instr, qp_id, (uint32_t) mes_sent * ctx->q_info->active_num,
+                  sent_bytes * ctx->q_info->active_num);
+  }
 }
 
 /* ---------------------------------------------------------------------------
@@ -182,6 +243,7 @@ inline void ctx_send_unicasts(context_t *ctx,
 {
   struct ibv_send_wr *bad_send_wr;
   uint16_t mes_i = 0;
+  uint64_t sent_bytes = 0;
   per_qp_meta_t *qp_meta = &ctx->qp_meta[qp_id];
   for (uint16_t fifo_i = 0; fifo_i < qp_meta->send_fifo_num; ++fifo_i) {
     fifo_t *send_fifo = &qp_meta->send_fifo[fifo_i];
@@ -192,6 +254,7 @@ inline void ctx_send_unicasts(context_t *ctx,
         qp_meta->mfs->send_helper(ctx);
       }
       ctx_forge_unicast_wr(ctx, qp_id, fifo_i, mes_i);
+      sent_bytes += qp_meta->send_sgl[mes_i].length;
 
       slot_meta_t *slot_meta = get_fifo_slot_meta_pull(send_fifo);
       fifo_send_from_pull_slot(send_fifo);
@@ -203,6 +266,9 @@ inline void ctx_send_unicasts(context_t *ctx,
       }
       mes_i++;
     }
+    // the fifo still has messages, so it ran out of credits
+    if (qp_meta->needs_credits && send_fifo->capacity > 0)
+      od_instr_credit_stall(ctx->instr, qp_id);
   }
 
     if (mes_i > 0) {
@@ -216,6 +282,7 @@ inline void ctx_send_unicasts(context_t *ctx,
       ctx_check_unicast_before_send(ctx, qp_meta->leader_m_id, qp_id);
       int ret = ibv_post_send(qp_meta->send_qp, qp_meta->send_wr, &bad_send_wr);
       CPE(ret, "Unicast ibv_post_send error", ret);
+      od_instr_sent(ctx->instr, qp_id, mes_i, sent_bytes);
     }
 
 }
@@ -230,6 +297,7 @@ inline void ctx_poll_incoming_messages(context_t *ctx, uint16_t qp_id)
                                          &qp_meta->completed_but_not_polled,
                                          qp_meta->recv_buf_slot_num, ctx->t_id);
   if (completed_messages <= 0) {
+    od_instr_polled(ctx->instr, qp_id, 0);
     if (qp_meta->recv_type == RECV_REPLY) {
       if (qp_meta->outstanding_messages > 0) qp_meta->wait_for_reps_ctr++;
     }
@@ -248,6 +316,7 @@ inline void ctx_poll_incoming_messages(context_t *ctx, uint16_t qp_id)
     qp_meta->polled_messages++;
   }
   qp_meta->completed_but_not_polled = completed_messages - qp_meta->polled_messages;
+  od_instr_polled(ctx->instr, qp_id, qp_meta->polled_messages);
   //printf("polled %d , completed not polled %d \n", qp_meta->polled_messages, qp_meta->completed_but_not_polled);
   //zk_debug_info_bookkeep(ctx, qp_id, completed_messages, qp_meta->polled_messages);
   if (ENABLE_ASSERTIONS) {
@@ -401,6 +470,7 @@ forceinline void od_send_acks(context_t *ctx, uint16_t qp_id)
     qp_meta->send_wr[prev_ack_i].next = NULL;
     int ret = ibv_post_send(qp_meta->send_qp, &qp_meta->send_wr[first_wr], &bad_send_wr);
     if (ENABLE_ASSERTIONS) CPE(ret, "ACK ibv_post_send error", ret);
+    od_instr_sent(ctx->instr, qp_id, ack_i, (uint64_t) ack_i * qp_meta->send_size);
   }
 }
 
@@ -462,8 +532,8 @@ forceinline void create_inputs_of_op(uint8_t **value_to_write, uint8_t **value_t
     (*real_val_len) = (uint32_t) VALUE_SIZE;
     (*value_to_write) = op_value;
     (*value_to_read) = op_value;
-    (*range_start) = op_value;
-    (*range_end) = op_value + 10;
+    (*range_start) = trace->key_hash;
+    (*range_end) = trace->range_end_hash;
     if (*opcode == FETCH_AND_ADD) *(uint64_t *) op_value = 1;
   }
 }
@@ -0,0 +1,69 @@
+//
+// Busy-poll scheduler for the worker main loops
+//
+
+#include "od_sched.h"
+
+od_sched_t *od_sched_create(context_t *ctx)
+{
+  od_sched_t *sched = (od_sched_t *) calloc(1, sizeof(od_sched_t));
+  assert(sched != NULL);
+  sched->instr = ctx->instr;
+  return sched;
+}
+
+void od_sched_add(od_sched_t *sched, const char *name,
+                  od_stage_fn_t fn, uint16_t arg, od_stage_flag_t flag)
+{
+  assert(sched->stage_num < SCHED_MAX_STAGES);
+  od_stage_t *stage = &sched->stage[sched->stage_num];
+  memset(stage, 0, sizeof(od_stage_t));
+  stage->fn = fn;
+  stage->arg = arg;
+  stage->flag = flag;
+  stage->name = name;
+  od_instr_register_stage(sched->instr, sched->stage_num, name);
+  sched->stage_num++;
+}
+
+/* ---------------------------------------------------------------------------
+//------------------------------ GENERIC STAGES --------------------------------
+//---------------------------------------------------------------------------*/
+
+bool od_stage_send_broadcasts(context_t *ctx, uint16_t qp_id)
+{
+  bool queued = ctx->qp_meta[qp_id].send_fifo->net_capacity > 0;
+  ctx_send_broadcasts(ctx, qp_id);
+  return queued;
+}
+
+bool od_stage_send_unicasts(context_t *ctx, uint16_t qp_id)
+{
+  per_qp_meta_t *qp_meta = &ctx->qp_meta[qp_id];
+  bool queued = false;
+  for (uint16_t fifo_i = 0; fifo_i < qp_meta->send_fifo_num; fifo_i++)
+    queued |= qp_meta->send_fifo[fifo_i].capacity > 0;
+  ctx_send_unicasts(ctx, qp_id);
+  return queued;
+}
+
+// Messages that were completed but could not be handled yet count as work
+bool od_stage_poll(context_t *ctx, uint16_t qp_id)
+{
+  per_qp_meta_t *qp_meta = &ctx->qp_meta[qp_id];
+  uint32_t pull_ptr = qp_meta->recv_fifo->pull_ptr;
+  ctx_poll_incoming_messages(ctx, qp_id);
+  return qp_meta->recv_fifo->pull_ptr != pull_ptr ||
+         qp_meta->completed_but_not_polled > 0;
+}
+
+bool od_stage_send_acks(context_t *ctx, uint16_t qp_id)
+{
+  per_qp_meta_t *qp_meta = &ctx->qp_meta[qp_id];
+  ctx_ack_mes_t *acks = (ctx_ack_mes_t *) qp_meta->send_fifo->fifo;
+  bool queued = false;
+  for (uint8_t m_i = 0; m_i <= qp_meta->receipient_num; m_i++)
+    queued |= acks[m_i].opcode != OP_ACK;
+  od_send_acks(ctx, qp_id);
+  return queued;
+}
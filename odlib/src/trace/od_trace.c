@@ -3,6 +3,11 @@
 //
 
 #include "../../include/trace/od_trace_util.h"
+#include "od_kvs_backend.h"
+#include "od_workload.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 typedef struct opcode_info {
   bool is_rmw;
@@ -21,8 +26,8 @@ typedef struct opcode_info {
   uint32_t range_queries;
 } opcode_info_t;
 
-//When manufacturing the trace
-static uint8_t compute_opcode(struct opcode_info *opc_info, uint *seed)
+//When manufacturing the trace, with the compile-time mix
+static uint8_t compute_opcode(struct opcode_info *opc_info, uint64_t *seed)
 {
   uint8_t  opcode = 0;
   uint8_t cas_opcode = USE_WEAK_CAS ? COMPARE_AND_SWAP_WEAK : COMPARE_AND_SWAP_STRONG;
@@ -30,14 +35,14 @@ static uint8_t compute_opcode(struct opcode_info *opc_info, uint *seed)
   if (ENABLE_RMWS) {
     if (ALL_RMWS_SINGLE_KEY) is_rmw = true;
     else
-      is_rmw = rand() % 1000 < RMW_RATIO;
+      is_rmw = hrd_fastrand(seed) % 1000 < RMW_RATIO;
   }
   if (!is_rmw) {
-    is_update = rand() % 1000 < write_ratio; //rand_r(seed) % 1000 < WRITE_RATIO;
-    is_sc = rand() % 1000 < SC_RATIO; //rand_r(seed) % 1000 < SC_RATIO;
-#if USE_SPLINTERDB || USE_BPLUS    
-    is_range = rand() % 1000 < RANGE_RATIO;
-    #endif
+    is_update = hrd_fastrand(seed) % 1000 < write_ratio;
+    is_sc = hrd_fastrand(seed) % 1000 < SC_RATIO;
+    // MICA is a hash index and cannot serve range queries
+    if (kvs_backend != MICA_KVS)
+      is_range = hrd_fastrand(seed) % 1000 < RANGE_RATIO;
   }
 
   if (is_rmw) {
@@ -45,7 +50,7 @@ static uint8_t compute_opcode(struct opcode_info *opc_info, uint *seed)
     if (TRACE_ONLY_CAS) opcode = cas_opcode;
     else if (TRACE_ONLY_FA) opcode = FETCH_AND_ADD;
     else if (TRACE_MIXED_RMWS)
-      opcode = (uint8_t) ((rand_r(seed) % 1000 < TRACE_CAS_RATIO) ? cas_opcode : FETCH_AND_ADD);
+      opcode = (uint8_t) ((hrd_fastrand(seed) % 1000 < TRACE_CAS_RATIO) ? cas_opcode : FETCH_AND_ADD);
     if (opcode == cas_opcode) opc_info->cas++;
     else opc_info->fa++;
   }
@@ -61,7 +66,6 @@ static uint8_t compute_opcode(struct opcode_info *opc_info, uint *seed)
   } else if (is_range) {
     opcode = KVS_OP_RANGE;
     opc_info->range_queries++;
-    opc_info->is_range = true;
   } else  {
     if (is_sc && ENABLE_ACQUIRES) {
       opcode = OP_ACQUIRE;
@@ -75,12 +79,60 @@ static uint8_t compute_opcode(struct opcode_info *opc_info, uint *seed)
   opc_info->is_rmw = is_rmw;
   opc_info->is_update = is_update;
   opc_info->is_sc = is_sc;
+  opc_info->is_range = is_range;
   return opcode;
 }
 
+// When manufacturing the trace, with a --workload mix: returns the opcode
+// and picks the key (and the scan length) of the next op
+static uint8_t wl_compute_opcode(struct opcode_info *opc_info, od_wl_gen_t *gen,
+                                 uint32_t *key_id, uint32_t *scan_len,
+                                 bool *rmw_pending)
+{
+  opc_info->is_rmw = false;
+  opc_info->is_update = false;
+  opc_info->is_sc = false;
+  opc_info->is_range = false;
+  od_wl_op_t op = od_wl_next_op(gen);
+  switch (op) {
+    case OD_WL_UPDATE:
+    case OD_WL_INSERT:
+      opc_info->is_update = true;
+      opc_info->writes++;
+      *key_id = op == OD_WL_INSERT ? od_wl_next_insert_key(gen) : od_wl_next_key(gen);
+      return KVS_OP_PUT;
+    case OD_WL_SCAN:
+      *key_id = od_wl_next_key(gen);
+      // MICA is a hash index and cannot serve range queries
+      if (kvs_backend == MICA_KVS) break;
+      opc_info->is_range = true;
+      opc_info->range_queries++;
+      *scan_len = od_wl_next_scan_len(gen);
+      return KVS_OP_RANGE;
+    case OD_WL_RMW:
+      *key_id = od_wl_next_key(gen);
+      if (ENABLE_RMWS) {
+        opc_info->is_rmw = true;
+        opc_info->rmws++;
+        opc_info->fa++;
+        return FETCH_AND_ADD;
+      }
+      // a read, and then a write of the same key
+      *rmw_pending = true;
+      break;
+    case OD_WL_READ:
+    default:
+      *key_id = od_wl_next_key(gen);
+      break;
+  }
+  opc_info->reads++;
+  return KVS_OP_GET;
+}
+
 
 // Parse a trace, use this for skewed workloads as uniform trace can be manufactured easily
-static trace_t* parse_trace(char* path, int t_id){
+// @op_num is set to the number of ops, without the closing NOP
+static trace_t* parse_trace(char* path, int t_id, uint32_t *op_num){
   trace_t *trace;
   FILE * fp;
   ssize_t read;
@@ -110,8 +162,7 @@ static trace_t* parse_trace(char* path, int t_id){
   trace = (trace_t *)malloc((cmd_count + 1) * sizeof(trace_t));
   struct timespec time;
   clock_gettime(CLOCK_MONOTONIC, &time);
-  uint seed = (uint)(time.tv_nsec + ((machine_id * WORKERS_PER_MACHINE) + t_id) + (uint64_t)trace);
-  srand (seed);
+  uint64_t seed = (uint64_t) time.tv_nsec + ((machine_id * WORKERS_PER_MACHINE) + t_id) + (uint64_t) trace;
   int debug_cnt = 0;
   //parse file line by line and insert trace to cmd.
   for (i = 0; i < cmd_count; i++) {
@@ -138,6 +189,10 @@ static trace_t* parse_trace(char* path, int t_id){
         uint128 key_hash = CityHash128((char *) &(key_id), 4);
         debug_cnt++;
         memcpy(trace[i].key_hash, &(key_hash.second), 8);
+        trace[i].key_id = key_id;
+        if (opc_info->is_range)
+          od_kvs_range_end((mica_key_t *) trace[i].key_hash,
+                           (mica_key_t *) trace[i].range_end_hash, RANGE_LEN);
       }
       word_count++;
       word = strtok_r(NULL, " ", &saveptr);
@@ -166,66 +221,78 @@ static trace_t* parse_trace(char* path, int t_id){
   fclose(fp);
   if (line)
     free(line);
+  free(opc_info);
+  *op_num = cmd_count;
   return trace;
 }
 
 
-// Manufactures a trace with a uniform distrbution without a backing file
+// Manufactures a trace without a backing file, from the workload selected
+// at startup (od_workload.h)
 static trace_t* manufacture_trace(int t_id)
 {
   trace_t *trace = (trace_t *) calloc ((TRACE_SIZE + 1), sizeof(trace_t));
-  struct timespec time;
-  //struct random_data *recv_buf;
-  clock_gettime(CLOCK_MONOTONIC, &time);
-  uint seed = (uint)(time.tv_nsec + ((machine_id * WORKERS_PER_MACHINE) + t_id) + (uint64_t)trace);
-  srand (seed);
+  od_wl_gen_t gen;
+  od_wl_gen_init(&gen, (uint32_t) GET_GLOBAL_T_ID(machine_id, t_id));
   opcode_info_t *opc_info = (opcode_info_t *) calloc(1, sizeof(opcode_info_t));
   uint32_t i, sess_id = 0;
+  bool rmw_pending = false;
 
   //parse file line by line and insert trace to cmd.
   for (i = 0; i < TRACE_SIZE; i++) {
     trace[i].opcode = 0;
 
     int session_window = 10 * SESSIONS_PER_THREAD;
+    uint32 key_id;
+    uint32_t scan_len = RANGE_LEN;
 
-    //Before reading the request decide if it's gone be r_rep or write
-    trace[i].opcode = compute_opcode(opc_info, &seed);
+    if (wl_cfg.mix != NULL) {
+      if (rmw_pending) {
+        // the write half of a read-modify-write
+        trace[i].opcode = KVS_OP_PUT;
+        key_id = trace[i - 1].key_id;
+        opc_info->is_range = false;
+        opc_info->writes++;
+        rmw_pending = false;
+      }
+      else trace[i].opcode = wl_compute_opcode(opc_info, &gen, &key_id,
+                                               &scan_len, &rmw_pending);
+    }
+    else {
+      //Before reading the request decide if it's gone be r_rep or write
+      trace[i].opcode = compute_opcode(opc_info, &gen.seed);
 
-    //--- KEY ID----------
-    uint32 key_id;
-    uint32 range_start, range_end;
-    if(USE_A_SINGLE_KEY == 1) key_id =  0;
-    uint128 key_hash;// = CityHash128((char *) &(key_id), 4);
-    if (opc_info->is_rmw) {
-      if (ALL_RMWS_SINGLE_KEY || ENABLE_ALL_CONFLICT_RMW)
-        key_id = 0;
-      else if (RMW_ONE_KEY_PER_THREAD)
-        key_id = (uint32_t) t_id;
-      else if (ENABLE_NO_CONFLICT_RMW) {
-        key_id = (uint32_t) ((machine_id * WORKERS_PER_MACHINE * session_window) + (t_id * session_window) +
-                             sess_id);
-        //if (i < SESSIONS_PER_THREAD) printf("%u: key_id  %u\n", i, key_id);
-        MOD_INCR(sess_id, session_window);
+      //--- KEY ID----------
+      if (opc_info->is_rmw) {
+        if (ALL_RMWS_SINGLE_KEY || ENABLE_ALL_CONFLICT_RMW)
+          key_id = 0;
+        else if (RMW_ONE_KEY_PER_THREAD)
+          key_id = (uint32_t) t_id;
+        else if (ENABLE_NO_CONFLICT_RMW) {
+          key_id = (uint32_t) ((machine_id * WORKERS_PER_MACHINE * session_window) + (t_id * session_window) +
+                               sess_id);
+          //if (i < SESSIONS_PER_THREAD) printf("%u: key_id  %u\n", i, key_id);
+          MOD_INCR(sess_id, session_window);
+        }
+        else key_id = od_wl_next_key(&gen);
       }
-      else key_id = (uint32_t) (rand_r(&seed) % KVS_NUM_KEYS);
-
-      //printf("Wrkr %u key %u \n", t_id, key_id);
-      key_hash = CityHash128((char *) &(key_id), 4);
-    } else if (opc_info->is_range) {
-      //! we have a range query. Generate a start and end range value
-      //! using key_id as range start, key_hash as range end
-      key_id = (uint32) rand() % KVS_NUM_KEYS;
-      key_hash = CityHash128((char *) &(key_id), 4);
-    } else {
-      key_id = (uint32) rand() % KVS_NUM_KEYS;
-      key_hash = CityHash128((char *) &(key_id), 4);
+      else key_id = od_wl_next_key(&gen);
     }
+    if (USE_A_SINGLE_KEY == 1) key_id = 0;
+
+    uint128 key_hash = CityHash128((char *) &(key_id), 4);
     memcpy(trace[i].key_hash, &(key_hash.second), 8);
     trace[i].key_id = key_id;
+    // A range query starts at the key and covers ~scan_len keys
+    if (opc_info->is_range)
+      od_kvs_range_end((mica_key_t *) trace[i].key_hash,
+                       (mica_key_t *) trace[i].range_end_hash, scan_len);
   }
 
   if (t_id == 0) {
-    my_printf(cyan, "UNIFORM TRACE \n");
+    my_printf(cyan, "MANUFACTURED TRACE: workload %s, %s keys \n",
+              wl_cfg.mix == NULL ? "compile-time" : wl_cfg.mix->name,
+              od_wl_dist_name(wl_cfg.dist));
     printf("Writes: %.2f%%, SC Writes: %.2f%%, Reads: %.2f%% SC Reads: %.2f%% RMWs: %.2f%%, "
              "CAS: %.2f%%, F&A: %.2f%%, RMW-Acquires: %.2f%%\n Trace w_size %u/%d, Write ratio %d \nRange Query Percentage: %.2f%%\n",
            (double) (opc_info->writes * 100) / TRACE_SIZE,
@@ -240,10 +307,130 @@ static trace_t* manufacture_trace(int t_id)
            opc_info->rmw_acquires,
            TRACE_SIZE, write_ratio, (double) (opc_info->range_queries * 100) / TRACE_SIZE);
   }
+  free(opc_info);
   trace[TRACE_SIZE].opcode = NOP;
   return trace;
-  // printf("CLient %d Trace w_size: %d, debug counter %d hot keys %d, cold keys %d \n",l_id, cmd_count, debug_cnt,
-  //         t_stats[l_id].hot_keys_per_trace, t_stats[l_id].cold_keys_per_trace );
+}
+
+/* ---------------------------------------------------------------------------
+//------------------------------ BINARY TRACE --------------------------------
+//---------------------------------------------------------------------------*/
+
+static const od_trace_bin_hdr_t *bin_trace = NULL;
+static pthread_once_t bin_trace_once = PTHREAD_ONCE_INIT;
+
+static void od_trace_path(char *path, size_t size, const char *name)
+{
+  char cwd[1024];
+  char *was_successful = getcwd(cwd, sizeof(cwd));
+  if (!was_successful) {
+    printf("ERROR: getcwd failed!\n");
+    exit(EXIT_FAILURE);
+  }
+  snprintf(path, size, "%s%s%s", cwd, TRACE_DIR, name);
+}
+
+static void od_trace_text_path(char *path, size_t size, uint32_t g_t_id)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "t_%04d_a_0.%d.txt", g_t_id, SKEW_EXPONENT_A);
+  od_trace_path(path, size, name);
+}
+
+static void od_trace_bin_path(char *path, size_t size)
+{
+  char name[64];
+  snprintf(name, sizeof(name), TRACE_BIN_NAME, SKEW_EXPONENT_A);
+  od_trace_path(path, size, name);
+}
+
+// Maps the binary trace once per process; without one, bin_trace stays NULL
+static void od_trace_map_bin(void)
+{
+  char path[2048];
+  struct stat st;
+  od_trace_bin_path(path, sizeof(path));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(od_trace_bin_hdr_t)) {
+    my_printf(red, "ERROR: Binary trace %s is truncated \n", path);
+    exit(EXIT_FAILURE);
+  }
+  void *addr = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    my_printf(red, "ERROR: Cannot mmap binary trace %s: %s \n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  const od_trace_bin_hdr_t *hdr = (const od_trace_bin_hdr_t *) addr;
+  if (hdr->magic != OD_TRACE_BIN_MAGIC || hdr->version != OD_TRACE_BIN_VERSION ||
+      hdr->rec_size != sizeof(trace_t) ||
+      od_trace_bin_recs_start(hdr->part_num) + hdr->rec_num * sizeof(trace_t) > (uint64_t) st.st_size ||
+      hdr->part_offset[hdr->part_num] != hdr->rec_num) {
+    my_printf(red, "ERROR: %s is not a binary trace of this build, rerun --convert-trace \n", path);
+    exit(EXIT_FAILURE);
+  }
+  if (hdr->write_ratio != write_ratio)
+    my_printf(yellow, "WARNING: Binary trace %s was drawn with write ratio %d, not %d \n",
+              path, hdr->write_ratio, write_ratio);
+  my_printf(cyan, "Mapped binary trace %s: %u threads, %lu ops \n",
+            path, hdr->part_num, hdr->rec_num);
+  bin_trace = hdr;
+}
+
+static trace_t *od_trace_from_bin(uint32_t g_t_id)
+{
+  pthread_once(&bin_trace_once, od_trace_map_bin);
+  if (bin_trace == NULL || g_t_id >= bin_trace->part_num) return NULL;
+  trace_t *recs = (trace_t *) ((uint8_t *) bin_trace + od_trace_bin_recs_start(bin_trace->part_num));
+  return &recs[bin_trace->part_offset[g_t_id]];
+}
+
+void od_trace_convert(const char *out_path)
+{
+  uint32_t part_num = WORKER_NUM;
+  trace_t **part = (trace_t **) calloc(part_num, sizeof(trace_t *));
+  od_trace_bin_hdr_t *hdr = (od_trace_bin_hdr_t *)
+    calloc(1, od_trace_bin_recs_start(part_num));
+  hdr->magic = OD_TRACE_BIN_MAGIC;
+  hdr->version = OD_TRACE_BIN_VERSION;
+  hdr->rec_size = sizeof(trace_t);
+  hdr->part_num = part_num;
+  hdr->write_ratio = write_ratio;
+
+  for (uint32_t g_t_id = 0; g_t_id < part_num; g_t_id++) {
+    char path[2048];
+    uint32_t op_num;
+    od_trace_text_path(path, sizeof(path), g_t_id);
+    part[g_t_id] = parse_trace(path, g_t_id, &op_num);
+    hdr->part_offset[g_t_id] = hdr->rec_num;
+    hdr->rec_num += op_num + 1; // the closing NOP
+  }
+  hdr->part_offset[part_num] = hdr->rec_num;
+
+  char tmp_path[2048];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", out_path);
+  FILE *fp = fopen(tmp_path, "w");
+  if (fp == NULL) {
+    printf("ERROR: Cannot open file: %s\n", tmp_path);
+    exit(EXIT_FAILURE);
+  }
+  bool ok = fwrite(hdr, od_trace_bin_recs_start(part_num), 1, fp) == 1;
+  for (uint32_t g_t_id = 0; g_t_id < part_num; g_t_id++) {
+    uint64_t recs = hdr->part_offset[g_t_id + 1] - hdr->part_offset[g_t_id];
+    ok &= fwrite(part[g_t_id], sizeof(trace_t), recs, fp) == recs;
+    free(part[g_t_id]);
+  }
+  ok &= fclose(fp) == 0;
+  if (!ok || rename(tmp_path, out_path) != 0) {
+    printf("ERROR: Could not write binary trace %s\n", out_path);
+    exit(EXIT_FAILURE);
+  }
+  my_printf(green, "Wrote binary trace %s: %u threads, %lu ops \n",
+            out_path, part_num, hdr->rec_num);
+  free(hdr);
+  free(part);
 }
 
 // Initiialize the trace
@@ -251,19 +438,15 @@ trace_t* trace_init(uint16_t t_id) {
   trace_t *trace;
   //create the trace path path
   if (FEED_FROM_TRACE == 1) {
-    char path[2048];
-    char cwd[1024];
-    char *was_successful = getcwd(cwd, sizeof(cwd));
-    if (!was_successful) {
-      printf("ERROR: getcwd failed!\n");
-      exit(EXIT_FAILURE);
+    uint32_t g_t_id = (uint32_t) GET_GLOBAL_T_ID(machine_id, t_id);
+    trace = od_trace_from_bin(g_t_id);
+    if (trace == NULL) {
+      char path[2048];
+      uint32_t op_num;
+      od_trace_text_path(path, sizeof(path), g_t_id);
+      //initialize the command array from the trace file
+      trace = parse_trace(path, t_id, &op_num);
     }
-    snprintf(path, sizeof(path), "%s%s%04d%s%d%s", cwd,
-             "/../../../traces/current-splited-traces/t_",
-             GET_GLOBAL_T_ID(machine_id, t_id), "_a_0.", SKEW_EXPONENT_A, ".txt");
-
-    //initialize the command array from the trace file
-    trace = parse_trace(path, t_id);
   }
   else {
     trace = manufacture_trace(t_id);
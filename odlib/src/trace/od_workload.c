@@ -0,0 +1,173 @@
+//
+// Workload generator of the manufactured traces
+//
+
+#include "od_workload.h"
+#include <math.h>
+
+static const od_workload_t ycsb_workloads[] = {
+  { .name = "a", .read = 500, .update = 500, .dist = OD_DIST_ZIPF },
+  { .name = "b", .read = 950, .update = 50, .dist = OD_DIST_ZIPF },
+  { .name = "c", .read = 1000, .dist = OD_DIST_ZIPF },
+  { .name = "d", .read = 950, .insert = 50, .dist = OD_DIST_LATEST },
+  { .name = "e", .scan = 950, .insert = 50, .dist = OD_DIST_ZIPF },
+  { .name = "f", .read = 500, .rmw = 500, .dist = OD_DIST_ZIPF },
+};
+#define YCSB_WORKLOAD_NUM (sizeof(ycsb_workloads) / sizeof(od_workload_t))
+
+static const char *dist_names[OD_DIST_NUM] = { "uniform", "zipf", "latest" };
+
+od_wl_cfg_t wl_cfg = {
+  .mix = NULL,
+  .dist = OD_DIST_UNIFORM,
+  .dist_is_set = false,
+  .zipf_theta = 0.99,
+  .scan_len = RANGE_LEN,
+  .record_num = KVS_NUM_KEYS
+};
+
+// Constants of YCSB's ZipfianGenerator (Gray et al., "Quickly generating
+// billion-record synthetic databases"), for ranks [0, record_num)
+static struct {
+  double zetan;
+  double alpha;
+  double eta;
+  double half_pow_theta;
+} zipf;
+
+const char *od_wl_dist_name(od_key_dist_t dist)
+{
+  assert(dist < OD_DIST_NUM);
+  return dist_names[dist];
+}
+
+void od_wl_set_workload(const char *name)
+{
+  for (uint32_t i = 0; i < YCSB_WORKLOAD_NUM; i++) {
+    if (strcasecmp(name, ycsb_workloads[i].name) == 0) {
+      wl_cfg.mix = &ycsb_workloads[i];
+      return;
+    }
+  }
+  my_printf(red, "Unknown workload %s, use one of: a b c d e f \n", name);
+  exit(EXIT_FAILURE);
+}
+
+void od_wl_set_dist(const char *name)
+{
+  for (int i = 0; i < OD_DIST_NUM; i++) {
+    if (strcmp(name, dist_names[i]) == 0) {
+      wl_cfg.dist = (od_key_dist_t) i;
+      wl_cfg.dist_is_set = true;
+      return;
+    }
+  }
+  my_printf(red, "Unknown key distribution %s, use one of: uniform zipf latest \n", name);
+  exit(EXIT_FAILURE);
+}
+
+static double zeta(uint64_t n, double theta)
+{
+  double sum = 0;
+  for (uint64_t i = 1; i <= n; i++)
+    sum += 1 / pow((double) i, theta);
+  return sum;
+}
+
+void od_wl_init(void)
+{
+  if (wl_cfg.mix != NULL) {
+    if (!wl_cfg.dist_is_set) wl_cfg.dist = wl_cfg.mix->dist;
+    // the protocols size their write paths with write_ratio
+    write_ratio = wl_cfg.mix->update + wl_cfg.mix->insert + wl_cfg.mix->rmw;
+  }
+  if (wl_cfg.record_num == 0 || wl_cfg.record_num > KVS_NUM_KEYS) {
+    my_printf(red, "--records must be in [1, %u], the keys the store is populated with \n",
+              KVS_NUM_KEYS);
+    exit(EXIT_FAILURE);
+  }
+  if (wl_cfg.scan_len == 0) {
+    my_printf(red, "--scan-len must be at least 1 \n");
+    exit(EXIT_FAILURE);
+  }
+  if (wl_cfg.dist != OD_DIST_UNIFORM) {
+    double theta = wl_cfg.zipf_theta;
+    if (theta <= 0 || theta >= 1) {
+      my_printf(red, "--zipf must be in (0, 1) \n");
+      exit(EXIT_FAILURE);
+    }
+    zipf.zetan = zeta(wl_cfg.record_num, theta);
+    zipf.alpha = 1 / (1 - theta);
+    zipf.eta = (1 - pow(2.0 / wl_cfg.record_num, 1 - theta)) /
+               (1 - zeta(2, theta) / zipf.zetan);
+    zipf.half_pow_theta = 1 + pow(0.5, theta);
+  }
+  my_printf(cyan, "Workload %s: %s keys over %u records, zipf %.2f, scans up to %u keys \n",
+            wl_cfg.mix == NULL ? "compile-time" : wl_cfg.mix->name,
+            od_wl_dist_name(wl_cfg.dist), wl_cfg.record_num,
+            wl_cfg.zipf_theta, wl_cfg.scan_len);
+}
+
+void od_wl_gen_init(od_wl_gen_t *gen, uint32_t g_t_id)
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  gen->seed = (uint64_t) time.tv_nsec ^ ((uint64_t) (g_t_id + 1) << 32);
+  // the threads insert into disjoint stretches of the key space
+  gen->insert_head = (uint32_t) (((uint64_t) wl_cfg.record_num * g_t_id / WORKER_NUM)
+                                 % wl_cfg.record_num);
+}
+
+od_wl_op_t od_wl_next_op(od_wl_gen_t *gen)
+{
+  const od_workload_t *mix = wl_cfg.mix;
+  assert(mix != NULL);
+  uint32_t r = od_wl_rand(gen, 1000);
+  if (r < mix->read) return OD_WL_READ;
+  r -= mix->read;
+  if (r < mix->update) return OD_WL_UPDATE;
+  r -= mix->update;
+  if (r < mix->insert) return OD_WL_INSERT;
+  r -= mix->insert;
+  if (r < mix->scan) return OD_WL_SCAN;
+  return OD_WL_RMW;
+}
+
+// Rank in [0, record_num), 0 being the most popular
+static uint32_t od_wl_zipf_rank(od_wl_gen_t *gen)
+{
+  double u = hrd_fastrand(&gen->seed) / (double) UINT32_MAX;
+  double uz = u * zipf.zetan;
+  if (uz < 1) return 0;
+  if (uz < zipf.half_pow_theta) return 1;
+  uint64_t rank = (uint64_t) (wl_cfg.record_num *
+                              pow(zipf.eta * u - zipf.eta + 1, zipf.alpha));
+  return (uint32_t) MIN(rank, wl_cfg.record_num - 1);
+}
+
+uint32_t od_wl_next_key(od_wl_gen_t *gen)
+{
+  switch (wl_cfg.dist) {
+    case OD_DIST_ZIPF:
+      return od_wl_zipf_rank(gen);
+    case OD_DIST_LATEST:
+      return (gen->insert_head + wl_cfg.record_num - od_wl_zipf_rank(gen)) %
+             wl_cfg.record_num;
+    case OD_DIST_UNIFORM:
+    default:
+      return od_wl_rand(gen, wl_cfg.record_num);
+  }
+}
+
+// The store holds a fixed key set, so an insert overwrites the key that
+// follows the thread's last insert, which "latest" then favours
+uint32_t od_wl_next_insert_key(od_wl_gen_t *gen)
+{
+  gen->insert_head = (gen->insert_head + 1) % wl_cfg.record_num;
+  return gen->insert_head;
+}
+
+uint32_t od_wl_next_scan_len(od_wl_gen_t *gen)
+{
+  return 1 + od_wl_rand(gen, wl_cfg.scan_len);
+}
@@ -216,6 +216,26 @@ splinterdb_delete(const splinterdb *kvsb, slice key);
 int
 splinterdb_update(const splinterdb *kvsb, slice key, slice delta);
 
+// Batched inserts and updates
+//
+// Same as calling splinterdb_insert / splinterdb_update on each key, in
+// order, but the keys are sorted and inserted under one memtable lock per
+// SPLINTERDB_MAX_BATCH keys. On error, a prefix of the keys, in key order,
+// may have been inserted.
+#define SPLINTERDB_MAX_BATCH 64
+
+int
+splinterdb_insert_batch(const splinterdb *kvsb,
+                        uint64            num,
+                        const slice      *keys,
+                        const slice      *values);
+
+int
+splinterdb_update_batch(const splinterdb *kvsb,
+                        uint64            num,
+                        const slice      *keys,
+                        const slice      *deltas);
+
 // Lookups
 
 // Size of opaque data required to hold a lookup result
@@ -281,6 +301,68 @@ splinterdb_lookup(const splinterdb         *kvs,   // IN
                   splinterdb_lookup_result *result // IN/OUT
 );
 
+// Lookup the messages of num keys, results[i] gets the result of keys[i]
+//
+// Cheaper than num calls to splinterdb_lookup: the keys are sorted and
+// share the memtable lock and the trunk nodes they go through.
+// Every result must have first been initialized using
+// splinterdb_lookup_result_init
+int
+splinterdb_lookup_batch(const splinterdb         *kvs,    // IN
+                        uint64                    num,    // IN
+                        const slice              *keys,   // IN
+                        splinterdb_lookup_result *results // IN/OUT
+);
+
+// Asynchronous lookups
+//
+// A lookup that misses in the cache starts its IO and returns, so that a
+// thread can keep many lookups in flight instead of blocking on each miss:
+//
+//    splinterdb_lookup_async_start(kvs, key, &result, lookup);
+//    while (!splinterdb_lookup_async_poll(kvs, lookup)) {
+//       splinterdb_async_io_poll(kvs); // once per round, for all lookups
+//    }
+//    ... splinterdb_lookup_found(&result) ...
+//
+// A splinterdb_async_lookup serves one lookup at a time and can be reused
+// once poll returned true. A lookup must be started, polled and completed
+// by the same registered thread, as IO completions are per thread.
+typedef struct splinterdb_async_lookup splinterdb_async_lookup;
+
+int
+splinterdb_async_lookup_create(const splinterdb         *kvs,   // IN
+                               splinterdb_async_lookup **lookup // OUT
+);
+
+void
+splinterdb_async_lookup_destroy(const splinterdb        *kvs,   // IN
+                                splinterdb_async_lookup *lookup // IN
+);
+
+// Starts the lookup of key, which is copied, and runs it as far as the
+// cache allows. result must have first been initialized using
+// splinterdb_lookup_result_init, and must not be used until the lookup is
+// complete.
+int
+splinterdb_lookup_async_start(const splinterdb         *kvs,    // IN
+                              slice                     key,    // IN
+                              splinterdb_lookup_result *result, // IN/OUT
+                              splinterdb_async_lookup  *lookup  // IN/OUT
+);
+
+// Advances the lookup if the page it waits for has arrived.
+// Returns true once the result is available.
+_Bool
+splinterdb_lookup_async_poll(const splinterdb        *kvs,   // IN
+                             splinterdb_async_lookup *lookup // IN/OUT
+);
+
+// Handles the completed IOs of the calling thread, moving the lookups that
+// waited for them forward. Never blocks.
+void
+splinterdb_async_io_poll(const splinterdb *kvs);
+
 
 /*
 Iterator API (range query)
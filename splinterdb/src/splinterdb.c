@@ -550,6 +550,95 @@ splinterdb_update(const splinterdb *kvsb, slice user_key, slice update)
    return splinterdb_insert_message(kvsb, user_key, msg);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_batch_sort --
+ *
+ *      Sorts the positions of num (<= SPLINTERDB_MAX_BATCH) keys by key.
+ *      Equal keys keep their order, so that updates to a key are applied in
+ *      the order they were given.
+ *-----------------------------------------------------------------------------
+ */
+typedef struct {
+   const data_config *cfg;
+   const slice       *keys;
+} splinterdb_batch_sort_arg;
+
+static int
+splinterdb_batch_cmp(const void *a, const void *b, void *arg)
+{
+   const splinterdb_batch_sort_arg *sort_arg = arg;
+   uint16                           ia = *(const uint16 *)a;
+   uint16                           ib = *(const uint16 *)b;
+   int cmp = data_key_compare(sort_arg->cfg,
+                              key_create_from_slice(sort_arg->keys[ia]),
+                              key_create_from_slice(sort_arg->keys[ib]));
+   return cmp != 0 ? cmp : (ia > ib) - (ia < ib);
+}
+
+static void
+splinterdb_batch_sort(const splinterdb *kvs,
+                      uint64            num,
+                      const slice      *keys,
+                      uint16           *order) // OUT
+{
+   uint16                    temp;
+   splinterdb_batch_sort_arg sort_arg = {.cfg = kvs->data_cfg, .keys = keys};
+   for (uint16 i = 0; i < num; i++) {
+      order[i] = i;
+   }
+   platform_sort_slow(
+      order, num, sizeof(*order), splinterdb_batch_cmp, &sort_arg, &temp);
+}
+
+static int
+splinterdb_insert_message_batch(const splinterdb *kvs,
+                                uint64            num,
+                                const slice      *user_keys,
+                                const slice      *values,
+                                message_type      type)
+{
+   platform_assert(kvs != NULL);
+   for (uint64 start = 0; start < num; start += SPLINTERDB_MAX_BATCH) {
+      uint64  chunk = MIN(num - start, SPLINTERDB_MAX_BATCH);
+      uint16  order[SPLINTERDB_MAX_BATCH];
+      key     tuple_keys[SPLINTERDB_MAX_BATCH];
+      message msgs[SPLINTERDB_MAX_BATCH];
+      splinterdb_batch_sort(kvs, chunk, &user_keys[start], order);
+      for (uint64 i = 0; i < chunk; i++) {
+         tuple_keys[i] = key_create_from_slice(user_keys[start + order[i]]);
+         msgs[i]       = message_create(type, values[start + order[i]]);
+      }
+      platform_status status =
+         trunk_insert_batch(kvs->spl, chunk, tuple_keys, msgs);
+      if (!SUCCESS(status)) {
+         return platform_status_to_int(status);
+      }
+   }
+   return 0;
+}
+
+int
+splinterdb_insert_batch(const splinterdb *kvsb,
+                        uint64            num,
+                        const slice      *user_keys,
+                        const slice      *values)
+{
+   return splinterdb_insert_message_batch(
+      kvsb, num, user_keys, values, MESSAGE_TYPE_INSERT);
+}
+
+int
+splinterdb_update_batch(const splinterdb *kvsb,
+                        uint64            num,
+                        const slice      *user_keys,
+                        const slice      *deltas)
+{
+   platform_assert(kvsb->data_cfg->merge_tuples);
+   return splinterdb_insert_message_batch(
+      kvsb, num, user_keys, deltas, MESSAGE_TYPE_UPDATE);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * _splinterdb_lookup_result structure --
@@ -645,6 +734,172 @@ splinterdb_lookup(const splinterdb         *kvs, // IN
    return platform_status_to_int(status);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_lookup_batch --
+ *
+ *      Lookup num tuples: the keys are sorted and looked up with one
+ *      memtable lookup lock and one trunk walk per batch of
+ *      SPLINTERDB_MAX_BATCH keys.
+ *
+ *      results[i] must have been initialized via
+ *      splinterdb_lookup_result_init() and gets the result of keys[i].
+ *
+ * Results:
+ *      0 on success (including keys not found), otherwise an error number.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_lookup_batch(const splinterdb         *kvs, // IN
+                        uint64                    num,
+                        const slice              *user_keys,
+                        splinterdb_lookup_result *results) // IN/OUT
+{
+   platform_assert(kvs != NULL);
+   for (uint64 start = 0; start < num; start += SPLINTERDB_MAX_BATCH) {
+      uint64             chunk = MIN(num - start, SPLINTERDB_MAX_BATCH);
+      uint16             order[SPLINTERDB_MAX_BATCH];
+      key                targets[SPLINTERDB_MAX_BATCH];
+      merge_accumulator *values[SPLINTERDB_MAX_BATCH];
+      splinterdb_batch_sort(kvs, chunk, &user_keys[start], order);
+      for (uint64 i = 0; i < chunk; i++) {
+         _splinterdb_lookup_result *_result =
+            (_splinterdb_lookup_result *)&results[start + order[i]];
+         targets[i] = key_create_from_slice(user_keys[start + order[i]]);
+         values[i]  = &_result->value;
+      }
+      platform_status status =
+         trunk_lookup_batch(kvs->spl, chunk, targets, values);
+      if (!SUCCESS(status)) {
+         return platform_status_to_int(status);
+      }
+   }
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_async_lookup --
+ *
+ *      An async trunk lookup and the key it looks for. ready is set by the
+ *      IO completion callback, when the lookup can be run again.
+ *-----------------------------------------------------------------------------
+ */
+struct splinterdb_async_lookup {
+   trunk_async_ctxt           ctxt;
+   key_buffer                 key;
+   _splinterdb_lookup_result *result;
+   bool32                     ready;
+   bool32                     done;
+};
+
+static void
+splinterdb_async_lookup_callback(trunk_async_ctxt *ctxt)
+{
+   splinterdb_async_lookup *lookup =
+      container_of(ctxt, splinterdb_async_lookup, ctxt);
+   lookup->ready = TRUE;
+}
+
+int
+splinterdb_async_lookup_create(const splinterdb         *kvs,   // IN
+                               splinterdb_async_lookup **lookup // OUT
+)
+{
+   splinterdb_async_lookup *l = TYPED_ZALLOC(kvs->spl->heap_id, l);
+   if (l == NULL) {
+      platform_error_log("TYPED_ZALLOC error\n");
+      return platform_status_to_int(STATUS_NO_MEMORY);
+   }
+   key_buffer_init(&l->key, kvs->spl->heap_id);
+   l->done = TRUE;
+   *lookup = l;
+   return 0;
+}
+
+void
+splinterdb_async_lookup_destroy(const splinterdb        *kvs,   // IN
+                                splinterdb_async_lookup *lookup // IN
+)
+{
+   platform_assert(lookup->done);
+   key_buffer_deinit(&lookup->key);
+   platform_free(kvs->spl->heap_id, lookup);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_lookup_async_poll --
+ *
+ *      Runs the trunk_lookup_async state machine until it completes, has to
+ *      be retried (the page is locked, or no IO request is available) or
+ *      waits for an IO.
+ *
+ * Results:
+ *      TRUE if the result is available.
+ *-----------------------------------------------------------------------------
+ */
+_Bool
+splinterdb_lookup_async_poll(const splinterdb        *kvs,   // IN
+                             splinterdb_async_lookup *lookup // IN/OUT
+)
+{
+   if (lookup->done) {
+      return TRUE;
+   }
+   if (!lookup->ready) {
+      return FALSE;
+   }
+   // The callback may run before trunk_lookup_async returns
+   lookup->ready = FALSE;
+   cache_async_result res = trunk_lookup_async(kvs->spl,
+                                               key_buffer_key(&lookup->key),
+                                               &lookup->result->value,
+                                               &lookup->ctxt);
+   switch (res) {
+      case async_locked:
+      case async_no_reqs:
+         lookup->ready = TRUE;
+         return FALSE;
+      case async_io_started:
+         return FALSE;
+      case async_success:
+         lookup->done = TRUE;
+         return TRUE;
+      default:
+         platform_assert(0);
+   }
+   return FALSE;
+}
+
+int
+splinterdb_lookup_async_start(const splinterdb         *kvs,    // IN
+                              slice                     user_key,
+                              splinterdb_lookup_result *result, // IN/OUT
+                              splinterdb_async_lookup  *lookup  // IN/OUT
+)
+{
+   platform_assert(kvs != NULL);
+   platform_assert(lookup->done);
+   platform_status rc = key_buffer_copy_slice(&lookup->key, user_key);
+   if (!SUCCESS(rc)) {
+      return platform_status_to_int(rc);
+   }
+   trunk_async_ctxt_init(&lookup->ctxt, splinterdb_async_lookup_callback);
+   lookup->result = (_splinterdb_lookup_result *)result;
+   lookup->ready  = TRUE;
+   lookup->done   = FALSE;
+   splinterdb_lookup_async_poll(kvs, lookup);
+   return 0;
+}
+
+void
+splinterdb_async_io_poll(const splinterdb *kvs)
+{
+   io_cleanup((io_handle *)&kvs->io_handle, 0);
+}
+
 
 struct splinterdb_iterator {
    trunk_range_iterator sri;
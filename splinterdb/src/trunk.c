@@ -6717,6 +6717,70 @@ out:
    return rc;
 }
 
+/*
+ * trunk_insert_batch --
+ *
+ *      Inserts num messages, as trunk_insert does for each, under a single
+ *      memtable insert lock. The memtable may grow past its size by up to
+ *      num - 1 tuples before it is rotated.
+ */
+platform_status
+trunk_insert_batch(trunk_handle *spl, uint64 num, key *keys, message *msgs)
+{
+   const threadid tid = platform_get_tid();
+   for (uint64 i = 0; i < num; i++) {
+      if (trunk_max_key_size(spl) < key_length(keys[i])) {
+         return STATUS_BAD_PARAM;
+      }
+      if (message_class(msgs[i]) == MESSAGE_TYPE_DELETE) {
+         msgs[i] = DELETE_MESSAGE;
+      }
+   }
+
+   uint64          generation;
+   platform_status rc =
+      memtable_maybe_rotate_and_begin_insert(spl->mt_ctxt, &generation);
+   while (STATUS_IS_EQ(rc, STATUS_BUSY)) {
+      task_perform_one_if_needed(spl->ts, 0);
+      rc = memtable_maybe_rotate_and_begin_insert(spl->mt_ctxt, &generation);
+   }
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+
+   // this call is safe because we hold the insert lock
+   memtable *mt = trunk_get_memtable(spl, generation);
+   for (uint64 i = 0; i < num && SUCCESS(rc); i++) {
+      uint64 leaf_generation; // used for ordering the log
+      rc = memtable_insert(
+         spl->mt_ctxt, mt, spl->heap_id, keys[i], msgs[i], &leaf_generation);
+      if (SUCCESS(rc) && spl->cfg.use_log
+          && log_write(spl->log, keys[i], msgs[i], leaf_generation) != 0)
+      {
+         break;
+      }
+      if (SUCCESS(rc) && spl->cfg.use_stats) {
+         switch (message_class(msgs[i])) {
+            case MESSAGE_TYPE_INSERT:
+               spl->stats[tid].insertions++;
+               break;
+            case MESSAGE_TYPE_UPDATE:
+               spl->stats[tid].updates++;
+               break;
+            case MESSAGE_TYPE_DELETE:
+               spl->stats[tid].deletions++;
+               break;
+            default:
+               platform_assert(0);
+         }
+      }
+   }
+   memtable_end_insert(spl->mt_ctxt);
+
+   task_perform_one_if_needed(spl->ts, spl->cfg.queue_scale_percent);
+   return rc;
+}
+
 bool32
 trunk_filter_lookup(trunk_handle      *spl,
                     trunk_node        *node,
@@ -6969,6 +7033,118 @@ found_final_answer_early:
    return STATUS_OK;
 }
 
+/*
+ * trunk_lookup_batch --
+ *
+ *      Looks up num keys, which must be sorted, as trunk_lookup does for
+ *      each. The memtable lookup lock is taken once and the trunk root is
+ *      read once for the whole batch. The trunk path of the previous key is
+ *      kept: sorted keys mostly go down the same children, so their trunk
+ *      nodes (and the filters of their bundles) are only fetched once.
+ */
+platform_status
+trunk_lookup_batch(trunk_handle       *spl,
+                   uint64              num,
+                   key                *targets, // IN: sorted
+                   merge_accumulator **results) // OUT
+{
+   // path[h] is the node at height h on the path of the previous key;
+   // path_pivot[h] is the pivot of path[h] that leads to path[h - 1]
+   trunk_node path[TRUNK_MAX_HEIGHT];
+   uint16     path_pivot[TRUNK_MAX_HEIGHT];
+
+   memtable_begin_lookup(spl->mt_ctxt);
+   uint64 mt_gen_start = memtable_generation(spl->mt_ctxt);
+   uint64 mt_gen_end   = memtable_generation_retired(spl->mt_ctxt);
+   platform_assert(mt_gen_start - mt_gen_end <= TRUNK_NUM_MEMTABLES);
+   for (uint64 i = 0; i < num; i++) {
+      merge_accumulator_set_to_null(results[i]);
+      for (uint64 mt_gen = mt_gen_start; mt_gen != mt_gen_end; mt_gen--) {
+         platform_status rc;
+         rc = trunk_memtable_lookup(spl, mt_gen, targets[i], results[i]);
+         platform_assert_status_ok(rc);
+         if (merge_accumulator_is_definitive(results[i])) {
+            break;
+         }
+      }
+   }
+
+   uint16 root_height;
+   trunk_root_get(spl, &path[0]);
+   memtable_end_lookup(spl->mt_ctxt);
+   root_height       = trunk_node_height(&path[0]);
+   path[root_height] = path[0];
+   // lowest height on the path that holds a node
+   uint16 path_low = root_height;
+
+   for (uint64 i = 0; i < num; i++) {
+      if (merge_accumulator_is_definitive(results[i])) {
+         continue;
+      }
+      key                target = targets[i];
+      merge_accumulator *result = results[i];
+      bool32             should_continue;
+      uint16             h;
+      for (h = root_height; h > 0; h--) {
+         trunk_node *node     = &path[h];
+         uint16      pivot_no = trunk_find_pivot(
+            spl, node, target, less_than_or_equal);
+         debug_assert(pivot_no < trunk_num_children(spl, node));
+         trunk_pivot_data *pdata = trunk_get_pivot_data(spl, node, pivot_no);
+         should_continue = trunk_pivot_lookup(spl, node, pdata, target, result);
+         if (!should_continue) {
+            break;
+         }
+         if (path_low < h && path_pivot[h] == pivot_no) {
+            continue;
+         }
+         // Leave the path of the previous key
+         for (; path_low < h; path_low++) {
+            trunk_node_unget(spl->cc, &path[path_low]);
+         }
+         trunk_node_get(spl->cc, pdata->addr, &path[h - 1]);
+         path_pivot[h] = pivot_no;
+         path_low      = h - 1;
+      }
+      if (h == 0) {
+         trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &path[0], 0);
+         should_continue =
+            trunk_pivot_lookup(spl, &path[0], pdata, target, result);
+      }
+      if (should_continue) {
+         debug_assert(merge_accumulator_is_null(result)
+                      || merge_accumulator_message_class(result)
+                            == MESSAGE_TYPE_UPDATE);
+         if (!merge_accumulator_is_null(result)) {
+            data_merge_tuples_final(spl->cfg.data_cfg, target, result);
+         }
+      }
+   }
+
+   for (; path_low <= root_height; path_low++) {
+      trunk_node_unget(spl->cc, &path[path_low]);
+   }
+
+   for (uint64 i = 0; i < num; i++) {
+      if (spl->cfg.use_stats) {
+         threadid tid = platform_get_tid();
+         if (!merge_accumulator_is_null(results[i])) {
+            spl->stats[tid].lookups_found++;
+         } else {
+            spl->stats[tid].lookups_not_found++;
+         }
+      }
+      /* Normalize DELETE messages to return a null merge_accumulator */
+      if (!merge_accumulator_is_null(results[i])
+          && merge_accumulator_message_class(results[i]) == MESSAGE_TYPE_DELETE)
+      {
+         merge_accumulator_set_to_null(results[i]);
+      }
+   }
+
+   return STATUS_OK;
+}
+
 /*
  * trunk_async_set_state sets the state of the async splinter
  * lookup state machine.
@@ -333,9 +333,18 @@ typedef struct trunk_async_ctxt {
 platform_status
 trunk_insert(trunk_handle *spl, key tuple_key, message data);
 
+platform_status
+trunk_insert_batch(trunk_handle *spl, uint64 num, key *keys, message *msgs);
+
 platform_status
 trunk_lookup(trunk_handle *spl, key target, merge_accumulator *result);
 
+platform_status
+trunk_lookup_batch(trunk_handle       *spl,
+                   uint64              num,
+                   key                *targets,
+                   merge_accumulator **results);
+
 static inline bool32
 trunk_lookup_found(merge_accumulator *result)
 {
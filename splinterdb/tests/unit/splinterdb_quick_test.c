@@ -728,6 +728,293 @@ CTEST2(splinterdb_quick, test_close_and_reopen)
    splinterdb_lookup_result_deinit(&result);
 }
 
+#define TEST_BATCH_KEYS 100
+
+/*
+ * Test case to verify async lookups: keys are looked up all at once after a
+ * re-open, so that lookups that miss in the cache are in flight together.
+ * Every other key was never inserted.
+ */
+CTEST2(splinterdb_quick, test_async_lookups)
+{
+   const int num_lookups = TEST_BATCH_KEYS;
+
+   int rc = insert_keys(data->kvsb, 0, num_lookups / 2, 2);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_async_lookup *lookups[TEST_BATCH_KEYS];
+   splinterdb_lookup_result results[TEST_BATCH_KEYS];
+   char                     keys[TEST_BATCH_KEYS][TEST_INSERT_KEY_LENGTH];
+
+   for (int i = 0; i < num_lookups; i++) {
+      rc = splinterdb_async_lookup_create(data->kvsb, &lookups[i]);
+      ASSERT_EQUAL(0, rc);
+      splinterdb_lookup_result_init(data->kvsb, &results[i], 0, NULL);
+      snprintf(keys[i], sizeof(keys[i]), key_fmt, i);
+      rc = splinterdb_lookup_async_start(data->kvsb,
+                                         slice_create(sizeof(keys[i]), keys[i]),
+                                         &results[i],
+                                         lookups[i]);
+      ASSERT_EQUAL(0, rc);
+   }
+
+   int pending = num_lookups;
+   while (pending > 0) {
+      splinterdb_async_io_poll(data->kvsb);
+      pending = 0;
+      for (int i = 0; i < num_lookups; i++) {
+         if (!splinterdb_lookup_async_poll(data->kvsb, lookups[i])) {
+            pending++;
+         }
+      }
+   }
+
+   for (int i = 0; i < num_lookups; i++) {
+      ASSERT_EQUAL(i % 2 == 0,
+                   splinterdb_lookup_found(&results[i]),
+                   "Unexpected lookup result for key %d\n",
+                   i);
+      if (i % 2 == 0) {
+         char  val[TEST_INSERT_VAL_LENGTH] = {0};
+         slice value;
+         snprintf(val, sizeof(val), val_fmt, i);
+         rc = splinterdb_lookup_result_value(&results[i], &value);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_STREQN(val, slice_data(value), slice_length(value));
+      }
+      splinterdb_lookup_result_deinit(&results[i]);
+      splinterdb_async_lookup_destroy(data->kvsb, lookups[i]);
+   }
+}
+
+/*
+ * Test case to verify batched inserts and lookups. Keys are handed over
+ * in reverse order, larger than one SPLINTERDB_MAX_BATCH, and looked up
+ * both from the memtable and, after a re-open, from the trunk.
+ * Every other key is never inserted.
+ */
+CTEST2(splinterdb_quick, test_batch_insert_and_lookup)
+{
+   const int num_lookups = TEST_BATCH_KEYS;
+   const int num_inserts = num_lookups / 2;
+
+   slice                    keys[TEST_BATCH_KEYS];
+   slice                    values[TEST_BATCH_KEYS];
+   splinterdb_lookup_result results[TEST_BATCH_KEYS];
+   char                     key_data[TEST_BATCH_KEYS][TEST_INSERT_KEY_LENGTH];
+   char                     val_data[TEST_BATCH_KEYS][TEST_INSERT_VAL_LENGTH];
+
+   for (int i = 0; i < num_lookups; i++) {
+      snprintf(key_data[i], sizeof(key_data[i]), key_fmt, i);
+      snprintf(val_data[i], sizeof(val_data[i]), val_fmt, i);
+   }
+   for (int i = 0; i < num_inserts; i++) {
+      int k     = 2 * (num_inserts - 1 - i);
+      keys[i]   = slice_create(sizeof(key_data[k]), key_data[k]);
+      values[i] = slice_create(sizeof(val_data[k]), val_data[k]);
+   }
+   int rc = splinterdb_insert_batch(data->kvsb, num_inserts, keys, values);
+   ASSERT_EQUAL(0, rc);
+
+   for (int i = 0; i < num_lookups; i++) {
+      keys[i] = slice_create(sizeof(key_data[i]), key_data[i]);
+   }
+   for (int pass = 0; pass < 2; pass++) {
+      if (pass == 1) {
+         splinterdb_close(&data->kvsb);
+         rc = splinterdb_open(&data->cfg, &data->kvsb);
+         ASSERT_EQUAL(0, rc);
+      }
+      for (int i = 0; i < num_lookups; i++) {
+         splinterdb_lookup_result_init(data->kvsb, &results[i], 0, NULL);
+      }
+      rc = splinterdb_lookup_batch(data->kvsb, num_lookups, keys, results);
+      ASSERT_EQUAL(0, rc);
+
+      for (int i = 0; i < num_lookups; i++) {
+         ASSERT_EQUAL(i % 2 == 0,
+                      splinterdb_lookup_found(&results[i]),
+                      "Unexpected lookup result for key %d, pass %d\n",
+                      i,
+                      pass);
+         if (i % 2 == 0) {
+            slice value;
+            rc = splinterdb_lookup_result_value(&results[i], &value);
+            ASSERT_EQUAL(0, rc);
+            ASSERT_STREQN(val_data[i], slice_data(value), slice_length(value));
+         }
+         splinterdb_lookup_result_deinit(&results[i]);
+      }
+   }
+}
+
+#define TEST_CMP_KEYS     (16 * 1024)
+#define TEST_ASYNC_SLOTS  32
+#define TEST_CMP_KEY_STEP 7919 // odd: visits every key, out of order
+
+/*
+ * Test case to verify that batched and async lookups return what the
+ * synchronous lookup does. The keys are spread over two flushed generations
+ * and the memtable: overwritten, deleted and never inserted keys are mixed,
+ * and are looked up out of key order, before and after a re-open. The async
+ * lookups reuse TEST_ASYNC_SLOTS lookups, as the KVS backend does.
+ */
+CTEST2(splinterdb_quick, test_batch_and_async_lookups_match_sync)
+{
+   platform_heap_id hid = data->cfg.heap_id;
+   char             key_data[TEST_INSERT_KEY_LENGTH];
+   char             val_data[TEST_INSERT_VAL_LENGTH];
+   int              rc;
+
+   // Keys 4i..4i+2 in the first generation, then 4i+1 overwritten and
+   // 4i+2 deleted in the second, then 8i+3 in the memtable
+   for (int gen = 0; gen < 3; gen++) {
+      for (int i = 0; i < TEST_CMP_KEYS; i++) {
+         snprintf(key_data, sizeof(key_data), key_fmt, i);
+         slice key = slice_create(sizeof(key_data), key_data);
+         if (gen == 0 && i % 4 != 3) {
+            snprintf(val_data, sizeof(val_data), val_fmt, i);
+            rc = splinterdb_insert(
+               data->kvsb, key, slice_create(sizeof(val_data), val_data));
+         } else if (gen == 1 && i % 4 == 1) {
+            snprintf(val_data, sizeof(val_data), val_fmt, i + 1);
+            rc = splinterdb_insert(
+               data->kvsb, key, slice_create(sizeof(val_data), val_data));
+         } else if (gen == 1 && i % 4 == 2) {
+            rc = splinterdb_delete(data->kvsb, key);
+         } else if (gen == 2 && i % 8 == 3) {
+            snprintf(val_data, sizeof(val_data), val_fmt, i);
+            rc = splinterdb_insert(
+               data->kvsb, key, slice_create(sizeof(val_data), val_data));
+         } else {
+            continue;
+         }
+         ASSERT_EQUAL(0, rc);
+      }
+      if (gen < 2) {
+         splinterdb_close(&data->kvsb);
+         rc = splinterdb_open(&data->cfg, &data->kvsb);
+         ASSERT_EQUAL(0, rc);
+      }
+   }
+
+   char *keys =
+      TYPED_ARRAY_ZALLOC(hid, keys, TEST_CMP_KEYS * TEST_INSERT_KEY_LENGTH);
+   slice *key_slices = TYPED_ARRAY_ZALLOC(hid, key_slices, TEST_CMP_KEYS);
+   splinterdb_lookup_result *sync_results =
+      TYPED_ARRAY_ZALLOC(hid, sync_results, TEST_CMP_KEYS);
+   splinterdb_lookup_result *batch_results =
+      TYPED_ARRAY_ZALLOC(hid, batch_results, TEST_CMP_KEYS);
+   splinterdb_lookup_result *async_results =
+      TYPED_ARRAY_ZALLOC(hid, async_results, TEST_CMP_KEYS);
+
+   for (int i = 0; i < TEST_CMP_KEYS; i++) {
+      int k = (int)(((uint64)i * TEST_CMP_KEY_STEP) % TEST_CMP_KEYS);
+      char *key = &keys[i * TEST_INSERT_KEY_LENGTH];
+      snprintf(key, TEST_INSERT_KEY_LENGTH, key_fmt, k);
+      key_slices[i] = slice_create(TEST_INSERT_KEY_LENGTH, key);
+   }
+
+   // The second pass runs after a re-open: the memtable is flushed and the
+   // async lookups, which go first, miss in the cache
+   splinterdb_async_lookup *lookups[TEST_ASYNC_SLOTS];
+   int                      slot_key[TEST_ASYNC_SLOTS];
+   for (int pass = 0; pass < 2; pass++) {
+      if (pass == 1) {
+         splinterdb_close(&data->kvsb);
+         rc = splinterdb_open(&data->cfg, &data->kvsb);
+         ASSERT_EQUAL(0, rc);
+      }
+      for (int i = 0; i < TEST_CMP_KEYS; i++) {
+         splinterdb_lookup_result_init(data->kvsb, &sync_results[i], 0, NULL);
+         splinterdb_lookup_result_init(data->kvsb, &batch_results[i], 0, NULL);
+         splinterdb_lookup_result_init(data->kvsb, &async_results[i], 0, NULL);
+      }
+
+      int next_key = 0;
+      int inflight = 0;
+      for (int s = 0; s < TEST_ASYNC_SLOTS; s++) {
+         rc = splinterdb_async_lookup_create(data->kvsb, &lookups[s]);
+         ASSERT_EQUAL(0, rc);
+         slot_key[s] = -1;
+      }
+      do {
+         for (int s = 0; s < TEST_ASYNC_SLOTS; s++) {
+            if (slot_key[s] >= 0
+                && !splinterdb_lookup_async_poll(data->kvsb, lookups[s]))
+            {
+               continue;
+            }
+            if (slot_key[s] >= 0) {
+               slot_key[s] = -1;
+               inflight--;
+            }
+            if (next_key < TEST_CMP_KEYS) {
+               rc = splinterdb_lookup_async_start(data->kvsb,
+                                                  key_slices[next_key],
+                                                  &async_results[next_key],
+                                                  lookups[s]);
+               ASSERT_EQUAL(0, rc);
+               slot_key[s] = next_key++;
+               inflight++;
+            }
+         }
+         splinterdb_async_io_poll(data->kvsb);
+      } while (inflight > 0);
+      for (int s = 0; s < TEST_ASYNC_SLOTS; s++) {
+         splinterdb_async_lookup_destroy(data->kvsb, lookups[s]);
+      }
+
+      rc = splinterdb_lookup_batch(
+         data->kvsb, TEST_CMP_KEYS, key_slices, batch_results);
+      ASSERT_EQUAL(0, rc);
+
+      int num_found = 0;
+      for (int i = 0; i < TEST_CMP_KEYS; i++) {
+         rc = splinterdb_lookup(data->kvsb, key_slices[i], &sync_results[i]);
+         ASSERT_EQUAL(0, rc);
+         bool32 found = splinterdb_lookup_found(&sync_results[i]);
+         ASSERT_EQUAL(found,
+                      splinterdb_lookup_found(&batch_results[i]),
+                      "Batched lookup of %s disagrees, pass %d\n",
+                      (char *)slice_data(key_slices[i]),
+                      pass);
+         ASSERT_EQUAL(found,
+                      splinterdb_lookup_found(&async_results[i]),
+                      "Async lookup of %s disagrees, pass %d\n",
+                      (char *)slice_data(key_slices[i]),
+                      pass);
+         if (found) {
+            slice sync_val, batch_val, async_val;
+            rc = splinterdb_lookup_result_value(&sync_results[i], &sync_val);
+            ASSERT_EQUAL(0, rc);
+            rc = splinterdb_lookup_result_value(&batch_results[i], &batch_val);
+            ASSERT_EQUAL(0, rc);
+            rc = splinterdb_lookup_result_value(&async_results[i], &async_val);
+            ASSERT_EQUAL(0, rc);
+            ASSERT_TRUE(slice_equals(sync_val, batch_val));
+            ASSERT_TRUE(slice_equals(sync_val, async_val));
+            num_found++;
+         }
+         splinterdb_lookup_result_deinit(&sync_results[i]);
+         splinterdb_lookup_result_deinit(&batch_results[i]);
+         splinterdb_lookup_result_deinit(&async_results[i]);
+      }
+      // Keys 4i, 4i+1 and 8i+3 are live
+      ASSERT_EQUAL(TEST_CMP_KEYS / 2 + TEST_CMP_KEYS / 8, num_found);
+   }
+
+   platform_free(hid, async_results);
+   platform_free(hid, batch_results);
+   platform_free(hid, sync_results);
+   platform_free(hid, key_slices);
+   platform_free(hid, keys);
+}
+
 /*
  * Regression test for bug where repeating a cycle of insert-close-reopen
  * causes a space leak and eventually hits an assertion
@@ -151,7 +151,9 @@ static inline void send_acks_helper(context_t *ctx)
 //------------------------------ GID HANDLING -----------------------------
 //---------------------------------------------------------------------------*/
 
-// Propagates Updates that have seen all acks to the KVS
+// Propagates Updates that have seen all acks to the KVS: with g_id ordering
+// they are staged, applied in g_id order by any worker,
+// and retired from the w_rob once visible
 static inline void propagate_updates(context_t *ctx)
 {
   zk_ctx_t *zk_ctx = (zk_ctx_t *) ctx->appl_ctx;
@@ -161,9 +163,14 @@ static inline void propagate_updates(context_t *ctx)
   // remember the starting point to use it when writing the KVS
   uint32_t starting_pull_ptr = zk_ctx->w_rob->pull_ptr;
   uint64_t committed_g_id = atomic_load_explicit(&committed_global_w_id, memory_order_relaxed);
+  if (ENABLE_GID_ORDERING) {
+    zk_stage_updates(zk_ctx, committed_g_id);
+    zk_apply_staged_updates();
+    committed_g_id = atomic_load_explicit(&committed_global_w_id, memory_order_acquire);
+  }
   flr_increase_counter_if_waiting_for_commit(zk_ctx, committed_g_id, ctx->t_id);
   while(((w_rob_t *) get_fifo_pull_slot(zk_ctx->w_rob))->w_state == READY) {
-    if (!is_expected_g_id_ready(zk_ctx, &committed_g_id, &update_op_i,
+    if (!is_expected_g_id_ready(zk_ctx, committed_g_id, &update_op_i,
                                 ctx->t_id))
       break;
   }
@@ -177,11 +184,10 @@ static inline void propagate_updates(context_t *ctx)
 
     zk_ctx->local_w_id += update_op_i; // this must happen after inserting commits
     fifo_decrease_capacity(zk_ctx->w_rob, update_op_i);
-    zk_KVS_batch_op_updates((uint16_t) update_op_i, zk_ctx, starting_pull_ptr,
-                            ctx->t_id);
+    if (ENABLE_GID_ORDERING) zk_ctx->staged_num -= update_op_i;
+    else zk_KVS_batch_op_updates((uint16_t) update_op_i, zk_ctx, starting_pull_ptr,
+                                 ctx->t_id);
 
-    if (ENABLE_GID_ORDERING)
-      atomic_store_explicit(&committed_global_w_id, committed_g_id, memory_order_relaxed);
     zk_signal_completion_and_bookkeep_for_writes(zk_ctx, update_op_i, starting_pull_ptr,
                                                  zk_ctx->protocol, ctx->t_id);
   }
@@ -158,6 +158,84 @@ static inline void zk_KVS_batch_op_updates(uint16_t op_num, zk_ctx_t *zk_ctx,
 }
 
 
+/* ---------------------------------------------------------------------------
+//------------------------------ STAGED UPDATES -----------------------------
+//---------------------------------------------------------------------------*/
+
+// Publishes the READY writes that follow the already staged ones to
+// staged_updates, so that whichever worker holds the next g_id can apply them
+static inline void zk_stage_updates(zk_ctx_t *zk_ctx, uint64_t committed_g_id)
+{
+  fifo_t *w_rob_fifo = zk_ctx->w_rob;
+  uint32_t first_ptr = w_rob_fifo->pull_ptr + zk_ctx->staged_num;
+  uint16_t op_i, op_num = 0;
+  while (zk_ctx->staged_num + op_num < w_rob_fifo->capacity) {
+    w_rob_t *w_rob = (w_rob_t *) get_fifo_slot_mod(w_rob_fifo, first_ptr + op_num);
+    // the slot of a g_id further ahead may still hold an unapplied write
+    if (w_rob->w_state != READY || w_rob->g_id > committed_g_id + ZK_G_ID_RING)
+      break;
+    op_num++;
+  }
+  if (op_num == 0) return;
+  if (ENABLE_ASSERTIONS) assert(op_num <= ZK_UPDATE_BATCH);
+
+  unsigned int bkt[ZK_UPDATE_BATCH];
+  struct mica_bkt *bkt_ptr[ZK_UPDATE_BATCH];
+  unsigned int tag[ZK_UPDATE_BATCH];
+  mica_op_t *kv_ptr[ZK_UPDATE_BATCH];	/* Ptr to KV item in log */
+
+  for(op_i = 0; op_i < op_num; op_i++) {
+    w_rob_t *w_rob = (w_rob_t *) get_fifo_slot_mod(w_rob_fifo, first_ptr + op_i);
+    KVS_locate_one_bucket(op_i, bkt, &w_rob->ptr_to_op->key, bkt_ptr, tag, kv_ptr, KVS);
+  }
+  KVS_locate_all_kv_pairs(op_num, tag, bkt_ptr, kv_ptr, KVS);
+
+  for(op_i = 0; op_i < op_num; op_i++) {
+    w_rob_t *w_rob = (w_rob_t *) get_fifo_slot_mod(w_rob_fifo, first_ptr + op_i);
+    zk_prepare_t *op = w_rob->ptr_to_op;
+    if (ENABLE_ASSERTIONS) {
+      assert(kv_ptr[op_i] != NULL);
+      assert(memcmp(&kv_ptr[op_i]->key, &op->key, KEY_SIZE) == 0);
+      assert(op->opcode == KVS_OP_PUT);
+      assert(w_rob->g_id > committed_global_w_id);
+    }
+    zk_staged_t *staged = &staged_updates[w_rob->g_id % ZK_G_ID_RING];
+    staged->kv_ptr = kv_ptr[op_i];
+    staged->op = op;
+    // seq_cst, pairs with the re-check in zk_apply_staged_updates
+    atomic_store(&staged->g_id, w_rob->g_id);
+  }
+  zk_ctx->staged_num += op_num;
+}
+
+// The worker that wins applying_updates writes the staged updates to the KVS
+// in g_id order, and a write is visible to committed_global_w_id only after
+// all smaller g_ids. The others return and retire their writes later.
+static inline void zk_apply_staged_updates()
+{
+  uint64_t g_id;
+  do {
+    if (atomic_exchange(&applying_updates, true)) return;
+    g_id = atomic_load_explicit(&committed_global_w_id, memory_order_relaxed) + 1;
+    zk_staged_t *staged = &staged_updates[g_id % ZK_G_ID_RING];
+    while (atomic_load_explicit(&staged->g_id, memory_order_acquire) == g_id) {
+      if (!DISABLE_UPDATING_KVS) {
+        mica_op_t *kv_ptr = staged->kv_ptr;
+        lock_seqlock(&kv_ptr->seqlock);
+        kv_ptr->g_id = g_id;
+        memcpy(kv_ptr->value, staged->op->value, (size_t) VALUE_SIZE);
+        unlock_seqlock(&kv_ptr->seqlock);
+      }
+      atomic_store_explicit(&committed_global_w_id, g_id, memory_order_release);
+      g_id++;
+      staged = &staged_updates[g_id % ZK_G_ID_RING];
+    }
+    atomic_store(&applying_updates, false);
+    // a write staged while the flag was held would otherwise wait for the next staging
+  } while (atomic_load(&staged_updates[g_id % ZK_G_ID_RING].g_id) == g_id);
+}
+
+
 static inline void zk_KVS_batch_op_reads(context_t *ctx)
 {
   zk_ctx_t *zk_ctx = (zk_ctx_t *) ctx->appl_ctx;
@@ -188,6 +188,10 @@ typedef enum {FOLLOWER = 1, LEADER} protocol_t;
 
 #define ZK_TRACE_BATCH SESSIONS_PER_THREAD
 #define ZK_UPDATE_BATCH  MAX (FLR_PENDING_WRITES, LEADER_PENDING_WRITES)
+// Committed writes staged for in-order application, shared by the workers of a machine.
+// The w_robs of a machine hold at most WORKERS_PER_MACHINE * ZK_UPDATE_BATCH
+// uncommitted g_ids, so zk_stage_updates never waits for a slot to free up
+#define ZK_G_ID_RING (2 * WORKERS_PER_MACHINE * ZK_UPDATE_BATCH)
 /*-------------------------------------------------
 -----------------QUEUE DEPTHS-------------------------
 --------------------------------------------------*/
@@ -408,6 +412,7 @@ typedef struct zk_ctx {
 
 	uint32_t unordered_ptr;
   uint64_t highest_g_id_taken;
+  uint32_t staged_num; // w_rob entries from the pull_ptr published to staged_updates
 
   uint32_t *index_to_req_array; // [SESSIONS_PER_THREAD]
 	bool *stalled;
@@ -474,6 +479,17 @@ extern thread_stats_t t_stats[WORKERS_PER_MACHINE];
 struct mica_op;
 extern atomic_uint_fast64_t global_w_id, committed_global_w_id;
 
+// A committed write waiting for all smaller g_ids to be applied;
+// slot g_id % ZK_G_ID_RING is free once committed_global_w_id >= g_id
+typedef struct zk_staged {
+  atomic_uint_fast64_t g_id; // published last
+  struct mica_op *kv_ptr;
+  zk_prepare_t *op;
+} __attribute__ ((aligned (32))) zk_staged_t;
+
+extern zk_staged_t *staged_updates;
+extern atomic_bool applying_updates;
+
 
 void print_latency_stats(void);
 
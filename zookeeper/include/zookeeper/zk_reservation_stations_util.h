@@ -129,19 +129,16 @@ flr_increase_counter_if_waiting_for_commit(zk_ctx_t *zk_ctx,
 
 
 static inline bool is_expected_g_id_ready(zk_ctx_t *zk_ctx,
-                                          uint64_t *committed_g_id,
+                                          uint64_t committed_g_id,
                                           uint16_t *update_op_i,
                                           uint16_t t_id)
 {
   w_rob_t * w_rob = (w_rob_t *) get_fifo_pull_slot(zk_ctx->w_rob);
   if (ENABLE_GID_ORDERING) {
-    if (w_rob->g_id != (*committed_g_id) + 1) {
+    // zk_apply_staged_updates writes the KVS in g_id order,
+    // the write retires once committed_global_w_id covers it
+    if (w_rob->g_id > committed_g_id) {
       if (ENABLE_ASSERTIONS) {
-        if((*committed_g_id) >= w_rob->g_id) {
-          my_printf(red, "Committed g_id/expected %lu/%lu \n",
-                    (*committed_g_id), w_rob->g_id);
-          assert(false);
-        }
         zk_ctx->wait_for_gid_dbg_counter++;
 
         //if (*wait_for_reps_ctr % MILLION == 0)
@@ -157,7 +154,6 @@ static inline bool is_expected_g_id_ready(zk_ctx_t *zk_ctx,
   if (ENABLE_ASSERTIONS) zk_ctx->wait_for_gid_dbg_counter = 0;
   fifo_incr_pull_ptr(zk_ctx->w_rob);
   (*update_op_i)++;
-  (*committed_g_id)++;
 
   return true;
 }
@@ -3,7 +3,11 @@
 #include <zk_inline_util.h>
 #include "zk_util.h"
 
-atomic_uint_fast64_t global_w_id, committed_global_w_id;
+// the leader workers fetch-add global_w_id, all workers poll committed_global_w_id
+atomic_uint_fast64_t global_w_id __attribute__ ((aligned (64)));
+atomic_uint_fast64_t committed_global_w_id __attribute__ ((aligned (64)));
+zk_staged_t *staged_updates;
+atomic_bool applying_updates __attribute__ ((aligned (64)));
 
 
 void zk_print_parameters_in_the_start()
@@ -79,6 +83,8 @@ void zk_init_globals()
 {
   global_w_id = 1; // DO not start from 0, because when checking for acks there is a non-zero test
   committed_global_w_id = 0;
+  staged_updates = (zk_staged_t *) calloc(ZK_G_ID_RING, sizeof(zk_staged_t));
+  applying_updates = false;
 }
 
 